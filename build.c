@@ -14,10 +14,27 @@ int main(int argc, char **argv) {
   cmd.build_dir = "build";
   cmd.cache_modules = false;
   cmd.cflags = "-g -Wall -pedantic -std=c99 -I./raylib/src/";
-  cmd.link_with = "-L./raylib/src/ -lraylib -lm";
+  cmd.link_with = "-L./raylib/src/ -lraylib -lm -lpthread";
 
   vec_push(cmd.modules, "src/main");
   vec_push(cmd.modules, "src/network");
+  vec_push(cmd.modules, "src/args");
+  vec_push(cmd.modules, "src/game");
+  vec_push(cmd.modules, "src/batch");
+  vec_push(cmd.modules, "src/runner");
+  vec_push(cmd.modules, "src/timing");
+  vec_push(cmd.modules, "src/replay");
+  vec_push(cmd.modules, "src/rollback");
+  vec_push(cmd.modules, "src/snapshot");
+  vec_push(cmd.modules, "src/delta");
+  vec_push(cmd.modules, "src/event_loop");
+  vec_push(cmd.modules, "src/session");
+  vec_push(cmd.modules, "src/input_stream");
+  vec_push(cmd.modules, "src/net_thread");
+  vec_push(cmd.modules, "src/net_quality");
+  vec_push(cmd.modules, "src/clock_sync");
+  vec_push(cmd.modules, "src/net_connect");
+  vec_push(cmd.modules, "src/net_uring");
 
   if (!file_exist("raylib/src/libraylib.a")) {
     vec_push(cmd.git_dependencies, ((GitDependency){
@@ -34,9 +51,115 @@ int main(int argc, char **argv) {
     ok = cmd_run_sync(&cmd);
   }
 
+  // multi-room server without window, raylib is only used for logging
+  CompileCmd server_cmd = {0};
+  server_cmd.compiler = COMPILER_C_ANY;
+  server_cmd.target_name = "ping_pong_server";
+  server_cmd.build_dir = "build";
+  server_cmd.cache_modules = false;
+  server_cmd.cflags = "-O2 -g -Wall -pedantic -std=c99 -I./raylib/src/";
+  server_cmd.link_with = "-L./raylib/src/ -lraylib -lm -lpthread";
+
+  vec_push(server_cmd.modules, "src/server");
+  vec_push(server_cmd.modules, "src/network");
+  vec_push(server_cmd.modules, "src/args");
+  vec_push(server_cmd.modules, "src/net_uring");
+  vec_push(server_cmd.modules, "src/game");
+  vec_push(server_cmd.modules, "src/delta");
+  vec_push(server_cmd.modules, "src/event_loop");
+  vec_push(server_cmd.modules, "src/session");
+  vec_push(server_cmd.modules, "src/input_stream");
+  vec_push(server_cmd.modules, "src/timing");
+
+  if (ok) {
+    ok = cmd_run_sync(&server_cmd);
+  }
+
+  // relay that delays, drops, duplicates and reorders datagrams for local tests
+  CompileCmd proxy_cmd = {0};
+  proxy_cmd.compiler = COMPILER_C_ANY;
+  proxy_cmd.target_name = "ping_pong_proxy";
+  proxy_cmd.build_dir = "build";
+  proxy_cmd.cache_modules = false;
+  proxy_cmd.cflags = "-O2 -g -Wall -pedantic -std=c99 -I./raylib/src/";
+  proxy_cmd.link_with = "-L./raylib/src/ -lraylib -lm -lpthread";
+
+  vec_push(proxy_cmd.modules, "src/proxy");
+  vec_push(proxy_cmd.modules, "src/impair");
+  vec_push(proxy_cmd.modules, "src/network");
+  vec_push(proxy_cmd.modules, "src/args");
+  vec_push(proxy_cmd.modules, "src/net_uring");
+  vec_push(proxy_cmd.modules, "src/timing");
+
+  if (ok) {
+    ok = cmd_run_sync(&proxy_cmd);
+  }
+
+  // thousands of bot clients in one process to find how many rooms a host holds
+  CompileCmd load_cmd = {0};
+  load_cmd.compiler = COMPILER_C_ANY;
+  load_cmd.target_name = "ping_pong_load";
+  load_cmd.build_dir = "build";
+  load_cmd.cache_modules = false;
+  load_cmd.cflags = "-O2 -g -Wall -pedantic -std=c99 -I./raylib/src/";
+  load_cmd.link_with = "-L./raylib/src/ -lraylib -lm -lpthread";
+
+  vec_push(load_cmd.modules, "src/load");
+  vec_push(load_cmd.modules, "src/network");
+  vec_push(load_cmd.modules, "src/args");
+  vec_push(load_cmd.modules, "src/net_uring");
+  vec_push(load_cmd.modules, "src/game");
+  vec_push(load_cmd.modules, "src/delta");
+  vec_push(load_cmd.modules, "src/input_stream");
+  vec_push(load_cmd.modules, "src/timing");
+
+  if (ok) {
+    ok = cmd_run_sync(&load_cmd);
+  }
+
   char *prog = shift_args(&argc, &argv);
   char *sub_cmd = shift_args(&argc, &argv);
 
+  if (ok && NULL != sub_cmd && 0 == strcmp(sub_cmd, "bench")) {
+    // micro-benchmarks of the hot paths, optimized unlike the game itself
+    CompileCmd bench_cmd = {0};
+    bench_cmd.compiler = COMPILER_C_ANY;
+    bench_cmd.target_name = "ping_pong_bench";
+    bench_cmd.build_dir = "build";
+    bench_cmd.cache_modules = false;
+    bench_cmd.cflags = "-O2 -g -Wall -pedantic -std=c99 -I./raylib/src/";
+    bench_cmd.link_with = "-L./raylib/src/ -lraylib -lm -lpthread";
+
+    vec_push(bench_cmd.modules, "src/bench");
+    vec_push(bench_cmd.modules, "src/network");
+    vec_push(bench_cmd.modules, "src/args");
+    vec_push(bench_cmd.modules, "src/net_uring");
+    vec_push(bench_cmd.modules, "src/delta");
+    vec_push(bench_cmd.modules, "src/game");
+    vec_push(bench_cmd.modules, "src/timing");
+
+    ok = cmd_run_sync(&bench_cmd) && make_dir("bench");
+
+    if (ok) {
+      StringBuilder args_sb = {0};
+      string_builder_append_cstr(&args_sb, "./");
+      string_builder_append_cstr(&args_sb, bench_cmd.target_name);
+      string_builder_append_rune(&args_sb, ' ');
+
+      while (argc > 0) {
+        char *arg = shift_args(&argc, &argv);
+        string_builder_append_cstr(&args_sb, arg);
+        string_builder_append_rune(&args_sb, ' ');
+      }
+
+      ok = 0 == run_str_cmd_sync(string_builder_build(&args_sb));
+
+      string_builder_free(args_sb);
+    }
+
+    cmd_free(&bench_cmd);
+  }
+
   if (ok && NULL != sub_cmd && 0 == strncmp(sub_cmd, "run", 3)) {
     StringBuilder args_sb = {0};
     string_builder_append_cstr(&args_sb, "./");
@@ -54,6 +177,9 @@ int main(int argc, char **argv) {
     string_builder_free(args_sb);
   }
 
+  cmd_free(&server_cmd);
+  cmd_free(&proxy_cmd);
+  cmd_free(&load_cmd);
   cmd_free(&cmd);
 
   return !ok;
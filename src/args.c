@@ -0,0 +1,47 @@
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "raylib.h"
+
+#include "args.h"
+
+
+char *shift_args(int *argc, char ***argv) {
+  if (0 == *argc) return NULL;
+
+  char *arg = *argv[0];
+  *argv += 1;
+  *argc -= 1;
+  return arg;
+}
+
+long args_long(const char *option, const char *value, long min, long max) {
+  char *end = NULL;
+  errno = 0;
+  long number = strtol(value, &end, 10);
+  if (end == value || '\0' != *end || 0 != errno || number < min || number > max) {
+    // the largest value of the type only means there is no upper bound
+    if (LONG_MAX == max || INT_MAX == max) {
+      TraceLog(LOG_FATAL, "%s must be a whole number, at least %ld, got %s", option, min, value);
+    } else {
+      TraceLog(LOG_FATAL, "%s must be a whole number in range [%ld, %ld], got %s", option, min, max, value);
+    }
+  }
+  return number;
+}
+
+int args_int(const char *option, const char *value, int min, int max) {
+  return (int)args_long(option, value, min, max);
+}
+
+double args_double(const char *option, const char *value) {
+  char *end = NULL;
+  errno = 0;
+  double number = strtod(value, &end);
+  if (end == value || '\0' != *end || 0 != errno || !isfinite(number)) {
+    TraceLog(LOG_FATAL, "%s must be a number, got %s", option, value);
+  }
+  return number;
+}
@@ -0,0 +1,18 @@
+#ifndef __ARGS_H__
+#define __ARGS_H__
+
+/// @returns the next command line argument and moves past it, NULL if there is none
+char *shift_args(int *argc, char ***argv);
+
+/// Parses the value of a command line option, a value that is not a whole
+/// number in [min, max] is fatal
+long args_long(const char *option, const char *value, long min, long max);
+
+/// Same as args_long for the options that fit an int
+int args_int(const char *option, const char *value, int min, int max);
+
+/// Parses the value of a command line option that may have a fraction, a value
+/// that is not a finite number is fatal. The range is up to the caller
+double args_double(const char *option, const char *value);
+
+#endif // !__ARGS_H__
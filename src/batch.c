@@ -0,0 +1,306 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "batch.h"
+
+#define BATCH_ALIGNMENT 16
+
+
+static void *batch_alloc(int capacity, size_t elem_size) {
+  void *ptr = NULL;
+  if (0 != posix_memalign(&ptr, BATCH_ALIGNMENT, capacity * elem_size)) {
+    return NULL;
+  }
+  memset(ptr, 0, capacity * elem_size);
+  return ptr;
+}
+
+bool game_batch_create(GameBatch *batch, int count, const GameState *p_template) {
+  assert(count > 0);
+
+  memset(batch, 0, sizeof(*batch));
+  batch->count = count;
+  batch->capacity = (count + BATCH_LANES - 1) / BATCH_LANES * BATCH_LANES;
+  batch->template_state = *p_template;
+  batch->scratch_state = *p_template;
+
+  bool ok = true;
+  for (int i = 0; i < 2; ++i) {
+    ok = ok && NULL != (batch->paddle_y[i] = batch_alloc(batch->capacity, sizeof(float)));
+    ok = ok && NULL != (batch->paddle_velocity[i] = batch_alloc(batch->capacity, sizeof(float)));
+    ok = ok && NULL != (batch->paddle_acceleration[i] = batch_alloc(batch->capacity, sizeof(float)));
+    ok = ok && NULL != (batch->pressed_key[i] = batch_alloc(batch->capacity, sizeof(int)));
+    ok = ok && NULL != (batch->scores[i] = batch_alloc(batch->capacity, sizeof(int)));
+  }
+  ok = ok && NULL != (batch->ball_x = batch_alloc(batch->capacity, sizeof(float)));
+  ok = ok && NULL != (batch->ball_y = batch_alloc(batch->capacity, sizeof(float)));
+  ok = ok && NULL != (batch->ball_speed = batch_alloc(batch->capacity, sizeof(float)));
+  ok = ok && NULL != (batch->ball_spin_factor = batch_alloc(batch->capacity, sizeof(float)));
+  ok = ok && NULL != (batch->ball_direction_x = batch_alloc(batch->capacity, sizeof(float)));
+  ok = ok && NULL != (batch->ball_direction_y = batch_alloc(batch->capacity, sizeof(float)));
+  ok = ok && NULL != (batch->events = batch_alloc(batch->capacity, sizeof(unsigned)));
+
+  if (!ok) {
+    game_batch_free(batch);
+    return false;
+  }
+
+  for (int i = 0; i < batch->capacity; ++i) {
+    game_batch_load(batch, i, p_template);
+  }
+
+  return true;
+}
+
+void game_batch_free(GameBatch *batch) {
+  for (int i = 0; i < 2; ++i) {
+    free(batch->paddle_y[i]);
+    free(batch->paddle_velocity[i]);
+    free(batch->paddle_acceleration[i]);
+    free(batch->pressed_key[i]);
+    free(batch->scores[i]);
+  }
+  free(batch->ball_x);
+  free(batch->ball_y);
+  free(batch->ball_speed);
+  free(batch->ball_spin_factor);
+  free(batch->ball_direction_x);
+  free(batch->ball_direction_y);
+  free(batch->events);
+  memset(batch, 0, sizeof(*batch));
+}
+
+void game_batch_load(GameBatch *batch, int index, const GameState *p_state) {
+  assert(index >= 0 && index < batch->capacity);
+
+  for (int i = 0; i < 2; ++i) {
+    batch->paddle_y[i][index] = p_state->paddles[i].rect.y;
+    batch->paddle_velocity[i][index] = p_state->paddles[i].velocity;
+    batch->paddle_acceleration[i][index] = p_state->paddles[i].acceleration;
+    batch->pressed_key[i][index] = p_state->pressed_key[i];
+    batch->scores[i][index] = p_state->scores[i];
+  }
+  batch->ball_x[index] = p_state->ball.rect.x;
+  batch->ball_y[index] = p_state->ball.rect.y;
+  batch->ball_speed[index] = p_state->ball.speed;
+  batch->ball_spin_factor[index] = p_state->ball.spin_factor;
+  batch->ball_direction_x[index] = p_state->ball.direction.x;
+  batch->ball_direction_y[index] = p_state->ball.direction.y;
+}
+
+/// Writes the state of the match at index into *p_state,
+/// leaves the fields kept only in the template as they are
+static void batch_gather(const GameBatch *batch, int index, GameState *p_state) {
+  for (int i = 0; i < 2; ++i) {
+    p_state->paddles[i].rect.y = batch->paddle_y[i][index];
+    p_state->paddles[i].velocity = batch->paddle_velocity[i][index];
+    p_state->paddles[i].acceleration = batch->paddle_acceleration[i][index];
+    p_state->pressed_key[i] = batch->pressed_key[i][index];
+    p_state->scores[i] = batch->scores[i][index];
+  }
+  p_state->ball.rect.x = batch->ball_x[index];
+  p_state->ball.rect.y = batch->ball_y[index];
+  p_state->ball.speed = batch->ball_speed[index];
+  p_state->ball.spin_factor = batch->ball_spin_factor[index];
+  p_state->ball.direction.x = batch->ball_direction_x[index];
+  p_state->ball.direction.y = batch->ball_direction_y[index];
+}
+
+void game_batch_store(const GameBatch *batch, int index, GameState *p_state) {
+  assert(index >= 0 && index < batch->capacity);
+
+  *p_state = batch->template_state;
+  batch_gather(batch, index, p_state);
+}
+
+void game_batch_apply_pressed_keys(GameBatch *batch) {
+  for (int i = 0; i < 2; ++i) {
+    for (int j = 0; j < batch->capacity; ++j) {
+      switch (batch->pressed_key[i][j]) {
+        case 0: batch->paddle_acceleration[i][j] = 0; break;
+        case KEY_DOWN: batch->paddle_acceleration[i][j] = PADDLE_ACCELERATION; break;
+        case KEY_UP: batch->paddle_acceleration[i][j] = -PADDLE_ACCELERATION; break;
+      }
+    }
+  }
+}
+
+void game_batch_bot_input(GameBatch *batch) {
+  Rectangle paddle_rects[2] = {
+    batch->template_state.paddles[0].rect,
+    batch->template_state.paddles[1].rect,
+  };
+  Rectangle ball_rect = batch->template_state.ball.rect;
+
+  for (int j = 0; j < batch->capacity; ++j) {
+    ball_rect.x = batch->ball_x[j];
+    ball_rect.y = batch->ball_y[j];
+    Vector2 direction = { batch->ball_direction_x[j], batch->ball_direction_y[j] };
+
+    for (int i = 0; i < 2; ++i) {
+      paddle_rects[i].y = batch->paddle_y[i][j];
+      batch->pressed_key[i][j] = game_bot_key(paddle_rects[i], ball_rect, direction, i);
+    }
+  }
+
+  game_batch_apply_pressed_keys(batch);
+}
+
+static void batch_step_scalar(GameBatch *batch, int index, float dt) {
+  batch_gather(batch, index, &batch->scratch_state);
+  batch->scratch_state.tick = batch->template_state.tick;
+  batch->events[index] = game_state_step(&batch->scratch_state, dt);
+  game_batch_load(batch, index, &batch->scratch_state);
+  batch->scalar_steps += 1;
+}
+
+#ifdef __SSE__
+
+static inline __m128 select_ps(__m128 mask, __m128 if_true, __m128 if_false) {
+  return _mm_or_ps(_mm_and_ps(mask, if_true), _mm_andnot_ps(mask, if_false));
+}
+
+/// Same as raymath Clamp, including which bound wins for NaN and signed zeros
+static inline __m128 clamp_ps(__m128 value, __m128 min, __m128 max) {
+  __m128 result = select_ps(_mm_cmplt_ps(value, min), min, value);
+  return select_ps(_mm_cmpgt_ps(result, max), max, result);
+}
+
+/// Vectorized update_paddle followed by clamping it within the screen
+static inline void step_paddles_vector(float *p_y, float *p_velocity, const float *p_acceleration,
+                                       __m128 quiet, float dt) {
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 friction_pos = _mm_set1_ps(PADDLE_FRICTION);
+  const __m128 friction_neg = _mm_set1_ps(-PADDLE_FRICTION);
+  const __m128 max_velocity = _mm_set1_ps(MAX_PADDLE_SPEED * PHYSICS_REFERENCE_DT);
+  const __m128 min_velocity = _mm_set1_ps(-MAX_PADDLE_SPEED * PHYSICS_REFERENCE_DT);
+  const __m128 max_y = _mm_set1_ps(WINDOW_HEIGHT - (float)PADDLE_HEIGHT);
+  const __m128 dt_ps = _mm_set1_ps(dt);
+  const __m128 step_scale = _mm_set1_ps(dt / PHYSICS_REFERENCE_DT);
+
+  __m128 y = _mm_load_ps(p_y);
+  __m128 velocity = _mm_load_ps(p_velocity);
+  __m128 acceleration = _mm_load_ps(p_acceleration);
+
+  __m128 friction = select_ps(_mm_cmpgt_ps(velocity, zero), friction_pos,
+                              select_ps(_mm_cmplt_ps(velocity, zero), friction_neg, zero));
+  __m128 prev_velocity = velocity;
+  velocity = _mm_add_ps(velocity, _mm_mul_ps(_mm_sub_ps(acceleration, friction), dt_ps));
+  velocity = clamp_ps(velocity, min_velocity, max_velocity);
+
+  __m128 stop = _mm_or_ps(
+    _mm_or_ps(_mm_and_ps(_mm_cmpgt_ps(velocity, zero), _mm_cmplt_ps(prev_velocity, zero)),
+              _mm_and_ps(_mm_cmplt_ps(velocity, zero), _mm_cmpgt_ps(prev_velocity, zero))),
+    _mm_or_ps(_mm_and_ps(_mm_cmple_ps(y, zero), _mm_cmplt_ps(acceleration, zero)),
+              _mm_and_ps(_mm_cmpge_ps(y, max_y), _mm_cmpgt_ps(acceleration, zero))));
+  velocity = select_ps(stop, zero, velocity);
+
+  __m128 new_y = _mm_add_ps(y, _mm_mul_ps(velocity, step_scale));
+  new_y = clamp_ps(new_y, zero, max_y);
+
+  _mm_store_ps(p_y, select_ps(quiet, new_y, y));
+  _mm_store_ps(p_velocity, select_ps(quiet, velocity, prev_velocity));
+}
+
+/// Steps BATCH_LANES matches starting at base. Matches where the ball can reach
+/// a wall, a paddle or a goal within this step are left for the scalar path
+/// @returns bit mask of matches that were not stepped
+static int step_lanes_vector(GameBatch *batch, int base, float dt) {
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.f);
+  const __m128 dt_ps = _mm_set1_ps(dt);
+  const __m128 ball_side = _mm_set1_ps(BALL_SIDES);
+  const __m128 max_ball_x = _mm_set1_ps(WINDOW_WIDTH - (float)BALL_SIDES);
+  const __m128 max_ball_y = _mm_set1_ps(WINDOW_HEIGHT - (float)BALL_SIDES);
+  const __m128 min_ball_speed = _mm_set1_ps(MIN_BALL_SPEED);
+  const __m128 max_ball_speed = _mm_set1_ps(MAX_BALL_SPEED);
+  const __m128 speed_decay = _mm_set1_ps(.5f * (dt / PHYSICS_REFERENCE_DT));
+  const Rectangle *p_left = &batch->template_state.paddles[0].rect;
+  const Rectangle *p_right = &batch->template_state.paddles[1].rect;
+  const __m128 left_paddle_edge = _mm_set1_ps(p_left->x + p_left->width);
+  const __m128 right_paddle_edge = _mm_set1_ps(p_right->x);
+
+  __m128 x = _mm_load_ps(batch->ball_x + base);
+  __m128 y = _mm_load_ps(batch->ball_y + base);
+  __m128 speed = _mm_load_ps(batch->ball_speed + base);
+  __m128 direction_x = _mm_load_ps(batch->ball_direction_x + base);
+  __m128 direction_y = _mm_load_ps(batch->ball_direction_y + base);
+
+  // conservative broad phase: the ball is farther than it can travel
+  // in this step from the walls and from the paddle columns
+  __m128 reach = _mm_add_ps(_mm_mul_ps(speed, dt_ps), one);
+  __m128 quiet = _mm_and_ps(
+    _mm_and_ps(_mm_cmpgt_ps(_mm_sub_ps(y, reach), zero),
+               _mm_cmplt_ps(_mm_add_ps(_mm_add_ps(y, ball_side), reach), _mm_set1_ps(WINDOW_HEIGHT))),
+    _mm_and_ps(_mm_cmpgt_ps(_mm_sub_ps(x, reach), left_paddle_edge),
+               _mm_cmplt_ps(_mm_add_ps(_mm_add_ps(x, ball_side), reach), right_paddle_edge)));
+
+  int quiet_bits = _mm_movemask_ps(quiet);
+  if (0 == quiet_bits) {
+    return (1 << BATCH_LANES) - 1;
+  }
+
+  step_paddles_vector(batch->paddle_y[0] + base, batch->paddle_velocity[0] + base,
+                  batch->paddle_acceleration[0] + base, quiet, dt);
+  step_paddles_vector(batch->paddle_y[1] + base, batch->paddle_velocity[1] + base,
+                  batch->paddle_acceleration[1] + base, quiet, dt);
+
+  // Vector2Normalize
+  __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(direction_x, direction_x),
+                                         _mm_mul_ps(direction_y, direction_y)));
+  __m128 has_length = _mm_cmpgt_ps(length, zero);
+  __m128 inv_length = _mm_div_ps(one, length);
+  __m128 new_direction_x = select_ps(has_length, _mm_mul_ps(direction_x, inv_length), zero);
+  __m128 new_direction_y = select_ps(has_length, _mm_mul_ps(direction_y, inv_length), zero);
+
+  __m128 new_x = _mm_add_ps(x, _mm_mul_ps(_mm_mul_ps(speed, new_direction_x), dt_ps));
+  __m128 new_y = _mm_add_ps(y, _mm_mul_ps(_mm_mul_ps(speed, new_direction_y), dt_ps));
+  __m128 new_speed = clamp_ps(_mm_sub_ps(speed, speed_decay), min_ball_speed, max_ball_speed);
+
+  new_y = clamp_ps(new_y, zero, max_ball_y);
+  new_x = clamp_ps(new_x, zero, max_ball_x);
+
+  _mm_store_ps(batch->ball_x + base, select_ps(quiet, new_x, x));
+  _mm_store_ps(batch->ball_y + base, select_ps(quiet, new_y, y));
+  _mm_store_ps(batch->ball_speed + base, select_ps(quiet, new_speed, speed));
+  _mm_store_ps(batch->ball_direction_x + base, select_ps(quiet, new_direction_x, direction_x));
+  _mm_store_ps(batch->ball_direction_y + base, select_ps(quiet, new_direction_y, direction_y));
+
+  return ~quiet_bits & ((1 << BATCH_LANES) - 1);
+}
+
+#else
+
+// No vector unit, every match goes through game_state_step
+static int step_lanes_vector(GameBatch *batch, int base, float dt) {
+  (void)batch;
+  (void)base;
+  (void)dt;
+  return (1 << BATCH_LANES) - 1;
+}
+
+#endif // __SSE__
+
+void game_batch_step(GameBatch *batch, float dt) {
+  for (int base = 0; base < batch->capacity; base += BATCH_LANES) {
+    int scalar_lanes = step_lanes_vector(batch, base, dt);
+
+    for (int lane = 0; lane < BATCH_LANES; ++lane) {
+      if (scalar_lanes & (1 << lane)) {
+        batch_step_scalar(batch, base + lane, dt);
+      } else {
+        batch->events[base + lane] = GAME_EVENT_NONE;
+        batch->vector_steps += 1;
+      }
+    }
+  }
+
+  batch->template_state.tick += 1;
+}
@@ -0,0 +1,68 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <stdbool.h>
+
+#include "game.h"
+
+// Number of matches stepped by one vector instruction
+#define BATCH_LANES 4
+
+/// Many matches kept as structure of arrays of their GameState.
+/// Arrays have capacity elements (count rounded up to BATCH_LANES),
+/// padding matches are stepped too but never reported
+typedef struct {
+  int count;
+  int capacity;
+
+  float *paddle_y[2];
+  float *paddle_velocity[2];
+  float *paddle_acceleration[2];
+  int *pressed_key[2];
+
+  float *ball_x;
+  float *ball_y;
+  float *ball_speed;
+  float *ball_spin_factor;
+  float *ball_direction_x;
+  float *ball_direction_y;
+
+  int *scores[2];
+  // GameEvent mask of the last step of every match
+  unsigned *events;
+
+  // state every match starts from and that is not stored per match
+  // (paddle x and sizes, ball size, win score, the tick all matches are at)
+  GameState template_state;
+  // state the scalar path steps a single match in
+  GameState scratch_state;
+
+  // matches that had to be stepped by the scalar game_state_step
+  // because something more than plain movement could happen
+  long scalar_steps;
+  long vector_steps;
+} GameBatch;
+
+/// Allocates count matches, all of them copies of *p_template
+/// @returns false if allocation fails
+bool game_batch_create(GameBatch *batch, int count, const GameState *p_template);
+void game_batch_free(GameBatch *batch);
+
+/// Copies the state into the match at index
+void game_batch_load(GameBatch *batch, int index, const GameState *p_state);
+
+/// Fills *p_state with the match at index
+void game_batch_store(const GameBatch *batch, int index, GameState *p_state);
+
+/// Converts pressed_key of every match into paddle acceleration
+/// the same way game_apply_pressed_key does
+void game_batch_apply_pressed_keys(GameBatch *batch);
+
+/// Sets pressed_key and acceleration of both paddles of every match with game_bot_key
+void game_batch_bot_input(GameBatch *batch);
+
+/// Advances every match by dt, results are bit-identical to game_state_step
+/// called on each match separately
+void game_batch_step(GameBatch *batch, float dt);
+
+#endif // !__BATCH_H__
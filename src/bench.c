@@ -0,0 +1,665 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "raylib.h"
+
+#include "game.h"
+#include "args.h"
+#include "network.h"
+#include "delta.h"
+#include "timing.h"
+
+#define BENCH_DEFAULT_SAMPLES 200
+#define BENCH_DEFAULT_WARMUP_MS 200
+// every sample runs the function in a loop for about this long,
+// so the clock resolution does not matter even for nanosecond functions
+#define BENCH_SAMPLE_NS 100000
+#define BENCH_DEFAULT_THRESHOLD 10.
+#define BENCH_DEFAULT_OUT "build/bench.json"
+#define BENCH_DEFAULT_BASELINE "bench/baseline.json"
+#define BENCH_NAME_CAPACITY 64
+
+typedef struct {
+  const char *out_path;
+  const char *baseline_path;
+  // allowed slowdown of the median against the baseline, in percent
+  double threshold;
+  int samples;
+  int warmup_ms;
+  bool save_baseline;
+  const char *filter;
+} BenchConfig;
+
+typedef void (*BenchFn)(void *state);
+
+typedef struct {
+  const char *name;
+  BenchFn fn;
+  void *state;
+  // datagrams every call sends and receives, 0 if it does no network I/O
+  int packets;
+  // datagrams that never arrived so far, NULL if it does no network I/O
+  const long *p_lost;
+} Bench;
+
+/// Nanoseconds per operation, percentiles are over the samples
+typedef struct {
+  char name[BENCH_NAME_CAPACITY];
+  long iterations;
+  double ns_per_op;
+  double min;
+  double p50;
+  double p90;
+  double p99;
+  // user and system CPU time of the samples per operation, the kernel's share of
+  // the network I/O included
+  double cpu_ns_per_op;
+} BenchResult;
+
+
+typedef struct {
+  BallState ball;
+  PaddleState paddle;
+  Vector2 direction;
+  float speed;
+} CollisionState;
+
+static void bench_handle_collision(void *state) {
+  CollisionState *p_state = state;
+  // every call bounces the same ball, otherwise it drifts to other branches
+  p_state->ball.direction = p_state->direction;
+  p_state->ball.speed = p_state->speed;
+  handle_collision(&p_state->ball, &p_state->paddle);
+}
+
+static void bench_update_paddle(void *state) {
+  PaddleState *p_paddle = state;
+  update_paddle(p_paddle, PHYSICS_REFERENCE_DT);
+
+  // keep the paddle travelling between the walls instead of resting at one
+  if (p_paddle->rect.y <= 0) {
+    p_paddle->rect.y = 0;
+    p_paddle->acceleration = PADDLE_SPEED;
+  } else if (p_paddle->rect.y >= WINDOW_HEIGHT - p_paddle->rect.height) {
+    p_paddle->rect.y = WINDOW_HEIGHT - p_paddle->rect.height;
+    p_paddle->acceleration = -PADDLE_SPEED;
+  }
+}
+
+static void bench_headless_tick(void *state) {
+  GameContext *ctx = state;
+  if (NULL == ctx->update) {
+    *ctx = game_context_create();
+    ctx->update = game_headless_update;
+  }
+  ctx->update(ctx, ctx->tick_dt);
+}
+
+typedef struct {
+  Ball ball;
+  Rectangle rect;
+} TailState;
+
+static void bench_tail_segments(void *state) {
+  TailState *p_state = state;
+  TailSegment segments[TAIL_MAX_SEGMENTS];
+
+  p_state->rect.x = p_state->rect.x >= WINDOW_WIDTH ? 0 : p_state->rect.x + 7;
+  game_tail_segments(p_state->rect, p_state->ball.color, true,
+                     p_state->ball.tail, &p_state->ball.tail_begin, &p_state->ball.tail_len,
+                     TAIL_CAPACITY_BALL, segments);
+}
+
+typedef struct {
+  GameStateRing ring;
+  GameState state;
+  GameState restored;
+  uint32_t depth;
+  uint64_t hash;
+} SnapshotState;
+
+static void bench_state_save(void *state) {
+  SnapshotState *p_state = state;
+  p_state->state.tick += 1;
+  game_state_save(&p_state->ring, &p_state->state);
+}
+
+static void bench_state_restore(void *state) {
+  SnapshotState *p_state = state;
+  // walk over the whole ring like rollbacks of varying depth would
+  uint32_t tick = p_state->state.tick - p_state->depth++ % GAME_STATE_RING_CAPACITY;
+  if (!game_state_restore(&p_state->ring, tick, &p_state->restored)) {
+    TraceLog(LOG_FATAL, "Tick %u is not in the ring", tick);
+  }
+}
+
+static void bench_state_hash(void *state) {
+  SnapshotState *p_state = state;
+  p_state->hash ^= game_state_hash(&p_state->restored);
+  p_state->restored.tick += 1;
+}
+
+// Datagrams per operation of the batched loopback benchmark
+#define BENCH_BATCH_DATAGRAMS 16
+
+// A loopback datagram that has not arrived this long after the last one is lost,
+// the operation gives up on it instead of waiting forever
+#define BENCH_RECV_TIMEOUT_MS 100
+
+typedef struct {
+  UdpSocket server;
+  UdpSocket client;
+  NetSnapshot snapshot;
+  NetBatch *p_server_batch;
+  NetBatch *p_client_batch;
+  long lost;
+} LoopbackState;
+
+/// Sleeps until the fd has something to read
+/// @returns false if nothing came within BENCH_RECV_TIMEOUT_MS
+static bool wait_readable(int fd) {
+  struct pollfd pfd = { .fd = fd, .events = POLLIN };
+  int ready = 0;
+  do {
+    ready = poll(&pfd, 1, BENCH_RECV_TIMEOUT_MS);
+  } while (ready < 0 && EINTR == errno);
+  return ready > 0;
+}
+
+static void bench_net_snapshot(void *state) {
+  LoopbackState *p_state = state;
+  char buf[NET_BUF_SIZE] = {0};
+  int len = 0;
+
+  p_state->snapshot.tick += 1;
+  p_state->snapshot.positions[GE_BALL][0] += 1.f;
+  net_send_snapshot(&p_state->client, &p_state->snapshot);
+
+  // loopback delivery is immediate, but recv is non-blocking
+  while ((len = net_recv_cmd(&p_state->server, buf)) == 0) {
+    if (!wait_readable(p_state->server.fd)) {
+      p_state->lost += 1;
+      return;
+    }
+  }
+  if (!net_decode_snapshot(buf, len, &p_state->snapshot)) {
+    TraceLog(LOG_FATAL, "Loopback snapshot is corrupted");
+  }
+}
+
+typedef struct {
+  DeltaEncoder encoder;
+  NetSnapshot snapshot;
+  char buf[NET_BUF_SIZE];
+} DeltaState;
+
+static void bench_delta_encode(void *state) {
+  DeltaState *p_state = state;
+  // a rally with the client acking a few ticks behind
+  p_state->snapshot.tick += 1;
+  p_state->snapshot.positions[GE_BALL][0] += 7.5f;
+  p_state->snapshot.positions[GE_BALL][1] += 1.25f;
+  delta_encoder_ack(&p_state->encoder, p_state->snapshot.tick - 6);
+  delta_encode(&p_state->encoder, &p_state->snapshot, p_state->buf);
+}
+
+static void bench_net_batch(void *state) {
+  LoopbackState *p_state = state;
+  char buf[NET_BUF_SIZE] = {0};
+
+  for (int i = 0; i < BENCH_BATCH_DATAGRAMS; ++i) {
+    p_state->snapshot.tick += 1;
+    net_encode_snapshot(&p_state->snapshot, buf);
+    net_batch_queue(p_state->p_client_batch, &p_state->client.addr, buf, NET_SNAPSHOT_SIZE);
+  }
+  net_batch_flush(p_state->p_client_batch);
+
+  int received = 0;
+  while (received < BENCH_BATCH_DATAGRAMS) {
+    int count = net_batch_recv(p_state->p_server_batch);
+    received += count;
+    // with io_uring the recv above armed the ring the wait polls
+    if (0 == count && !wait_readable(net_batch_poll_fd(p_state->p_server_batch))) {
+      p_state->lost += BENCH_BATCH_DATAGRAMS - received;
+      return;
+    }
+  }
+}
+
+/// Batches of both sockets use the backend, it stays the selected one
+static bool loopback_init(LoopbackState *p_state, NetBackend backend) {
+  struct sockaddr_in6 addr = {0};
+  socklen_t addrlen = sizeof(addr);
+
+  if (!create_udp_server_socket(0, &p_state->server)) {
+    return false;
+  }
+
+  if (-1 == getsockname(p_state->server.fd, (struct sockaddr*)&addr, &addrlen)) {
+    TraceLog(LOG_ERROR, "Could not get the bound port: %s\n", strerror(errno));
+    close(p_state->server.fd);
+    return false;
+  }
+
+  if (!connect_to_host_udp("127.0.0.1", ntohs(addr.sin6_port), &p_state->client)) {
+    close(p_state->server.fd);
+    return false;
+  }
+
+  net_set_backend(backend);
+  p_state->p_server_batch = net_batch_create(p_state->server.fd);
+  p_state->p_client_batch = net_batch_create(p_state->client.fd);
+  if (NULL == p_state->p_server_batch || NULL == p_state->p_client_batch
+    || net_batch_backend(p_state->p_server_batch) != backend
+    || net_batch_backend(p_state->p_client_batch) != backend) {
+    net_batch_destroy(p_state->p_server_batch);
+    net_batch_destroy(p_state->p_client_batch);
+    close(p_state->client.fd);
+    close(p_state->server.fd);
+    return false;
+  }
+
+  return true;
+}
+
+
+static int compare_doubles(const void *lhs, const void *rhs) {
+  double l = *(const double*)lhs;
+  double r = *(const double*)rhs;
+  return (l > r) - (l < r);
+}
+
+static double percentile(const double *sorted, int count, double p) {
+  int index = (int)(p * (count - 1) + .5);
+  return sorted[index];
+}
+
+static double cpu_time_ns(void) {
+  struct rusage usage = {0};
+  getrusage(RUSAGE_SELF, &usage);
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e9
+    + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e3;
+}
+
+static uint64_t run_batch(const Bench *p_bench, long iterations) {
+  uint64_t start = time_now_ns();
+  for (long i = 0; i < iterations; ++i) {
+    p_bench->fn(p_bench->state);
+  }
+  return time_now_ns() - start;
+}
+
+/// Warms up the function, finds how many calls fill BENCH_SAMPLE_NS
+/// and measures ns per call in cfg->samples samples
+static BenchResult run_bench(const BenchConfig *p_cfg, const Bench *p_bench) {
+  BenchResult result = {0};
+  snprintf(result.name, sizeof(result.name), "%s", p_bench->name);
+
+  long batch = 1;
+  uint64_t warmup_end = time_now_ns() + (uint64_t)p_cfg->warmup_ms * 1000000;
+  while (time_now_ns() < warmup_end) {
+    if (run_batch(p_bench, batch) < BENCH_SAMPLE_NS) {
+      batch *= 2;
+    }
+  }
+
+  double *samples = malloc(p_cfg->samples * sizeof(double));
+  if (NULL == samples) {
+    TraceLog(LOG_FATAL, "Could not allocate %d samples", p_cfg->samples);
+  }
+
+  uint64_t total_ns = 0;
+  double cpu_start_ns = cpu_time_ns();
+  for (int i = 0; i < p_cfg->samples; ++i) {
+    uint64_t ns = run_batch(p_bench, batch);
+    total_ns += ns;
+    samples[i] = (double)ns / batch;
+  }
+
+  qsort(samples, p_cfg->samples, sizeof(double), compare_doubles);
+
+  result.iterations = batch * p_cfg->samples;
+  result.ns_per_op = (double)total_ns / result.iterations;
+  result.cpu_ns_per_op = (cpu_time_ns() - cpu_start_ns) / result.iterations;
+  result.min = samples[0];
+  result.p50 = percentile(samples, p_cfg->samples, .5);
+  result.p90 = percentile(samples, p_cfg->samples, .9);
+  result.p99 = percentile(samples, p_cfg->samples, .99);
+
+  free(samples);
+  return result;
+}
+
+
+static bool write_results(const char *path, const BenchResult *results, int count) {
+  FILE *file = fopen(path, "w");
+  if (NULL == file) {
+    TraceLog(LOG_ERROR, "Could not open %s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  fprintf(file, "{\n  \"benchmarks\": [\n");
+  for (int i = 0; i < count; ++i) {
+    fprintf(file, "    {\"name\": \"%s\", \"iterations\": %ld, \"ns_per_op\": %.3f, "
+            "\"min\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f}%s\n",
+            results[i].name, results[i].iterations, results[i].ns_per_op,
+            results[i].min, results[i].p50, results[i].p90, results[i].p99,
+            i + 1 < count ? "," : "");
+  }
+  fprintf(file, "  ]\n}\n");
+
+  bool ok = 0 == ferror(file);
+  ok = 0 == fclose(file) && ok;
+  if (!ok) {
+    TraceLog(LOG_ERROR, "Could not write %s\n", path);
+  }
+  return ok;
+}
+
+static char *read_file(const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (NULL == file) {
+    return NULL;
+  }
+
+  char *content = NULL;
+  long size = 0;
+  if (0 == fseek(file, 0, SEEK_END) && (size = ftell(file)) >= 0 && 0 == fseek(file, 0, SEEK_SET)) {
+    content = malloc(size + 1);
+  }
+
+  if (NULL != content) {
+    content[fread(content, 1, size, file)] = '\0';
+  }
+
+  fclose(file);
+  return content;
+}
+
+static const char *skip_space(const char *p) {
+  while (' ' == *p || '\n' == *p || '\r' == *p || '\t' == *p) p += 1;
+  return p;
+}
+
+/// Copies a JSON string without escapes, which is all write_results writes
+/// @returns the position after its closing quote, NULL if there is no such string or it does not fit
+static const char *parse_string(const char *p, char *buf, int size) {
+  if ('"' != *p) return NULL;
+
+  const char *end = strchr(p + 1, '"');
+  if (NULL == end || end - p - 1 >= size || NULL != memchr(p + 1, '\\', end - p - 1)) {
+    return NULL;
+  }
+  memcpy(buf, p + 1, end - p - 1);
+  buf[end - p - 1] = '\0';
+  return end + 1;
+}
+
+/// Finds the median of the benchmark in the file written by write_results: walks the
+/// objects of its "benchmarks" array and matches the keys and the name exactly
+/// @returns false if the baseline has no such benchmark or is not in that format
+static bool baseline_p50(const char *baseline, const char *name, double *p_out) {
+  const char *p = strstr(baseline, "\"benchmarks\"");
+  if (NULL == p || NULL == (p = strchr(p, '['))) {
+    return false;
+  }
+
+  p = skip_space(p + 1);
+  while ('{' == *p) {
+    char entry[BENCH_NAME_CAPACITY] = {0};
+    double p50 = 0.;
+    bool has_p50 = false;
+
+    p = skip_space(p + 1);
+    while ('"' == *p) {
+      char key[BENCH_NAME_CAPACITY] = {0};
+      p = parse_string(p, key, sizeof(key));
+      if (NULL == p || ':' != *(p = skip_space(p))) return false;
+      p = skip_space(p + 1);
+
+      if ('"' == *p) {
+        char value[BENCH_NAME_CAPACITY] = {0};
+        if (NULL == (p = parse_string(p, value, sizeof(value)))) return false;
+        if (0 == strcmp(key, "name")) memcpy(entry, value, sizeof(entry));
+      } else {
+        char *end = NULL;
+        double number = strtod(p, &end);
+        if (end == p) return false;
+        p = end;
+        if (0 == strcmp(key, "p50")) {
+          p50 = number;
+          has_p50 = true;
+        }
+      }
+
+      p = skip_space(p);
+      if (',' == *p) p = skip_space(p + 1);
+    }
+
+    if ('}' != *p) {
+      return false;
+    }
+    if (has_p50 && 0 == strcmp(entry, name)) {
+      *p_out = p50;
+      return true;
+    }
+
+    p = skip_space(p + 1);
+    if (',' == *p) p = skip_space(p + 1);
+  }
+  return false;
+}
+
+/// Prints results against the baseline medians
+/// @returns false if any benchmark got slower than the threshold allows
+static bool compare_with_baseline(const BenchConfig *p_cfg, const BenchResult *results, int count) {
+  char *baseline = read_file(p_cfg->baseline_path);
+  if (NULL == baseline) {
+    printf("No baseline at %s, run with --save-baseline to store one\n", p_cfg->baseline_path);
+    return true;
+  }
+
+  bool ok = true;
+  printf("\nAgainst %s (threshold %.1f%%):\n", p_cfg->baseline_path, p_cfg->threshold);
+
+  for (int i = 0; i < count; ++i) {
+    double base = 0.;
+    if (!baseline_p50(baseline, results[i].name, &base) || base <= 0.) {
+      printf("  %-20s no baseline\n", results[i].name);
+      continue;
+    }
+
+    double change = (results[i].p50 / base - 1.) * 100.;
+    bool regressed = change > p_cfg->threshold;
+    ok = ok && !regressed;
+
+    printf("  %-20s %10.2f -> %10.2f ns  %+7.1f%%%s\n",
+           results[i].name, base, results[i].p50, change, regressed ? "  REGRESSION" : "");
+  }
+
+  free(baseline);
+  return ok;
+}
+
+
+static BenchConfig parse_args(int argc, char **argv) {
+  BenchConfig config = {0};
+  config.out_path = BENCH_DEFAULT_OUT;
+  config.baseline_path = BENCH_DEFAULT_BASELINE;
+  config.threshold = BENCH_DEFAULT_THRESHOLD;
+  config.samples = BENCH_DEFAULT_SAMPLES;
+  config.warmup_ms = BENCH_DEFAULT_WARMUP_MS;
+
+  shift_args(&argc, &argv);
+
+  while (argc > 0) {
+    char *arg = shift_args(&argc, &argv);
+    if (0 == strcmp(arg, "--save-baseline")) {
+      config.save_baseline = true;
+      continue;
+    }
+
+    if (argc < 1) {
+      TraceLog(LOG_FATAL, "Value must be provided for %s", arg);
+    }
+    char *value = shift_args(&argc, &argv);
+
+    if (0 == strcmp(arg, "--out")) {
+      config.out_path = value;
+    } else if (0 == strcmp(arg, "--baseline")) {
+      config.baseline_path = value;
+    } else if (0 == strcmp(arg, "--threshold")) {
+      config.threshold = args_double("--threshold", value);
+      if (config.threshold < 0) {
+        TraceLog(LOG_FATAL, "--threshold must not be negative, got %s", value);
+      }
+    } else if (0 == strcmp(arg, "--samples")) {
+      config.samples = args_int("--samples", value, 1, INT_MAX);
+    } else if (0 == strcmp(arg, "--warmup-ms")) {
+      config.warmup_ms = args_int("--warmup-ms", value, 0, INT_MAX);
+    } else if (0 == strcmp(arg, "--filter")) {
+      config.filter = value;
+    } else {
+      TraceLog(LOG_FATAL, "Unknown argument %s", arg);
+    }
+  }
+
+  return config;
+}
+
+int main(int argc, char **argv) {
+  BenchConfig cfg = parse_args(argc, argv);
+  SetTraceLogLevel(LOG_WARNING);
+
+  GameContext ctx = game_context_create();
+
+  CollisionState collision = { .ball = ctx.state.ball, .paddle = ctx.state.paddles[0] };
+  collision.paddle.velocity = MAX_PADDLE_SPEED * PHYSICS_REFERENCE_DT / 2;
+  collision.ball.rect.y = collision.paddle.rect.y + collision.paddle.rect.height / 3;
+  collision.direction = collision.ball.direction;
+  collision.speed = collision.ball.speed;
+
+  PaddleState paddle = ctx.state.paddles[1];
+  paddle.acceleration = PADDLE_SPEED;
+
+  GameContext headless_ctx = game_context_create();
+  headless_ctx.update = game_headless_update;
+
+  TailState tail = { .ball = ctx.ball, .rect = ctx.state.ball.rect };
+
+  static SnapshotState snapshot = {0};
+  snapshot.state = ctx.state;
+  for (int i = 0; i < GAME_STATE_RING_CAPACITY; ++i) {
+    snapshot.state.tick = i;
+    game_state_save(&snapshot.ring, &snapshot.state);
+  }
+
+  static DeltaState delta = {0};
+  delta_encoder_init(&delta.encoder);
+  delta.snapshot.input_count = NET_TICK_INPUTS_HISTORY;
+
+  LoopbackState loopback = {0};
+  bool has_loopback = loopback_init(&loopback, NET_BACKEND_SYSCALL);
+  if (!has_loopback) {
+    TraceLog(LOG_WARNING, "Loopback sockets are not available, skipping network benchmarks");
+  }
+
+  LoopbackState uring_loopback = {0};
+  bool has_uring_loopback = has_loopback && loopback_init(&uring_loopback, NET_BACKEND_IO_URING);
+  if (has_loopback && !has_uring_loopback) {
+    TraceLog(LOG_WARNING, "io_uring is not available, skipping its benchmark");
+  }
+  net_set_backend(NET_BACKEND_SYSCALL);
+
+  Bench benches[] = {
+    { .name = "handle_collision", .fn = bench_handle_collision, .state = &collision },
+    { .name = "update_paddle", .fn = bench_update_paddle, .state = &paddle },
+    { .name = "headless_tick", .fn = bench_headless_tick, .state = &headless_ctx },
+    { .name = "tail_segments", .fn = bench_tail_segments, .state = &tail },
+    { .name = "state_save", .fn = bench_state_save, .state = &snapshot },
+    { .name = "state_restore", .fn = bench_state_restore, .state = &snapshot },
+    { .name = "state_hash", .fn = bench_state_hash, .state = &snapshot },
+    { .name = "delta_encode", .fn = bench_delta_encode, .state = &delta },
+    { .name = "net_snapshot_loopback", .fn = has_loopback ? bench_net_snapshot : NULL, .state = &loopback,
+      .packets = 1, .p_lost = &loopback.lost },
+    // BENCH_BATCH_DATAGRAMS snapshots per operation, one sendmmsg and as few recvmmsg as it takes
+    { .name = "net_batch16_loopback", .fn = has_loopback ? bench_net_batch : NULL, .state = &loopback,
+      .packets = BENCH_BATCH_DATAGRAMS, .p_lost = &loopback.lost },
+    // the same through io_uring: one io_uring_enter, the receives are already posted
+    { .name = "net_uring16_loopback", .fn = has_uring_loopback ? bench_net_batch : NULL,
+      .state = &uring_loopback, .packets = BENCH_BATCH_DATAGRAMS, .p_lost = &uring_loopback.lost },
+  };
+  int bench_count = sizeof(benches) / sizeof(benches[0]);
+
+  BenchResult results[sizeof(benches) / sizeof(benches[0])] = {0};
+  int packets[sizeof(benches) / sizeof(benches[0])] = {0};
+  long lost[sizeof(benches) / sizeof(benches[0])] = {0};
+  int result_count = 0;
+
+  printf("%-22s %12s %10s %10s %10s %10s\n", "benchmark", "iterations", "ns/op", "p50", "p90", "p99");
+  for (int i = 0; i < bench_count; ++i) {
+    if (NULL == benches[i].fn || (NULL != cfg.filter && NULL == strstr(benches[i].name, cfg.filter))) {
+      continue;
+    }
+
+    packets[result_count] = benches[i].packets;
+    long lost_before = NULL != benches[i].p_lost ? *benches[i].p_lost : 0;
+    BenchResult *p_result = &results[result_count];
+    *p_result = run_bench(&cfg, &benches[i]);
+    if (NULL != benches[i].p_lost) {
+      lost[result_count] = *benches[i].p_lost - lost_before;
+    }
+    result_count += 1;
+    printf("%-22s %12ld %10.2f %10.2f %10.2f %10.2f\n", p_result->name, p_result->iterations,
+           p_result->ns_per_op, p_result->p50, p_result->p90, p_result->p99);
+  }
+
+  // every datagram is sent and received, the CPU time covers both ends
+  for (int i = 0; i < result_count; ++i) {
+    if (packets[i] > 0) {
+      printf("%-22s %10.0f packets/s %10.1f ns CPU/packet\n", results[i].name,
+             packets[i] * 1e9 / results[i].ns_per_op, results[i].cpu_ns_per_op / packets[i]);
+    }
+    // the warmup included, every loss stalled an operation for BENCH_RECV_TIMEOUT_MS
+    if (lost[i] > 0) {
+      printf("%-22s lost %ld datagrams, the timings above are off\n", results[i].name, lost[i]);
+    }
+  }
+
+  if (has_uring_loopback) {
+    net_batch_destroy(uring_loopback.p_server_batch);
+    net_batch_destroy(uring_loopback.p_client_batch);
+    close(uring_loopback.client.fd);
+    close(uring_loopback.server.fd);
+  }
+
+  if (has_loopback) {
+    net_batch_destroy(loopback.p_server_batch);
+    net_batch_destroy(loopback.p_client_batch);
+    close(loopback.client.fd);
+    close(loopback.server.fd);
+  }
+
+  if (cfg.save_baseline) {
+    bool ok = write_results(cfg.baseline_path, results, result_count);
+    if (ok) {
+      printf("Saved baseline to %s\n", cfg.baseline_path);
+    }
+    return !ok;
+  }
+
+  bool ok = write_results(cfg.out_path, results, result_count);
+  if (ok) {
+    printf("Results written to %s\n", cfg.out_path);
+  }
+
+  return !(compare_with_baseline(&cfg, results, result_count) && ok);
+}
@@ -0,0 +1,202 @@
+#include <math.h>
+#include <string.h>
+
+#include "clock_sync.h"
+
+// A sample this many residuals off the fit (and more than half the delay filter) is a spike
+#define CLOCK_SYNC_SPIKE_RESIDUALS 4.
+
+// Every slack sample counts this much in the smoothed one
+#define CLOCK_ALIGN_SMOOTHING (1. / 8.)
+
+// A pong moves the host's step schedule this much of the way to the step it tells
+#define CLOCK_TICKS_SMOOTHING (1. / 8.)
+
+static double clamp(double value, double min, double max) {
+  return value < min ? min : value > max ? max : value;
+}
+
+void clock_sync_init(ClockSync *p_sync) {
+  memset(p_sync, 0, sizeof(*p_sync));
+}
+
+/// @returns the fitted offset at the local time
+static double offset_at(const ClockSync *p_sync, double local_time) {
+  return p_sync->offset + p_sync->drift * (local_time - p_sync->ref_time);
+}
+
+/// Fits the line through the samples: the offset at their mean time and the slope
+static void fit(ClockSync *p_sync) {
+  long count = p_sync->sample_count < CLOCK_SYNC_SAMPLES ? p_sync->sample_count : CLOCK_SYNC_SAMPLES;
+  const ClockSample *p_newest = &p_sync->samples[(p_sync->sample_count - 1) % CLOCK_SYNC_SAMPLES];
+  const ClockSample *p_oldest = &p_sync->samples[count < CLOCK_SYNC_SAMPLES ? 0 : p_sync->sample_count % CLOCK_SYNC_SAMPLES];
+
+  double mean_time = 0;
+  double mean_offset = 0;
+  for (long i = 0; i < count; ++i) {
+    mean_time += p_sync->samples[i].time;
+    mean_offset += p_sync->samples[i].offset;
+  }
+  mean_time /= count;
+  mean_offset /= count;
+
+  // centered on the mean time, so the squares of the times since boot do not eat the precision
+  double stt = 0;
+  double sto = 0;
+  for (long i = 0; i < count; ++i) {
+    double dt = p_sync->samples[i].time - mean_time;
+    stt += dt * dt;
+    sto += dt * (p_sync->samples[i].offset - mean_offset);
+  }
+
+  p_sync->ref_time = mean_time;
+  p_sync->offset = mean_offset;
+  p_sync->drift = 0;
+  if (count >= CLOCK_SYNC_MIN_FIT_SAMPLES && p_newest->time - p_oldest->time >= 1. && stt > 0) {
+    p_sync->drift = clamp(sto / stt, -CLOCK_SYNC_MAX_DRIFT, CLOCK_SYNC_MAX_DRIFT);
+  }
+
+  double squares = 0;
+  for (long i = 0; i < count; ++i) {
+    double miss = p_sync->samples[i].offset - offset_at(p_sync, p_sync->samples[i].time);
+    squares += miss * miss;
+  }
+  // the mean and the slope take two degrees of freedom
+  p_sync->residual = sqrt(squares / (count > 2 ? count - 2 : 1));
+
+  double newest_dt = p_newest->time - mean_time;
+  p_sync->error = p_sync->residual * sqrt(1. / count + (stt > 0 ? newest_dt * newest_dt / stt : 0));
+}
+
+bool clock_sync_add(ClockSync *p_sync, double t1, double t2, double t3, double t4) {
+  double delay = (t4 - t1) - (t3 - t2);
+  if (delay < 0) delay = 0;
+  double offset = ((t2 - t1) + (t3 - t4)) / 2;
+  double time = (t1 + t4) / 2;
+
+  if (0 == p_sync->stats.exchanges++) {
+    p_sync->first_time = time;
+  }
+
+  p_sync->delays[p_sync->delay_count++ % CLOCK_SYNC_DELAY_WINDOW] = delay;
+  long delay_count = p_sync->delay_count < CLOCK_SYNC_DELAY_WINDOW ? p_sync->delay_count : CLOCK_SYNC_DELAY_WINDOW;
+  p_sync->min_delay = delay;
+  for (long i = 0; i < delay_count; ++i) {
+    if (p_sync->delays[i] < p_sync->min_delay) p_sync->min_delay = p_sync->delays[i];
+  }
+
+  if (delay > p_sync->min_delay + CLOCK_SYNC_MAX_EXTRA_DELAY) {
+    p_sync->stats.delayed += 1;
+    return false;
+  }
+
+  if (p_sync->sample_count >= CLOCK_SYNC_MIN_FIT_SAMPLES) {
+    double miss = fabs(offset - offset_at(p_sync, time));
+    if (miss > CLOCK_SYNC_SPIKE_RESIDUALS * p_sync->residual + CLOCK_SYNC_MAX_EXTRA_DELAY / 2) {
+      p_sync->stats.spikes += 1;
+      if (++p_sync->spikes_in_row < CLOCK_SYNC_MAX_SPIKES) {
+        return false;
+      }
+      // the samples so far are of the clock before the step
+      p_sync->stats.restarts += 1;
+      p_sync->sample_count = 0;
+      p_sync->is_converged = false;
+      p_sync->first_time = time;
+    }
+  }
+  p_sync->spikes_in_row = 0;
+  p_sync->stats.accepted += 1;
+
+  ClockSample *p_sample = &p_sync->samples[p_sync->sample_count++ % CLOCK_SYNC_SAMPLES];
+  p_sample->time = time;
+  p_sample->offset = offset;
+  fit(p_sync);
+
+  if (!p_sync->is_converged && p_sync->sample_count >= CLOCK_SYNC_MIN_FIT_SAMPLES
+    && p_sync->error < CLOCK_SYNC_CONVERGED_ERROR) {
+    p_sync->is_converged = true;
+    p_sync->converge_time = time - p_sync->first_time;
+  }
+  return true;
+}
+
+bool clock_sync_has_offset(const ClockSync *p_sync) {
+  return p_sync->sample_count > 0;
+}
+
+double clock_sync_peer_time(const ClockSync *p_sync, double local_time) {
+  return local_time + offset_at(p_sync, local_time);
+}
+
+double clock_sync_local_time(const ClockSync *p_sync, double peer_time) {
+  // the drift changes the offset by less than a microsecond over the offset itself
+  double local_time = peer_time - p_sync->offset;
+  return peer_time - offset_at(p_sync, local_time);
+}
+
+void clock_align_init(ClockAlign *p_align, double tick_dt) {
+  memset(p_align, 0, sizeof(*p_align));
+  p_align->tick_dt = tick_dt;
+  p_align->scale = 1;
+}
+
+void clock_align_on_tick(ClockAlign *p_align, uint32_t tick, double now) {
+  p_align->tick = tick;
+  p_align->tick_time = now;
+}
+
+void clock_align_on_host_tick(ClockAlign *p_align, const ClockSync *p_sync, uint32_t input_tick,
+                              double host_time, double jitter) {
+  if (0 == p_align->tick || !clock_sync_has_offset(p_sync)) {
+    return;
+  }
+
+  // the host steps one client tick after the other, the newest one this much later
+  double apply_time = clock_sync_local_time(p_sync, host_time)
+    + (int32_t)(p_align->tick - input_tick) * p_align->tick_dt;
+  double arrival = p_align->tick_time + p_sync->min_delay / 2;
+  double slack = apply_time - arrival;
+
+  p_align->last_slack = slack;
+  if (!p_align->has_slack) {
+    p_align->has_slack = true;
+    p_align->slack = slack;
+  } else {
+    p_align->slack += (slack - p_align->slack) * CLOCK_ALIGN_SMOOTHING;
+  }
+  p_align->samples += 1;
+
+  // too much slack delays the inputs for nothing, too little makes the host hold them
+  p_align->target = CLOCK_ALIGN_MARGIN + 2 * jitter;
+  double correction = (p_align->slack - p_align->target) / CLOCK_ALIGN_HORIZON;
+  p_align->scale = 1 - clamp(correction, -CLOCK_ALIGN_MAX_SCALE, CLOCK_ALIGN_MAX_SCALE);
+}
+
+void clock_ticks_init(ClockTicks *p_ticks, double tick_dt) {
+  memset(p_ticks, 0, sizeof(*p_ticks));
+  p_ticks->tick_dt = tick_dt;
+}
+
+void clock_ticks_on_host_step(ClockTicks *p_ticks, uint32_t tick, double host_time) {
+  if (0 == tick) return;
+
+  // a host that renders or catches up steps off its schedule by a bit
+  double expected = p_ticks->time + (int32_t)(tick - p_ticks->tick) * p_ticks->tick_dt;
+  double error = host_time - expected;
+  p_ticks->time = 0 == p_ticks->tick || fabs(error) > CLOCK_TICKS_MAX_ERROR
+    ? host_time
+    : expected + error * CLOCK_TICKS_SMOOTHING;
+  p_ticks->tick = tick;
+}
+
+bool clock_ticks_has_time(const ClockTicks *p_ticks, const ClockSync *p_sync) {
+  return 0 != p_ticks->tick && clock_sync_has_offset(p_sync);
+}
+
+double clock_ticks_local_time(const ClockTicks *p_ticks, const ClockSync *p_sync, uint32_t tick, double arrival) {
+  if (!clock_ticks_has_time(p_ticks, p_sync)) {
+    return arrival;
+  }
+  double host_time = p_ticks->time + (int32_t)(tick - p_ticks->tick) * p_ticks->tick_dt;
+  return clock_sync_local_time(p_sync, host_time);
+}
@@ -0,0 +1,159 @@
+#ifndef __CLOCK_SYNC_H__
+#define __CLOCK_SYNC_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Accepted exchanges the offset and the drift are fitted to, about 6 s of pings
+#define CLOCK_SYNC_SAMPLES 128
+
+// The quickest round trip of this many latest exchanges is the one the others are compared to
+#define CLOCK_SYNC_DELAY_WINDOW 32
+
+// An exchange that took this much longer than the quickest one is rejected, seconds:
+// the queue it waited in on one way puts its offset off by up to half of that
+#define CLOCK_SYNC_MAX_EXTRA_DELAY 0.002
+
+// This many spikes in a row mean the peer's clock stepped, the fit starts over with them
+#define CLOCK_SYNC_MAX_SPIKES 8
+
+// The drift is fitted once there are this many samples over at least a second
+#define CLOCK_SYNC_MIN_FIT_SAMPLES 8
+
+// Quartz is off by far less (NTP allows 500 ppm), a larger slope is noise
+#define CLOCK_SYNC_MAX_DRIFT 500e-6
+
+// The estimate is converged once its error is below this, seconds
+#define CLOCK_SYNC_CONVERGED_ERROR 0.0005
+
+// Inputs should reach the host this long before it steps with them on top of
+// twice the jitter of the round trip, seconds
+#define CLOCK_ALIGN_MARGIN 0.002
+
+// The slack that is off the target is made up in about this many seconds
+#define CLOCK_ALIGN_HORIZON 2.
+
+// The client's simulation runs at most this much faster or slower than real time
+#define CLOCK_ALIGN_MAX_SCALE 0.05
+
+// A host step this far off the schedule of the previous ones means the host
+// started its ticks over (a new match), seconds
+#define CLOCK_TICKS_MAX_ERROR 0.1
+
+typedef struct {
+  // local time of the exchange (the middle of the round trip), seconds
+  double time;
+  // peer time - local time
+  double offset;
+} ClockSample;
+
+typedef struct {
+  long exchanges;
+  long accepted;
+  // rejected for the round trip, or for the offset far off the fit
+  long delayed;
+  long spikes;
+  // the fit started over after a step of the peer's clock
+  long restarts;
+} ClockSyncStats;
+
+/// Offset and drift of the peer's clock from NTP like exchanges: a ping sent at local
+/// t1, received by the peer at its t2, answered at its t3 and back at local t4 measures
+/// offset ((t2 - t1) + (t3 - t4)) / 2, exact if both ways took as long. Exchanges
+/// that queued on the way are rejected by their round trip, the rest are fitted
+/// with a line (least squares) whose slope is the drift
+typedef struct {
+  ClockSample samples[CLOCK_SYNC_SAMPLES];
+  long sample_count;
+  double delays[CLOCK_SYNC_DELAY_WINDOW];
+  long delay_count;
+  // quickest round trip of the delay window, seconds
+  double min_delay;
+  int spikes_in_row;
+
+  // the fit: offset at ref_time and its change per second
+  double offset;
+  double drift;
+  double ref_time;
+  // standard error of the fitted offset at the newest sample, seconds
+  double error;
+  // RMS of the samples around the fit, the spike threshold
+  double residual;
+
+  bool is_converged;
+  // seconds from the first exchange (or the restart) until the error got below
+  // CLOCK_SYNC_CONVERGED_ERROR
+  double converge_time;
+  double first_time;
+  ClockSyncStats stats;
+} ClockSync;
+
+/// Paces the ticks of the client, so the input of a tick arrives just before the host
+/// steps with it: the host tells in its pongs the tick it applies next and when, the
+/// synced clock turns that into local time, and the gap to the estimated arrival of
+/// the newest input is the slack. The client's time runs a bit faster while the slack
+/// is short of the target and a bit slower while it is over
+typedef struct {
+  double tick_dt;
+  // newest tick the client sent and the local time it went out, 0 before the first one
+  uint32_t tick;
+  double tick_time;
+
+  // smoothed (1/8 a sample) slack and the one to reach, seconds. Negative slack is late
+  bool has_slack;
+  double slack;
+  double last_slack;
+  double target;
+  // the client's simulation time runs this many times as fast as real time
+  double scale;
+  long samples;
+} ClockAlign;
+
+/// When the host stepped its ticks, on the host's clock. The host steps every tick_dt
+/// and its pongs tell the tick of its next step and when it is, every pong moves
+/// the schedule a bit towards what it tells
+typedef struct {
+  double tick_dt;
+  // the tick and the host time it is stepped at, seconds, tick 0 before the first pong
+  uint32_t tick;
+  double time;
+} ClockTicks;
+
+void clock_sync_init(ClockSync *p_sync);
+
+/// Takes an exchange of local times t1 and t4 and peer times t2 and t3, in seconds
+/// @returns false if it was rejected as an outlier
+bool clock_sync_add(ClockSync *p_sync, double t1, double t2, double t3, double t4);
+
+/// @returns true once an exchange was accepted
+bool clock_sync_has_offset(const ClockSync *p_sync);
+
+/// @returns the peer's time at the local time
+double clock_sync_peer_time(const ClockSync *p_sync, double local_time);
+
+/// @returns the local time at the peer's time
+double clock_sync_local_time(const ClockSync *p_sync, double peer_time);
+
+void clock_align_init(ClockAlign *p_align, double tick_dt);
+
+/// The input of the tick went out at the local time
+void clock_align_on_tick(ClockAlign *p_align, uint32_t tick, double now);
+
+/// Takes the host's word that it steps with the input of input_tick at host_time,
+/// adjusts the scale to the slack. jitter of the round trip, seconds
+void clock_align_on_host_tick(ClockAlign *p_align, const ClockSync *p_sync, uint32_t input_tick,
+                              double host_time, double jitter);
+
+void clock_ticks_init(ClockTicks *p_ticks, double tick_dt);
+
+/// Takes the host's word that its next step makes the tick at host_time, seconds
+void clock_ticks_on_host_step(ClockTicks *p_ticks, uint32_t tick, double host_time);
+
+/// @returns true once the host's steps can be turned into local time
+bool clock_ticks_has_time(const ClockTicks *p_ticks, const ClockSync *p_sync);
+
+/// @returns the local time the host stepped to the tick at (or will), arrival
+/// until clock_ticks_has_time
+double clock_ticks_local_time(const ClockTicks *p_ticks, const ClockSync *p_sync, uint32_t tick, double arrival);
+
+#endif // !__CLOCK_SYNC_H__
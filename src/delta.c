@@ -0,0 +1,335 @@
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include "delta.h"
+
+#define SLOT(tick) ((tick) % DELTA_HISTORY)
+
+// Every quantized field fits into a signed 16 bit integer
+#define FIELD_BITS 16
+#define FIELD_MIN INT16_MIN
+#define FIELD_MAX INT16_MAX
+
+// A changed field goes as the zigzag encoded difference from the baseline in
+// one of the classes: '0' + SMALL bits, '10' + MEDIUM bits or '11' + the value itself
+#define DELTA_SMALL_BITS 6
+#define DELTA_MEDIUM_BITS 12
+
+#define INPUT_COUNT_BITS 4
+#define INPUT_BITS 4
+
+typedef enum {
+  FIELD_POSITION,
+  FIELD_PADDLE_VELOCITY,
+  FIELD_BALL_VELOCITY,
+  FIELD_SCORE,
+} FieldKind;
+
+// Units per pixel: 1/8 px positions, 1/256 px per reference step paddle velocity
+// (at most about 8.5) and 1/4 px per second ball velocity (at most about 910)
+static const float field_scale[] = {
+  [FIELD_POSITION] = 8.f,
+  [FIELD_PADDLE_VELOCITY] = 256.f,
+  [FIELD_BALL_VELOCITY] = 4.f,
+  [FIELD_SCORE] = 1.f,
+};
+
+typedef struct {
+  FieldKind kind;
+  int entity;
+  // 0 and 1 are x and y of a position, 2 and 3 of a velocity, unused for scores
+  int component;
+} FieldDesc;
+
+static const FieldDesc fields[DELTA_FIELD_COUNT] = {
+  { FIELD_POSITION, GE_PADDLE_1, 0 },
+  { FIELD_POSITION, GE_PADDLE_1, 1 },
+  { FIELD_PADDLE_VELOCITY, GE_PADDLE_1, 3 },
+  { FIELD_POSITION, GE_PADDLE_2, 0 },
+  { FIELD_POSITION, GE_PADDLE_2, 1 },
+  { FIELD_PADDLE_VELOCITY, GE_PADDLE_2, 3 },
+  { FIELD_POSITION, GE_BALL, 0 },
+  { FIELD_POSITION, GE_BALL, 1 },
+  { FIELD_BALL_VELOCITY, GE_BALL, 2 },
+  { FIELD_BALL_VELOCITY, GE_BALL, 3 },
+  { FIELD_SCORE, 0, -1 },
+  { FIELD_SCORE, 1, -1 },
+};
+
+typedef struct {
+  unsigned char *data;
+  int capacity;
+  int bit_pos;
+} BitWriter;
+
+typedef struct {
+  const unsigned char *data;
+  int len;
+  int bit_pos;
+  bool is_overrun;
+} BitReader;
+
+/// Appends the low count bits of value, least significant first
+static void write_bits(BitWriter *p_writer, uint32_t value, int count) {
+  for (int i = 0; i < count; ++i) {
+    int byte = p_writer->bit_pos / 8;
+    assert(byte < p_writer->capacity);
+    if (value >> i & 1) {
+      p_writer->data[byte] |= 1 << (p_writer->bit_pos % 8);
+    }
+    p_writer->bit_pos += 1;
+  }
+}
+
+static uint32_t read_bits(BitReader *p_reader, int count) {
+  uint32_t value = 0;
+  for (int i = 0; i < count; ++i) {
+    int byte = p_reader->bit_pos / 8;
+    if (byte >= p_reader->len) {
+      p_reader->is_overrun = true;
+      return 0;
+    }
+    value |= (uint32_t)(p_reader->data[byte] >> (p_reader->bit_pos % 8) & 1) << i;
+    p_reader->bit_pos += 1;
+  }
+  return value;
+}
+
+static uint32_t zigzag(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value) {
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static float get_field(const NetSnapshot *p_snapshot, const FieldDesc *p_desc) {
+  if (p_desc->component < 2) return p_snapshot->positions[p_desc->entity][p_desc->component];
+  return p_snapshot->velocities[p_desc->entity][p_desc->component - 2];
+}
+
+static void set_field(NetSnapshot *p_snapshot, const FieldDesc *p_desc, float value) {
+  if (p_desc->component < 2) p_snapshot->positions[p_desc->entity][p_desc->component] = value;
+  else p_snapshot->velocities[p_desc->entity][p_desc->component - 2] = value;
+}
+
+static int32_t quantize(float value, FieldKind kind) {
+  float scaled = roundf(value * field_scale[kind]);
+  if (scaled < FIELD_MIN) return FIELD_MIN;
+  if (scaled > FIELD_MAX) return FIELD_MAX;
+  return (int32_t)scaled;
+}
+
+static void frame_from_snapshot(const NetSnapshot *p_snapshot, DeltaFrame *out) {
+  out->tick = p_snapshot->tick;
+  out->is_valid = true;
+  for (int i = 0; i < DELTA_FIELD_COUNT; ++i) {
+    const FieldDesc *p_desc = &fields[i];
+    if (FIELD_SCORE == p_desc->kind) {
+      out->fields[i] = p_snapshot->scores[p_desc->entity];
+    } else {
+      out->fields[i] = quantize(get_field(p_snapshot, p_desc), p_desc->kind);
+    }
+  }
+}
+
+static void snapshot_from_frame(const DeltaFrame *p_frame, NetSnapshot *out) {
+  out->tick = p_frame->tick;
+  for (int i = 0; i < DELTA_FIELD_COUNT; ++i) {
+    const FieldDesc *p_desc = &fields[i];
+    if (FIELD_SCORE == p_desc->kind) {
+      out->scores[p_desc->entity] = (int16_t)p_frame->fields[i];
+    } else {
+      set_field(out, p_desc, p_frame->fields[i] / field_scale[p_desc->kind]);
+    }
+  }
+}
+
+void delta_quantize_snapshot(NetSnapshot *p_snapshot) {
+  DeltaFrame frame = {0};
+  frame_from_snapshot(p_snapshot, &frame);
+  snapshot_from_frame(&frame, p_snapshot);
+}
+
+void delta_encoder_init(DeltaEncoder *p_enc) {
+  memset(p_enc, 0, sizeof(*p_enc));
+}
+
+void delta_encoder_ack(DeltaEncoder *p_enc, uint32_t tick) {
+  const DeltaFrame *p_frame = &p_enc->sent[SLOT(tick)];
+  if (0 == tick || !p_frame->is_valid || p_frame->tick != tick) {
+    return;
+  }
+
+  if (p_enc->has_ack && (int32_t)(tick - p_enc->acked_tick) <= 0) {
+    return;
+  }
+
+  p_enc->acked_tick = tick;
+  p_enc->has_ack = true;
+}
+
+int delta_encode(DeltaEncoder *p_enc, const NetSnapshot *p_snapshot, char *buf) {
+  DeltaFrame *p_frame = &p_enc->sent[SLOT(p_snapshot->tick)];
+  frame_from_snapshot(p_snapshot, p_frame);
+
+  static const DeltaFrame zero_frame = {0};
+  const DeltaFrame *p_baseline = &zero_frame;
+  uint32_t age = p_snapshot->tick - p_enc->acked_tick;
+  if (p_enc->has_ack && age > 0 && age <= DELTA_MAX_BASELINE_AGE
+    && p_enc->sent[SLOT(p_enc->acked_tick)].tick == p_enc->acked_tick) {
+    p_baseline = &p_enc->sent[SLOT(p_enc->acked_tick)];
+  } else {
+    // the client has nothing in common with us, everything goes against zeros
+    age = 0;
+    p_enc->stats.keyframes += 1;
+  }
+
+  unsigned char *ptr = (unsigned char*)buf;
+  memset(buf, 0, NET_BUF_SIZE);
+  *ptr++ = NET_CMD_DELTA_SNAPSHOT;
+  for (int i = 0; i < 4; ++i) {
+    *ptr++ = p_snapshot->tick >> (8 * i) & 0xff;
+  }
+  *ptr++ = (unsigned char)age;
+
+  BitWriter writer = { ptr, NET_BUF_SIZE - DELTA_HEADER_SIZE, 0 };
+
+  uint32_t changed = 0;
+  for (int i = 0; i < DELTA_FIELD_COUNT; ++i) {
+    changed |= (uint32_t)(p_frame->fields[i] != p_baseline->fields[i]) << i;
+  }
+  write_bits(&writer, changed, DELTA_FIELD_COUNT);
+
+  for (int i = 0; i < DELTA_FIELD_COUNT; ++i) {
+    if (!(changed >> i & 1)) continue;
+
+    uint32_t diff = zigzag(p_frame->fields[i] - p_baseline->fields[i]);
+    if (diff < 1u << DELTA_SMALL_BITS) {
+      write_bits(&writer, 0, 1);
+      write_bits(&writer, diff, DELTA_SMALL_BITS);
+    } else if (diff < 1u << DELTA_MEDIUM_BITS) {
+      write_bits(&writer, 1, 2);
+      write_bits(&writer, diff, DELTA_MEDIUM_BITS);
+    } else {
+      write_bits(&writer, 3, 2);
+      write_bits(&writer, (uint16_t)p_frame->fields[i], FIELD_BITS);
+    }
+  }
+
+  // the client has the inputs up to the baseline already
+  int input_count = p_snapshot->input_count;
+  if (age > 0 && (uint32_t)input_count > age) input_count = age;
+
+  // inputs mostly repeat: one bit if the input is the same as the newer one
+  write_bits(&writer, input_count, INPUT_COUNT_BITS);
+  for (int i = 0; i < input_count; ++i) {
+    if (i > 0 && p_snapshot->inputs[i] == p_snapshot->inputs[i - 1]) {
+      write_bits(&writer, 0, 1);
+      continue;
+    }
+    if (i > 0) write_bits(&writer, 1, 1);
+    write_bits(&writer, p_snapshot->inputs[i], INPUT_BITS);
+  }
+
+  // one bit for a spectator, and one for the ack bits of a player that lost nothing
+  const NetAck *p_ack = &p_snapshot->input_ack;
+  write_bits(&writer, 0 != p_ack->tick, 1);
+  if (0 != p_ack->tick) {
+    write_bits(&writer, p_ack->tick, 32);
+    write_bits(&writer, UINT32_MAX != p_ack->bits, 1);
+    if (UINT32_MAX != p_ack->bits) write_bits(&writer, p_ack->bits, NET_ACK_BITS);
+  }
+
+  int size = DELTA_HEADER_SIZE + (writer.bit_pos + 7) / 8;
+  p_enc->stats.snapshots += 1;
+  p_enc->stats.bytes += size;
+  return size;
+}
+
+void delta_decoder_init(DeltaDecoder *p_dec) {
+  memset(p_dec, 0, sizeof(*p_dec));
+}
+
+uint32_t delta_decoder_ack(const DeltaDecoder *p_dec) {
+  return p_dec->has_newest ? p_dec->newest_tick : 0;
+}
+
+bool delta_decode(DeltaDecoder *p_dec, const char *buf, int len, NetSnapshot *out) {
+  const unsigned char *ptr = (const unsigned char*)buf;
+  if (len < DELTA_HEADER_SIZE || NET_CMD_DELTA_SNAPSHOT != *ptr++) {
+    return false;
+  }
+
+  uint32_t tick = 0;
+  for (int i = 0; i < 4; ++i) {
+    tick |= (uint32_t)*ptr++ << (8 * i);
+  }
+  uint32_t age = *ptr++;
+
+  static const DeltaFrame zero_frame = {0};
+  const DeltaFrame *p_baseline = &zero_frame;
+  if (age > 0) {
+    p_baseline = &p_dec->received[SLOT(tick - age)];
+    if (!p_baseline->is_valid || p_baseline->tick != tick - age) {
+      p_dec->stats.missing_baseline += 1;
+      return false;
+    }
+  }
+
+  BitReader reader = { ptr, len - DELTA_HEADER_SIZE, 0, false };
+  DeltaFrame frame = { .tick = tick, .is_valid = true };
+
+  uint32_t changed = read_bits(&reader, DELTA_FIELD_COUNT);
+  for (int i = 0; i < DELTA_FIELD_COUNT; ++i) {
+    frame.fields[i] = p_baseline->fields[i];
+    if (!(changed >> i & 1)) continue;
+
+    if (0 == read_bits(&reader, 1)) {
+      frame.fields[i] += unzigzag(read_bits(&reader, DELTA_SMALL_BITS));
+    } else if (0 == read_bits(&reader, 1)) {
+      frame.fields[i] += unzigzag(read_bits(&reader, DELTA_MEDIUM_BITS));
+    } else {
+      frame.fields[i] = (int16_t)read_bits(&reader, FIELD_BITS);
+    }
+  }
+
+  memset(out, 0, sizeof(*out));
+  out->input_count = read_bits(&reader, INPUT_COUNT_BITS);
+  if (out->input_count > NET_TICK_INPUTS_HISTORY) {
+    return false;
+  }
+  for (int i = 0; i < out->input_count; ++i) {
+    if (i > 0 && 0 == read_bits(&reader, 1)) {
+      out->inputs[i] = out->inputs[i - 1];
+    } else {
+      out->inputs[i] = read_bits(&reader, INPUT_BITS);
+    }
+  }
+
+  if (read_bits(&reader, 1)) {
+    out->input_ack.tick = read_bits(&reader, 32);
+    out->input_ack.bits = read_bits(&reader, 1) ? read_bits(&reader, NET_ACK_BITS) : UINT32_MAX;
+  }
+
+  if (reader.is_overrun) {
+    return false;
+  }
+
+  snapshot_from_frame(&frame, out);
+
+  // a late snapshot must not push out a newer one from its slot
+  DeltaFrame *p_slot = &p_dec->received[SLOT(tick)];
+  if (!p_slot->is_valid || (int32_t)(tick - p_slot->tick) > 0) {
+    *p_slot = frame;
+  }
+
+  if (!p_dec->has_newest || (int32_t)(tick - p_dec->newest_tick) > 0) {
+    p_dec->newest_tick = tick;
+    p_dec->has_newest = true;
+  }
+  p_dec->stats.snapshots += 1;
+
+  return true;
+}
@@ -0,0 +1,81 @@
+#ifndef __DELTA_H__
+#define __DELTA_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "network.h"
+
+// Snapshots both sides keep as possible baselines
+#define DELTA_HISTORY 64
+
+// Baselines older than this many ticks are not used, a keyframe goes instead.
+// Below DELTA_HISTORY, so both sides still have the baseline
+#define DELTA_MAX_BASELINE_AGE 60
+
+// Quantized fields in the order of the changed fields bitmask:
+// x, y and y velocity of both paddles, ball position and velocity, scores
+#define DELTA_FIELD_COUNT 12
+
+// cmd, tick, age of the baseline
+#define DELTA_HEADER_SIZE (1 + 4 + 1)
+
+typedef struct {
+  uint32_t tick;
+  bool is_valid;
+  int32_t fields[DELTA_FIELD_COUNT];
+} DeltaFrame;
+
+typedef struct {
+  long snapshots;
+  long keyframes;
+  uint64_t bytes;
+} DeltaEncoderStats;
+
+/// Host side: remembers the snapshots it sent and the newest one the client acked,
+/// every snapshot is encoded against that one
+typedef struct {
+  DeltaFrame sent[DELTA_HISTORY];
+  uint32_t acked_tick;
+  bool has_ack;
+  DeltaEncoderStats stats;
+} DeltaEncoder;
+
+typedef struct {
+  long snapshots;
+  // snapshots whose baseline was not received or not kept anymore
+  long missing_baseline;
+} DeltaDecoderStats;
+
+/// Client side: remembers the snapshots it received to decode deltas against them
+typedef struct {
+  DeltaFrame received[DELTA_HISTORY];
+  uint32_t newest_tick;
+  bool has_newest;
+  DeltaDecoderStats stats;
+} DeltaDecoder;
+
+void delta_encoder_init(DeltaEncoder *p_enc);
+
+/// The client has received the snapshot of the tick. Acks of ticks that were
+/// never sent or are older than the current baseline are ignored
+void delta_encoder_ack(DeltaEncoder *p_enc, uint32_t tick);
+
+/// Quantizes the snapshot and bit-packs the fields that differ from the acked baseline
+/// into a NET_CMD_DELTA_SNAPSHOT, or all of them if there is no usable baseline
+/// @returns size of the message in buf of at least NET_BUF_SIZE
+int delta_encode(DeltaEncoder *p_enc, const NetSnapshot *p_snapshot, char *buf);
+
+void delta_decoder_init(DeltaDecoder *p_dec);
+
+/// Decodes NET_CMD_DELTA_SNAPSHOT of len bytes received into buf
+/// @returns false if the message is malformed or its baseline is unknown
+bool delta_decode(DeltaDecoder *p_dec, const char *buf, int len, NetSnapshot *out);
+
+/// Tick the client should ack, the newest one it decoded. 0 if there is none yet
+uint32_t delta_decoder_ack(const DeltaDecoder *p_dec);
+
+/// Rounds the snapshot to the precision it is sent with
+void delta_quantize_snapshot(NetSnapshot *p_snapshot);
+
+#endif // !__DELTA_H__
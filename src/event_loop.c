@@ -0,0 +1,119 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "raylib.h"
+
+#include "event_loop.h"
+#include "timing.h"
+
+bool event_loop_init(EventLoop *p_loop, int socket_fd) {
+  struct epoll_event event = {0};
+
+  memset(p_loop, 0, sizeof(*p_loop));
+  p_loop->socket_fd = socket_fd;
+  p_loop->timer_fd = -1;
+
+  p_loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (-1 == p_loop->epoll_fd) {
+    TraceLog(LOG_ERROR, "Could not create epoll: %s", strerror(errno));
+    return false;
+  }
+
+  p_loop->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (-1 == p_loop->timer_fd) {
+    TraceLog(LOG_ERROR, "Could not create timerfd: %s", strerror(errno));
+    goto defer;
+  }
+
+  event.events = EPOLLIN;
+  event.data.fd = socket_fd;
+  if (-1 == epoll_ctl(p_loop->epoll_fd, EPOLL_CTL_ADD, socket_fd, &event)) {
+    TraceLog(LOG_ERROR, "Could not watch the socket: %s", strerror(errno));
+    goto defer;
+  }
+
+  event.data.fd = p_loop->timer_fd;
+  if (-1 == epoll_ctl(p_loop->epoll_fd, EPOLL_CTL_ADD, p_loop->timer_fd, &event)) {
+    TraceLog(LOG_ERROR, "Could not watch the timer: %s", strerror(errno));
+    goto defer;
+  }
+
+  return true;
+
+defer:
+  event_loop_fini(p_loop);
+  return false;
+}
+
+void event_loop_fini(EventLoop *p_loop) {
+  if (p_loop->timer_fd >= 0) close(p_loop->timer_fd);
+  if (p_loop->epoll_fd >= 0) close(p_loop->epoll_fd);
+  p_loop->timer_fd = -1;
+  p_loop->epoll_fd = -1;
+}
+
+bool event_loop_start_ticks(EventLoop *p_loop, float tick_dt) {
+  p_loop->tick_ns = (uint64_t)(tick_dt * 1e9);
+
+  struct itimerspec spec = {0};
+  spec.it_interval.tv_sec = p_loop->tick_ns / 1000000000ull;
+  spec.it_interval.tv_nsec = p_loop->tick_ns % 1000000000ull;
+  spec.it_value = spec.it_interval;
+
+  if (-1 == timerfd_settime(p_loop->timer_fd, 0, &spec, NULL)) {
+    TraceLog(LOG_ERROR, "Could not start the tick timer: %s", strerror(errno));
+    return false;
+  }
+
+  p_loop->next_tick_ns = time_now_ns() + p_loop->tick_ns;
+  return true;
+}
+
+unsigned event_loop_wait(EventLoop *p_loop, int timeout_ms, uint64_t *p_ticks) {
+  struct epoll_event events[2];
+  unsigned result = EVENT_LOOP_NONE;
+  *p_ticks = 0;
+
+  int count = epoll_wait(p_loop->epoll_fd, events, 2, timeout_ms);
+  if (count < 0) {
+    if (EINTR != errno) {
+      TraceLog(LOG_WARNING, "Could not wait for events: %s", strerror(errno));
+    }
+    return result;
+  }
+
+  p_loop->stats.wakeups += 1;
+  for (int i = 0; i < count; ++i) {
+    if (events[i].data.fd == p_loop->socket_fd) {
+      result |= EVENT_LOOP_READABLE;
+      p_loop->stats.socket_wakeups += 1;
+      continue;
+    }
+
+    uint64_t expirations = 0;
+    if (read(p_loop->timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+      continue;
+    }
+
+    // the first due tick tells how late the loop woke up
+    uint64_t now = time_now_ns();
+    uint64_t lateness = now > p_loop->next_tick_ns ? now - p_loop->next_tick_ns : 0;
+    p_loop->stats.tick_lateness_ns += lateness;
+    if (lateness > p_loop->stats.max_tick_lateness_ns) p_loop->stats.max_tick_lateness_ns = lateness;
+
+    p_loop->next_tick_ns += expirations * p_loop->tick_ns;
+    p_loop->stats.ticks += expirations;
+    p_loop->stats.late_ticks += expirations - 1;
+
+    result |= EVENT_LOOP_TICK;
+    *p_ticks = expirations;
+  }
+
+  return result;
+}
@@ -0,0 +1,48 @@
+#ifndef __EVENT_LOOP_H__
+#define __EVENT_LOOP_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum {
+  EVENT_LOOP_NONE = 0,
+  // the socket has datagrams to read
+  EVENT_LOOP_READABLE = 1 << 0,
+  // one or more simulation ticks are due
+  EVENT_LOOP_TICK = 1 << 1,
+} EventLoopEvent;
+
+typedef struct {
+  long wakeups;
+  long socket_wakeups;
+  long ticks;
+  // ticks that were due together with another one, the loop woke up too late for them
+  long late_ticks;
+  // how long after its deadline a tick was noticed
+  uint64_t tick_lateness_ns;
+  uint64_t max_tick_lateness_ns;
+} EventLoopStats;
+
+/// Sleeps in epoll until the socket is readable or a tick of a timerfd is due,
+/// so a host uses no CPU between ticks and reads input as soon as it arrives
+typedef struct {
+  int epoll_fd;
+  int timer_fd;
+  int socket_fd;
+  uint64_t tick_ns;
+  // deadline of the next tick, 0 while ticks are stopped
+  uint64_t next_tick_ns;
+  EventLoopStats stats;
+} EventLoop;
+
+bool event_loop_init(EventLoop *p_loop, int socket_fd);
+void event_loop_fini(EventLoop *p_loop);
+
+/// Starts the tick timer, the first tick is due tick_dt seconds from now
+bool event_loop_start_ticks(EventLoop *p_loop, float tick_dt);
+
+/// Waits for the events, at most timeout_ms (-1 waits forever, 0 only checks)
+/// @returns EventLoopEvent flags, *p_ticks is the number of ticks due
+unsigned event_loop_wait(EventLoop *p_loop, int timeout_ms, uint64_t *p_ticks);
+
+#endif // !__EVENT_LOOP_H__
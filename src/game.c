@@ -0,0 +1,563 @@
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "raylib.h"
+// Compile raymath into this unit with our own flags, so every path that
+// steps the simulation (scalar, batched) does the exact same float math
+#define RAYMATH_STATIC_INLINE
+#include "raymath.h"
+
+#include "game.h"
+
+// Collisions the ball may resolve during a single step,
+// the rest of the step is dropped if there are more
+#define MAX_BALL_SUBSTEPS 4
+
+// what the ball hits in move_ball, paddles are hit by their index
+#define BALL_HIT_NONE -1
+#define BALL_HIT_WALL 2
+
+
+static void clamp_rect_within_screen(Rectangle *p_rect) {
+  p_rect->y = Clamp(p_rect->y, 0, WINDOW_HEIGHT - p_rect->height);
+  p_rect->x = Clamp(p_rect->x, 0, WINDOW_WIDTH - p_rect->width);
+}
+
+void handle_collision(BallState *p_ball, const PaddleState *p_paddle) {
+  p_ball->direction.x = -p_ball->direction.x;
+  p_ball->direction.y = -p_ball->direction.y;
+
+  float collision_point = (p_ball->rect.y + p_ball->rect.height / 2) - (p_paddle->rect.y + p_paddle->rect.height / 2);
+  float ball_speed_factor = 1.0f;
+  float reflection_angle = 0.f;
+
+  bool are_opposite_Y_directions = (p_ball->direction.y * p_paddle->velocity) < 0.f
+    || (p_ball->direction.y == 0 && p_paddle->velocity != 0)
+    || (p_ball->direction.y != 0 && p_paddle->velocity == 0);
+  float speed_diff = fabsf(p_ball->speed - fabsf(p_paddle->velocity));
+  p_ball->spin_factor = 0.020f * (powf(speed_diff, 0.5f) + 0.5f) * are_opposite_Y_directions;
+  p_ball->direction = Vector2Rotate(p_ball->direction, -p_ball->spin_factor);
+
+  float collision_point_abs = fabsf(collision_point);
+  if (collision_point_abs <= p_paddle->rect.height * 0.35f) {
+    ball_speed_factor += fabsf(collision_point / (p_paddle->rect.height * 0.25f)) * 0.5f;
+  } else if (collision_point_abs > p_paddle->rect.height * 0.45f) {
+    ball_speed_factor -= fabsf(collision_point / (p_paddle->rect.height * 0.75f)) * 0.5f;
+  }
+
+  if (collision_point_abs <= p_paddle->rect.height * 0.35f) {
+    reflection_angle = collision_point / (p_paddle->rect.height * 0.25f) * 0.2f * !!p_paddle->velocity;
+  } else {
+    reflection_angle = collision_point / (p_paddle->rect.height * 0.75f) * 0.2f * !!p_paddle->velocity;
+  }
+
+  p_ball->speed = Clamp(p_ball->speed * ball_speed_factor, MIN_BALL_SPEED, MAX_BALL_SPEED);
+  p_ball->direction = Vector2Rotate(p_ball->direction, reflection_angle);
+}
+
+static void start_hit_effect(Paddle *p_paddle, Rectangle rect) {
+  p_paddle->hit_countdown = PADDLE_HIT_EFFECT_DURATION;
+  for (int i = 0; i < 3; ++i) {
+    p_paddle->hit_effect[i] = CLITERAL(Rectangle){
+      .x = rect.x - 2 * (i + 1),
+      .y = rect.y - 2 * (i + 1),
+      .width = rect.width + 4 * (i + 1),
+      .height = rect.height + 4 * (i + 1),
+    };
+  }
+}
+
+void update_paddle(PaddleState *p_paddle, float dt) {
+  float friction = 0;
+
+  if (p_paddle->velocity > 0) {
+    friction = PADDLE_FRICTION;
+  } else if (p_paddle->velocity < 0) {
+    friction = -PADDLE_FRICTION;
+  }
+
+  float prev_velocity = p_paddle->velocity;
+  p_paddle->velocity += (p_paddle->acceleration - friction) * dt;
+
+  // velocity is kept in pixels per reference step
+  p_paddle->velocity = Clamp(p_paddle->velocity, -MAX_PADDLE_SPEED * PHYSICS_REFERENCE_DT, MAX_PADDLE_SPEED * PHYSICS_REFERENCE_DT);
+  if ((p_paddle->velocity > 0 && prev_velocity < 0) || (p_paddle->velocity < 0 && prev_velocity > 0)
+    || (p_paddle->rect.y <= 0 && p_paddle->acceleration < 0)
+    || (p_paddle->rect.y >= WINDOW_HEIGHT - p_paddle->rect.height && p_paddle->acceleration > 0)) {
+    p_paddle->velocity = 0.f;
+  }
+
+  p_paddle->rect.y += p_paddle->velocity * (dt / PHYSICS_REFERENCE_DT);
+}
+
+/// Finds the fraction of the move (dx, dy) at which the moving rectangle
+/// starts to overlap the target, touching edges do not count as overlap
+/// the same way as in CheckCollisionRecs
+/// @returns false if they do not overlap during the move
+static bool sweep_rects(Rectangle moving, float dx, float dy, Rectangle target, float *p_toi) {
+  float entry[2] = {0};
+  float exit[2] = {0};
+  float position[2] = { moving.x, moving.y };
+  float size[2] = { moving.width, moving.height };
+  float delta[2] = { dx, dy };
+  float target_position[2] = { target.x, target.y };
+  float target_size[2] = { target.width, target.height };
+
+  for (int axis = 0; axis < 2; ++axis) {
+    float near_gap = target_position[axis] - (position[axis] + size[axis]);
+    float far_gap = target_position[axis] + target_size[axis] - position[axis];
+
+    if (delta[axis] > 0) {
+      entry[axis] = near_gap / delta[axis];
+      exit[axis] = far_gap / delta[axis];
+    } else if (delta[axis] < 0) {
+      entry[axis] = far_gap / delta[axis];
+      exit[axis] = near_gap / delta[axis];
+    } else if (near_gap < 0 && far_gap > 0) {
+      entry[axis] = -INFINITY;
+      exit[axis] = INFINITY;
+    } else {
+      return false;
+    }
+  }
+
+  float toi = fmaxf(entry[0], entry[1]);
+  float toi_exit = fminf(exit[0], exit[1]);
+  if (toi >= toi_exit || toi >= 1.f || toi_exit <= 0.f) {
+    return false;
+  }
+
+  *p_toi = fmaxf(toi, 0.f);
+  return true;
+}
+
+/// Moves the ball by its velocity for dt with continuous collision detection:
+/// finds the earliest time of impact with a wall or a paddle, resolves it
+/// and continues with the rest of the step, so a fast ball cannot pass
+/// through a paddle at low tick rates
+/// @returns mask of GameEvent caused by the ball
+static unsigned move_ball(GameState *p_state, float dt) {
+  unsigned events = GAME_EVENT_NONE;
+  float remaining = 1.f;
+
+  for (int substep = 0; substep < MAX_BALL_SUBSTEPS; ++substep) {
+    BallState *p_ball = &p_state->ball;
+    float dx = p_ball->speed * p_ball->direction.x * dt * remaining;
+    float dy = p_ball->speed * p_ball->direction.y * dt * remaining;
+
+    int hit = BALL_HIT_NONE;
+    float toi = 1.f;
+
+    if (dy < 0 && -p_ball->rect.y / dy < toi) {
+      toi = -p_ball->rect.y / dy;
+      hit = BALL_HIT_WALL;
+    } else if (dy > 0 && (WINDOW_HEIGHT - p_ball->rect.height - p_ball->rect.y) / dy < toi) {
+      toi = (WINDOW_HEIGHT - p_ball->rect.height - p_ball->rect.y) / dy;
+      hit = BALL_HIT_WALL;
+    }
+    toi = fmaxf(toi, 0.f);
+
+    for (int i = 0; i < 2; ++i) {
+      float paddle_toi = 0.f;
+      if (sweep_rects(p_ball->rect, dx, dy, p_state->paddles[i].rect, &paddle_toi) && paddle_toi < toi) {
+        toi = paddle_toi;
+        hit = i;
+      }
+    }
+
+    if (BALL_HIT_NONE == hit) {
+      p_ball->rect.x += dx;
+      p_ball->rect.y += dy;
+      break;
+    }
+
+    p_ball->rect.x += dx * toi;
+    p_ball->rect.y += dy * toi;
+    remaining *= 1.f - toi;
+
+    if (BALL_HIT_WALL == hit) {
+      p_ball->direction.y *= -1;
+      p_ball->speed = Clamp(p_ball->speed * 0.9f, MIN_BALL_SPEED, MAX_BALL_SPEED);
+      events |= GAME_EVENT_WALL_BOUNCE;
+    } else {
+      PaddleState *p_paddle = &p_state->paddles[hit];
+      handle_collision(p_ball, p_paddle);
+      // Move ball to avoid sticking
+      p_ball->rect.x = 0 == hit
+        ? p_paddle->rect.x + p_paddle->rect.width
+        : p_paddle->rect.x - p_paddle->rect.width;
+      events |= GAME_EVENT_PADDLE_HIT;
+    }
+  }
+
+  return events;
+}
+
+/// Puts paddles to the middle and serves the ball from the paddle at server_index
+static void serve_ball(GameState *p_state, int server_index) {
+  p_state->paddles[0].rect.y = (float)WINDOW_HEIGHT / 2 - (float)PADDLE_HEIGHT / 2;
+  p_state->paddles[1].rect.y = (float)WINDOW_HEIGHT / 2 - (float)PADDLE_HEIGHT / 2;
+
+  if (0 == server_index) {
+    p_state->ball.rect.x = p_state->paddles[0].rect.x + PADDLE_WIDTH;
+    p_state->ball.direction.x = 1;
+  } else {
+    p_state->ball.rect.x = p_state->paddles[1].rect.x - PADDLE_WIDTH;
+    p_state->ball.direction.x = -1;
+  }
+  p_state->ball.rect.y = p_state->paddles[server_index].rect.y + p_state->paddles[server_index].rect.height / 2 - (float)BALL_SIDES / 2;
+  p_state->ball.direction.y = 0.f;
+  p_state->ball.speed = BALL_SPEED;
+  p_state->ball.spin_factor = 0.f;
+}
+
+
+GameState game_state_create(void) {
+  GameState state = {0};
+
+  state.paddles[0].rect = (Rectangle){
+    .x = 30,
+    .y = (float)WINDOW_HEIGHT / 2 - (float)PADDLE_HEIGHT / 2,
+    .width = PADDLE_WIDTH,
+    .height = PADDLE_HEIGHT
+  };
+
+  state.paddles[1].rect = (Rectangle){
+    .x = WINDOW_WIDTH - 30 - PADDLE_WIDTH,
+    .y = (float)WINDOW_HEIGHT / 2 - (float)PADDLE_HEIGHT / 2,
+    .width = PADDLE_WIDTH,
+    .height = PADDLE_HEIGHT
+  };
+
+  state.ball = (BallState){
+    .rect = {
+      .x = 30 + PADDLE_WIDTH,
+      .y = (float)WINDOW_HEIGHT / 2 - (float)BALL_SIDES / 2,
+      .width = BALL_SIDES,
+      .height = BALL_SIDES
+    },
+    .speed = BALL_SPEED,
+    .spin_factor = 0.f,
+    .direction = {
+      .x = 1.f,
+      .y = 0.f
+    }
+  };
+
+  state.win_score = 11;
+  return state;
+}
+
+GameContext game_context_create(void) {
+  GameContext ctx = {
+    .state = game_state_create(),
+    .update = NULL,
+    .tick_dt = 1.f / GAME_DEFAULT_TICK_RATE,
+    .accumulator = 0.f,
+    .main_menu_state = MAIN_MENU_START,
+    .is_paused = false,
+    .should_exit = false,
+  };
+
+  ctx.paddles[0].color = SKYBLUE;
+  ctx.paddles[1].color = MAGENTA;
+  ctx.ball.color = SKYBLUE;
+
+  ctx.paddles[0].prev_rect = ctx.state.paddles[0].rect;
+  ctx.paddles[1].prev_rect = ctx.state.paddles[1].rect;
+  ctx.ball.prev_rect = ctx.state.ball.rect;
+
+  return ctx;
+}
+
+unsigned game_state_step(GameState *p_state, float dt) {
+  unsigned events = GAME_EVENT_NONE;
+  p_state->tick += 1;
+
+  for (int i = 0; i < 2; ++i) {
+    // ball went past the opposite side of the paddle i
+    bool is_goal = 0 == i
+      ? p_state->ball.rect.x >= WINDOW_WIDTH - p_state->ball.rect.width
+      : p_state->ball.rect.x <= 0;
+    if (!is_goal) continue;
+
+    p_state->scores[i] += 1;
+    events |= GAME_EVENT_SCORE;
+    serve_ball(p_state, i);
+
+    if (p_state->scores[i] >= p_state->win_score) {
+      p_state->scores[0] = 0;
+      p_state->scores[1] = 0;
+      return events | GAME_EVENT_MATCH_OVER;
+    }
+  }
+
+  update_paddle(&p_state->paddles[0], dt);
+  update_paddle(&p_state->paddles[1], dt);
+  clamp_rect_within_screen(&p_state->paddles[0].rect);
+  clamp_rect_within_screen(&p_state->paddles[1].rect);
+
+  p_state->ball.direction = Vector2Normalize(p_state->ball.direction);
+  events |= move_ball(p_state, dt);
+  p_state->ball.speed = Clamp(p_state->ball.speed - .5f * (dt / PHYSICS_REFERENCE_DT), MIN_BALL_SPEED, MAX_BALL_SPEED);
+
+  clamp_rect_within_screen(&p_state->ball.rect);
+
+  return events;
+}
+
+unsigned game_step(GameContext *ctx, float dt) {
+  ctx->paddles[0].prev_rect = ctx->state.paddles[0].rect;
+  ctx->paddles[1].prev_rect = ctx->state.paddles[1].rect;
+  ctx->ball.prev_rect = ctx->state.ball.rect;
+
+  unsigned events = game_state_step(&ctx->state, dt);
+
+  // the ball always leaves the paddle that touched or served it last
+  int last_touch = ctx->state.ball.direction.x > 0 ? 0 : 1;
+
+  if (events & GAME_EVENT_SCORE) {
+    ctx->paddles[0].tail_len = 0;
+    ctx->paddles[1].tail_len = 0;
+    ctx->ball.tail_len = 0;
+    ctx->ball.color = ctx->paddles[last_touch].color;
+
+    // do not interpolate across the field
+    ctx->paddles[0].prev_rect = ctx->state.paddles[0].rect;
+    ctx->paddles[1].prev_rect = ctx->state.paddles[1].rect;
+    ctx->ball.prev_rect = ctx->state.ball.rect;
+  }
+
+  if (events & GAME_EVENT_PADDLE_HIT) {
+    ctx->ball.color = ctx->paddles[last_touch].color;
+    start_hit_effect(&ctx->paddles[last_touch], ctx->state.paddles[last_touch].rect);
+  }
+
+  return events;
+}
+
+void game_state_save(GameStateRing *p_ring, const GameState *p_state) {
+  memcpy(&p_ring->frames[p_state->tick % GAME_STATE_RING_CAPACITY], p_state, sizeof(GameState));
+  p_ring->is_saved[p_state->tick % GAME_STATE_RING_CAPACITY] = true;
+}
+
+bool game_state_restore(const GameStateRing *p_ring, uint32_t tick, GameState *p_out) {
+  const GameState *p_frame = &p_ring->frames[tick % GAME_STATE_RING_CAPACITY];
+  if (!p_ring->is_saved[tick % GAME_STATE_RING_CAPACITY] || p_frame->tick != tick) {
+    return false;
+  }
+
+  memcpy(p_out, p_frame, sizeof(GameState));
+  return true;
+}
+
+uint64_t game_state_hash(const GameState *p_state) {
+  const unsigned char *bytes = (const unsigned char*)p_state;
+  uint64_t hash = 14695981039346656037ull;
+
+  // every field is 4 bytes, so the FNV-1a steps take a field at a time instead
+  // of a byte, a quarter of the multiplies for a hash that is not FNV-1a proper
+  for (size_t i = 0; i < sizeof(GameState); i += sizeof(uint32_t)) {
+    uint32_t word = 0;
+    memcpy(&word, bytes + i, sizeof(word));
+    hash ^= word;
+    hash *= 1099511628211ull;
+  }
+
+  return hash;
+}
+
+int game_tail_segments(Rectangle orig_rect, Color orig_color, bool advance,
+                       Vector2 *p_tail, int *p_begin, int *p_len, int tail_capacity,
+                       TailSegment *p_out) {
+  if (advance) {
+    p_tail[*p_begin] = (Vector2){ orig_rect.x + orig_rect.width / 2, orig_rect.y + orig_rect.height / 2 };
+    *p_begin = (*p_begin + 1) % tail_capacity;
+    *p_len += *p_len != tail_capacity;
+  }
+
+  int step = tail_capacity / TAIL_SEGMENTS_PER_CAPACITY;
+  int count = 0;
+
+  for (
+    int curr = *p_begin, i = 0;
+    i < *p_len && count < TAIL_MAX_SEGMENTS;
+    curr = (curr + step) % tail_capacity, i += step
+  ) {
+    TailSegment *p_segment = &p_out[count++];
+    p_segment->color = orig_color;
+    p_segment->color.a = Lerp(orig_color.a, 0, 1 - (float)i / tail_capacity);
+    float w = Lerp(orig_rect.width, orig_rect.width / tail_capacity, 1 - (float)i / tail_capacity);
+    float h = Lerp(orig_rect.height, orig_rect.height / tail_capacity, 1 - (float)i / tail_capacity);
+    p_segment->rect = (Rectangle){ p_tail[curr].x - w / 2, p_tail[curr].y - h / 2, w, h };
+  }
+
+  return count;
+}
+
+void game_apply_pressed_key(GameState *p_state, int paddle_index) {
+  assert(paddle_index >= 0 && paddle_index < 2);
+
+  switch (p_state->pressed_key[paddle_index]) {
+    case 0: p_state->paddles[paddle_index].acceleration = 0; break;
+    case KEY_DOWN: p_state->paddles[paddle_index].acceleration = PADDLE_ACCELERATION; break;
+    case KEY_UP: p_state->paddles[paddle_index].acceleration = -PADDLE_ACCELERATION; break;
+  }
+}
+
+// every key takes 2 bits in the packed form
+#define KEY_CODE_NONE 0
+#define KEY_CODE_UP 1
+#define KEY_CODE_DOWN 2
+
+static unsigned char encode_key(int key) {
+  switch (key) {
+    case KEY_UP: return KEY_CODE_UP;
+    case KEY_DOWN: return KEY_CODE_DOWN;
+    default: return KEY_CODE_NONE;
+  }
+}
+
+static int decode_key(unsigned char code) {
+  switch (code) {
+    case KEY_CODE_UP: return KEY_UP;
+    case KEY_CODE_DOWN: return KEY_DOWN;
+    default: return 0;
+  }
+}
+
+unsigned char game_keys_pack(const int32_t pressed_key[2]) {
+  return encode_key(pressed_key[0]) | encode_key(pressed_key[1]) << 2;
+}
+
+void game_keys_unpack(unsigned char packed, int32_t pressed_key[2]) {
+  pressed_key[0] = decode_key(packed & 3);
+  pressed_key[1] = decode_key(packed >> 2 & 3);
+}
+
+unsigned char game_key_pack(int key) {
+  return encode_key(key);
+}
+
+int game_key_unpack(unsigned char packed) {
+  return decode_key(packed & 3);
+}
+
+int game_bot_key(Rectangle paddle_rect, Rectangle ball_rect, Vector2 ball_direction, int paddle_index) {
+  float paddle_center = paddle_rect.y + paddle_rect.height / 2;
+  float ball_center = ball_rect.y + ball_rect.height / 2;
+  bool is_ball_approaching = 0 == paddle_index
+    ? ball_direction.x < 0
+    : ball_direction.x > 0;
+  if (!is_ball_approaching) {
+    // return to the middle while the opponent is serving
+    ball_center = (float)WINDOW_HEIGHT / 2;
+  }
+  float dead_zone = paddle_rect.height / 4;
+
+  int key = 0;
+  if (ball_center > paddle_center + dead_zone) {
+    key = KEY_DOWN;
+  } else if (ball_center < paddle_center - dead_zone) {
+    key = KEY_UP;
+  }
+
+  // swing the paddle right before the hit to put some spin on the ball
+  float distance_x = fabsf(ball_rect.x - paddle_rect.x);
+  if (is_ball_approaching && distance_x < PADDLE_WIDTH * 4) {
+    key = ball_direction.y < 0 ? KEY_UP : KEY_DOWN;
+  }
+
+  return key;
+}
+
+void game_bot_input(GameState *p_state, int paddle_index) {
+  assert(paddle_index >= 0 && paddle_index < 2);
+
+  p_state->pressed_key[paddle_index] = game_bot_key(p_state->paddles[paddle_index].rect, p_state->ball.rect,
+                                                    p_state->ball.direction, paddle_index);
+  game_apply_pressed_key(p_state, paddle_index);
+}
+
+void game_headless_update(GameContext *ctx, float dt) {
+  game_bot_input(&ctx->state, 0);
+  game_bot_input(&ctx->state, 1);
+
+  unsigned events = game_step(ctx, dt);
+  if (events & GAME_EVENT_MATCH_OVER) {
+    ctx->update = NULL;
+  }
+}
+
+NetSnapshot game_state_snapshot(const GameState *p_state, const unsigned char *p_keys) {
+  NetSnapshot snapshot = {0};
+
+  snapshot.tick = p_state->tick;
+  for (int i = 0; i < 2; ++i) {
+    snapshot.positions[i][0] = p_state->paddles[i].rect.x;
+    snapshot.positions[i][1] = p_state->paddles[i].rect.y;
+    snapshot.velocities[i][1] = p_state->paddles[i].velocity;
+    snapshot.scores[i] = (int16_t)p_state->scores[i];
+  }
+  snapshot.positions[GE_BALL][0] = p_state->ball.rect.x;
+  snapshot.positions[GE_BALL][1] = p_state->ball.rect.y;
+  snapshot.velocities[GE_BALL][0] = p_state->ball.direction.x * p_state->ball.speed;
+  snapshot.velocities[GE_BALL][1] = p_state->ball.direction.y * p_state->ball.speed;
+
+  snapshot.input_count = p_state->tick < NET_TICK_INPUTS_HISTORY ? (int)p_state->tick : NET_TICK_INPUTS_HISTORY;
+  memcpy(snapshot.inputs, p_keys, sizeof(snapshot.inputs));
+
+  return snapshot;
+}
+
+int game_state_encode(char *buf, const GameState *p_state) {
+  assert(1 + sizeof(GameState) == NET_STATE_SIZE);
+  const unsigned char *bytes = (const unsigned char*)p_state;
+  unsigned char *ptr = (unsigned char*)buf;
+  *ptr++ = NET_CMD_STATE;
+
+  // every field is 4 bytes, they go little-endian as their bits
+  for (size_t i = 0; i < sizeof(GameState); i += sizeof(uint32_t)) {
+    uint32_t word = 0;
+    memcpy(&word, bytes + i, sizeof(word));
+    for (int j = 0; j < 4; ++j) {
+      *ptr++ = (unsigned char)(word >> (8 * j));
+    }
+  }
+  return NET_STATE_SIZE;
+}
+
+bool game_state_decode(const char *buf, int len, GameState *out) {
+  const unsigned char *ptr = (const unsigned char*)buf;
+  if (len < (int)NET_STATE_SIZE || NET_CMD_STATE != *ptr++) {
+    return false;
+  }
+
+  unsigned char *bytes = (unsigned char*)out;
+  for (size_t i = 0; i < sizeof(GameState); i += sizeof(uint32_t)) {
+    uint32_t word = 0;
+    for (int j = 0; j < 4; ++j) {
+      word |= (uint32_t)*ptr++ << (8 * j);
+    }
+    memcpy(bytes + i, &word, sizeof(word));
+  }
+  return true;
+}
+
+NetEvent game_state_event(const GameState *p_state, unsigned events) {
+  NetEvent event = {0};
+
+  event.tick = p_state->tick;
+  event.events = (unsigned char)events;
+  event.ball_position[0] = p_state->ball.rect.x;
+  event.ball_position[1] = p_state->ball.rect.y;
+  event.ball_direction[0] = p_state->ball.direction.x;
+  event.ball_direction[1] = p_state->ball.direction.y;
+  event.ball_speed = p_state->ball.speed;
+  for (int i = 0; i < 2; ++i) {
+    event.scores[i] = (int16_t)p_state->scores[i];
+  }
+
+  return event;
+}
@@ -0,0 +1,226 @@
+#ifndef __GAME_H__
+#define __GAME_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "raylib.h"
+
+#include "network.h"
+
+#ifndef WINDOW_SIDE
+#define WINDOW_SIDE 200
+#endif /* !WINDOW_SIDE */
+
+#define WINDOW_WIDTH_RATIO 4
+#define WINDOW_HEIGHT_RATIO 3
+
+#define WINDOW_WIDTH (int)(WINDOW_SIDE * WINDOW_WIDTH_RATIO)
+#define WINDOW_HEIGHT (int)(WINDOW_SIDE * WINDOW_HEIGHT_RATIO)
+
+#define PADDLE_HEIGHT (int)(WINDOW_SIDE / 2.67f)
+#define PADDLE_WIDTH (int)(WINDOW_SIDE / 13.33)
+#define MAX_PADDLE_SPEED (int)(WINDOW_SIDE / 0.39f)
+#define MIN_PADDLE_SPEED (int)(WINDOW_SIDE / 0.57f)
+#define PADDLE_SPEED (int)(WINDOW_SIDE / 0.5f)
+#define PADDLE_ACCELERATION 25.f
+#define PADDLE_FRICTION (PADDLE_ACCELERATION / 4)
+#define PADDLE_HIT_EFFECT_DURATION .25f
+
+#define BALL_SPEED (int)(WINDOW_SIDE / 0.44f)
+#define MAX_BALL_SPEED (int)(WINDOW_SIDE / 0.22f)
+#define MIN_BALL_SPEED (int)(WINDOW_SIDE / 0.60f)
+#define BALL_SIDES (int)(WINDOW_SIDE / 13.33f)
+
+#define GAME_DEFAULT_TICK_RATE 60
+// Speeds and accelerations were tuned for one simulation step per 1/60 s
+#define PHYSICS_REFERENCE_DT (1.f / 60)
+// Longest frame time fed into the accumulator, so a hitch does not
+// cause a burst of catch-up steps
+#define MAX_FRAME_TIME .25f
+
+#define TAIL_CAPACITY_BALL 15
+#define TAIL_CAPACITY_PADDLE 24
+// Every tail is drawn as this many rectangles spread over its capacity
+#define TAIL_SEGMENTS_PER_CAPACITY 5
+// capacity / (capacity / 5) rounded up is at most 6 for capacity >= 5
+#define TAIL_MAX_SEGMENTS (TAIL_SEGMENTS_PER_CAPACITY + 1)
+#define TAIL_STRUCT(size) Vector2 tail[(size)]; int tail_begin; int tail_len
+
+#define GAME_STATE_RING_CAPACITY 64
+
+typedef struct {
+  Rectangle rect;
+  float velocity;
+  float acceleration;
+} PaddleState;
+
+typedef struct {
+  Rectangle rect;
+  float speed;
+  float spin_factor;
+  Vector2 direction;
+} BallState;
+
+/// Everything the simulation depends on and nothing else.
+/// Fixed size, pointer free and made of 4 byte fields only, so there is
+/// no padding: it is copied with memcpy and hashed byte by byte
+typedef struct {
+  uint32_t tick;
+  PaddleState paddles[2];
+  BallState ball;
+  int32_t scores[2];
+  int32_t win_score;
+  int32_t pressed_key[2];
+} GameState;
+
+/// Past states indexed by their tick, the last GAME_STATE_RING_CAPACITY are kept.
+/// Zero initialized ring is empty
+typedef struct {
+  GameState frames[GAME_STATE_RING_CAPACITY];
+  bool is_saved[GAME_STATE_RING_CAPACITY];
+} GameStateRing;
+
+/// Render state of a paddle, does not affect the simulation
+typedef struct {
+  Rectangle prev_rect;
+  Color color;
+  TAIL_STRUCT(TAIL_CAPACITY_PADDLE);
+
+  Rectangle hit_effect[3];
+  float hit_countdown;
+} Paddle;
+
+/// Render state of the ball, does not affect the simulation
+typedef struct {
+  Rectangle prev_rect;
+  Color color;
+  TAIL_STRUCT(TAIL_CAPACITY_BALL);
+} Ball;
+
+typedef struct {
+  Rectangle rect;
+  Color color;
+} TailSegment;
+
+typedef enum {
+  MAIN_MENU_NULL,
+  MAIN_MENU_START,
+  MAIN_MENU_WIN_SCORE,
+  MAIN_MENU_EXIT,
+  MAIN_MENU_ITEMS_COUNT
+} MainMenuState;
+
+typedef struct GameContext GameContext;
+typedef void (*UpdateFn)(GameContext *ctx, float dt);
+
+struct GameContext {
+  GameState state;
+  Paddle paddles[2];
+  Ball ball;
+  MainMenuState main_menu_state;
+  UpdateFn update;
+  UdpSocket server_sock;
+  UdpSocket client_sock;
+  float tick_dt;
+  float accumulator;
+  bool is_paused;
+  bool should_exit;
+};
+
+/// Things that happened during a single simulation step,
+/// so the caller can decide how to present them (sound, network, stats)
+typedef enum {
+  GAME_EVENT_NONE = 0,
+  GAME_EVENT_PADDLE_HIT = 1 << 0,
+  GAME_EVENT_WALL_BOUNCE = 1 << 1,
+  GAME_EVENT_SCORE = 1 << 2,
+  GAME_EVENT_MATCH_OVER = 1 << 3,
+} GameEvent;
+
+
+/// Creates a state with paddles and ball at their starting positions
+GameState game_state_create(void);
+
+/// Creates a context with paddles and ball at their starting positions
+/// and the default fixed simulation step.
+/// Does not touch the window, audio or network
+GameContext game_context_create(void);
+
+/// Advances physics and scoring of the match by dt seconds
+/// using p_state->pressed_key as the input of the step
+/// @returns mask of GameEvent that happened during the step
+unsigned game_state_step(GameState *p_state, float dt);
+
+/// Same as game_state_step on ctx->state, also updates the render state:
+/// saves positions before the step into prev_rect for interpolation,
+/// colors and hit effects. Does not draw or play sounds
+/// @returns mask of GameEvent that happened during the step
+unsigned game_step(GameContext *ctx, float dt);
+
+/// Stores the state into the ring slot of its tick
+void game_state_save(GameStateRing *p_ring, const GameState *p_state);
+
+/// Copies the state of the tick from the ring into *p_out
+/// @returns false if the tick has already been overwritten or never saved
+bool game_state_restore(const GameStateRing *p_ring, uint32_t tick, GameState *p_out);
+
+/// 64 bit hash of the state, FNV-1a steps over its 4 byte fields instead of its bytes,
+/// equal states have equal hashes
+uint64_t game_state_hash(const GameState *p_state);
+
+/// Bounces the ball off the paddle, changing its direction, speed and spin
+/// by the hit point and the paddle velocity
+void handle_collision(BallState *p_ball, const PaddleState *p_paddle);
+
+/// Moves the paddle by its acceleration and friction for dt seconds,
+/// the paddle is not clamped within the screen
+void update_paddle(PaddleState *p_paddle, float dt);
+
+/// Pushes the center of orig_rect into the tail ring if advance is set
+/// and fills p_out with the rectangles the tail is drawn with,
+/// fading out from orig_color.
+/// p_out should have room for TAIL_MAX_SEGMENTS
+/// @returns number of segments written to p_out
+int game_tail_segments(Rectangle orig_rect, Color orig_color, bool advance,
+                       Vector2 *p_tail, int *p_begin, int *p_len, int tail_capacity,
+                       TailSegment *p_out);
+
+/// Converts p_state->pressed_key[paddle_index] into the paddle acceleration
+void game_apply_pressed_key(GameState *p_state, int paddle_index);
+
+/// Packs pressed keys of both paddles into the low 4 bits of a byte
+unsigned char game_keys_pack(const int32_t pressed_key[2]);
+void game_keys_unpack(unsigned char packed, int32_t pressed_key[2]);
+
+/// Packs a single key into the low 2 bits of a byte
+unsigned char game_key_pack(int key);
+int game_key_unpack(unsigned char packed);
+
+/// Snapshot of the state to send to clients,
+/// p_keys are the packed keys of the latest NET_TICK_INPUTS_HISTORY steps, newest first
+NetSnapshot game_state_snapshot(const GameState *p_state, const unsigned char *p_keys);
+
+/// Encodes NET_CMD_STATE: the whole state bit for bit, into buf of at least NET_STATE_SIZE
+/// @returns size of the message
+int game_state_encode(char *buf, const GameState *p_state);
+
+/// Decodes NET_CMD_STATE of len bytes received into buf
+/// @returns false if the message is not a whole state
+bool game_state_decode(const char *buf, int len, GameState *out);
+
+/// Event message of the events of the step the state has just made
+NetEvent game_state_event(const GameState *p_state, unsigned events);
+
+/// Key a simple deterministic AI would press for the paddle at paddle_index
+int game_bot_key(Rectangle paddle_rect, Rectangle ball_rect, Vector2 ball_direction, int paddle_index);
+
+/// Simple deterministic AI that follows the ball,
+/// sets p_state->pressed_key[paddle_index] and the paddle acceleration
+void game_bot_input(GameState *p_state, int paddle_index);
+
+/// UpdateFn of a bot vs bot match without window, audio or drawing.
+/// Sets ctx->update to NULL once the match is over
+void game_headless_update(GameContext *ctx, float dt);
+
+#endif // !__GAME_H__
@@ -0,0 +1,284 @@
+// strtok_r
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "raylib.h"
+
+#include "impair.h"
+
+#define PROFILE_MAX_LINE 256
+#define PROFILE_MAX_VALUES 4
+
+// Pareto of shape 3 with scale 1 has mean 1.5 and a tail of rare long delays
+#define PARETO_SHAPE 3.
+#define PARETO_MEAN 1.5
+
+#define TWO_PI 6.283185307179586
+
+static uint64_t next_random(ImpairLink *p_link) {
+  // xorshift64*
+  p_link->rng ^= p_link->rng >> 12;
+  p_link->rng ^= p_link->rng << 25;
+  p_link->rng ^= p_link->rng >> 27;
+  return p_link->rng * 0x2545f4914f6cdd1dull;
+}
+
+/// @returns uniform in [0, 1)
+static double random_unit(ImpairLink *p_link) {
+  return (next_random(p_link) >> 11) * (1. / 9007199254740992.);
+}
+
+static bool chance(ImpairLink *p_link, float percent) {
+  return percent > 0 && random_unit(p_link) * 100. < percent;
+}
+
+static double jitter_ms(ImpairLink *p_link) {
+  const ImpairConfig *p_cfg = &p_link->cfg;
+  if (p_cfg->jitter_ms <= 0) {
+    return 0;
+  }
+
+  switch (p_cfg->jitter_kind) {
+    case IMPAIR_JITTER_UNIFORM: {
+      return (2. * random_unit(p_link) - 1.) * p_cfg->jitter_ms;
+    }
+    case IMPAIR_JITTER_NORMAL: {
+      // Box-Muller, 1 - u is never 0
+      double u1 = 1. - random_unit(p_link);
+      double u2 = random_unit(p_link);
+      return sqrt(-2. * log(u1)) * cos(TWO_PI * u2) * p_cfg->jitter_ms;
+    }
+    case IMPAIR_JITTER_PARETO: {
+      double u = 1. - random_unit(p_link);
+      return (pow(u, -1. / PARETO_SHAPE) - PARETO_MEAN) * p_cfg->jitter_ms;
+    }
+  }
+  return 0;
+}
+
+static bool is_lost(ImpairLink *p_link) {
+  const ImpairConfig *p_cfg = &p_link->cfg;
+  if (p_cfg->ge_p <= 0) {
+    return chance(p_link, p_cfg->loss);
+  }
+
+  if (p_link->is_bad ? chance(p_link, p_cfg->ge_r) : chance(p_link, p_cfg->ge_p)) {
+    p_link->is_bad = !p_link->is_bad;
+  }
+  return chance(p_link, p_link->is_bad ? p_cfg->ge_loss_bad : p_cfg->ge_loss_good);
+}
+
+ImpairConfig impair_config_default(void) {
+  ImpairConfig cfg = {0};
+  cfg.jitter_kind = IMPAIR_JITTER_NORMAL;
+  cfg.ge_loss_bad = 100;
+  cfg.limit = IMPAIR_DEFAULT_LIMIT;
+  return cfg;
+}
+
+void impair_link_init(ImpairLink *p_link, const ImpairConfig *p_cfg, uint64_t seed) {
+  memset(p_link, 0, sizeof(*p_link));
+  p_link->cfg = *p_cfg;
+  // xorshift never leaves 0
+  p_link->rng = 0 != seed ? seed : 0x9e3779b97f4a7c15ull;
+}
+
+ImpairDecision impair_link_admit(ImpairLink *p_link, uint64_t now_ns, int len) {
+  const ImpairConfig *p_cfg = &p_link->cfg;
+  ImpairDecision decision = {0};
+  p_link->stats.datagrams += 1;
+  p_link->stats.bytes += len;
+
+  if (is_lost(p_link)) {
+    p_link->stats.lost += 1;
+    decision.fate = IMPAIR_LOST;
+    return decision;
+  }
+
+  decision.copies = chance(p_link, p_cfg->duplicate) ? 2 : 1;
+  if (p_link->queued + decision.copies > p_cfg->limit) {
+    p_link->stats.queue_full += 1;
+    decision.fate = IMPAIR_QUEUE_FULL;
+    decision.copies = 0;
+    return decision;
+  }
+
+  // the capped link sends the datagrams one after another, the delay comes on top
+  uint64_t sent_ns = now_ns;
+  if (p_cfg->rate_kbit > 0) {
+    uint64_t start_ns = p_link->link_free_ns > now_ns ? p_link->link_free_ns : now_ns;
+    double bits = (len + IMPAIR_HEADER_BYTES) * 8.;
+    p_link->link_free_ns = start_ns + (uint64_t)(bits * 1e6 / p_cfg->rate_kbit);
+    sent_ns = p_link->link_free_ns;
+  }
+
+  decision.is_reordered = chance(p_link, p_cfg->reorder);
+  uint64_t release_ns = sent_ns;
+  if (decision.is_reordered) {
+    p_link->stats.reordered += 1;
+  } else {
+    double delay_ms = p_cfg->delay_ms + jitter_ms(p_link);
+    if (delay_ms > 0) release_ns += (uint64_t)(delay_ms * 1e6);
+    if (release_ns < p_link->last_release_ns) release_ns = p_link->last_release_ns;
+    p_link->last_release_ns = release_ns;
+  }
+
+  if (2 == decision.copies) {
+    p_link->stats.duplicated += 1;
+  }
+  decision.fate = IMPAIR_SENT;
+  decision.release_ns[0] = release_ns;
+  decision.release_ns[1] = release_ns;
+  p_link->queued += decision.copies;
+  return decision;
+}
+
+void impair_link_release(ImpairLink *p_link, uint64_t arrival_ns, uint64_t now_ns) {
+  double delay_ms = (now_ns - arrival_ns) / 1e6;
+  p_link->queued -= 1;
+  p_link->stats.sent += 1;
+  p_link->stats.delay_ms_sum += delay_ms;
+  if (delay_ms > p_link->stats.max_delay_ms) p_link->stats.max_delay_ms = delay_ms;
+}
+
+void impair_link_drop(ImpairLink *p_link) {
+  p_link->queued -= 1;
+}
+
+/// Parses count values of the key into out
+/// @returns false if there are fewer than min_count or one is not a number
+static bool parse_values(char **values, int value_count, int min_count, float *out, int max_count) {
+  if (value_count < min_count || value_count > max_count) {
+    return false;
+  }
+
+  for (int i = 0; i < value_count; ++i) {
+    char *end = NULL;
+    out[i] = strtof(values[i], &end);
+    if (end == values[i] || '\0' != *end || out[i] < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool apply_key(ImpairConfig *p_cfg, const char *key, char **values, int value_count) {
+  float v[PROFILE_MAX_VALUES] = {0};
+
+  if (0 == strcmp(key, "delay")) {
+    if (!parse_values(values, value_count, 1, v, 1)) return false;
+    p_cfg->delay_ms = v[0];
+  } else if (0 == strcmp(key, "jitter")) {
+    if (!parse_values(values, value_count > 1 ? 1 : value_count, 1, v, 1)) return false;
+    p_cfg->jitter_ms = v[0];
+    if (value_count > 2) return false;
+    if (2 == value_count) {
+      if (0 == strcmp(values[1], "uniform")) p_cfg->jitter_kind = IMPAIR_JITTER_UNIFORM;
+      else if (0 == strcmp(values[1], "normal")) p_cfg->jitter_kind = IMPAIR_JITTER_NORMAL;
+      else if (0 == strcmp(values[1], "pareto")) p_cfg->jitter_kind = IMPAIR_JITTER_PARETO;
+      else return false;
+    }
+  } else if (0 == strcmp(key, "loss")) {
+    if (!parse_values(values, value_count, 1, v, 1)) return false;
+    p_cfg->loss = v[0];
+  } else if (0 == strcmp(key, "gilbert")) {
+    v[3] = 100;
+    if (!parse_values(values, value_count, 2, v, 4)) return false;
+    p_cfg->ge_p = v[0];
+    p_cfg->ge_r = v[1];
+    p_cfg->ge_loss_good = v[2];
+    p_cfg->ge_loss_bad = v[3];
+  } else if (0 == strcmp(key, "duplicate")) {
+    if (!parse_values(values, value_count, 1, v, 1)) return false;
+    p_cfg->duplicate = v[0];
+  } else if (0 == strcmp(key, "reorder")) {
+    if (!parse_values(values, value_count, 1, v, 1)) return false;
+    p_cfg->reorder = v[0];
+  } else if (0 == strcmp(key, "rate")) {
+    if (!parse_values(values, value_count, 1, v, 1)) return false;
+    p_cfg->rate_kbit = v[0];
+  } else if (0 == strcmp(key, "limit")) {
+    if (!parse_values(values, value_count, 1, v, 1) || v[0] < 1) return false;
+    p_cfg->limit = (int)v[0];
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool impair_load_profile(const char *path, ImpairConfig cfgs[IMPAIR_DIRECTIONS], uint64_t *p_seed) {
+  FILE *file = fopen(path, "r");
+  if (NULL == file) {
+    TraceLog(LOG_ERROR, "Could not open the profile %s: %s", path, strerror(errno));
+    return false;
+  }
+
+  bool ok = true;
+  // the directions the keys apply to
+  bool sections[IMPAIR_DIRECTIONS] = { true, true };
+  char line[PROFILE_MAX_LINE] = {0};
+  int line_number = 0;
+
+  while (ok && NULL != fgets(line, sizeof(line), file)) {
+    line_number += 1;
+    char *comment = strchr(line, '#');
+    if (NULL != comment) *comment = '\0';
+
+    char *save = NULL;
+    char *key = strtok_r(line, " \t\r\n", &save);
+    if (NULL == key) continue;
+
+    char *values[PROFILE_MAX_VALUES + 1] = {0};
+    int value_count = 0;
+    char *value = NULL;
+    while (NULL != (value = strtok_r(NULL, " \t\r\n", &save)) && value_count <= PROFILE_MAX_VALUES) {
+      values[value_count++] = value;
+    }
+
+    if (0 == strcmp(key, "[up]") || 0 == strcmp(key, "[down]") || 0 == strcmp(key, "[both]")) {
+      sections[IMPAIR_UP] = 0 != strcmp(key, "[down]");
+      sections[IMPAIR_DOWN] = 0 != strcmp(key, "[up]");
+      ok = 0 == value_count;
+    } else if (0 == strcmp(key, "seed")) {
+      char *end = NULL;
+      ok = 1 == value_count;
+      if (ok) *p_seed = strtoull(values[0], &end, 0);
+      ok = ok && '\0' == *end;
+    } else {
+      for (int i = 0; i < IMPAIR_DIRECTIONS && ok; ++i) {
+        if (sections[i]) ok = apply_key(&cfgs[i], key, values, value_count);
+      }
+    }
+
+    if (!ok) {
+      TraceLog(LOG_ERROR, "%s:%d: could not read \"%s\"", path, line_number, key);
+    }
+  }
+
+  fclose(file);
+  return ok;
+}
+
+const char *impair_direction_name(ImpairDirection direction) {
+  return IMPAIR_UP == direction ? "up" : "down";
+}
+
+void impair_log_config(ImpairDirection direction, const ImpairConfig *p_cfg) {
+  static const char *jitter_names[] = { "uniform", "normal", "pareto" };
+  TraceLog(LOG_INFO, "%-4s delay %.1f ms, jitter %.1f ms %s, reorder %.1f%%, duplicate %.1f%%, "
+           "rate %.0f kbit/s, limit %d", impair_direction_name(direction), p_cfg->delay_ms,
+           p_cfg->jitter_ms, jitter_names[p_cfg->jitter_kind], p_cfg->reorder, p_cfg->duplicate,
+           p_cfg->rate_kbit, p_cfg->limit);
+  if (p_cfg->ge_p > 0) {
+    TraceLog(LOG_INFO, "%-4s Gilbert-Elliott loss: p %.2f%%, r %.2f%%, %.1f%% good, %.1f%% bad",
+             impair_direction_name(direction), p_cfg->ge_p, p_cfg->ge_r,
+             p_cfg->ge_loss_good, p_cfg->ge_loss_bad);
+  } else {
+    TraceLog(LOG_INFO, "%-4s loss %.2f%%", impair_direction_name(direction), p_cfg->loss);
+  }
+}
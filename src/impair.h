@@ -0,0 +1,130 @@
+#ifndef __IMPAIR_H__
+#define __IMPAIR_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Packets a link holds at most (like the limit of netem), later ones are dropped
+#define IMPAIR_DEFAULT_LIMIT 1000
+
+// A capped rate counts the UDP and IPv4 headers of every datagram too
+#define IMPAIR_HEADER_BYTES 28
+
+typedef enum {
+  // client to host
+  IMPAIR_UP,
+  // host to client
+  IMPAIR_DOWN,
+  IMPAIR_DIRECTIONS
+} ImpairDirection;
+
+typedef enum {
+  // in [-jitter, jitter]
+  IMPAIR_JITTER_UNIFORM,
+  // with standard deviation jitter
+  IMPAIR_JITTER_NORMAL,
+  // Pareto with mean 0: mostly a bit early, now and then far late
+  IMPAIR_JITTER_PARETO,
+} ImpairJitter;
+
+/// What one direction of the link does to the datagrams, percents are of the datagrams
+typedef struct {
+  float delay_ms;
+  float jitter_ms;
+  ImpairJitter jitter_kind;
+  // independent loss, ignored with Gilbert-Elliott
+  float loss;
+  // Gilbert-Elliott loss if ge_p > 0: a datagram moves the link from the good state
+  // to the bad one with ge_p and back with ge_r, and is lost with ge_loss_good
+  // or ge_loss_bad there, so losses come in bursts
+  float ge_p;
+  float ge_r;
+  float ge_loss_good;
+  float ge_loss_bad;
+  float duplicate;
+  // sent right away, ahead of the delayed datagrams sent before it
+  float reorder;
+  // 0 if unlimited, otherwise datagrams queue for the link
+  float rate_kbit;
+  int limit;
+} ImpairConfig;
+
+typedef enum {
+  IMPAIR_SENT,
+  IMPAIR_LOST,
+  // over the limit
+  IMPAIR_QUEUE_FULL,
+} ImpairFate;
+
+/// What happens to one datagram
+typedef struct {
+  ImpairFate fate;
+  // 2 if duplicated
+  int copies;
+  bool is_reordered;
+  // time_now_ns to send each copy at
+  uint64_t release_ns[2];
+} ImpairDecision;
+
+typedef struct {
+  long datagrams;
+  long bytes;
+  long lost;
+  long queue_full;
+  long duplicated;
+  long reordered;
+  // copies sent and the time they were held
+  long sent;
+  double delay_ms_sum;
+  double max_delay_ms;
+} ImpairStats;
+
+/// One direction of the impaired link. Seeded, so a run with the same arrivals
+/// makes the same decisions
+typedef struct {
+  ImpairConfig cfg;
+  uint64_t rng;
+  bool is_bad;
+  // the capped link sends the previous datagrams until then
+  uint64_t link_free_ns;
+  // delayed datagrams stay in order, jitter does not reorder them
+  uint64_t last_release_ns;
+  // decided and not released yet
+  int queued;
+  ImpairStats stats;
+} ImpairLink;
+
+/// No impairment at all
+ImpairConfig impair_config_default(void);
+
+void impair_link_init(ImpairLink *p_link, const ImpairConfig *p_cfg, uint64_t seed);
+
+/// Decides the fate of a datagram of len bytes that arrived at now_ns
+ImpairDecision impair_link_admit(ImpairLink *p_link, uint64_t now_ns, int len);
+
+/// A copy of a datagram admitted at arrival_ns was sent at now_ns
+void impair_link_release(ImpairLink *p_link, uint64_t arrival_ns, uint64_t now_ns);
+
+/// A copy of a datagram was thrown away before its release
+void impair_link_drop(ImpairLink *p_link);
+
+/// Reads a profile: lines of a key and its values, # starts a comment.
+/// Keys apply to both directions until a line [up] or [down], [both] goes back:
+///   seed N
+///   delay MS
+///   jitter MS [uniform|normal|pareto]
+///   loss PERCENT
+///   gilbert P R [LOSS_GOOD [LOSS_BAD]]   (percents, 0 and 100 by default)
+///   duplicate PERCENT
+///   reorder PERCENT
+///   rate KBIT
+///   limit DATAGRAMS
+/// @returns false if the file can not be read or has an error, logged with its line
+bool impair_load_profile(const char *path, ImpairConfig cfgs[IMPAIR_DIRECTIONS], uint64_t *p_seed);
+
+const char *impair_direction_name(ImpairDirection direction);
+
+/// Logs the config of the direction
+void impair_log_config(ImpairDirection direction, const ImpairConfig *p_cfg);
+
+#endif // !__IMPAIR_H__
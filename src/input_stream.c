@@ -0,0 +1,128 @@
+#include <string.h>
+
+#include "input_stream.h"
+
+#define SLOT(tick) ((tick) & (INPUT_STREAM_CAPACITY - 1))
+
+void input_sender_init(InputSender *p_sender) {
+  memset(p_sender, 0, sizeof(*p_sender));
+}
+
+void input_sender_push(InputSender *p_sender, uint32_t tick, unsigned char key) {
+  p_sender->keys[SLOT(tick)] = key;
+  p_sender->newest_tick = tick;
+}
+
+void input_sender_ack(InputSender *p_sender, const NetAck *p_ack) {
+  if (0 == p_ack->tick) return;
+
+  // acks come with snapshots that may be reordered, merge rather than replace
+  if (0 != p_sender->ack.tick && (int32_t)(p_ack->tick - p_sender->ack.tick) < 0) {
+    for (int i = 0; i <= NET_ACK_BITS; ++i) {
+      uint32_t tick = p_ack->tick - i;
+      if (net_ack_has(p_ack, tick)) net_ack_mark(&p_sender->ack, tick);
+    }
+    return;
+  }
+
+  NetAck merged = *p_ack;
+  for (int i = 0; i <= NET_ACK_BITS; ++i) {
+    uint32_t tick = p_sender->ack.tick - i;
+    if (net_ack_has(&p_sender->ack, tick)) net_ack_mark(&merged, tick);
+  }
+  p_sender->ack = merged;
+}
+
+bool input_sender_build(const InputSender *p_sender, NetInput *out) {
+  if (0 == p_sender->newest_tick) {
+    return false;
+  }
+
+  out->tick = p_sender->newest_tick;
+  out->count = 1;
+
+  // the oldest key the host may be missing decides how far back to go
+  int count = p_sender->newest_tick < NET_INPUT_WINDOW ? (int)p_sender->newest_tick : NET_INPUT_WINDOW;
+  for (int i = count - 1; i > 0; --i) {
+    uint32_t tick = p_sender->newest_tick - i;
+    bool is_acked = net_ack_has(&p_sender->ack, tick)
+      || (0 != p_sender->ack.tick && (int32_t)(p_sender->ack.tick - tick) > NET_ACK_BITS);
+    if (!is_acked) {
+      out->count = i + 1;
+      break;
+    }
+  }
+
+  for (int i = 0; i < out->count; ++i) {
+    out->keys[i] = p_sender->keys[SLOT(p_sender->newest_tick - i)];
+  }
+  return true;
+}
+
+void input_receiver_init(InputReceiver *p_receiver) {
+  memset(p_receiver, 0, sizeof(*p_receiver));
+}
+
+static bool has_tick(const InputReceiver *p_receiver, uint32_t tick) {
+  return 0 != tick && p_receiver->ticks[SLOT(tick)] == tick;
+}
+
+void input_receiver_push(InputReceiver *p_receiver, const NetInput *p_input) {
+  if (0 == p_receiver->next_tick) {
+    // the match goes on from now, what the client pressed before is history
+    p_receiver->next_tick = p_input->tick;
+  }
+
+  for (int i = 0; i < p_input->count; ++i) {
+    uint32_t tick = p_input->tick - i;
+    if ((int32_t)(tick - p_receiver->next_tick) < 0) {
+      // applied or skipped already, only acked so the client stops sending it
+      net_ack_mark(&p_receiver->ack, tick);
+      continue;
+    }
+    if (has_tick(p_receiver, tick)) {
+      continue;
+    }
+
+    p_receiver->keys[SLOT(tick)] = p_input->keys[i];
+    p_receiver->ticks[SLOT(tick)] = tick;
+    net_ack_mark(&p_receiver->ack, tick);
+    if (i > 0) {
+      p_receiver->stats.recovered += 1;
+    }
+  }
+}
+
+unsigned char input_receiver_take(InputReceiver *p_receiver) {
+  if (0 == p_receiver->next_tick) {
+    return p_receiver->key;
+  }
+  p_receiver->stats.ticks += 1;
+
+  uint32_t newest = p_receiver->ack.tick;
+  while ((int32_t)(newest - p_receiver->next_tick) >= INPUT_RECEIVER_MAX_DELAY) {
+    if (has_tick(p_receiver, p_receiver->next_tick)) {
+      p_receiver->key = p_receiver->keys[SLOT(p_receiver->next_tick)];
+    }
+    p_receiver->next_tick += 1;
+    p_receiver->stats.skipped += 1;
+  }
+
+  // behind the client, a tick that presses the same key as the next one changes nothing
+  uint32_t next = p_receiver->next_tick;
+  while ((int32_t)(newest - next) > 0 && has_tick(p_receiver, next) && has_tick(p_receiver, next + 1)
+    && p_receiver->keys[SLOT(next)] == p_receiver->keys[SLOT(next + 1)]) {
+    next += 1;
+  }
+  p_receiver->next_tick = next;
+
+  if (!has_tick(p_receiver, next)) {
+    // late, or lost and coming with the next datagram
+    p_receiver->stats.held += 1;
+    return p_receiver->key;
+  }
+
+  p_receiver->key = p_receiver->keys[SLOT(next)];
+  p_receiver->next_tick = next + 1;
+  return p_receiver->key;
+}
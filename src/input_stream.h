@@ -0,0 +1,74 @@
+#ifndef __INPUT_STREAM_H__
+#define __INPUT_STREAM_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "network.h"
+
+// Keys both sides keep, by tick. Above NET_INPUT_WINDOW and a power of two
+#define INPUT_STREAM_CAPACITY 64
+
+// The host is at most this many client ticks behind the newest input,
+// older ones it has not applied yet are skipped
+#define INPUT_RECEIVER_MAX_DELAY 4
+
+/// Client side: the keys of every tick it sampled, sent again and again
+/// until the host acks them
+typedef struct {
+  unsigned char keys[INPUT_STREAM_CAPACITY];
+  // tick of the newest key, 0 before the first one
+  uint32_t newest_tick;
+  // inputs the host has received
+  NetAck ack;
+} InputSender;
+
+typedef struct {
+  // ticks the host has applied
+  long ticks;
+  // ticks first received through a later datagram, their own one was lost
+  long recovered;
+  // ticks the host had no new input for and kept the last key: it was lost or late
+  long held;
+  // inputs dropped to catch up with the client
+  long skipped;
+} InputReceiverStats;
+
+/// Host side: the keys a client sent by its tick, applied one tick per host tick
+typedef struct {
+  unsigned char keys[INPUT_STREAM_CAPACITY];
+  uint32_t ticks[INPUT_STREAM_CAPACITY];
+  // inputs received, sent back with the snapshots
+  NetAck ack;
+  // client tick of the next key to apply
+  uint32_t next_tick;
+  // packed key applied last, kept while nothing newer is there
+  unsigned char key;
+  InputReceiverStats stats;
+} InputReceiver;
+
+void input_sender_init(InputSender *p_sender);
+
+/// Adds the packed key of the client tick, ticks go one by one
+void input_sender_push(InputSender *p_sender, uint32_t tick, unsigned char key);
+
+/// Takes the ack a snapshot brought
+void input_sender_ack(InputSender *p_sender, const NetAck *p_ack);
+
+/// Fills the input to send: the newest key and every older one in NET_INPUT_WINDOW
+/// the host may not have yet
+/// @returns false if there is no key yet
+bool input_sender_build(const InputSender *p_sender, NetInput *out);
+
+void input_receiver_init(InputReceiver *p_receiver);
+
+/// Stores the keys of the datagram the receiver does not have yet
+void input_receiver_push(InputReceiver *p_receiver, const NetInput *p_input);
+
+/// Picks the key of the next client tick for a host tick. A missing tick is waited
+/// for as the next datagram brings it again, ticks with the same key are merged
+/// to catch up after that, so inputs are not delayed for long
+/// @returns the packed key
+unsigned char input_receiver_take(InputReceiver *p_receiver);
+
+#endif // !__INPUT_STREAM_H__
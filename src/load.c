@@ -0,0 +1,795 @@
+// CLOCK_MONOTONIC timers, nanosleep and getrlimit
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/timerfd.h>
+
+#include "raylib.h"
+
+#include "args.h"
+#include "network.h"
+#include "game.h"
+#include "delta.h"
+#include "input_stream.h"
+#include "timing.h"
+
+#define LOAD_DEFAULT_PORT 7777
+#define LOAD_DEFAULT_START_ROOMS 16
+#define LOAD_DEFAULT_STEP_ROOMS 16
+#define LOAD_DEFAULT_MAX_ROOMS 1024
+#define LOAD_DEFAULT_STEP_SECONDS 5
+#define LOAD_DEFAULT_PATTERN_PERIOD 30
+#define LOAD_MAX_THREADS 64
+
+// A bot without NET_CMD_READY sends NET_CMD_CONNECT again this often
+#define LOAD_CONNECT_RETRY_NS 500000000ull
+
+// Bots connect and settle for this long at the start of a step before it is measured
+#define LOAD_WARMUP_NS 1000000000ull
+
+// Input to state latencies are counted in 1 ms buckets up to this, longer ones in the last one
+#define LOAD_LATENCY_HISTOGRAM_MS 1000
+
+// A step holds up while the bots that play get this much of the send rate and lose less
+// than LOAD_MAX_DROP_PERCENT of the snapshots. A bot below LOAD_STARVED_RATIO is starved
+#define LOAD_MIN_RATE_RATIO .95
+#define LOAD_STARVED_RATIO .9
+#define LOAD_MAX_DROP_PERCENT 1.
+
+// Bots still waiting for an opponent are no load, SO_REUSEPORT may leave one alone on a core
+// of the server. The step fails only if more of them than this got no room
+#define LOAD_MAX_WAITING_PERCENT 10.
+
+// The timer fd of a worker in epoll, bots are there by their index
+#define LOAD_TIMER_EVENT UINT32_MAX
+
+#define LOAD_EPOLL_EVENTS 256
+
+typedef enum {
+  // up, nothing, down, nothing, every pattern_period ticks
+  LOAD_PATTERN_SWEEP,
+  // a different key after pattern_period ticks on average
+  LOAD_PATTERN_RANDOM,
+  // no key at all, only the input stream
+  LOAD_PATTERN_IDLE,
+} LoadPattern;
+
+typedef struct {
+  const char *host;
+  int port;
+  // resolved once in main, a bot only connects its socket to them
+  struct sockaddr_in6 host_addrs[NET_RESOLVE_MAX_ADDRS];
+  int host_addr_count;
+  int thread_count;
+  // the host's, every bot should get send_rate snapshots a second
+  int tick_rate;
+  int send_rate;
+  int input_rate;
+  int start_rooms;
+  int step_rooms;
+  int max_rooms;
+  int step_seconds;
+  LoadPattern pattern;
+  int pattern_period;
+  uint64_t seed;
+} LoadConfig;
+
+/// A fake client playing one paddle
+typedef struct {
+  UdpSocket sock;
+  uint16_t token;
+  // from NET_CMD_READY, -1 before it
+  int paddle;
+  uint64_t connect_ns;
+
+  InputSender sender;
+  uint32_t input_tick;
+  NetAck snapshot_ack;
+  DeltaDecoder decoder;
+  bool has_snapshot;
+  uint32_t newest_tick;
+
+  // packed key it sends, the time it changed to it, 0 once a snapshot showed it
+  unsigned char key;
+  uint64_t key_change_ns;
+  int pattern_phase;
+
+  // snapshots since the warmup of the step
+  long snapshots;
+} LoadBot;
+
+typedef struct {
+  long snapshots;
+  // snapshots the ticks up to the newest decoded one should have brought at the send rate
+  double expected;
+  // snapshots whose baseline was lost
+  long undecodable;
+  long datagrams_in;
+  long datagrams_out;
+  long bytes_in;
+  long bytes_out;
+  long latencies[LOAD_LATENCY_HISTOGRAM_MS + 1];
+  long latency_count;
+  // key changes the state never showed, a newer one came first
+  long unseen_keys;
+} LoadStats;
+
+/// One thread with its own bots, epoll and tick timer. The main thread only
+/// touches it under the lock: to add bots and to take the stats of a step
+typedef struct {
+  int index;
+  const LoadConfig *p_cfg;
+  int epoll_fd;
+  int timer_fd;
+  uint64_t rng;
+
+  pthread_mutex_t lock;
+  LoadBot *bots;
+  int bot_capacity;
+  int bot_count;
+  // bots the main thread asks for
+  int target_bot_count;
+  LoadStats stats;
+  bool is_ok;
+} LoadWorker;
+
+static volatile sig_atomic_t load_should_stop = 0;
+
+static void handle_stop_signal(int signal) {
+  (void)signal;
+  load_should_stop = 1;
+}
+
+static uint32_t next_random(uint64_t *p_rng) {
+  // xorshift64*
+  *p_rng ^= *p_rng >> 12;
+  *p_rng ^= *p_rng << 25;
+  *p_rng ^= *p_rng >> 27;
+  return (uint32_t)((*p_rng * 0x2545f4914f6cdd1dull) >> 32);
+}
+
+static void send_datagram(LoadWorker *p_worker, LoadBot *p_bot, const char *buf, int len) {
+  if (send(p_bot->sock.fd, buf, len, 0) == len) {
+    p_worker->stats.datagrams_out += 1;
+    p_worker->stats.bytes_out += len;
+  }
+}
+
+static void send_connect(LoadWorker *p_worker, LoadBot *p_bot, uint64_t now) {
+  char buf[NET_CMD_SIZE] = {0};
+  int len = net_encode_connect(buf, NET_ROLE_PLAYER, p_bot->token);
+  send_datagram(p_worker, p_bot, buf, len);
+  p_bot->connect_ns = now;
+}
+
+static bool open_bot(LoadWorker *p_worker, LoadBot *p_bot, uint32_t bot_index, uint64_t now) {
+  const LoadConfig *p_cfg = p_worker->p_cfg;
+  memset(p_bot, 0, sizeof(*p_bot));
+  p_bot->paddle = -1;
+
+  // in the order of getaddrinfo, which puts the preferred family first
+  bool is_connected = false;
+  for (int i = 0; i < p_cfg->host_addr_count && !is_connected; ++i) {
+    is_connected = net_connect_udp(&p_cfg->host_addrs[i], &p_bot->sock);
+  }
+  if (!is_connected) {
+    return false;
+  }
+
+  struct epoll_event event = {0};
+  event.events = EPOLLIN;
+  event.data.u32 = bot_index;
+  if (-1 == epoll_ctl(p_worker->epoll_fd, EPOLL_CTL_ADD, p_bot->sock.fd, &event)) {
+    TraceLog(LOG_ERROR, "Could not watch the socket of a bot: %s", strerror(errno));
+    close(p_bot->sock.fd);
+    return false;
+  }
+
+  p_bot->token = (uint16_t)next_random(&p_worker->rng);
+  p_bot->pattern_phase = next_random(&p_worker->rng) % (4 * p_cfg->pattern_period);
+  p_bot->key = game_key_pack(0);
+  input_sender_init(&p_bot->sender);
+  delta_decoder_init(&p_bot->decoder);
+  send_connect(p_worker, p_bot, now);
+  return true;
+}
+
+static void record_latency(LoadStats *p_stats, uint64_t latency_ns) {
+  uint64_t ms = latency_ns / 1000000;
+  if (ms > LOAD_LATENCY_HISTOGRAM_MS) ms = LOAD_LATENCY_HISTOGRAM_MS;
+  p_stats->latencies[ms] += 1;
+  p_stats->latency_count += 1;
+}
+
+static void on_snapshot(LoadWorker *p_worker, LoadBot *p_bot, const NetSnapshot *p_snapshot, uint64_t now) {
+  LoadStats *p_stats = &p_worker->stats;
+  p_stats->snapshots += 1;
+  p_bot->snapshots += 1;
+
+  const LoadConfig *p_cfg = p_worker->p_cfg;
+  if (!p_bot->has_snapshot) {
+    p_bot->has_snapshot = true;
+    p_bot->newest_tick = p_snapshot->tick;
+    p_stats->expected += 1;
+  } else if ((int32_t)(p_snapshot->tick - p_bot->newest_tick) > 0) {
+    p_stats->expected += (double)(p_snapshot->tick - p_bot->newest_tick) * p_cfg->send_rate / p_cfg->tick_rate;
+    p_bot->newest_tick = p_snapshot->tick;
+  }
+
+  net_ack_mark(&p_bot->snapshot_ack, p_snapshot->tick);
+  input_sender_ack(&p_bot->sender, &p_snapshot->input_ack);
+
+  // the newest key the host stepped the bot's paddle with
+  if (0 != p_bot->key_change_ns && p_snapshot->input_count > 0) {
+    int32_t pressed_key[2] = {0};
+    game_keys_unpack(p_snapshot->inputs[0], pressed_key);
+    if (game_key_pack(pressed_key[p_bot->paddle]) == p_bot->key) {
+      record_latency(p_stats, now - p_bot->key_change_ns);
+      p_bot->key_change_ns = 0;
+    }
+  }
+}
+
+/// The room closed under the bot, it connects again for a new one
+static void rejoin(LoadWorker *p_worker, LoadBot *p_bot, uint64_t now) {
+  p_bot->paddle = -1;
+  p_bot->input_tick = 0;
+  p_bot->has_snapshot = false;
+  p_bot->key_change_ns = 0;
+  memset(&p_bot->snapshot_ack, 0, sizeof(p_bot->snapshot_ack));
+  input_sender_init(&p_bot->sender);
+  delta_decoder_init(&p_bot->decoder);
+  send_connect(p_worker, p_bot, now);
+}
+
+static void receive(LoadWorker *p_worker, LoadBot *p_bot) {
+  char buf[NET_BUF_SIZE] = {0};
+  uint64_t now = time_now_ns();
+
+  for (;;) {
+    int len = recv(p_bot->sock.fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (len < 0) break;
+    p_worker->stats.datagrams_in += 1;
+    p_worker->stats.bytes_in += len;
+
+    if (NET_CMD_READY == buf[0] && len >= (int)NET_CMD_SIZE) {
+      // a bot only ever plays, anything else is not a paddle it can press keys for
+      if (0 == buf[1] || 1 == buf[1]) p_bot->paddle = buf[1];
+      continue;
+    }
+    if (NET_CMD_CLOSED == buf[0] && len >= (int)NET_CMD_SIZE) {
+      rejoin(p_worker, p_bot, now);
+      continue;
+    }
+    if (NET_CMD_DELTA_SNAPSHOT != buf[0]) continue;
+
+    NetSnapshot snapshot = {0};
+    if (!delta_decode(&p_bot->decoder, buf, len, &snapshot)) {
+      p_worker->stats.undecodable += 1;
+      continue;
+    }
+    on_snapshot(p_worker, p_bot, &snapshot, now);
+  }
+}
+
+/// @returns packed key of the bot's pattern for its next tick
+static unsigned char next_key(LoadWorker *p_worker, LoadBot *p_bot) {
+  const LoadConfig *p_cfg = p_worker->p_cfg;
+  static const int sweep[4] = { KEY_UP, 0, KEY_DOWN, 0 };
+
+  switch (p_cfg->pattern) {
+    case LOAD_PATTERN_SWEEP: {
+      int step = (p_bot->input_tick + p_bot->pattern_phase) / p_cfg->pattern_period;
+      return game_key_pack(sweep[step % 4]);
+    }
+    case LOAD_PATTERN_RANDOM: {
+      if (0 != next_random(&p_worker->rng) % p_cfg->pattern_period) return p_bot->key;
+      // one of the two other keys
+      static const int keys[3] = { KEY_UP, 0, KEY_DOWN };
+      int current = game_key_unpack(p_bot->key);
+      int index = KEY_UP == current ? 0 : KEY_DOWN == current ? 2 : 1;
+      return game_key_pack(keys[(index + 1 + next_random(&p_worker->rng) % 2) % 3]);
+    }
+    case LOAD_PATTERN_IDLE: {
+      return game_key_pack(0);
+    }
+  }
+  return p_bot->key;
+}
+
+/// Samples the key of the next input tick and sends the inputs the host may not have
+static void send_input(LoadWorker *p_worker, LoadBot *p_bot, uint64_t now) {
+  unsigned char key = next_key(p_worker, p_bot);
+  if (key != p_bot->key) {
+    if (0 != p_bot->key_change_ns) p_worker->stats.unseen_keys += 1;
+    p_bot->key = key;
+    p_bot->key_change_ns = now;
+  }
+  input_sender_push(&p_bot->sender, ++p_bot->input_tick, key);
+
+  NetInput input = {0};
+  if (!input_sender_build(&p_bot->sender, &input)) return;
+  input.snapshot_ack = p_bot->snapshot_ack;
+
+  char buf[NET_INPUT_MAX_SIZE] = {0};
+  int len = net_encode_input(buf, &input, p_bot->token);
+  send_datagram(p_worker, p_bot, buf, len);
+}
+
+static void tick(LoadWorker *p_worker) {
+  uint64_t now = time_now_ns();
+
+  int target = p_worker->target_bot_count;
+  while (p_worker->bot_count < target) {
+    uint32_t index = p_worker->bot_count;
+    if (!open_bot(p_worker, &p_worker->bots[index], index, now)) {
+      load_should_stop = 1;
+      return;
+    }
+    p_worker->bot_count += 1;
+  }
+
+  for (int i = 0; i < p_worker->bot_count; ++i) {
+    LoadBot *p_bot = &p_worker->bots[i];
+    if (p_bot->paddle < 0) {
+      if (now - p_bot->connect_ns >= LOAD_CONNECT_RETRY_NS) send_connect(p_worker, p_bot, now);
+    } else {
+      send_input(p_worker, p_bot, now);
+    }
+  }
+}
+
+static void *worker_main(void *p_arg) {
+  LoadWorker *p_worker = p_arg;
+  struct epoll_event events[LOAD_EPOLL_EVENTS];
+
+  while (!load_should_stop) {
+    int count = epoll_wait(p_worker->epoll_fd, events, LOAD_EPOLL_EVENTS, 100);
+    if (count < 0) {
+      if (EINTR == errno) continue;
+      TraceLog(LOG_ERROR, "Could not wait for the bots: %s", strerror(errno));
+      load_should_stop = 1;
+      break;
+    }
+
+    pthread_mutex_lock(&p_worker->lock);
+    for (int i = 0; i < count; ++i) {
+      uint32_t index = events[i].data.u32;
+      if (LOAD_TIMER_EVENT != index) {
+        receive(p_worker, &p_worker->bots[index]);
+        continue;
+      }
+
+      uint64_t expirations = 0;
+      if (read(p_worker->timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+        // a late wakeup sends one input, the host merges the ticks anyway
+        tick(p_worker);
+      }
+    }
+    pthread_mutex_unlock(&p_worker->lock);
+  }
+
+  p_worker->is_ok = true;
+  return NULL;
+}
+
+static bool worker_init(LoadWorker *p_worker, int index, const LoadConfig *p_cfg, int bot_capacity) {
+  p_worker->index = index;
+  p_worker->p_cfg = p_cfg;
+  p_worker->rng = p_cfg->seed + (index + 1) * 0x9e3779b97f4a7c15ull;
+  p_worker->bot_capacity = bot_capacity;
+  p_worker->epoll_fd = -1;
+  p_worker->timer_fd = -1;
+  pthread_mutex_init(&p_worker->lock, NULL);
+
+  p_worker->bots = calloc(bot_capacity, sizeof(LoadBot));
+  if (NULL == p_worker->bots) {
+    TraceLog(LOG_ERROR, "Could not allocate %d bots of worker %d", bot_capacity, index);
+    return false;
+  }
+
+  p_worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (-1 == p_worker->epoll_fd) {
+    TraceLog(LOG_ERROR, "Could not create epoll: %s", strerror(errno));
+    return false;
+  }
+
+  p_worker->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (-1 == p_worker->timer_fd) {
+    TraceLog(LOG_ERROR, "Could not create timerfd: %s", strerror(errno));
+    return false;
+  }
+
+  struct epoll_event event = {0};
+  event.events = EPOLLIN;
+  event.data.u32 = LOAD_TIMER_EVENT;
+  if (-1 == epoll_ctl(p_worker->epoll_fd, EPOLL_CTL_ADD, p_worker->timer_fd, &event)) {
+    TraceLog(LOG_ERROR, "Could not watch the timer: %s", strerror(errno));
+    return false;
+  }
+
+  uint64_t input_ns = 1000000000ull / p_cfg->input_rate;
+  struct itimerspec spec = {0};
+  spec.it_interval.tv_sec = input_ns / 1000000000ull;
+  spec.it_interval.tv_nsec = input_ns % 1000000000ull;
+  // the workers tick apart from each other, so the host does not get all the inputs at once
+  spec.it_value.tv_nsec = input_ns * (index + 1) / (p_cfg->thread_count + 1);
+  if (-1 == timerfd_settime(p_worker->timer_fd, 0, &spec, NULL)) {
+    TraceLog(LOG_ERROR, "Could not start the input timer: %s", strerror(errno));
+    return false;
+  }
+
+  return true;
+}
+
+static void worker_fini(LoadWorker *p_worker) {
+  if (NULL != p_worker->bots) {
+    for (int i = 0; i < p_worker->bot_count; ++i) {
+      close(p_worker->bots[i].sock.fd);
+    }
+  }
+  if (p_worker->timer_fd >= 0) close(p_worker->timer_fd);
+  if (p_worker->epoll_fd >= 0) close(p_worker->epoll_fd);
+  pthread_mutex_destroy(&p_worker->lock);
+  free(p_worker->bots);
+}
+
+static void merge_stats(LoadStats *p_into, const LoadStats *p_from) {
+  p_into->snapshots += p_from->snapshots;
+  p_into->expected += p_from->expected;
+  p_into->undecodable += p_from->undecodable;
+  p_into->datagrams_in += p_from->datagrams_in;
+  p_into->datagrams_out += p_from->datagrams_out;
+  p_into->bytes_in += p_from->bytes_in;
+  p_into->bytes_out += p_from->bytes_out;
+  for (int i = 0; i <= LOAD_LATENCY_HISTOGRAM_MS; ++i) {
+    p_into->latencies[i] += p_from->latencies[i];
+  }
+  p_into->latency_count += p_from->latency_count;
+  p_into->unseen_keys += p_from->unseen_keys;
+}
+
+/// @returns the latency in ms that p (in range [0, 1]) of the key changes did not exceed, -1 if none
+static double latency_percentile(const LoadStats *p_stats, double p) {
+  if (0 == p_stats->latency_count) return -1;
+
+  long rank = (long)(p * p_stats->latency_count);
+  long seen = 0;
+  for (int i = 0; i <= LOAD_LATENCY_HISTOGRAM_MS; ++i) {
+    seen += p_stats->latencies[i];
+    if (seen > rank) return i;
+  }
+  return LOAD_LATENCY_HISTOGRAM_MS;
+}
+
+/// What the bots saw during a step, after its warmup
+typedef struct {
+  int rooms;
+  int bots;
+  int playing;
+  // without NET_CMD_READY, no opponent or no room for them
+  int waiting;
+  // of the ones playing
+  int starved;
+  double seconds;
+  double snapshot_rate;
+  double drop_percent;
+  double packets_in;
+  double packets_out;
+  LoadStats stats;
+} LoadStep;
+
+/// Starts the measurement of the step: forgets what happened during the warmup
+static void reset_step(LoadWorker *workers, int worker_count) {
+  for (int i = 0; i < worker_count; ++i) {
+    LoadWorker *p_worker = &workers[i];
+    pthread_mutex_lock(&p_worker->lock);
+    memset(&p_worker->stats, 0, sizeof(p_worker->stats));
+    for (int j = 0; j < p_worker->bot_count; ++j) {
+      p_worker->bots[j].snapshots = 0;
+    }
+    pthread_mutex_unlock(&p_worker->lock);
+  }
+}
+
+static void measure_step(LoadWorker *workers, int worker_count, const LoadConfig *p_cfg,
+                         double seconds, LoadStep *out) {
+  memset(out, 0, sizeof(*out));
+  out->seconds = seconds;
+
+  for (int i = 0; i < worker_count; ++i) {
+    LoadWorker *p_worker = &workers[i];
+    pthread_mutex_lock(&p_worker->lock);
+    merge_stats(&out->stats, &p_worker->stats);
+    for (int j = 0; j < p_worker->bot_count; ++j) {
+      const LoadBot *p_bot = &p_worker->bots[j];
+      out->bots += 1;
+      if (p_bot->paddle < 0) {
+        out->waiting += 1;
+        continue;
+      }
+      out->playing += 1;
+      out->starved += p_bot->snapshots < LOAD_STARVED_RATIO * p_cfg->send_rate * seconds;
+    }
+    pthread_mutex_unlock(&p_worker->lock);
+  }
+
+  const LoadStats *p_stats = &out->stats;
+  out->rooms = out->bots / 2;
+  out->snapshot_rate = out->playing > 0 ? p_stats->snapshots / seconds / out->playing : 0;
+  double missing = p_stats->expected - p_stats->snapshots;
+  out->drop_percent = p_stats->expected > 0 && missing > 0 ? 100. * missing / p_stats->expected : 0;
+  out->packets_in = p_stats->datagrams_in / seconds;
+  out->packets_out = p_stats->datagrams_out / seconds;
+}
+
+/// Tells why the step did not hold up into buf of size bytes
+/// @returns false if it did hold up
+static bool step_failure(const LoadStep *p_step, const LoadConfig *p_cfg, char *buf, int size) {
+  double min_rate = LOAD_MIN_RATE_RATIO * p_cfg->send_rate;
+  if (0 == p_step->playing) {
+    snprintf(buf, size, "no bot is playing");
+  } else if (100. * p_step->waiting / p_step->bots > LOAD_MAX_WAITING_PERCENT) {
+    snprintf(buf, size, "%d of %d bots got no room", p_step->waiting, p_step->bots);
+  } else if (p_step->snapshot_rate < min_rate) {
+    snprintf(buf, size, "%.1f snapshots/s per bot, below %.1f", p_step->snapshot_rate, min_rate);
+  } else if (p_step->drop_percent >= LOAD_MAX_DROP_PERCENT) {
+    snprintf(buf, size, "%.2f%% of the snapshots dropped, %.2f%% allowed", p_step->drop_percent,
+             LOAD_MAX_DROP_PERCENT);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static void print_step(const LoadStep *p_step, const char *failure) {
+  printf("rooms %4d: bots %d (%d playing, %d waiting, %d starved), snapshots %.1f/s per bot, "
+         "drops %.2f%% (%ld undecodable), input to state ",
+         p_step->rooms, p_step->bots, p_step->playing, p_step->waiting, p_step->starved,
+         p_step->snapshot_rate, p_step->drop_percent, p_step->stats.undecodable);
+  if (p_step->stats.latency_count > 0) {
+    printf("p50 %.0f ms, p99 %.0f ms", latency_percentile(&p_step->stats, .5),
+           latency_percentile(&p_step->stats, .99));
+  } else {
+    printf("none");
+  }
+  printf(", %.0f packets/s in, %.0f out", p_step->packets_in, p_step->packets_out);
+  if (NULL != failure) {
+    printf("  SATURATED: %s", failure);
+  }
+  printf("\n");
+  fflush(stdout);
+}
+
+/// Sleeps until the time unless the run is stopped
+/// @returns false if it was
+static bool sleep_until(uint64_t deadline_ns) {
+  for (uint64_t now = time_now_ns(); now < deadline_ns && !load_should_stop; now = time_now_ns()) {
+    uint64_t left_ns = deadline_ns - now;
+    if (left_ns > 100000000ull) left_ns = 100000000ull;
+    struct timespec pause = { 0, (long)left_ns };
+    nanosleep(&pause, NULL);
+  }
+  return !load_should_stop;
+}
+
+/// Asks the workers for their share of the bots of the rooms
+static void set_rooms(LoadWorker *workers, int worker_count, int rooms) {
+  int bots = rooms * 2;
+  for (int i = 0; i < worker_count; ++i) {
+    LoadWorker *p_worker = &workers[i];
+    pthread_mutex_lock(&p_worker->lock);
+    p_worker->target_bot_count = bots / worker_count + (i < bots % worker_count);
+    pthread_mutex_unlock(&p_worker->lock);
+  }
+}
+
+/// Every bot has its own socket, so it needs as many descriptors
+static bool raise_file_limit(int bots) {
+  struct rlimit limit = {0};
+  if (0 != getrlimit(RLIMIT_NOFILE, &limit)) {
+    TraceLog(LOG_ERROR, "Could not get the file limit: %s", strerror(errno));
+    return false;
+  }
+
+  // the workers' epoll and timer and the standard ones
+  rlim_t needed = bots + 2 * LOAD_MAX_THREADS + 16;
+  if (limit.rlim_cur >= needed) return true;
+
+  limit.rlim_cur = limit.rlim_max < needed ? limit.rlim_max : needed;
+  if (0 != setrlimit(RLIMIT_NOFILE, &limit) || limit.rlim_cur < needed) {
+    TraceLog(LOG_ERROR, "%d bots need %lu files, the limit is %lu (ulimit -n)", bots,
+             (unsigned long)needed, (unsigned long)limit.rlim_cur);
+    return false;
+  }
+  return true;
+}
+
+static LoadConfig parse_args(int argc, char **argv) {
+  LoadConfig config = {0};
+  config.host = "127.0.0.1";
+  config.port = LOAD_DEFAULT_PORT;
+  config.thread_count = 1;
+  config.tick_rate = GAME_DEFAULT_TICK_RATE;
+  config.input_rate = GAME_DEFAULT_TICK_RATE;
+  config.start_rooms = LOAD_DEFAULT_START_ROOMS;
+  config.step_rooms = LOAD_DEFAULT_STEP_ROOMS;
+  config.max_rooms = LOAD_DEFAULT_MAX_ROOMS;
+  config.step_seconds = LOAD_DEFAULT_STEP_SECONDS;
+  config.pattern_period = LOAD_DEFAULT_PATTERN_PERIOD;
+  config.seed = 1;
+
+  shift_args(&argc, &argv);
+
+  while (argc > 0) {
+    char *arg = shift_args(&argc, &argv);
+    if (argc < 1) {
+      TraceLog(LOG_FATAL, "Value must be provided for %s", arg);
+    }
+    char *value = shift_args(&argc, &argv);
+
+    if (0 == strcmp(arg, "--host")) {
+      config.host = value;
+    } else if (0 == strcmp(arg, "--port")) {
+      config.port = args_int("--port", value, 1, 65535);
+    } else if (0 == strcmp(arg, "--threads")) {
+      config.thread_count = args_int("--threads", value, 1, LOAD_MAX_THREADS);
+    } else if (0 == strcmp(arg, "--tick-rate")) {
+      config.tick_rate = args_int("--tick-rate", value, 1, INT_MAX);
+    } else if (0 == strcmp(arg, "--send-rate")) {
+      config.send_rate = args_int("--send-rate", value, 1, INT_MAX);
+    } else if (0 == strcmp(arg, "--input-rate")) {
+      config.input_rate = args_int("--input-rate", value, 1, INT_MAX);
+    } else if (0 == strcmp(arg, "--rooms")) {
+      config.start_rooms = args_int("--rooms", value, 1, INT_MAX);
+    } else if (0 == strcmp(arg, "--rooms-step")) {
+      config.step_rooms = args_int("--rooms-step", value, 0, INT_MAX);
+    } else if (0 == strcmp(arg, "--max-rooms")) {
+      config.max_rooms = args_int("--max-rooms", value, 1, INT_MAX);
+    } else if (0 == strcmp(arg, "--step-seconds")) {
+      // the first second of a step is the warmup
+      config.step_seconds = args_int("--step-seconds", value, 2, INT_MAX);
+    } else if (0 == strcmp(arg, "--pattern")) {
+      if (0 == strcmp(value, "sweep")) config.pattern = LOAD_PATTERN_SWEEP;
+      else if (0 == strcmp(value, "random")) config.pattern = LOAD_PATTERN_RANDOM;
+      else if (0 == strcmp(value, "idle")) config.pattern = LOAD_PATTERN_IDLE;
+      else TraceLog(LOG_FATAL, "Pattern must be sweep, random or idle");
+    } else if (0 == strcmp(arg, "--pattern-period")) {
+      config.pattern_period = args_int("--pattern-period", value, 1, INT_MAX);
+    } else if (0 == strcmp(arg, "--seed")) {
+      config.seed = strtoull(value, NULL, 0);
+    } else {
+      TraceLog(LOG_FATAL, "Unknown argument %s", arg);
+    }
+  }
+
+  if (0 == config.send_rate) {
+    config.send_rate = config.tick_rate;
+  }
+  if (config.max_rooms < config.start_rooms) {
+    TraceLog(LOG_FATAL, "Rooms must be at most --max-rooms");
+  }
+
+  return config;
+}
+
+int main(int argc, char **argv) {
+  LoadConfig cfg = parse_args(argc, argv);
+  SetTraceLogLevel(LOG_WARNING);
+  int result = 1;
+  int initialized = 0;
+  int started = 0;
+
+  struct sigaction action = {0};
+  action.sa_handler = handle_stop_signal;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  LoadWorker *workers = calloc(cfg.thread_count, sizeof(LoadWorker));
+  pthread_t *threads = calloc(cfg.thread_count, sizeof(pthread_t));
+  LoadStep *p_step = calloc(1, sizeof(LoadStep));
+  LoadStep *p_last_ok = calloc(1, sizeof(LoadStep));
+  if (NULL == workers || NULL == threads || NULL == p_step || NULL == p_last_ok) {
+    TraceLog(LOG_ERROR, "Could not allocate %d workers", cfg.thread_count);
+    goto defer;
+  }
+
+  if (!raise_file_limit(cfg.max_rooms * 2)) {
+    goto defer;
+  }
+
+  cfg.host_addr_count = net_resolve(cfg.host, cfg.port, cfg.host_addrs, NET_RESOLVE_MAX_ADDRS);
+  if (cfg.host_addr_count < 0) {
+    goto defer;
+  }
+  if (0 == cfg.host_addr_count) {
+    TraceLog(LOG_ERROR, "The host %s has no address", cfg.host);
+    goto defer;
+  }
+
+  int bots_per_worker = (cfg.max_rooms * 2 + cfg.thread_count - 1) / cfg.thread_count;
+  for (; initialized < cfg.thread_count; ++initialized) {
+    if (!worker_init(&workers[initialized], initialized, &cfg, bots_per_worker)) {
+      // the one that failed half way is cleaned up too
+      initialized += 1;
+      goto defer;
+    }
+  }
+
+  printf("Loading %s:%d from %d threads, %d to %d rooms by %d, %d s a step, %d inputs/sec\n",
+         cfg.host, cfg.port, cfg.thread_count, cfg.start_rooms, cfg.max_rooms, cfg.step_rooms,
+         cfg.step_seconds, cfg.input_rate);
+  fflush(stdout);
+
+  for (; started < cfg.thread_count; ++started) {
+    if (0 != pthread_create(&threads[started], NULL, worker_main, &workers[started])) {
+      TraceLog(LOG_ERROR, "Could not start worker %d", started);
+      load_should_stop = 1;
+      break;
+    }
+  }
+
+  bool has_ok_step = false;
+  bool is_saturated = false;
+  for (int rooms = cfg.start_rooms; !load_should_stop && rooms <= cfg.max_rooms; rooms += cfg.step_rooms) {
+    set_rooms(workers, started, rooms);
+    uint64_t step_start = time_now_ns();
+    if (!sleep_until(step_start + LOAD_WARMUP_NS)) break;
+
+    reset_step(workers, started);
+    uint64_t measure_start = time_now_ns();
+    if (!sleep_until(step_start + cfg.step_seconds * 1000000000ull)) break;
+
+    measure_step(workers, started, &cfg, (time_now_ns() - measure_start) / 1e9, p_step);
+    char failure[128] = {0};
+    bool is_ok = !step_failure(p_step, &cfg, failure, sizeof(failure));
+    print_step(p_step, is_ok ? NULL : failure);
+    if (!is_ok) {
+      is_saturated = true;
+      break;
+    }
+    *p_last_ok = *p_step;
+    has_ok_step = true;
+    if (0 == cfg.step_rooms) break;
+  }
+  load_should_stop = 1;
+
+  for (int i = 0; i < started; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+
+  printf("\n");
+  if (has_ok_step) {
+    printf("%s %d rooms: %.0f packets/s from the host, %.0f to it, %.0f bytes/s from, %.0f to\n",
+           is_saturated ? "Saturated above" : "Held up to", p_last_ok->rooms,
+           p_last_ok->packets_in, p_last_ok->packets_out,
+           p_last_ok->stats.bytes_in / p_last_ok->seconds, p_last_ok->stats.bytes_out / p_last_ok->seconds);
+  } else if (is_saturated) {
+    printf("Saturated already at %d rooms\n", cfg.start_rooms);
+  }
+
+  result = started == cfg.thread_count ? 0 : 1;
+  for (int i = 0; i < started; ++i) {
+    if (!workers[i].is_ok) result = 1;
+  }
+
+defer:
+  for (int i = 0; i < initialized; ++i) {
+    worker_fini(&workers[i]);
+  }
+  free(p_last_ok);
+  free(p_step);
+  free(threads);
+  free(workers);
+  return result;
+}
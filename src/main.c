@@ -1,99 +1,59 @@
 #include <assert.h>
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <sys/resource.h>
 
 #include "raylib.h"
 #include "raymath.h"
 
+#include "args.h"
 #include "network.h"
-
-#ifndef WINDOW_SIDE
-#define WINDOW_SIDE 200
-#endif /* !WINDOW_SIDE */
-
-#define WINDOW_WIDTH_RATIO 4
-#define WINDOW_HEIGHT_RATIO 3
-
-#define WINDOW_WIDTH (int)(WINDOW_SIDE * WINDOW_WIDTH_RATIO)
-#define WINDOW_HEIGHT (int)(WINDOW_SIDE * WINDOW_HEIGHT_RATIO)
-
-#define PADDLE_HEIGHT (int)(WINDOW_SIDE / 2.67f)
-#define PADDLE_WIDTH (int)(WINDOW_SIDE / 13.33)
-#define MAX_PADDLE_SPEED (int)(WINDOW_SIDE / 0.39f)
-#define MIN_PADDLE_SPEED (int)(WINDOW_SIDE / 0.57f)
-#define PADDLE_SPEED (int)(WINDOW_SIDE / 0.5f)
-#define PADDLE_ACCELERATION 25.f
-#define PADDLE_FRICTION (PADDLE_ACCELERATION / 4)
-#define PADDLE_HIT_EFFECT_DURATION .25f
-
-#define BALL_SPEED (int)(WINDOW_SIDE / 0.44f)
-#define MAX_BALL_SPEED (int)(WINDOW_SIDE / 0.22f)
-#define MIN_BALL_SPEED (int)(WINDOW_SIDE / 0.60f)
-#define BALL_SIDES (int)(WINDOW_SIDE / 13.33f)
-
-#define TAIL_CAPACITY_BALL 15
-#define TAIL_CAPACITY_PADDLE 24
-#define TAIL_STRUCT(size) Vector2 tail[(size)]; int tail_begin; int tail_len
+#include "game.h"
+#include "batch.h"
+#include "timing.h"
+#include "runner.h"
+#include "replay.h"
+#include "rollback.h"
+#include "snapshot.h"
+#include "delta.h"
+#include "event_loop.h"
+#include "session.h"
+#include "net_thread.h"
+#include "net_quality.h"
+#include "clock_sync.h"
+#include "net_connect.h"
 
 #define WIN_SCORE_MAX 21
 
 #define BACKGROUND_COLOR CLITERAL(Color){ 30, 20, 40, 255 }// CLITERAL(Color){ 0, 37, 14, 255 }
 #define MAIN_UI_COLOR PURPLE
 #define SECOND_UI_COLOR PINK
+// The stats lines under the top line are this far apart
+#define UI_STATS_LINE_HEIGHT 20
 
-typedef struct {
-  Rectangle rect;
-  Color color;
-  float velocity;
-  float acceleration;
-  TAIL_STRUCT(TAIL_CAPACITY_PADDLE);
+#define HEADLESS_DEFAULT_TICKS 1000000
+#define DEFAULT_RENDER_FPS 60
+#define DEFAULT_REPLAY_SPEED 1.f
 
-  Rectangle hit_effect[3];
-  float hit_countdown;
-} Paddle;
+// One way latency of the simulated link of --bandwidth, in ticks
+#define BANDWIDTH_DEFAULT_LATENCY 3
+#define BANDWIDTH_MAX_LATENCY 120
+#define BANDWIDTH_UDP_IP_OVERHEAD 28
 
-typedef struct {
-  Rectangle rect;
-  Color color;
-  float speed;
-  float spin_factor;
-  Vector2 direction;
-  TAIL_STRUCT(TAIL_CAPACITY_BALL);
-} Ball;
-
-
-typedef enum {
-  MAIN_MENU_NULL,
-  MAIN_MENU_START,
-  MAIN_MENU_WIN_SCORE,
-  MAIN_MENU_EXIT,
-  MAIN_MENU_ITEMS_COUNT
-} MainMenuState;
-
-typedef struct GameContext GameContext;
-typedef void (*UpdateFn)(GameContext *ctx, float dt);
-
-struct GameContext {
-  Paddle paddles[2];
-  Ball ball;
-  int scores[2];
-  int win_score;
-  MainMenuState main_menu_state;
-  UpdateFn update;
-  UdpSocket server_sock;
-  UdpSocket client_sock;
-  int pressed_key[2];
-  bool is_paused;
-  bool should_exit;
-};
+// Players and spectators one host serves
+#define HOST_MAX_SESSIONS 64
 
+// A rollback client asks for the host's state again this often (seconds) until it comes
+#define CLIENT_RESYNC_INTERVAL .2
 
 typedef enum {
   GAME_LOCAL,
   GAME_NETWORK_HOST,
   GAME_NETWORK_CLIENT,
+  GAME_REPLAY,
 } GameKind;
 
 typedef struct {
@@ -101,167 +61,180 @@ typedef struct {
   GameKind game_kind;
   const char *host_addr;
   int host_port;
+  int tick_rate;
+  // snapshots the host sends a second, the tick rate by default
+  int send_rate;
+  int render_fps;
+  bool headless;
+  long headless_ticks;
+  int headless_matches;
+  int headless_threads;
+  bool headless_verify;
+  const char *record_path;
+  const char *replay_path;
+  float replay_speed;
+  bool rollback;
+  bool spectate;
+  NetBackend net_backend;
+  const char *net_csv_path;
+  bool bandwidth;
+  float bandwidth_loss;
+  int bandwidth_latency;
 } CmdConfig;
 
 Sound hit_sound;
 
+// the latest match is recorded if --record is given
+const char *replay_record_path = NULL;
+ReplayRecorder replay_recorder;
+ReplayReader replay_reader;
+float replay_speed = DEFAULT_REPLAY_SPEED;
+bool replay_is_finished = false;
+
+// client predicts with --rollback, the host always sends the keys it stepped with
+bool rollback_enabled = false;
+Rollback rollback;
+unsigned char host_sent_keys[NET_TICK_INPUTS_HISTORY];
+// the state the host's latest step made, its pongs carry the hash of it and
+// NET_CMD_RESYNC gets it whole
+GameState host_step_state;
+// a rollback client that lost inputs or whose state hashed differently waits for it
+bool client_wants_state = false;
+double client_state_asked = 0;
+
+// the host sends a snapshot every time the credit of --send-rate per tick makes up
+// a whole tick rate, and the events of a step right after it
+int host_send_rate = GAME_DEFAULT_TICK_RATE;
+int host_tick_rate = GAME_DEFAULT_TICK_RATE;
+int host_send_credit = 0;
+long host_snapshots_sent = 0;
+long host_events_sent = 0;
+
+// snapshots go delta encoded against the newest one the client acked.
+// A host keeps an encoder per session, --bandwidth plays both ends with these
+DeltaEncoder delta_encoder;
+DeltaDecoder delta_decoder;
+
+// every peer of the host socket, the first player plays the right paddle
+SessionTable host_sessions;
+int host_player = -1;
+
+// sent by the client with every command, so the host tells it from
+// an earlier client that had the same address
+uint16_t client_token;
+
+// the client resolves the host and races its addresses while the window stays up,
+// then connects with its role and plays with client_connected_update
+NetConnect *client_connect = NULL;
+const char *client_host = NULL;
+NetRole client_role = NET_ROLE_PLAYER;
+UpdateFn client_connected_update = NULL;
+
+// the client sends the keys of its latest ticks until the host acks them,
+// and acks the snapshots it received along with them
+InputSender input_sender;
+NetAck snapshot_ack;
+// tick of the newest key an interpolating client has sampled
+uint32_t client_input_tick = 0;
+// tick of the newest host event the client has taken
+uint32_t client_event_tick = 0;
+
+// the headless host sends and receives all datagrams of a tick through it
+// in one recvmmsg and one sendmmsg
+NetBatch *net_batch = NULL;
+
+// with a window the network I/O runs on its own thread (with its own batch),
+// so neither the frame nor vsync delay receiving and sending
+NetThread *net_thread = NULL;
+double net_io_start = 0;
+
+// health of the connection of the client, or of the host to its player.
+// F3 shows it, --net-csv logs it every second
+NetQuality net_quality;
+bool net_overlay_visible = false;
+
+// the client syncs to the host's clock with the pings and runs its ticks a bit faster
+// or slower, so its inputs reach the host just before the step that needs them
+ClockSync clock_sync;
+ClockAlign clock_align;
+// the host's steps, the snapshots are interpolated by when the host made them
+ClockTicks clock_ticks;
+// time_now_ns of the host's next step, its pongs tell the player when that is
+uint64_t host_next_step_ns = 0;
+
+// client without --rollback renders the host's positions a bit in the past
+bool interpolation_enabled = false;
+SnapshotBuffer snapshot_buffer;
+
 static void main_menu_update(GameContext *ctx, float dt);
 static void game_local_update(GameContext *ctx, float dt);
+static void game_client_connecting_update(GameContext *ctx, float dt);
 static void game_client_update(GameContext *ctx, float dt);
+static void game_client_rollback_update(GameContext *ctx, float dt);
 static void game_host_pending_update(GameContext *ctx, float dt);
 static void game_host_update(GameContext *ctx, float dt);
-static void game_draw_frame(GameContext *ctx, float dt);
+static bool host_handle_datagram(GameContext *ctx, const char *buf, int len,
+                                 const struct sockaddr_in6 *p_from, uint64_t arrival, uint64_t now);
+static void host_on_session_expired(void *p_user, int id);
+static void game_replay_update(GameContext *ctx, float dt);
+static bool game_run_fixed_steps(GameContext *ctx, float dt, void (*before_step)(GameContext *ctx),
+                                 void (*after_step)(GameContext *ctx, unsigned events));
+static void game_draw_frame(GameContext *ctx, float dt, float alpha);
 void game_fini(GameContext *ctx);
 
 
-static void clamp_rect_within_screen(Rectangle *p_rect) {
-  p_rect->y = Clamp(p_rect->y, 0, WINDOW_HEIGHT - p_rect->height);
-  p_rect->x = Clamp(p_rect->x, 0, WINDOW_WIDTH - p_rect->width);
-}
-
-static void handle_collision(Ball *p_ball, Paddle *p_paddle) {
-  p_ball->color = p_paddle->color;
-  p_ball->direction.x = -p_ball->direction.x;
-  p_ball->direction.y = -p_ball->direction.y;
-
-  float collision_point = (p_ball->rect.y + p_ball->rect.height / 2) - (p_paddle->rect.y + p_paddle->rect.height / 2);
-  float ball_speed_factor = 1.0f;
-  float reflection_angle = 0.f;
-
-  bool are_opposite_Y_directions = (p_ball->direction.y * p_paddle->velocity) < 0.f
-    || (p_ball->direction.y == 0 && p_paddle->velocity != 0)
-    || (p_ball->direction.y != 0 && p_paddle->velocity == 0);
-  float speed_diff = fabsf(p_ball->speed - fabsf(p_paddle->velocity));
-  p_ball->spin_factor = 0.020f * (powf(speed_diff, 0.5f) + 0.5f) * are_opposite_Y_directions;
-  p_ball->direction = Vector2Rotate(p_ball->direction, -p_ball->spin_factor);
-
-  float collision_point_abs = fabsf(collision_point);
-  if (collision_point_abs <= p_paddle->rect.height * 0.35f) {
-    ball_speed_factor += fabsf(collision_point / (p_paddle->rect.height * 0.25f)) * 0.5f;
-  } else if (collision_point_abs > p_paddle->rect.height * 0.45f) {
-    ball_speed_factor -= fabsf(collision_point / (p_paddle->rect.height * 0.75f)) * 0.5f;
-  }
-
-  if (collision_point_abs <= p_paddle->rect.height * 0.35f) {
-    reflection_angle = collision_point / (p_paddle->rect.height * 0.25f) * 0.2f * !!p_paddle->velocity;
-  } else {
-    reflection_angle = collision_point / (p_paddle->rect.height * 0.75f) * 0.2f * !!p_paddle->velocity;
-  }
-
-  p_ball->speed = Clamp(p_ball->speed * ball_speed_factor, MIN_BALL_SPEED, MAX_BALL_SPEED);
-  p_ball->direction = Vector2Rotate(p_ball->direction, reflection_angle);
-
-  // effects
-  PlaySound(hit_sound);
-  p_paddle->hit_countdown = PADDLE_HIT_EFFECT_DURATION;
-  for (int i = 0; i < 3; ++i) {
-    p_paddle->hit_effect[i] = CLITERAL(Rectangle){
-      .x = p_paddle->rect.x - 2 * (i + 1),
-      .y = p_paddle->rect.y - 2 * (i + 1),
-      .width = p_paddle->rect.width + 4 * (i + 1),
-      .height = p_paddle->rect.height + 4 * (i + 1),
-    };
-  }
-}
-
-
-static void handle_pressed_key(GameContext *ctx, int key_index) {
-  switch (ctx->pressed_key[key_index]) {
-    case 0: ctx->paddles[key_index].acceleration = 0; break;
-    case KEY_DOWN: ctx->paddles[key_index].acceleration = PADDLE_ACCELERATION; break;
-    case KEY_UP: ctx->paddles[key_index].acceleration = -PADDLE_ACCELERATION; break;
-  }
-}
-
 static void handle_input(GameContext *ctx, float dt) {
   (void)dt;
 
   if (IsKeyReleased(KEY_DOWN) || IsKeyReleased(KEY_UP)) {
-    ctx->pressed_key[1] = 0;
-    ctx->paddles[1].acceleration = 0;
+    ctx->state.pressed_key[1] = 0;
+    ctx->state.paddles[1].acceleration = 0;
   }
 
   if (IsKeyReleased(KEY_W) || IsKeyReleased(KEY_S)) {
-    ctx->pressed_key[0] = 0;
-    ctx->paddles[0].acceleration = 0;
+    ctx->state.pressed_key[0] = 0;
+    ctx->state.paddles[0].acceleration = 0;
   }
 
   if (IsKeyDown(KEY_S)) {
-    ctx->pressed_key[0] = KEY_DOWN;
-    ctx->paddles[0].acceleration = PADDLE_ACCELERATION;
+    ctx->state.pressed_key[0] = KEY_DOWN;
+    ctx->state.paddles[0].acceleration = PADDLE_ACCELERATION;
   }
 
   if (IsKeyDown(KEY_W)) {
-    ctx->pressed_key[0] = KEY_UP;
-    ctx->paddles[0].acceleration = -PADDLE_ACCELERATION;
+    ctx->state.pressed_key[0] = KEY_UP;
+    ctx->state.paddles[0].acceleration = -PADDLE_ACCELERATION;
   }
 
   if (IsKeyDown(KEY_DOWN)) {
-    ctx->pressed_key[1] = KEY_DOWN;
-    ctx->paddles[1].acceleration = PADDLE_ACCELERATION;
+    ctx->state.pressed_key[1] = KEY_DOWN;
+    ctx->state.paddles[1].acceleration = PADDLE_ACCELERATION;
   }
 
   if (IsKeyDown(KEY_UP)) {
-    ctx->pressed_key[1] = KEY_UP;
-    ctx->paddles[1].acceleration = -PADDLE_ACCELERATION;
+    ctx->state.pressed_key[1] = KEY_UP;
+    ctx->state.paddles[1].acceleration = -PADDLE_ACCELERATION;
   }
 }
 
 static GameContext game_init(const CmdConfig *p_cfg, const char *window_name) {
-  SetTargetFPS(60);
+  SetTargetFPS(p_cfg->render_fps);
   InitWindow(WINDOW_WIDTH, WINDOW_HEIGHT, window_name);
   InitAudioDevice();
 
   hit_sound = LoadSound("resources/shoot-small_4.wav");
 
-  Paddle p1 = {
-    .rect = { 
-      .x = 30, 
-      .y = (float)WINDOW_HEIGHT / 2 - (float)PADDLE_HEIGHT / 2, 
-      .width = PADDLE_WIDTH, 
-      .height = PADDLE_HEIGHT 
-    },
-    .color = SKYBLUE,
-  };
-
-  Paddle p2 = {
-    .rect = { 
-      .x = WINDOW_WIDTH - 30 - PADDLE_WIDTH, 
-      .y = (float)WINDOW_HEIGHT / 2 - (float)PADDLE_HEIGHT / 2, 
-      .width = PADDLE_WIDTH, 
-      .height = PADDLE_HEIGHT 
-    },
-    .color = MAGENTA,
-  };
-
-  Ball b = {
-    .rect = { 
-      .x = 30 + PADDLE_WIDTH, 
-      .y = (float)WINDOW_HEIGHT / 2 - (float)BALL_SIDES / 2, 
-      .width = BALL_SIDES, 
-      .height = BALL_SIDES
-    },
-    .color = SKYBLUE,
-    .speed = BALL_SPEED,
-    .spin_factor = 0.f,
-    .direction = {
-      .x = 1.f,
-      .y = 0.f
-    }
-  };
-
   UpdateFn update = NULL;
   UdpSocket server_sock = {0};
-  UdpSocket client_sock = {0};
 
   switch (p_cfg->game_kind) {
     case GAME_LOCAL: update = main_menu_update; break;
     case GAME_NETWORK_CLIENT: {
-      update = game_client_update; 
-      if (!connect_to_host_udp(p_cfg->host_addr, p_cfg->host_port, &client_sock)) {
-        TraceLog(LOG_FATAL, "Could not connect to the host");
-      }
-      net_send_cmd_wo_args(&client_sock, NET_CMD_CONNECT);
+      // a spectator has no paddle to predict
+      client_connected_update = p_cfg->rollback && !p_cfg->spectate
+        ? game_client_rollback_update
+        : game_client_update;
+      update = game_client_connecting_update;
     } break;
     case GAME_NETWORK_HOST: {
       update = game_host_pending_update; 
@@ -269,53 +242,190 @@ static GameContext game_init(const CmdConfig *p_cfg, const char *window_name) {
         TraceLog(LOG_FATAL, "Could not create a UDP server");
       }
     } break;
+    case GAME_REPLAY: update = game_replay_update; break;
   }
 
   assert(NULL != update || "Unknown game_kind");
 
-  GameContext ctx = {
-    .paddles = {p1, p2},
-    .ball = b,
-    .scores = {0},
-    .win_score = 11,
-    .update = update,
-    .server_sock = server_sock,
-    .client_sock = client_sock,
-    .pressed_key = {0},
-    .main_menu_state = MAIN_MENU_START,
-    .is_paused = false,
-    .should_exit = false,
-  };
+  GameContext ctx = {0};
+  if (GAME_REPLAY == p_cfg->game_kind) {
+    // replays run at the rate they were recorded with
+    ctx = replay_reader_initial_context(&replay_reader);
+  } else {
+    ctx = game_context_create();
+    ctx.tick_dt = 1.f / p_cfg->tick_rate;
+  }
+  ctx.update = update;
+  ctx.server_sock = server_sock;
+
+  if (GAME_NETWORK_HOST == p_cfg->game_kind) {
+    net_thread = net_thread_start(server_sock.fd);
+    if (NULL == net_thread) {
+      TraceLog(LOG_FATAL, "Could not start the network thread");
+    }
+    if (!session_table_init(&host_sessions, HOST_MAX_SESSIONS, SESSION_DEFAULT_TIMEOUT)) {
+      TraceLog(LOG_FATAL, "Could not allocate sessions");
+    }
+  } else if (GAME_NETWORK_CLIENT == p_cfg->game_kind) {
+    delta_decoder_init(&delta_decoder);
+    input_sender_init(&input_sender);
+    memset(&snapshot_ack, 0, sizeof(snapshot_ack));
+    clock_sync_init(&clock_sync);
+    clock_align_init(&clock_align, ctx.tick_dt);
+    clock_ticks_init(&clock_ticks, ctx.tick_dt);
+
+    // the network thread starts on the socket of the address that answers first
+    client_token = (uint16_t)(time_now_ns() ^ getpid());
+    client_role = p_cfg->spectate ? NET_ROLE_SPECTATOR : NET_ROLE_PLAYER;
+    client_host = p_cfg->host_addr;
+    client_connect = net_connect_start(p_cfg->host_addr, p_cfg->host_port, client_token);
+    if (NULL == client_connect) {
+      TraceLog(LOG_FATAL, "Could not start connecting to the host");
+    }
+  }
+  if (GAME_NETWORK_HOST == p_cfg->game_kind || GAME_NETWORK_CLIENT == p_cfg->game_kind) {
+    net_io_start = time_now_seconds();
+    net_quality_init(&net_quality, net_io_start);
+    if (NULL != p_cfg->net_csv_path && !net_quality_open_csv(&net_quality, p_cfg->net_csv_path)) {
+      TraceLog(LOG_WARNING, "Connection quality is not logged");
+    }
+  }
+
+  if (GAME_NETWORK_CLIENT == p_cfg->game_kind && p_cfg->rollback && !p_cfg->spectate) {
+    rollback_enabled = true;
+    rollback_init(&rollback, &ctx.state, 1);
+  } else if (GAME_NETWORK_CLIENT == p_cfg->game_kind) {
+    interpolation_enabled = true;
+    snapshot_buffer_init(&snapshot_buffer);
+  }
 
   return ctx;
 }
 
 
 
-static char *shift_args(int *argc, char ***argv) {
-  if (0 == *argc) return NULL;
-
-  char *arg = *argv[0];
-  *argv += 1;
-  *argc -= 1;
-  return arg;
-}
-
 static CmdConfig parse_args(int argc, char **argv) {
   CmdConfig config = {0};
+  config.headless_ticks = HEADLESS_DEFAULT_TICKS;
+  config.headless_matches = 1;
+  config.tick_rate = GAME_DEFAULT_TICK_RATE;
+  config.render_fps = DEFAULT_RENDER_FPS;
+  config.replay_speed = DEFAULT_REPLAY_SPEED;
+  config.bandwidth_latency = BANDWIDTH_DEFAULT_LATENCY;
 
   config.prog = shift_args(&argc, &argv);
 
   while (argc > 0) {
     char *arg = shift_args(&argc, &argv);
-    if (0 == strncmp(arg, "-h", 2)) {
+    if (0 == strcmp(arg, "--headless")) {
+      config.headless = true;
+    } else if (0 == strcmp(arg, "--ticks")) {
+      if (argc < 1) {
+        TraceLog(LOG_FATAL, "Number of ticks must be provided in command line argument: "
+                 "./ping_pong --headless --ticks N");
+      }
+      config.headless_ticks = args_long("--ticks", shift_args(&argc, &argv), 1, LONG_MAX);
+    } else if (0 == strcmp(arg, "--matches")) {
+      if (argc < 1) {
+        TraceLog(LOG_FATAL, "Number of matches must be provided in command line argument: "
+                 "./ping_pong --headless --matches N");
+      }
+      config.headless_matches = args_int("--matches", shift_args(&argc, &argv), 1, INT_MAX);
+    } else if (0 == strcmp(arg, "--threads")) {
+      if (argc < 1) {
+        TraceLog(LOG_FATAL, "Number of threads must be provided in command line argument: "
+                 "./ping_pong --headless --threads N");
+      }
+      config.headless_threads = args_int("--threads", shift_args(&argc, &argv), 1, RUNNER_MAX_WORKERS);
+    } else if (0 == strcmp(arg, "--verify")) {
+      config.headless_verify = true;
+    } else if (0 == strcmp(arg, "--tick-rate")) {
+      if (argc < 1) {
+        TraceLog(LOG_FATAL, "Simulation rate must be provided in command line argument: "
+                 "./ping_pong --tick-rate HZ");
+      }
+      config.tick_rate = args_int("--tick-rate", shift_args(&argc, &argv), 1, INT_MAX);
+    } else if (0 == strcmp(arg, "--send-rate")) {
+      if (argc < 1) {
+        TraceLog(LOG_FATAL, "Snapshot rate must be provided in command line argument: "
+                 "./ping_pong -h port --send-rate HZ");
+      }
+      config.send_rate = args_int("--send-rate", shift_args(&argc, &argv), 1, INT_MAX);
+    } else if (0 == strcmp(arg, "--fps")) {
+      if (argc < 1) {
+        TraceLog(LOG_FATAL, "Render rate must be provided in command line argument: "
+                 "./ping_pong --fps FPS");
+      }
+      config.render_fps = args_int("--fps", shift_args(&argc, &argv), 1, INT_MAX);
+    } else if (0 == strcmp(arg, "--bandwidth")) {
+      config.headless = true;
+      config.bandwidth = true;
+    } else if (0 == strcmp(arg, "--loss")) {
+      if (argc < 1) {
+        TraceLog(LOG_FATAL, "Loss must be provided in command line argument: "
+                 "./ping_pong --bandwidth --loss PERCENT");
+      }
+      char *value = shift_args(&argc, &argv);
+      config.bandwidth_loss = args_double("--loss", value);
+      if (config.bandwidth_loss < 0 || config.bandwidth_loss >= 100) {
+        TraceLog(LOG_FATAL, "--loss must be in range [0, 100), got %s", value);
+      }
+    } else if (0 == strcmp(arg, "--latency")) {
+      if (argc < 1) {
+        TraceLog(LOG_FATAL, "Latency must be provided in command line argument: "
+                 "./ping_pong --bandwidth --latency TICKS");
+      }
+      config.bandwidth_latency = args_int("--latency", shift_args(&argc, &argv), 1, BANDWIDTH_MAX_LATENCY);
+    } else if (0 == strcmp(arg, "--rollback")) {
+      config.rollback = true;
+    } else if (0 == strcmp(arg, "--spectate")) {
+      config.spectate = true;
+    } else if (0 == strcmp(arg, "--net-backend")) {
+      if (argc < 1) {
+        TraceLog(LOG_FATAL, "Network backend must be provided in command line argument: "
+                 "./ping_pong --net-backend syscall|io_uring");
+      }
+      if (!net_parse_backend(shift_args(&argc, &argv), &config.net_backend)) {
+        TraceLog(LOG_FATAL, "Network backend must be syscall or io_uring");
+      }
+    } else if (0 == strcmp(arg, "--net-csv")) {
+      if (argc < 1) {
+        TraceLog(LOG_FATAL, "CSV file must be provided in command line argument: "
+                 "./ping_pong --net-csv FILE");
+      }
+      config.net_csv_path = shift_args(&argc, &argv);
+    } else if (0 == strcmp(arg, "--record")) {
+      if (argc < 1) {
+        TraceLog(LOG_FATAL, "Replay file must be provided in command line argument: "
+                 "./ping_pong --record FILE");
+      }
+      config.record_path = shift_args(&argc, &argv);
+    } else if (0 == strcmp(arg, "--replay")) {
+      config.game_kind = GAME_REPLAY;
+
+      if (argc < 1) {
+        TraceLog(LOG_FATAL, "Replay file must be provided in command line argument: "
+                 "./ping_pong --replay FILE");
+      }
+      config.replay_path = shift_args(&argc, &argv);
+    } else if (0 == strcmp(arg, "--replay-speed")) {
+      if (argc < 1) {
+        TraceLog(LOG_FATAL, "Playback speed must be provided in command line argument: "
+                 "./ping_pong --replay FILE --replay-speed X");
+      }
+      char *value = shift_args(&argc, &argv);
+      config.replay_speed = args_double("--replay-speed", value);
+      if (config.replay_speed <= 0) {
+        TraceLog(LOG_FATAL, "--replay-speed must be positive, got %s", value);
+      }
+    } else if (0 == strncmp(arg, "-h", 2)) {
       config.game_kind = GAME_NETWORK_HOST;
 
       if (argc < 1) {
         TraceLog(LOG_FATAL, "Port must be provided in command line argument: "
                  "./ping_pong -h port");
       }
-      config.host_port = atoi(shift_args(&argc, &argv));
+      config.host_port = args_int("port", shift_args(&argc, &argv), 1, 65535);
     } else if (0 == strncmp(arg, "-c", 2)) {
       config.game_kind = GAME_NETWORK_CLIENT;
 
@@ -324,206 +434,830 @@ static CmdConfig parse_args(int argc, char **argv) {
                  "./ping_pong -c host port");
       }
       config.host_addr = shift_args(&argc, &argv);
-      config.host_port = atoi(shift_args(&argc, &argv));
+      config.host_port = args_int("port", shift_args(&argc, &argv), 1, 65535);
     }
   }
 
+  if (0 == config.send_rate) {
+    config.send_rate = config.tick_rate;
+  }
+  // every snapshot brings the keys of the ticks since the previous one
+  if (config.send_rate > config.tick_rate || config.send_rate * NET_TICK_INPUTS_HISTORY < config.tick_rate) {
+    TraceLog(LOG_FATAL, "Snapshot rate must be in range [%d, %d] Hz at %d ticks/sec",
+             (config.tick_rate + NET_TICK_INPUTS_HISTORY - 1) / NET_TICK_INPUTS_HISTORY,
+             config.tick_rate, config.tick_rate);
+  }
+
   return config;
 }
 
 
+/// Queues the keys the host has not acked with the snapshot acks
+static void client_queue_input(GameContext *ctx) {
+  NetInput input = {0};
+  if (!input_sender_build(&input_sender, &input)) return;
+  input.snapshot_ack = snapshot_ack;
+
+  char buf[NET_INPUT_MAX_SIZE] = {0};
+  int len = net_encode_input(buf, &input, client_token);
+  net_thread_queue(net_thread, &ctx->client_sock.addr, buf, len);
+}
+
+/// Asks the host for its state every CLIENT_RESYNC_INTERVAL while the rollback client waits for it
+static void client_queue_resync(GameContext *ctx) {
+  double now = time_now_seconds();
+  if (!client_wants_state || now - client_state_asked < CLIENT_RESYNC_INTERVAL) return;
+  client_state_asked = now;
+
+  char buf[NET_CMD_SIZE] = {0};
+  int len = net_encode_resync(buf, client_token);
+  net_thread_queue(net_thread, &ctx->client_sock.addr, buf, len);
+}
+
+/// Counts the second of net_quality and queues a ping to the peer (if not NULL) once it is due
+static void net_quality_tick(const struct sockaddr_in6 *p_peer, uint16_t token) {
+  double now = time_now_seconds();
+  NetThreadStats stats = net_thread_stats(net_thread);
+  net_quality_update(&net_quality, now, &stats.io);
+
+  NetPing ping = {0};
+  if (NULL != p_peer && net_quality_ping(&net_quality, now, &ping)) {
+    char buf[NET_PING_SIZE] = {0};
+    int len = net_encode_ping(buf, NET_CMD_PING, &ping, token);
+    net_thread_queue(net_thread, p_peer, buf, len);
+  }
+}
+
+/// Syncs the clock with the exchange of the pong, paces the ticks by the host's input tick
+static void client_on_pong(const NetPing *p_pong, double arrival) {
+  if (0 == p_pong->peer_time_ns) return;
+
+  double host_received = p_pong->peer_time_ns * 1e-9;
+  bool had_tick_time = clock_ticks_has_time(&clock_ticks, &clock_sync);
+  bool was_converged = clock_sync.is_converged;
+  clock_sync_add(&clock_sync, p_pong->time_ns * 1e-9, host_received,
+                 host_received + p_pong->hold_ns * 1e-9, arrival);
+  if (!was_converged && clock_sync.is_converged) {
+    TraceLog(LOG_INFO, "Clock synced with the host in %.2f s: offset %+.3f ms, drift %+.1f ppm, error %.3f ms",
+             clock_sync.converge_time, clock_sync.offset * 1000., clock_sync.drift * 1e6, clock_sync.error * 1000.);
+  }
+
+  if (0 != p_pong->input_tick) {
+    clock_align_on_host_tick(&clock_align, &clock_sync, p_pong->input_tick,
+                             host_received + p_pong->input_delay_ns * 1e-9, net_quality.jitter);
+  }
+
+  clock_ticks_on_host_step(&clock_ticks, p_pong->step_tick, host_received + p_pong->input_delay_ns * 1e-9);
+  if (rollback_enabled && 0 != p_pong->state_tick) {
+    rollback_expect_hash(&rollback, p_pong->state_tick, p_pong->state_hash);
+  }
+  if (!had_tick_time && clock_ticks_has_time(&clock_ticks, &clock_sync)) {
+    // the snapshots so far are stamped with their arrival, they do not mix with the next ones
+    snapshot_buffer_init(&snapshot_buffer);
+  }
+}
+
+/// Answers the host's ping, takes the round trip of a pong
+/// @returns false if the message is neither
+static bool client_handle_ping(GameContext *ctx, const NetMessage *p_message) {
+  NetPing ping = {0};
+  if (!net_decode_ping(p_message->buf, p_message->len, &ping)) {
+    return false;
+  }
+
+  if (NET_CMD_PONG == p_message->buf[0]) {
+    net_quality_on_pong(&net_quality, &ping, p_message->time);
+    client_on_pong(&ping, p_message->time);
+    return true;
+  }
+
+  net_quality_on_ping(&net_quality, &ping);
+  ping.received = net_quality.peer_received;
+  ping.hold_ns = (uint32_t)((time_now_seconds() - p_message->time) * 1e9);
+  ping.peer_time_ns = (uint64_t)(p_message->time * 1e9);
+  char buf[NET_PING_SIZE] = {0};
+  int len = net_encode_ping(buf, NET_CMD_PONG, &ping, client_token);
+  net_thread_queue(net_thread, &ctx->client_sock.addr, buf, len);
+  return true;
+}
+
+/// Drops the client's rendering of the host and lets it play locally from the menu
+static void client_back_to_menu(GameContext *ctx) {
+  rollback_enabled = false;
+  client_wants_state = false;
+  interpolation_enabled = false;
+  ctx->state = game_state_create();
+  ctx->accumulator = 0.f;
+  ctx->update = main_menu_update;
+}
+
+/// The host closed the session: the opponent left the room of ping_pong_server
+/// @returns false if the message is not NET_CMD_CLOSED
+static bool client_handle_closed(GameContext *ctx, const NetMessage *p_message) {
+  if (NET_CMD_CLOSED != p_message->buf[0] || p_message->len < (int)NET_CMD_SIZE) {
+    return false;
+  }
+  TraceLog(LOG_WARNING, "The host closed the match, the opponent left");
+  client_back_to_menu(ctx);
+  return true;
+}
+
+/// Acks the snapshot, takes the host's ack of the inputs it brought
+static void client_on_snapshot(const NetSnapshot *p_snapshot) {
+  net_ack_mark(&snapshot_ack, p_snapshot->tick);
+  input_sender_ack(&input_sender, &p_snapshot->input_ack);
+}
+
+/// Takes a host event as soon as it arrives: plays the hit, shows the scores and
+/// lets the ball go through where the event was between the snapshots
+/// @returns false if the message is not an event
+static bool client_handle_event(GameContext *ctx, const NetMessage *p_message) {
+  NetEvent event = {0};
+  if (!net_decode_event(p_message->buf, p_message->len, &event)) {
+    return false;
+  }
+  if (0 != client_event_tick && (int32_t)(event.tick - client_event_tick) <= 0) {
+    return true;
+  }
+  client_event_tick = event.tick;
+
+  if (event.events & GAME_EVENT_PADDLE_HIT) {
+    PlaySound(hit_sound);
+  }
+  for (int i = 0; i < 2; ++i) {
+    ctx->state.scores[i] = event.scores[i];
+  }
+  ctx->state.ball.speed = event.ball_speed;
+  ctx->state.ball.direction = CLITERAL(Vector2){ event.ball_direction[0], event.ball_direction[1] };
+
+  Vector2 position = { event.ball_position[0], event.ball_position[1] };
+  Vector2 velocity = Vector2Scale(ctx->state.ball.direction, event.ball_speed);
+  double time = clock_ticks_local_time(&clock_ticks, &clock_sync, event.tick, p_message->time);
+  snapshot_buffer_push_event(&snapshot_buffer, event.tick, time, position, velocity);
+  return true;
+}
+
+/// Buffers the snapshots the host sends by the time the host stepped to them
+/// and renders them interpolated at a delay that follows the network jitter
 static void game_client_update(GameContext *ctx, float dt) {
-  bool try_recieve = true;
-  bool enteties_updated[3] = {0};
-  char buf[NET_BUF_SIZE] = {0};
+  NetMessage message = {0};
+  while (net_thread_recv(net_thread, &message)) {
+    if (client_handle_ping(ctx, &message)) continue;
+    if (client_handle_event(ctx, &message)) continue;
+    if (client_handle_closed(ctx, &message)) {
+      game_draw_frame(ctx, dt, 1.f);
+      return;
+    }
 
-  net_send_input(&ctx->client_sock, ctx->pressed_key[1]);
-
-  while (try_recieve) {
-    if (!net_recv_cmd(&ctx->client_sock, buf)) return;
-
-    switch (buf[0]) {
-      case NET_CMD_UPDATE_POSITION: {
-        GameEntity e = buf[1];
-        try_recieve = !enteties_updated[e];
-        enteties_updated[e] = true;
-        switch (e) {
-          case GE_PADDLE_1: {
-            ctx->paddles[0].rect.x = *(float*)&buf[2];
-            ctx->paddles[0].rect.y = *(float*)&buf[2 + sizeof(float)];
-          } break;
-          case GE_PADDLE_2: {
-            ctx->paddles[1].rect.x = *(float*)&buf[2];
-            ctx->paddles[1].rect.y = *(float*)&buf[2 + sizeof(float)];
-          } break;
-          case GE_BALL: {
-            ctx->ball.rect.x = *(float*)&buf[2];
-            ctx->ball.rect.y = *(float*)&buf[2 + sizeof(float)];
-          } break;
-        }
-      } break;
-      default: TraceLog(LOG_WARNING, "Client got unknown message"); try_recieve = false;
+    NetSnapshot snapshot = {0};
+    if (!delta_decode(&delta_decoder, message.buf, message.len, &snapshot)) {
+      // snapshots with a lost baseline are just skipped, the host moves on to a newer one.
+      // NET_CMD_READY of ping_pong_server does not matter, the host's snapshots tell everything
+      if (NET_CMD_DELTA_SNAPSHOT != message.buf[0] && NET_CMD_READY != message.buf[0]) {
+        TraceLog(LOG_WARNING, "Client got unknown message");
+      }
+      continue;
+    }
+    client_on_snapshot(&snapshot);
+
+    Vector2 positions[SNAPSHOT_ENTITIES] = {0};
+    for (int i = 0; i < SNAPSHOT_ENTITIES; ++i) {
+      positions[i] = CLITERAL(Vector2){ snapshot.positions[i][0], snapshot.positions[i][1] };
+    }
+
+    double time = clock_ticks_local_time(&clock_ticks, &clock_sync, snapshot.tick, message.time);
+    if (snapshot_buffer_push(&snapshot_buffer, snapshot.tick, time, message.time, positions)) {
+      // the speeds shown and the tails follow the newest snapshot
+      for (int i = 0; i < 2; ++i) {
+        ctx->state.paddles[i].velocity = snapshot.velocities[i][1];
+        ctx->state.scores[i] = snapshot.scores[i];
+      }
+      Vector2 ball_velocity = { snapshot.velocities[GE_BALL][0], snapshot.velocities[GE_BALL][1] };
+      ctx->state.ball.speed = Vector2Length(ball_velocity);
+      if (ctx->state.ball.speed > 0) {
+        ctx->state.ball.direction = Vector2Scale(ball_velocity, 1.f / ctx->state.ball.speed);
+      }
     }
   }
 
-  game_draw_frame(ctx, dt);
+  // the key is sampled at the tick rate (as paced to the host), the host applies one per tick
+  uint32_t sent_tick = client_input_tick;
+  ctx->accumulator += fminf(dt, MAX_FRAME_TIME) * (float)clock_align.scale;
+  while (ctx->accumulator >= ctx->tick_dt) {
+    ctx->accumulator -= ctx->tick_dt;
+    input_sender_push(&input_sender, ++client_input_tick, game_key_pack(ctx->state.pressed_key[1]));
+  }
+  if (sent_tick != client_input_tick) {
+    client_queue_input(ctx);
+    clock_align_on_tick(&clock_align, client_input_tick, time_now_seconds());
+  }
+  net_quality_tick(&ctx->client_sock.addr, client_token);
+  net_thread_flush(net_thread);
+
+  double now = time_now_seconds();
+  Vector2 positions[SNAPSHOT_ENTITIES] = {0};
+  if (snapshot_buffer_sample(&snapshot_buffer, now, dt, positions)) {
+    for (int i = 0; i < 2; ++i) {
+      ctx->state.paddles[i].rect.x = positions[i].x;
+      ctx->state.paddles[i].rect.y = positions[i].y;
+      ctx->paddles[i].prev_rect = ctx->state.paddles[i].rect;
+    }
+    ctx->state.ball.rect.x = positions[GE_BALL].x;
+    ctx->state.ball.rect.y = positions[GE_BALL].y;
+    ctx->ball.prev_rect = ctx->state.ball.rect;
+  }
+
+  game_draw_frame(ctx, dt, 1.f);
+}
+
+/// Simulates right away with the local input and the predicted host input,
+/// rolls back and re-simulates once the keys the host stepped with differ
+static void game_client_rollback_update(GameContext *ctx, float dt) {
+  // same priority as handle_input
+  int local_key = IsKeyDown(KEY_UP) ? KEY_UP : IsKeyDown(KEY_DOWN) ? KEY_DOWN : 0;
+
+  NetMessage message = {0};
+  while (net_thread_recv(net_thread, &message)) {
+    const char *buf = message.buf;
+    int len = message.len;
+    if (client_handle_ping(ctx, &message)) continue;
+    if (client_handle_closed(ctx, &message)) {
+      game_draw_frame(ctx, dt, 1.f);
+      return;
+    }
+    // the client steps the match itself, the events happen in its own steps
+    if (NET_CMD_EVENT == buf[0]) continue;
+    if (NET_CMD_STATE == buf[0]) {
+      // the answer to an earlier request may come after the state was already taken
+      GameState host_state = {0};
+      if (!client_wants_state || !game_state_decode(buf, len, &host_state)) continue;
+
+      client_wants_state = false;
+      client_state_asked = 0;
+      if (!rollback_resync(&rollback, ctx, &host_state)) {
+        TraceLog(LOG_ERROR, "Could not resync with the host at tick %u from tick %u, leaving the match",
+                 host_state.tick, ctx->state.tick);
+        client_back_to_menu(ctx);
+        game_draw_frame(ctx, dt, 1.f);
+        return;
+      }
+      continue;
+    }
+    if (NET_CMD_READY == buf[0] && len >= (int)NET_CMD_SIZE) {
+      // ping_pong_server tells which paddle is ours. Nothing is confirmed before the match
+      // starts, so the ticks predicted for the other paddle are simply started over
+      int local_index = buf[1] ? 1 : 0;
+      if (local_index != rollback.local_index && 0 == rollback.confirmed_tick
+        && (0 == ctx->state.tick || game_state_restore(&rollback.ring, 0, &ctx->state))) {
+        rollback_init(&rollback, &ctx->state, local_index);
+      }
+      continue;
+    }
+
+    NetSnapshot snapshot = {0};
+    if (!delta_decode(&delta_decoder, buf, len, &snapshot)) {
+      // snapshots with a lost baseline are just skipped, the host moves on to a newer one
+      if (NET_CMD_DELTA_SNAPSHOT != buf[0]) TraceLog(LOG_WARNING, "Client got unknown message");
+      continue;
+    }
+    client_on_snapshot(&snapshot);
+    // the inputs go on from the host's state once it comes
+    if (client_wants_state) continue;
+
+    // only the inputs are needed, the client simulates the match itself
+    for (int i = snapshot.input_count - 1; i >= 0; --i) {
+      int32_t pressed_key[2] = {0};
+      game_keys_unpack(snapshot.inputs[i], pressed_key);
+      if (rollback_confirm(&rollback, snapshot.tick - 1 - i, pressed_key, ctx->state.tick)) continue;
+
+      // the ticks whose inputs were lost only come back with the host's exact state
+      client_wants_state = true;
+      break;
+    }
+  }
+
+  rollback_resolve(&rollback, ctx, ctx->tick_dt);
+  // a state that hashes differently than the host's never comes back on its own
+  if (!client_wants_state && !rollback_verify(&rollback, ctx->state.tick)) {
+    client_wants_state = true;
+  }
+
+  if (!ctx->is_paused) {
+    // paced to the host like the ticks of an interpolating client
+    ctx->accumulator += fminf(dt, MAX_FRAME_TIME) * (float)clock_align.scale;
+
+    while (ctx->accumulator >= ctx->tick_dt) {
+      unsigned events = GAME_EVENT_NONE;
+      if (!rollback_step(&rollback, ctx, local_key, ctx->tick_dt, &events)) {
+        // waiting for the host, do not pile up steps to run later
+        ctx->accumulator = ctx->tick_dt;
+        break;
+      }
+      ctx->accumulator -= ctx->tick_dt;
+      input_sender_push(&input_sender, ctx->state.tick, game_key_pack(local_key));
+
+      if (events & GAME_EVENT_PADDLE_HIT) {
+        PlaySound(hit_sound);
+      }
+    }
+  }
+
+  // the keys of all the steps of the frame go in one datagram
+  client_queue_input(ctx);
+  client_queue_resync(ctx);
+  if (input_sender.newest_tick != clock_align.tick) {
+    clock_align_on_tick(&clock_align, input_sender.newest_tick, time_now_seconds());
+  }
+  net_quality_tick(&ctx->client_sock.addr, client_token);
+  net_thread_flush(net_thread);
+
+  game_draw_frame(ctx, dt, ctx->accumulator / ctx->tick_dt);
+}
+
+/// Starts recording the match that begins with the next step into --record file,
+/// a replay keeps only the latest match
+static void start_match_recording(const GameContext *ctx) {
+  if (NULL == replay_record_path) return;
+
+  replay_recorder_end(&replay_recorder);
+  if (!replay_recorder_begin(&replay_recorder, replay_record_path, ctx)) {
+    TraceLog(LOG_WARNING, "The match is not recorded");
+  }
+}
+
+/// Queues the datagram on the network thread of a window, or in the batch of the headless host
+static void host_queue(const struct sockaddr_in6 *p_dest, const char *buf, int len) {
+  if (NULL != net_thread) {
+    net_thread_queue(net_thread, p_dest, buf, len);
+  } else {
+    net_batch_queue(net_batch, p_dest, buf, len);
+  }
+}
+
+static void host_flush(void) {
+  if (NULL != net_thread) {
+    net_thread_flush(net_thread);
+  } else {
+    net_batch_flush(net_batch);
+  }
+}
+
+/// Handles everything the network thread received since the last frame
+/// @returns true if the player has just connected
+static bool host_receive(GameContext *ctx) {
+  bool has_connected = false;
+  uint64_t now = time_now_ns();
+
+  NetMessage message = {0};
+  while (net_thread_recv(net_thread, &message)) {
+    uint64_t arrival = (uint64_t)(message.time * 1e9);
+    has_connected = host_handle_datagram(ctx, message.buf, message.len, &message.addr, arrival, now)
+      || has_connected;
+  }
+
+  session_table_expire(&host_sessions, now, host_on_session_expired, ctx);
+  return has_connected;
+}
+
+/// Starts the network thread on the socket of the address that won the race
+/// and asks the host to play or watch
+static void client_start(GameContext *ctx) {
+  if (!net_connect_take(client_connect, &ctx->client_sock)) {
+    TraceLog(LOG_FATAL, "Connected without a socket");
+  }
+  net_thread = net_thread_start(ctx->client_sock.fd);
+  if (NULL == net_thread) {
+    TraceLog(LOG_FATAL, "Could not start the network thread");
+  }
+  net_io_start = time_now_seconds();
+
+  char buf[NET_CMD_SIZE] = {0};
+  int len = net_encode_connect(buf, client_role, client_token);
+  net_thread_queue(net_thread, &ctx->client_sock.addr, buf, len);
+  net_thread_flush(net_thread);
+
+  const NetConnectStats *p_stats = net_connect_stats(client_connect);
+  char addr[NET_ADDR_STRLEN] = {0};
+  TraceLog(LOG_INFO, "Connected to %s over %s in %.1f ms: resolved in %.1f ms, "
+           "%d of %d addresses tried, RTT %.1f ms", net_addr_format(&ctx->client_sock.addr, addr),
+           net_addr_is_ipv4(&ctx->client_sock.addr) ? "IPv4" : "IPv6", p_stats->connect_time * 1000.,
+           p_stats->resolve_time * 1000., p_stats->attempts, p_stats->addresses, p_stats->rtt * 1000.);
+  net_connect_destroy(client_connect);
+  client_connect = NULL;
+}
+
+/// Draws the field while the host is resolved and its addresses are tried,
+/// falls back to the menu if none of them answers
+static void game_client_connecting_update(GameContext *ctx, float dt) {
+  game_draw_frame(ctx, dt, 1.f);
+
+  NetConnectState state = net_connect_poll(client_connect, time_now_seconds());
+  if (NET_CONNECT_DONE == state) {
+    client_start(ctx);
+    ctx->update = client_connected_update;
+    return;
+  }
+
+  if (NET_CONNECT_FAILED == state) {
+    const NetConnectStats *p_stats = net_connect_stats(client_connect);
+    TraceLog(LOG_WARNING, "Could not connect to %s after %.1f ms, %d of %d addresses tried",
+             client_host, p_stats->connect_time * 1000., p_stats->attempts, p_stats->addresses);
+    net_connect_destroy(client_connect);
+    client_connect = NULL;
+    client_back_to_menu(ctx);
+    return;
+  }
+
+  char text[128] = {0};
+  snprintf(text, sizeof(text), "%s %s", NET_CONNECT_RESOLVING == state ? "Resolving" : "Connecting to",
+           client_host);
+  DrawText(text, (WINDOW_WIDTH - MeasureText(text, 40)) / 2, WINDOW_HEIGHT / 2 - 20, 40, RED);
 }
 
 static void game_host_pending_update(GameContext *ctx, float dt) {
-  assert(ctx->client_sock.fd == 0 && "Client already has been connected");
+  assert(host_player < 0 && "Client already has been connected");
+
+  game_draw_frame(ctx, dt, 1.f);
 
-  game_draw_frame(ctx, dt);
+  bool has_connected = host_receive(ctx);
+  net_quality_tick(NULL, 0);
+  host_flush();
 
-  if (!net_check_for_connection(&ctx->server_sock, &ctx->client_sock)) {
+  if (!has_connected) {
     DrawText("Pending for a connection", WINDOW_WIDTH / 2 - 250, WINDOW_HEIGHT / 2 - 20, 40, RED);
     return;
   }
 
   ctx->update = game_host_update;
+  start_match_recording(ctx);
 }
 
-static void game_host_update(GameContext *ctx, float dt) {
+/// Sends the state of the step the host has just made to every session in a single
+/// datagram each, with the keys of that step and a few previous ones
+static void host_send_snapshot(GameContext *ctx) {
   char buf[NET_BUF_SIZE] = {0};
-  if (net_recv_cmd(&ctx->client_sock, buf)) {
-    switch (buf[0]) {
-      case NET_CMD_UPDATE_INPUT: {
-        ctx->pressed_key[1] = *(int*)(buf + 1);
-      } break;
-    }
-  }
 
-  handle_pressed_key(ctx, 0);
-  handle_pressed_key(ctx, 1);
+  NetSnapshot snapshot = game_state_snapshot(&ctx->state, host_sent_keys);
+  for (int id = 0; id < host_sessions.capacity; ++id) {
+    Session *p_session = session_get(&host_sessions, id);
+    if (NULL == p_session) continue;
 
-  game_local_update(ctx, dt);
+    memset(&snapshot.input_ack, 0, sizeof(snapshot.input_ack));
+    if (id == host_player) {
+      snapshot.input_ack = p_session->input.ack;
+    }
+    int len = delta_encode(&p_session->encoder, &snapshot, buf);
+    host_queue(&p_session->addr, buf, len);
+  }
+  host_snapshots_sent += 1;
+}
 
-  net_send_position(&ctx->client_sock, GE_PADDLE_1, ctx->paddles[0].rect.x, ctx->paddles[0].rect.y);
-  net_send_position(&ctx->client_sock, GE_PADDLE_2, ctx->paddles[1].rect.x, ctx->paddles[1].rect.y);
-  net_send_position(&ctx->client_sock, GE_BALL, ctx->ball.rect.x, ctx->ball.rect.y);
+/// Sends the hits, bounces and points of the step to every session right away
+static void host_send_event(GameContext *ctx, unsigned events) {
+  char buf[NET_EVENT_SIZE] = {0};
+  NetEvent event = game_state_event(&ctx->state, events);
+  int len = net_encode_event(buf, &event);
 
-  game_draw_frame(ctx, dt);
+  for (int id = 0; id < host_sessions.capacity; ++id) {
+    const Session *p_session = session_get(&host_sessions, id);
+    if (NULL != p_session) host_queue(&p_session->addr, buf, len);
+  }
+  host_events_sent += 1;
 }
 
-static void update_paddle(Paddle *p_paddle, float dt) {
-  float friction = 0;
+/// Keeps the keys of the step, sends its events and a snapshot if one is due at --send-rate
+static void host_after_step(GameContext *ctx, unsigned events) {
+  // the keys of the next step are set on ctx->state before it, this one stays as the step left it
+  host_step_state = ctx->state;
+  memmove(host_sent_keys + 1, host_sent_keys, sizeof(host_sent_keys) - 1);
+  host_sent_keys[0] = game_keys_pack(ctx->state.pressed_key);
 
-  if (p_paddle->velocity > 0) {
-    friction = PADDLE_FRICTION;
-  } else if (p_paddle->velocity < 0) {
-    friction = -PADDLE_FRICTION;
+  unsigned sent_events = events & (GAME_EVENT_PADDLE_HIT | GAME_EVENT_WALL_BOUNCE | GAME_EVENT_SCORE);
+  if (GAME_EVENT_NONE != sent_events) {
+    host_send_event(ctx, sent_events);
   }
 
-  float prev_velocity = p_paddle->velocity;
-  p_paddle->velocity += (p_paddle->acceleration - friction) * dt;
+  host_send_credit += host_send_rate;
+  if (host_send_credit >= host_tick_rate) {
+    host_send_credit -= host_tick_rate;
+    host_send_snapshot(ctx);
+  }
+}
+
+static void host_send_ready(const Session *p_session) {
+  char buf[NET_CMD_SIZE] = {0};
+  int len = net_encode_ready(buf, p_session->paddle, p_session->token);
+  host_queue(&p_session->addr, buf, len);
+}
 
-  p_paddle->velocity = Clamp(p_paddle->velocity, -MAX_PADDLE_SPEED * dt, MAX_PADDLE_SPEED * dt);
-  if ((p_paddle->velocity > 0 && prev_velocity < 0) || (p_paddle->velocity < 0 && prev_velocity > 0)
-    || (p_paddle->rect.y <= 0 && p_paddle->acceleration < 0) 
-    || (p_paddle->rect.y >= WINDOW_HEIGHT - p_paddle->rect.height && p_paddle->acceleration > 0)) {
-    p_paddle->velocity = 0.f;
+/// Sets the keys of the next step: the player's one of its next tick, the local one as is
+static void host_take_input(GameContext *ctx) {
+  Session *p_session = session_get(&host_sessions, host_player);
+  if (NULL != p_session) {
+    ctx->state.pressed_key[1] = game_key_unpack(input_receiver_take(&p_session->input));
   }
+  game_apply_pressed_key(&ctx->state, 0);
+  game_apply_pressed_key(&ctx->state, 1);
+}
 
-  p_paddle->rect.y += p_paddle->velocity;
+static void host_log_input_stats(const Session *p_session) {
+  const InputReceiverStats *p_stats = &p_session->input.stats;
+  TraceLog(LOG_INFO, "Inputs of %ld ticks: %ld recovered from a later datagram, "
+           "%ld held while late or lost, %ld skipped", p_stats->ticks, p_stats->recovered,
+           p_stats->held, p_stats->skipped);
 }
 
-static void game_local_update(GameContext *ctx, float dt) {
-  if (!ctx->is_paused) {
+/// The player's paddle stops and waits for the next player
+static void host_on_session_expired(void *p_user, int id) {
+  GameContext *ctx = p_user;
+  const Session *p_session = session_get(&host_sessions, id);
+  char addr[NET_ADDR_STRLEN] = {0};
+  TraceLog(LOG_INFO, "%s %s timed out", id == host_player ? "Client" : "Spectator",
+           net_addr_format(&p_session->addr, addr));
+
+  if (id == host_player) {
+    host_log_input_stats(p_session);
+    host_player = -1;
+    memset(&ctx->client_sock, 0, sizeof(ctx->client_sock));
+    ctx->state.pressed_key[1] = 0;
+  }
+}
 
-    if (ctx->ball.rect.x >= WINDOW_WIDTH - ctx->ball.rect.width) {
-      ctx->scores[0] += 1; 
-
-      ctx->paddles[0].rect.y = (float)WINDOW_HEIGHT / 2 - (float)PADDLE_HEIGHT / 2;
-      ctx->paddles[1].rect.y = (float)WINDOW_HEIGHT / 2 - (float)PADDLE_HEIGHT / 2;
-      ctx->paddles[0].tail_len = 0;
-      ctx->paddles[1].tail_len = 0;
-
-      ctx->ball.rect.x = ctx->paddles[0].rect.x + PADDLE_WIDTH;
-      ctx->ball.rect.y = ctx->paddles[0].rect.y + ctx->paddles[0].rect.height / 2 - (float)BALL_SIDES / 2;
-      ctx->ball.direction.x = 1;
-      ctx->ball.direction.y = 0.f;
-      ctx->ball.color = ctx->paddles[0].color;
-      ctx->ball.speed = BALL_SPEED;
-      ctx->ball.spin_factor = 0.f;
-      ctx->ball.tail_len = 0;
-
-      if (ctx->scores[0] >= ctx->win_score) {
-        ctx->update = main_menu_update;
-        ctx->scores[0] = 0;
-        ctx->scores[1] = 0;
-        return;
-      }
+/// Handles the datagram by the session of its address and token. NET_CMD_CONNECT
+/// from a new peer opens a session: the first player (or the next one after it
+/// timed out) becomes ctx->client_sock and plays the right paddle, everyone else watches
+/// @returns true if the player has just connected
+static bool host_handle_datagram(GameContext *ctx, const char *buf, int len,
+                                 const struct sockaddr_in6 *p_from, uint64_t arrival, uint64_t now) {
+  if (len < (int)NET_CMD_SIZE) return false;
+
+  bool has_connected = false;
+  uint16_t token = net_cmd_token(buf);
+  int id = session_find(&host_sessions, p_from, token);
+  if (id < 0 && NET_CMD_CONNECT == buf[0]) {
+    NetRole role = host_player < 0 ? net_decode_connect(buf) : NET_ROLE_SPECTATOR;
+    id = session_open(&host_sessions, p_from, token, role, now);
+    if (id < 0) return false;
+
+    if (NET_ROLE_PLAYER == role) {
+      host_sessions.sessions[id].paddle = 1;
+      host_player = id;
+      net_quality_restart(&net_quality);
+      ctx->client_sock.fd = ctx->server_sock.fd;
+      ctx->client_sock.addr = *p_from;
+      has_connected = true;
+    }
+  }
+  if (id < 0 && NET_CMD_PING == buf[0]) {
+    // a client probing the addresses before it connects, answered without a session
+    NetPing ping = {0};
+    if (net_decode_ping(buf, len, &ping)) {
+      ping.hold_ns = (uint32_t)(time_now_ns() - arrival);
+      ping.peer_time_ns = arrival;
+      char pong[NET_PING_SIZE] = {0};
+      int pong_len = net_encode_ping(pong, NET_CMD_PONG, &ping, token);
+      host_queue(p_from, pong, pong_len);
     }
+  }
+  if (id < 0) return false;
 
-    if (ctx->ball.rect.x <= 0) {
-      ctx->scores[1] += 1; 
+  Session *p_session = session_get(&host_sessions, id);
+  p_session->last_seen_ns = now;
 
-      ctx->paddles[0].rect.y = (float)WINDOW_HEIGHT / 2 - (float)PADDLE_HEIGHT / 2;
-      ctx->paddles[1].rect.y = (float)WINDOW_HEIGHT / 2 - (float)PADDLE_HEIGHT / 2;
-      ctx->paddles[0].tail_len = 0;
-      ctx->paddles[1].tail_len = 0;
+  switch (buf[0]) {
+    case NET_CMD_CONNECT: {
+      host_send_ready(p_session);
+    } break;
 
-      ctx->ball.rect.x = ctx->paddles[1].rect.x - PADDLE_WIDTH;
-      ctx->ball.rect.y = ctx->paddles[1].rect.y + ctx->paddles[1].rect.height / 2 - (float)BALL_SIDES / 2;
-      ctx->ball.direction.x = -1;
-      ctx->ball.direction.y = 0.f;
-      ctx->ball.color = ctx->paddles[1].color;
-      ctx->ball.speed = BALL_SPEED;
-      ctx->ball.spin_factor = 0.f;
-      ctx->ball.tail_len = 0;
+    case NET_CMD_UPDATE_INPUT: {
+      NetInput input = {0};
+      if (!net_decode_input(buf, len, &input)) break;
 
-      if (ctx->scores[1] >= ctx->win_score) {
-        ctx->update = main_menu_update;
-        ctx->scores[0] = 0;
-        ctx->scores[1] = 0;
-        return;
+      delta_encoder_ack(&p_session->encoder, input.snapshot_ack.tick);
+      // applied by tick in host_take_input
+      if (id == host_player) {
+        input_receiver_push(&p_session->input, &input);
+      }
+    } break;
+
+    case NET_CMD_PING: {
+      NetPing ping = {0};
+      if (!net_decode_ping(buf, len, &ping)) break;
+
+      p_session->pings_received += 1;
+      if (id == host_player) {
+        net_quality_on_ping(&net_quality, &ping);
+      }
+      ping.received = p_session->pings_received;
+      ping.hold_ns = (uint32_t)(time_now_ns() - arrival);
+      ping.peer_time_ns = arrival;
+      // the clients stamp the snapshots with the time of their step
+      ping.step_tick = ctx->state.tick + 1;
+      ping.input_delay_ns = host_next_step_ns > arrival ? (uint32_t)(host_next_step_ns - arrival) : 0;
+      if (id == host_player && 0 != p_session->input.next_tick) {
+        ping.input_tick = p_session->input.next_tick;
       }
+      if (id == host_player) {
+        ping.state_tick = host_step_state.tick;
+        ping.state_hash = game_state_hash(&host_step_state);
+      }
+      char pong[NET_PING_SIZE] = {0};
+      int pong_len = net_encode_ping(pong, NET_CMD_PONG, &ping, p_session->token);
+      host_queue(&p_session->addr, pong, pong_len);
+    } break;
+
+    case NET_CMD_PONG: {
+      NetPing pong = {0};
+      if (id == host_player && net_decode_ping(buf, len, &pong)) {
+        net_quality_on_pong(&net_quality, &pong, arrival * 1e-9);
+      }
+    } break;
+
+    case NET_CMD_RESYNC: {
+      // nothing to take before the first step
+      if (id != host_player || 0 == host_step_state.tick) break;
+
+      char state[NET_STATE_SIZE] = {0};
+      int state_len = game_state_encode(state, &host_step_state);
+      host_queue(&p_session->addr, state, state_len);
+    } break;
+  }
+
+  return has_connected;
+}
+
+/// Handles the count datagrams of the last net_batch_recv of the headless host
+/// @returns true if the player has just connected
+static bool host_handle_datagrams(GameContext *ctx, int count) {
+  bool has_connected = false;
+  uint64_t now = time_now_ns();
+
+  for (int i = 0; i < count; ++i) {
+    int len = 0;
+    struct sockaddr_in6 from = {0};
+    const char *buf = net_batch_datagram(net_batch, i, &len, &from);
+    uint64_t arrival = net_batch_datagram_time(net_batch, i);
+    has_connected = host_handle_datagram(ctx, buf, len, &from, 0 != arrival ? arrival : now, now)
+      || has_connected;
+  }
+
+  session_table_expire(&host_sessions, now, host_on_session_expired, ctx);
+  return has_connected;
+}
+
+static void game_host_update(GameContext *ctx, float dt) {
+  // the first step of the frame runs once the frame time fills the accumulator
+  float until_step = ctx->tick_dt - ctx->accumulator - fminf(dt, MAX_FRAME_TIME);
+  host_next_step_ns = time_now_ns() + (uint64_t)(fmaxf(until_step, 0.f) * 1e9f);
+  host_receive(ctx);
+
+  bool is_live = game_run_fixed_steps(ctx, dt, host_take_input, host_after_step);
+  const Session *p_player = session_get(&host_sessions, host_player);
+  net_quality_tick(NULL != p_player ? &p_player->addr : NULL, NULL != p_player ? p_player->token : 0);
+  // snapshots of all the steps of the frame go out together
+  host_flush();
+
+  if (is_live) {
+    game_draw_frame(ctx, dt, ctx->accumulator / ctx->tick_dt);
+  }
+}
+
+/// Runs as many fixed simulation steps as the elapsed frame time allows,
+/// calls before_step and after_step (if not NULL, with the events of the step) around every step.
+/// Goes to the main menu once the match is over
+/// @returns false if the match is over
+static bool game_run_fixed_steps(GameContext *ctx, float dt, void (*before_step)(GameContext *ctx),
+                                 void (*after_step)(GameContext *ctx, unsigned events)) {
+  if (ctx->is_paused) {
+    return true;
+  }
+
+  ctx->accumulator += fminf(dt, MAX_FRAME_TIME);
+
+  while (ctx->accumulator >= ctx->tick_dt) {
+    ctx->accumulator -= ctx->tick_dt;
+
+    if (NULL != before_step) {
+      before_step(ctx);
     }
 
-    if (ctx->ball.rect.y <= 0 || ctx->ball.rect.y >= WINDOW_HEIGHT - ctx->ball.rect.height) {
-      ctx->ball.direction.y *= -1;
-      ctx->ball.speed = Clamp(ctx->ball.speed * 0.9f, MIN_BALL_SPEED, MAX_BALL_SPEED);
+    replay_recorder_push(&replay_recorder, ctx);
+    unsigned events = game_step(ctx, ctx->tick_dt);
+
+    if (NULL != after_step) {
+      after_step(ctx, events);
     }
 
-    if (CheckCollisionRecs(ctx->ball.rect, ctx->paddles[0].rect)) {
-      handle_collision(&ctx->ball, &ctx->paddles[0]);
-      ctx->ball.rect.x = ctx->paddles[0].rect.x + ctx->paddles[0].rect.width; // Move ball to avoid sticking
+    if (events & GAME_EVENT_PADDLE_HIT) {
+      PlaySound(hit_sound);
     }
 
-    if (CheckCollisionRecs(ctx->ball.rect, ctx->paddles[1].rect)) {
-      handle_collision(&ctx->ball, &ctx->paddles[1]);
-      ctx->ball.rect.x = ctx->paddles[1].rect.x - ctx->paddles[1].rect.width; // Move ball to avoid sticking
+    if (events & GAME_EVENT_MATCH_OVER) {
+      replay_recorder_end(&replay_recorder);
+      ctx->accumulator = 0.f;
+      ctx->update = main_menu_update;
+      return false;
     }
+  }
+
+  return true;
+}
 
+/// Runs the fixed simulation steps, then renders the state
+/// interpolated between the last two steps
+static void game_local_update(GameContext *ctx, float dt) {
+  if (!game_run_fixed_steps(ctx, dt, NULL, NULL)) {
+    return;
+  }
+
+  game_draw_frame(ctx, dt, ctx->accumulator / ctx->tick_dt);
+}
+
+/// Plays the --replay file back at --replay-speed times the recorded rate
+static void game_replay_update(GameContext *ctx, float dt) {
+  if (!ctx->is_paused && !replay_is_finished) {
+    ctx->accumulator += fminf(dt, MAX_FRAME_TIME) * replay_speed;
+
+    while (ctx->accumulator >= ctx->tick_dt) {
+      ctx->accumulator -= ctx->tick_dt;
+
+      if (!replay_reader_next(&replay_reader, ctx)) {
+        replay_is_finished = true;
+        ctx->accumulator = ctx->tick_dt;
+        break;
+      }
 
-    update_paddle(&ctx->paddles[0], dt);
-    update_paddle(&ctx->paddles[1], dt);
-    
-    ctx->ball.direction = Vector2Normalize(ctx->ball.direction);
-    ctx->ball.rect.x += ctx->ball.speed * ctx->ball.direction.x * dt;
-    ctx->ball.rect.y += ctx->ball.speed * ctx->ball.direction.y * dt;
-    ctx->ball.speed = Clamp(ctx->ball.speed - .5f, MIN_BALL_SPEED, MAX_BALL_SPEED);
+      unsigned events = game_step(ctx, ctx->tick_dt);
 
-    clamp_rect_within_screen(&ctx->paddles[0].rect);
-    clamp_rect_within_screen(&ctx->paddles[1].rect);
-    clamp_rect_within_screen(&ctx->ball.rect);
+      if (events & GAME_EVENT_PADDLE_HIT) {
+        PlaySound(hit_sound);
+      }
+    }
   }
 
-  game_draw_frame(ctx, dt);
+  game_draw_frame(ctx, dt, ctx->accumulator / ctx->tick_dt);
+}
+
+/// Round trip, jitter and loss of the ping window, the rates of the last second,
+/// in lines from y down
+/// @returns the y of the line after them
+static int draw_net_overlay(int font_size, int y) {
+  char buf[256] = {0};
+
+  int len = 0;
+  if (net_quality.rtt >= 0) {
+    len = sprintf(buf, "RTT %.1f ms (min %.1f ms), jitter %.1f ms", net_quality.rtt * 1000.,
+                  net_quality.min_rtt * 1000., net_quality.jitter * 1000.);
+  } else {
+    len = sprintf(buf, "RTT -");
+  }
+  double loss_in = net_quality_loss_in(&net_quality);
+  double loss_out = net_quality_loss_out(&net_quality);
+  if (loss_in >= 0) len += sprintf(buf + len, ", loss in %.1f%%", 100. * loss_in);
+  if (loss_out >= 0) len += sprintf(buf + len, ", loss out %.1f%%", 100. * loss_out);
+  DrawText(buf, (WINDOW_WIDTH - MeasureText(buf, font_size)) / 2, y, font_size, MAIN_UI_COLOR);
+  y += UI_STATS_LINE_HEIGHT;
+
+  const NetQualitySecond *p_second = net_quality_last_second(&net_quality);
+  if (NULL != p_second) {
+    sprintf(buf, "In %.1f kB/s, %.0f packets/s, out %.1f kB/s, %.0f packets/s",
+            p_second->bytes_in / 1000., p_second->packets_in,
+            p_second->bytes_out / 1000., p_second->packets_out);
+    DrawText(buf, (WINDOW_WIDTH - MeasureText(buf, font_size)) / 2, y, font_size, MAIN_UI_COLOR);
+    y += UI_STATS_LINE_HEIGHT;
+  }
+
+  if (clock_sync_has_offset(&clock_sync)) {
+    const ClockSyncStats *p_stats = &clock_sync.stats;
+    sprintf(buf, "Clock offset %+.3f ms, drift %+.1f ppm, error %.3f ms, %ld of %ld exchanges (%ld delayed, %ld spikes)",
+            clock_sync.offset * 1000., clock_sync.drift * 1e6, clock_sync.error * 1000.,
+            p_stats->accepted, p_stats->exchanges,
+            p_stats->delayed, p_stats->spikes);
+    DrawText(buf, (WINDOW_WIDTH - MeasureText(buf, font_size)) / 2, y, font_size, MAIN_UI_COLOR);
+    y += UI_STATS_LINE_HEIGHT;
+  }
+  if (clock_align.has_slack) {
+    sprintf(buf, "Input slack %.1f ms (target %.1f ms), time scale %.3f",
+            clock_align.slack * 1000., clock_align.target * 1000., clock_align.scale);
+    DrawText(buf, (WINDOW_WIDTH - MeasureText(buf, font_size)) / 2, y, font_size, MAIN_UI_COLOR);
+    y += UI_STATS_LINE_HEIGHT;
+  }
+  return y;
 }
 
 static void game_draw_ui(GameContext *ctx, float dt) {
   char buf[1024] = {0};
   int stats_font_size = 14;
 
-  sprintf(buf, "Speed: %.2f", fabsf(ctx->paddles[0].velocity));
+  sprintf(buf, "Speed: %.2f", fabsf(ctx->state.paddles[0].velocity));
   DrawText(buf, 30, WINDOW_HEIGHT - 30, stats_font_size, MAIN_UI_COLOR);
 
-  sprintf(buf, "Speed: %.2f", fabsf(ctx->paddles[1].velocity));
+  sprintf(buf, "Speed: %.2f", fabsf(ctx->state.paddles[1].velocity));
   int speed1_width = MeasureText(buf, stats_font_size);
   int speed1_pos_x = WINDOW_WIDTH - speed1_width - 30;
   DrawText(buf, speed1_pos_x, WINDOW_HEIGHT - 30, stats_font_size, MAIN_UI_COLOR);
 
-  sprintf(buf, "Ball Speed: %.2f", ctx->ball.speed *  dt);
+  sprintf(buf, "Ball Speed: %.2f", ctx->state.ball.speed *  dt);
   int ball_speed_width = MeasureText(buf, stats_font_size);
   int ball_center_x = (WINDOW_WIDTH - ball_speed_width) / 2;
   DrawText(buf, ball_center_x, WINDOW_HEIGHT - 30, stats_font_size, MAIN_UI_COLOR);
@@ -532,10 +1266,71 @@ static void game_draw_ui(GameContext *ctx, float dt) {
   int fps_width = MeasureText(buf, stats_font_size);
   DrawText(buf, WINDOW_WIDTH - fps_width - 60, 30, stats_font_size, MAIN_UI_COLOR);
 
-  sprintf(buf, "Win score: %d", ctx->win_score);
+  sprintf(buf, "Win score: %d", ctx->state.win_score);
   int win_score_width = MeasureText(buf, stats_font_size);
   DrawText(buf, win_score_width - 60, 30, stats_font_size, MAIN_UI_COLOR);
 
+  // every stats line that is shown goes under the previous one
+  int stats_y = 50;
+  if (rollback_enabled) {
+    const RollbackStats *p_stats = &rollback.stats;
+    sprintf(buf, "Rollback depth %d (max %d), resim %.1f us (max %.1f us)",
+            p_stats->last_depth, p_stats->max_depth,
+            p_stats->rollbacks > 0 ? p_stats->resimulation_ns / 1000. / p_stats->rollbacks : 0.,
+            p_stats->max_resimulation_ns / 1000.);
+    int rollback_width = MeasureText(buf, stats_font_size);
+    DrawText(buf, (WINDOW_WIDTH - rollback_width) / 2, stats_y, stats_font_size, MAIN_UI_COLOR);
+    stats_y += UI_STATS_LINE_HEIGHT;
+  }
+
+  if (interpolation_enabled) {
+    sprintf(buf, "Interpolation delay %.1f ms, jitter %.1f ms, underruns %ld, stale %ld",
+            snapshot_buffer.delay * 1000., snapshot_buffer.jitter * 1000.,
+            snapshot_buffer.stats.underruns, snapshot_buffer.stats.stale);
+    int interpolation_width = MeasureText(buf, stats_font_size);
+    DrawText(buf, (WINDOW_WIDTH - interpolation_width) / 2, stats_y, stats_font_size, MAIN_UI_COLOR);
+    stats_y += UI_STATS_LINE_HEIGHT;
+  }
+
+  const Session *p_player = session_get(&host_sessions, host_player);
+  if (NULL != p_player && p_player->encoder.stats.snapshots > 0) {
+    const DeltaEncoderStats *p_stats = &p_player->encoder.stats;
+    sprintf(buf, "Snapshots %.1f B avg, %.0f B/s, keyframes %ld",
+            (double)p_stats->bytes / p_stats->snapshots,
+            (double)p_stats->bytes / p_stats->snapshots * host_send_rate, p_stats->keyframes);
+    int delta_width = MeasureText(buf, stats_font_size);
+    DrawText(buf, (WINDOW_WIDTH - delta_width) / 2, stats_y, stats_font_size, MAIN_UI_COLOR);
+    stats_y += UI_STATS_LINE_HEIGHT;
+  }
+
+  if (NULL != net_thread) {
+    double io_ticks = (time_now_seconds() - net_io_start) / ctx->tick_dt;
+    NetThreadStats stats = net_thread_stats(net_thread);
+    const NetBatchStats *p_stats = &stats.io;
+    sprintf(buf, "I/O %.2f syscalls/tick, %.2f datagrams/recvmmsg, %.2f datagrams/sendmmsg, dropped %ld",
+            io_ticks > 0 ? (p_stats->recv_syscalls + p_stats->send_syscalls) / io_ticks : 0.,
+            p_stats->recv_syscalls > 0 ? (double)p_stats->received / p_stats->recv_syscalls : 0.,
+            p_stats->send_syscalls > 0 ? (double)p_stats->sent / p_stats->send_syscalls : 0.,
+            stats.inbound_dropped + stats.outbound_dropped);
+    int io_width = MeasureText(buf, stats_font_size);
+    DrawText(buf, (WINDOW_WIDTH - io_width) / 2, stats_y, stats_font_size, MAIN_UI_COLOR);
+    stats_y += UI_STATS_LINE_HEIGHT;
+  }
+
+  if (NULL != net_thread && net_overlay_visible) {
+    stats_y = draw_net_overlay(stats_font_size, stats_y);
+  }
+
+  if (NULL != replay_reader.data) {
+    if (replay_is_finished) {
+      sprintf(buf, "Replay finished at tick %ld", replay_reader.tick);
+    } else {
+      sprintf(buf, "Replay x%.2f, tick %ld", replay_speed, replay_reader.tick);
+    }
+    int replay_width = MeasureText(buf, stats_font_size);
+    DrawText(buf, (WINDOW_WIDTH - replay_width) / 2, 30, stats_font_size, MAIN_UI_COLOR);
+  }
+
 }
 
 static void draw_score(GameContext *ctx, float dt) {
@@ -545,12 +1340,12 @@ static void draw_score(GameContext *ctx, float dt) {
   Color color = MAIN_UI_COLOR;
   color.a = 70;
 
-  sprintf(buf, "%d", ctx->scores[0]);
+  sprintf(buf, "%d", ctx->state.scores[0]);
   int score_width = MeasureText(buf, score_font_size);
   int score_center_x = (WINDOW_WIDTH - score_width) / 4;
   DrawText(buf, score_center_x, (WINDOW_HEIGHT - score_font_size) / 2, score_font_size, color);
 
-  sprintf(buf, "%d", ctx->scores[1]);
+  sprintf(buf, "%d", ctx->state.scores[1]);
   score_width = MeasureText(buf, score_font_size);
   score_center_x = WINDOW_WIDTH - (WINDOW_WIDTH - score_width) / 4 - score_width;
   DrawText(buf, score_center_x, (WINDOW_HEIGHT - score_font_size) / 2, score_font_size, color);
@@ -559,28 +1354,34 @@ static void draw_score(GameContext *ctx, float dt) {
 
 static void draw_tail(GameContext *ctx, Rectangle orig_rect, Color orig_color,
                       Vector2 *p_tail, int *p_begin, int *p_len, int tail_capacity) {
-  if (!ctx->is_paused) {
-    p_tail[*p_begin] = (Vector2){ orig_rect.x + orig_rect.width / 2, orig_rect.y + orig_rect.height / 2 };
-    *p_begin = (*p_begin + 1) % tail_capacity;
-    *p_len += *p_len != tail_capacity;
-  }
+  TailSegment segments[TAIL_MAX_SEGMENTS];
+  int count = game_tail_segments(orig_rect, orig_color, !ctx->is_paused,
+                                 p_tail, p_begin, p_len, tail_capacity, segments);
 
-  int step = tail_capacity / 5;
-
-  for (
-    int curr = *p_begin, i = 0; 
-    i < *p_len; 
-    curr = (curr + step) % tail_capacity, i += step
-  ) {
-    Color color = orig_color;
-    color.a = Lerp(color.a, 0, 1 - (float)i / tail_capacity);
-    float w = Lerp(orig_rect.width, orig_rect.width / tail_capacity, 1 - (float)i / tail_capacity);
-    float h = Lerp(orig_rect.height, orig_rect.height / tail_capacity, 1 - (float)i / tail_capacity);
-    DrawRectangleLines(p_tail[curr].x - w / 2, p_tail[curr].y - h / 2, w, h, color);
+  for (int i = 0; i < count; ++i) {
+    Rectangle rect = segments[i].rect;
+    DrawRectangleLines(rect.x, rect.y, rect.width, rect.height, segments[i].color);
   }
 }
 
-static void game_draw_frame(GameContext *ctx, float dt) {
+static Rectangle interpolate_rect(Rectangle prev, Rectangle curr, float alpha) {
+  return CLITERAL(Rectangle){
+    .x = Lerp(prev.x, curr.x, alpha),
+    .y = Lerp(prev.y, curr.y, alpha),
+    .width = curr.width,
+    .height = curr.height,
+  };
+}
+
+/// Draws the match with positions interpolated between the previous (alpha = 0)
+/// and the current (alpha = 1) simulation step
+static void game_draw_frame(GameContext *ctx, float dt, float alpha) {
+  Rectangle paddle_rects[2] = {
+    interpolate_rect(ctx->paddles[0].prev_rect, ctx->state.paddles[0].rect, alpha),
+    interpolate_rect(ctx->paddles[1].prev_rect, ctx->state.paddles[1].rect, alpha),
+  };
+  Rectangle ball_rect = interpolate_rect(ctx->ball.prev_rect, ctx->state.ball.rect, alpha);
+
   Rectangle middle_line = {0};
   middle_line.width = 5;
   middle_line.height = WINDOW_HEIGHT;
@@ -595,20 +1396,20 @@ static void game_draw_frame(GameContext *ctx, float dt) {
 
   float line_thickness = 2;
   DrawRectangleRec(middle_line, CLITERAL(Color){ 255, 255, 255, 100 });
-  DrawRectangleLinesEx(ctx->paddles[0].rect, line_thickness, ctx->paddles[0].color);
-  DrawRectangleLinesEx(ctx->paddles[1].rect, line_thickness, ctx->paddles[1].color);
-  DrawRectangleLinesEx(ctx->ball.rect, line_thickness, ctx->ball.color);
+  DrawRectangleLinesEx(paddle_rects[0], line_thickness, ctx->paddles[0].color);
+  DrawRectangleLinesEx(paddle_rects[1], line_thickness, ctx->paddles[1].color);
+  DrawRectangleLinesEx(ball_rect, line_thickness, ctx->ball.color);
 
-  draw_tail(ctx, ctx->ball.rect, ctx->ball.color, 
+  draw_tail(ctx, ball_rect, ctx->ball.color, 
             ctx->ball.tail, &ctx->ball.tail_begin, &ctx->ball.tail_len, TAIL_CAPACITY_BALL);
 
-  if (fabsf(ctx->paddles[0].velocity) != 0) {
-    draw_tail(ctx, ctx->paddles[0].rect, ctx->paddles[0].color, 
+  if (fabsf(ctx->state.paddles[0].velocity) != 0) {
+    draw_tail(ctx, paddle_rects[0], ctx->paddles[0].color, 
               ctx->paddles[0].tail, &ctx->paddles[0].tail_begin, &ctx->paddles[0].tail_len, TAIL_CAPACITY_PADDLE);
   }
 
-  if (fabsf(ctx->paddles[1].velocity) != 0) {
-    draw_tail(ctx, ctx->paddles[1].rect, ctx->paddles[1].color, 
+  if (fabsf(ctx->state.paddles[1].velocity) != 0) {
+    draw_tail(ctx, paddle_rects[1], ctx->paddles[1].color, 
               ctx->paddles[1].tail, &ctx->paddles[1].tail_begin, &ctx->paddles[1].tail_len, TAIL_CAPACITY_PADDLE);
   }
 
@@ -653,19 +1454,20 @@ void main_menu_update(GameContext *ctx, float dt) {
       start_color = SECOND_UI_COLOR;
       if (IsKeyPressed(KEY_ENTER)) {
         ctx->update= game_local_update;
+        start_match_recording(ctx);
       }
     } break;
 
     case MAIN_MENU_WIN_SCORE: {
       set_win_score_color = SECOND_UI_COLOR;
       if (IsKeyPressed(KEY_RIGHT) || IsKeyPressed(KEY_D)) {
-        ctx->win_score += 1;
-        if (ctx->win_score > WIN_SCORE_MAX) ctx->win_score = WIN_SCORE_MAX;
+        ctx->state.win_score += 1;
+        if (ctx->state.win_score > WIN_SCORE_MAX) ctx->state.win_score = WIN_SCORE_MAX;
       }
 
       if (IsKeyPressed(KEY_LEFT) || IsKeyPressed(KEY_A)) {
-        ctx->win_score -= 1;
-        if (ctx->win_score <= 0) ctx->win_score = 1;
+        ctx->state.win_score -= 1;
+        if (ctx->state.win_score <= 0) ctx->state.win_score = 1;
       }
     } break;
 
@@ -687,7 +1489,7 @@ void main_menu_update(GameContext *ctx, float dt) {
   int item_center_x = (WINDOW_WIDTH - item_width) / 2;
   DrawText(start_text, item_center_x, WINDOW_HEIGHT / 2 - 20 - 60, font_size, start_color);
 
-  sprintf(set_win_score_buf, set_win_score_fmt, ctx->win_score);
+  sprintf(set_win_score_buf, set_win_score_fmt, ctx->state.win_score);
   item_width = MeasureText(set_win_score_buf, font_size);
   item_center_x = (WINDOW_WIDTH - item_width) / 2;
   DrawText(set_win_score_buf, item_center_x, WINDOW_HEIGHT / 2 - 20, font_size, set_win_score_color);
@@ -700,20 +1502,518 @@ void main_menu_update(GameContext *ctx, float dt) {
 }
 
 void game_fini(GameContext *ctx) {
+  net_connect_destroy(client_connect);
+  client_connect = NULL;
+
+  if (NULL != net_thread) {
+    double io_ticks = (time_now_seconds() - net_io_start) / ctx->tick_dt;
+    NetThreadStats stats = net_thread_stats(net_thread);
+    const NetBatchStats *p_stats = &stats.io;
+    TraceLog(LOG_INFO, "Network I/O: %ld recvmmsg (%ld datagrams), %ld sendmmsg (%ld datagrams), "
+             "%.2f syscalls/tick, %ld wakeups, dropped %ld in, %ld out",
+             p_stats->recv_syscalls, p_stats->received, p_stats->send_syscalls, p_stats->sent,
+             io_ticks > 0 ? (p_stats->recv_syscalls + p_stats->send_syscalls) / io_ticks : 0.,
+             stats.wakeups, stats.inbound_dropped, stats.outbound_dropped);
+    if (net_quality.rtt >= 0) {
+      TraceLog(LOG_INFO, "Connection: RTT %.1f ms (min %.1f ms), jitter %.1f ms, "
+               "loss %.1f%% in, %.1f%% out", net_quality.rtt * 1000., net_quality.min_rtt * 1000.,
+               net_quality.jitter * 1000., fmax(0., 100. * net_quality_loss_in(&net_quality)),
+               fmax(0., 100. * net_quality_loss_out(&net_quality)));
+    }
+    net_quality_close_csv(&net_quality);
+    net_thread_stop(net_thread);
+    net_thread = NULL;
+  }
+
+  if (rollback_enabled) {
+    const RollbackStats *p_stats = &rollback.stats;
+    TraceLog(LOG_INFO, "Rollbacks: %ld, resimulated ticks: %ld, max depth: %d, "
+             "resimulation: %.1f us total, %.1f us max, resyncs: %ld, desyncs: %ld",
+             p_stats->rollbacks, p_stats->resimulated_ticks, p_stats->max_depth,
+             p_stats->resimulation_ns / 1000., p_stats->max_resimulation_ns / 1000., p_stats->resyncs,
+             p_stats->desyncs);
+  }
+
+  session_table_fini(&host_sessions);
+  replay_recorder_end(&replay_recorder);
+  replay_reader_close(&replay_reader);
   UnloadSound(hit_sound);
   CloseAudioDevice();
   CloseWindow();
 }
 
+/// Runs bot vs bot matches without window, audio or drawing
+/// as fast as possible and reports the simulation speed
+static int run_headless(const CmdConfig *p_cfg) {
+  GameContext ctx = game_context_create();
+  ctx.tick_dt = 1.f / p_cfg->tick_rate;
+  long points = 0;
+  long matches = 0;
+
+  start_match_recording(&ctx);
+
+  double start = time_now_seconds();
+
+  for (long tick = 0; tick < p_cfg->headless_ticks; ++tick) {
+    game_bot_input(&ctx.state, 0);
+    game_bot_input(&ctx.state, 1);
+
+    replay_recorder_push(&replay_recorder, &ctx);
+    unsigned events = game_step(&ctx, ctx.tick_dt);
+    points += !!(events & GAME_EVENT_SCORE);
+    matches += !!(events & GAME_EVENT_MATCH_OVER);
+
+    if (events & GAME_EVENT_MATCH_OVER) {
+      start_match_recording(&ctx);
+    }
+  }
+
+  double elapsed = time_now_seconds() - start;
+  replay_recorder_end(&replay_recorder);
+
+  printf("Simulated %ld ticks in %.3f s: %.0f ticks/sec\n",
+         p_cfg->headless_ticks, elapsed, elapsed > 0 ? p_cfg->headless_ticks / elapsed : 0.);
+  printf("Points: %ld, matches: %ld, ball: (%.2f, %.2f)\n",
+         points, matches, ctx.state.ball.rect.x, ctx.state.ball.rect.y);
+
+  return 0;
+}
+
+typedef struct {
+  char buf[NET_BUF_SIZE];
+  int len;
+  NetSnapshot expected;
+} BandwidthPacket;
+
+static uint32_t bandwidth_random(uint32_t *p_seed) {
+  // xorshift32, the runs are reproducible
+  *p_seed ^= *p_seed << 13;
+  *p_seed ^= *p_seed >> 17;
+  *p_seed ^= *p_seed << 5;
+  return *p_seed;
+}
+
+static bool bandwidth_is_lost(const CmdConfig *p_cfg, uint32_t *p_seed) {
+  return bandwidth_random(p_seed) % 10000 < p_cfg->bandwidth_loss * 100;
+}
+
+/// Plays a bot match headless and sends every snapshot the way the host does over
+/// a simulated link with --latency ticks each way and --loss percent of datagrams lost
+/// in both directions. Reports the bytes per second of the delta encoded snapshots
+/// against the full ones and checks that the client decodes exactly what was sent
+static int run_bandwidth_headless(const CmdConfig *p_cfg) {
+  static BandwidthPacket in_flight[BANDWIDTH_MAX_LATENCY];
+  static uint32_t acks_in_flight[BANDWIDTH_MAX_LATENCY];
+  GameContext ctx = game_context_create();
+  ctx.tick_dt = 1.f / p_cfg->tick_rate;
+  uint32_t seed = 0x9e3779b9;
+  int latency = p_cfg->bandwidth_latency;
+
+  delta_encoder_init(&delta_encoder);
+  delta_decoder_init(&delta_decoder);
+
+  long delivered = 0;
+  long mismatches = 0;
+  long idle_ticks = 0;
+  uint64_t idle_bytes = 0;
+
+  for (long tick = 0; tick < p_cfg->headless_ticks; ++tick) {
+    game_bot_input(&ctx.state, 0);
+    game_bot_input(&ctx.state, 1);
+    game_step(&ctx, ctx.tick_dt);
+
+    memmove(host_sent_keys + 1, host_sent_keys, sizeof(host_sent_keys) - 1);
+    host_sent_keys[0] = game_keys_pack(ctx.state.pressed_key);
+
+    int slot = tick % latency;
+
+    // whatever was sent latency ticks ago arrives now
+    BandwidthPacket *p_packet = &in_flight[slot];
+    if (p_packet->len > 0) {
+      NetSnapshot snapshot = {0};
+      if (delta_decode(&delta_decoder, p_packet->buf, p_packet->len, &snapshot)) {
+        delivered += 1;
+        mismatches += 0 != memcmp(&snapshot, &p_packet->expected, sizeof(snapshot));
+      }
+    }
+    if (acks_in_flight[slot] > 0) {
+      delta_encoder_ack(&delta_encoder, acks_in_flight[slot]);
+    }
+
+    NetSnapshot snapshot = game_state_snapshot(&ctx.state, host_sent_keys);
+    uint64_t bytes_before = delta_encoder.stats.bytes;
+    p_packet->len = delta_encode(&delta_encoder, &snapshot, p_packet->buf);
+
+    if (0 == ctx.state.paddles[0].velocity && 0 == ctx.state.paddles[1].velocity) {
+      idle_ticks += 1;
+      idle_bytes += delta_encoder.stats.bytes - bytes_before;
+    }
+
+    // the client gets exactly the quantized values and only the inputs past the baseline
+    uint32_t age = (unsigned char)p_packet->buf[DELTA_HEADER_SIZE - 1];
+    delta_quantize_snapshot(&snapshot);
+    if (age > 0 && (uint32_t)snapshot.input_count > age) {
+      snapshot.input_count = age;
+    }
+    memset(snapshot.inputs + snapshot.input_count, 0, sizeof(snapshot.inputs) - snapshot.input_count);
+    p_packet->expected = snapshot;
+
+    if (bandwidth_is_lost(p_cfg, &seed)) {
+      p_packet->len = 0;
+    }
+
+    // the client acks with its inputs every tick
+    acks_in_flight[slot] = bandwidth_is_lost(p_cfg, &seed) ? 0 : delta_decoder_ack(&delta_decoder);
+  }
+
+  const DeltaEncoderStats *p_stats = &delta_encoder.stats;
+  double seconds = p_cfg->headless_ticks * ctx.tick_dt;
+  double full_rate = (double)NET_SNAPSHOT_SIZE * p_cfg->headless_ticks / seconds;
+  double delta_rate = p_stats->bytes / seconds;
+
+  printf("Sent %ld snapshots (%.1f s of play), latency %d ticks, loss %.1f%%\n",
+         p_stats->snapshots, seconds, latency, p_cfg->bandwidth_loss);
+  printf("Full:  %d B/snapshot, %.0f B/s (%.0f B/s with UDP/IPv4 headers)\n",
+         (int)NET_SNAPSHOT_SIZE, full_rate, full_rate + BANDWIDTH_UDP_IP_OVERHEAD * p_cfg->tick_rate);
+  printf("Delta: %.2f B/snapshot, %.0f B/s (%.0f B/s with UDP/IPv4 headers), %.1f%% of full\n",
+         (double)p_stats->bytes / p_stats->snapshots, delta_rate,
+         delta_rate + BANDWIDTH_UDP_IP_OVERHEAD * p_cfg->tick_rate, 100. * delta_rate / full_rate);
+  printf("Idle paddles: %ld ticks, %.2f B/snapshot\n",
+         idle_ticks, idle_ticks > 0 ? (double)idle_bytes / idle_ticks : 0.);
+  printf("Keyframes: %ld, delivered: %ld, missing baseline: %ld, mismatches: %ld\n",
+         p_stats->keyframes, delivered, delta_decoder.stats.missing_baseline, mismatches);
+
+  return mismatches > 0;
+}
+
+/// Host without window: sleeps in the event loop until the client's input arrives
+/// or the next tick is due, plays the left paddle with the bot
+static int run_host_headless(const CmdConfig *p_cfg) {
+  GameContext ctx = game_context_create();
+  ctx.tick_dt = 1.f / p_cfg->tick_rate;
+  EventLoop loop = { .epoll_fd = -1, .timer_fd = -1 };
+  int result = 1;
+  long ticks = 0;
+  long points = 0;
+
+  if (!create_udp_server_socket(p_cfg->host_port, &ctx.server_sock)) {
+    return 1;
+  }
+
+  net_batch = net_batch_create(ctx.server_sock.fd);
+  if (NULL == net_batch || !event_loop_init(&loop, net_batch_poll_fd(net_batch))) {
+    goto defer;
+  }
+  if (!session_table_init(&host_sessions, HOST_MAX_SESSIONS, SESSION_DEFAULT_TIMEOUT)) {
+    TraceLog(LOG_ERROR, "Could not allocate sessions");
+    goto defer;
+  }
+
+  printf("Waiting for a client on port %d, %d snapshots/sec at %d ticks/sec\n",
+         p_cfg->host_port, p_cfg->send_rate, p_cfg->tick_rate);
+  // arms the io_uring receive on this thread, nothing can have arrived yet
+  host_handle_datagrams(&ctx, net_batch_recv(net_batch));
+
+  double start = 0;
+  struct rusage usage_start = {0};
+
+  while (ticks < p_cfg->headless_ticks) {
+    uint64_t due_ticks = 0;
+    unsigned events = event_loop_wait(&loop, -1, &due_ticks);
+    // the due ticks step right after the datagrams
+    host_next_step_ns = 0 != due_ticks ? time_now_ns() : loop.next_tick_ns;
+
+    if (events & EVENT_LOOP_READABLE) {
+      int count = 0;
+      do {
+        count = net_batch_recv(net_batch);
+        if (host_handle_datagrams(&ctx, count)) {
+          char addr[NET_ADDR_STRLEN] = {0};
+          printf("Client %s connected\n", net_addr_format(&ctx.client_sock.addr, addr));
+        }
+        // the match starts with the first player, a later one takes over its paddle
+        if (host_player >= 0 && 0 == loop.next_tick_ns) {
+          if (!event_loop_start_ticks(&loop, ctx.tick_dt)) goto defer;
+          start = time_now_seconds();
+          getrusage(RUSAGE_SELF, &usage_start);
+          start_match_recording(&ctx);
+        }
+      } while (NET_BATCH_CAPACITY == count);
+      net_batch_flush(net_batch);
+    }
+
+    if (events & EVENT_LOOP_TICK) {
+      session_table_expire(&host_sessions, time_now_ns(), host_on_session_expired, &ctx);
+
+      for (uint64_t i = 0; i < due_ticks && ticks < p_cfg->headless_ticks; ++i, ++ticks) {
+        game_bot_input(&ctx.state, 0);
+        host_take_input(&ctx);
+
+        replay_recorder_push(&replay_recorder, &ctx);
+        unsigned step_events = game_step(&ctx, ctx.tick_dt);
+        host_after_step(&ctx, step_events);
+
+        points += !!(step_events & GAME_EVENT_SCORE);
+        if (step_events & GAME_EVENT_MATCH_OVER) {
+          printf("Match over %d:%d\n", ctx.state.scores[0], ctx.state.scores[1]);
+          start_match_recording(&ctx);
+        }
+      }
+      net_batch_flush(net_batch);
+    }
+  }
+
+  replay_recorder_end(&replay_recorder);
+
+  double elapsed = time_now_seconds() - start;
+  struct rusage usage_end = {0};
+  getrusage(RUSAGE_SELF, &usage_end);
+  double cpu = (usage_end.ru_utime.tv_sec - usage_start.ru_utime.tv_sec)
+    + (usage_end.ru_utime.tv_usec - usage_start.ru_utime.tv_usec) * 1e-6
+    + (usage_end.ru_stime.tv_sec - usage_start.ru_stime.tv_sec)
+    + (usage_end.ru_stime.tv_usec - usage_start.ru_stime.tv_usec) * 1e-6;
+
+  const EventLoopStats *p_loop_stats = &loop.stats;
+  const NetBatchStats *p_io_stats = net_batch_stats(net_batch);
+  printf("Hosted %ld ticks in %.3f s, points: %ld, CPU %.3f s (%.2f%% of a core)\n",
+         ticks, elapsed, points, cpu, elapsed > 0 ? 100. * cpu / elapsed : 0.);
+  printf("Wakeups: %ld (%ld on input), late ticks: %ld, tick lateness avg %.1f us, max %.1f us\n",
+         p_loop_stats->wakeups, p_loop_stats->socket_wakeups, p_loop_stats->late_ticks,
+         p_loop_stats->ticks > 0 ? p_loop_stats->tick_lateness_ns / 1000. / p_loop_stats->ticks : 0.,
+         p_loop_stats->max_tick_lateness_ns / 1000.);
+  printf("Datagrams: %ld received, %ld sent, %.2f syscalls/tick\n",
+         p_io_stats->received, p_io_stats->sent,
+         ticks > 0 ? (double)(p_io_stats->recv_syscalls + p_io_stats->send_syscalls) / ticks : 0.);
+  printf("Snapshots: %ld (%.1f/tick), events: %ld\n", host_snapshots_sent,
+         ticks > 0 ? (double)host_snapshots_sent / ticks : 0., host_events_sent);
+  const Session *p_player = session_get(&host_sessions, host_player);
+  if (NULL != p_player) {
+    const InputReceiverStats *p_input_stats = &p_player->input.stats;
+    printf("Inputs: %ld ticks, %ld recovered, %ld held, %ld skipped\n", p_input_stats->ticks,
+           p_input_stats->recovered, p_input_stats->held, p_input_stats->skipped);
+  }
+
+  result = 0;
+
+defer:
+  event_loop_fini(&loop);
+  session_table_fini(&host_sessions);
+  net_batch_destroy(net_batch);
+  net_batch = NULL;
+  close(ctx.server_sock.fd);
+  return result;
+}
+
+/// Re-simulates the --replay file without window as fast as possible
+static int run_replay_headless(void) {
+  GameContext ctx = replay_reader_initial_context(&replay_reader);
+  long points = 0;
+  long matches = 0;
+
+  double start = time_now_seconds();
+
+  while (replay_reader_next(&replay_reader, &ctx)) {
+    unsigned events = game_step(&ctx, ctx.tick_dt);
+    points += !!(events & GAME_EVENT_SCORE);
+    matches += !!(events & GAME_EVENT_MATCH_OVER);
+  }
+
+  double elapsed = time_now_seconds() - start;
+
+  printf("Replayed %ld ticks (%.1f s of play) in %.3f s: %.0f ticks/sec\n",
+         replay_reader.tick, replay_reader.tick * ctx.tick_dt, elapsed,
+         elapsed > 0 ? replay_reader.tick / elapsed : 0.);
+  printf("Points: %ld, matches: %ld, scores: %d:%d, ball: (%.2f, %.2f)\n",
+         points, matches, ctx.state.scores[0], ctx.state.scores[1], ctx.state.ball.rect.x, ctx.state.ball.rect.y);
+
+  replay_reader_close(&replay_reader);
+  return 0;
+}
+
+/// Same as run_headless, but steps many matches at once with the batch simulator.
+/// With --verify every match is also stepped by game_state_step and compared bit for bit
+static int run_headless_batch(const CmdConfig *p_cfg) {
+  GameState template_state = game_state_create();
+  float tick_dt = 1.f / p_cfg->tick_rate;
+
+  GameBatch batch = {0};
+  if (!game_batch_create(&batch, p_cfg->headless_matches, &template_state)) {
+    TraceLog(LOG_ERROR, "Could not allocate %d matches", p_cfg->headless_matches);
+    return 1;
+  }
+
+  // serve every match at a slightly different angle so they do not play the same rally
+  for (int i = 0; i < batch.count; ++i) {
+    batch.ball_direction_y[i] = (i % 9 - 4) * .1f;
+  }
+
+  GameState *p_reference = NULL;
+  if (p_cfg->headless_verify) {
+    p_reference = malloc(sizeof(GameState) * batch.count);
+    if (NULL == p_reference) {
+      TraceLog(LOG_ERROR, "Could not allocate %d matches for verification", batch.count);
+      game_batch_free(&batch);
+      return 1;
+    }
+    for (int i = 0; i < batch.count; ++i) {
+      game_batch_store(&batch, i, &p_reference[i]);
+    }
+  }
+
+  long points = 0;
+  long matches = 0;
+  long mismatches = 0;
+  double elapsed = 0;
+  double elapsed_step = 0;
+
+  for (long tick = 0; tick < p_cfg->headless_ticks; ++tick) {
+    double start = time_now_seconds();
+    game_batch_bot_input(&batch);
+    double step_start = time_now_seconds();
+    game_batch_step(&batch, tick_dt);
+    double end = time_now_seconds();
+    elapsed += end - start;
+    elapsed_step += end - step_start;
+
+    for (int i = 0; i < batch.count; ++i) {
+      points += !!(batch.events[i] & GAME_EVENT_SCORE);
+      matches += !!(batch.events[i] & GAME_EVENT_MATCH_OVER);
+    }
+
+    if (NULL == p_reference) continue;
+
+    for (int i = 0; i < batch.count; ++i) {
+      GameState batched;
+      game_bot_input(&p_reference[i], 0);
+      game_bot_input(&p_reference[i], 1);
+      unsigned events = game_state_step(&p_reference[i], tick_dt);
+      game_batch_store(&batch, i, &batched);
+
+      if (events != batch.events[i] || 0 != memcmp(&p_reference[i], &batched, sizeof(GameState))) {
+        if (0 == mismatches) {
+          TraceLog(LOG_WARNING, "Match %d diverged from game_step at tick %ld", i, tick);
+        }
+        mismatches += 1;
+        p_reference[i] = batched;
+      }
+    }
+  }
+
+  long match_ticks = p_cfg->headless_ticks * batch.count;
+  printf("Simulated %d matches x %ld ticks in %.3f s: %.0f match ticks/sec\n",
+         batch.count, p_cfg->headless_ticks, elapsed, elapsed > 0 ? match_ticks / elapsed : 0.);
+  printf("Physics only: %.3f s: %.0f match ticks/sec\n",
+         elapsed_step, elapsed_step > 0 ? match_ticks / elapsed_step : 0.);
+  printf("Vector steps: %ld, scalar steps: %ld\n", batch.vector_steps, batch.scalar_steps);
+  printf("Points: %ld, matches: %ld\n", points, matches);
+  if (NULL != p_reference) {
+    printf("Mismatches against game_state_step: %ld\n", mismatches);
+  }
+
+  free(p_reference);
+  game_batch_free(&batch);
+
+  return 0 == mismatches ? 0 : 1;
+}
+
+/// Plays every match to the end (or --ticks) on a pool of worker threads
+/// and reports how busy every worker was
+static int run_headless_threads(const CmdConfig *p_cfg) {
+  GameContext *contexts = malloc(sizeof(GameContext) * p_cfg->headless_matches);
+  if (NULL == contexts) {
+    TraceLog(LOG_ERROR, "Could not allocate %d matches", p_cfg->headless_matches);
+    return 1;
+  }
+
+  for (int i = 0; i < p_cfg->headless_matches; ++i) {
+    contexts[i] = game_context_create();
+    contexts[i].tick_dt = 1.f / p_cfg->tick_rate;
+    contexts[i].update = game_headless_update;
+    // different serve angles make matches last different time
+    contexts[i].state.ball.direction.y = (i % 9 - 4) * .1f;
+  }
+
+  MatchRunner runner = {
+    .contexts = contexts,
+    .count = p_cfg->headless_matches,
+    .worker_count = p_cfg->headless_threads,
+    .group_size = RUNNER_DEFAULT_GROUP_SIZE,
+    .quantum = RUNNER_DEFAULT_QUANTUM,
+    .max_ticks = p_cfg->headless_ticks,
+  };
+
+  if (!runner_run(&runner)) {
+    TraceLog(LOG_ERROR, "Could not start worker threads");
+    free(contexts);
+    return 1;
+  }
+
+  double wall = runner.wall_ns * 1e-9;
+  long ticks = 0;
+  int finished = 0;
+  for (int i = 0; i < runner.worker_count; ++i) {
+    ticks += runner.workers[i].ticks;
+  }
+  for (int i = 0; i < runner.count; ++i) {
+    finished += NULL == contexts[i].update;
+  }
+
+  printf("Simulated %d matches (%d finished) on %d threads in %.3f s: %.0f match ticks/sec\n",
+         runner.count, finished, runner.worker_count, wall, wall > 0 ? ticks / wall : 0.);
+  for (int i = 0; i < runner.worker_count; ++i) {
+    const RunnerWorkerStats *p_stats = &runner.workers[i];
+    printf("  worker %2d: utilization %5.1f%%, ticks %ld, tasks %ld, stolen %ld/%ld\n",
+           i, runner.wall_ns > 0 ? 100. * p_stats->busy_ns / runner.wall_ns : 0.,
+           p_stats->ticks, p_stats->tasks_run, p_stats->tasks_stolen, p_stats->steal_attempts);
+  }
+
+  free(contexts);
+  return 0;
+}
+
 int main(int argc, char **argv)
 {
   CmdConfig config = parse_args(argc, argv);
+  replay_record_path = config.record_path;
+  replay_speed = config.replay_speed;
+  host_send_rate = config.send_rate;
+  host_tick_rate = config.tick_rate;
+  net_set_backend(config.net_backend);
+
+  if (GAME_REPLAY == config.game_kind) {
+    if (!replay_reader_open(&replay_reader, config.replay_path)) {
+      return 1;
+    }
+
+    if (config.headless) {
+      return run_replay_headless();
+    }
+  }
+
+  if (config.bandwidth) {
+    return run_bandwidth_headless(&config);
+  }
+
+  if (config.headless && GAME_NETWORK_HOST == config.game_kind) {
+    return run_host_headless(&config);
+  }
+
+  if (config.headless && config.headless_threads > 0) {
+    return run_headless_threads(&config);
+  }
+
+  if (config.headless) {
+    return config.headless_matches > 1 || config.headless_verify
+      ? run_headless_batch(&config)
+      : run_headless(&config);
+  }
 
   const char *window_name = NULL;
   switch (config.game_kind) {
     case GAME_LOCAL: window_name = "PingPong (Local)"; break;
     case GAME_NETWORK_HOST: window_name = "PingPong (Host)"; break;
     case GAME_NETWORK_CLIENT: window_name = "PingPong (Client)"; break;
+    case GAME_REPLAY: window_name = "PingPong (Replay)"; break;
   }
   assert(NULL != window_name);
  
@@ -725,6 +2025,9 @@ int main(int argc, char **argv)
     if (IsKeyPressed(KEY_SPACE)) {
       ctx.is_paused = !ctx.is_paused;
     } 
+    if (IsKeyPressed(KEY_F3)) {
+      net_overlay_visible = !net_overlay_visible;
+    }
 
     handle_input(&ctx, dt);
     ctx.update(&ctx, dt);
@@ -0,0 +1,280 @@
+// pthread_detach and strdup
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "raylib.h"
+
+#include "net_connect.h"
+#include "timing.h"
+
+/// Shared by the caller and the resolver thread, the last one to let go frees it
+typedef struct {
+  int refs;
+  int is_done;
+  char *host;
+  int port;
+  struct sockaddr_in6 addrs[NET_RESOLVE_MAX_ADDRS];
+  int count;
+  double done_time;
+} Resolve;
+
+typedef struct {
+  struct sockaddr_in6 addr;
+  UdpSocket sock;
+  bool has_failed;
+  double probe_time;
+  uint32_t probes;
+} Attempt;
+
+struct NetConnect {
+  NetConnectState state;
+  Resolve *p_resolve;
+  uint16_t token;
+  double start_time;
+
+  // addresses in the order they are tried, the first attempt_count have started
+  Attempt attempts[NET_RESOLVE_MAX_ADDRS];
+  int address_count;
+  int attempt_count;
+  double attempt_time;
+  int winner;
+
+  NetConnectStats stats;
+};
+
+static void resolve_release(Resolve *p_resolve) {
+  if (0 == __atomic_sub_fetch(&p_resolve->refs, 1, __ATOMIC_ACQ_REL)) {
+    free(p_resolve->host);
+    free(p_resolve);
+  }
+}
+
+static void *resolve_main(void *p_arg) {
+  Resolve *p_resolve = p_arg;
+  p_resolve->count = net_resolve(p_resolve->host, p_resolve->port, p_resolve->addrs, NET_RESOLVE_MAX_ADDRS);
+  p_resolve->done_time = time_now_seconds();
+  __atomic_store_n(&p_resolve->is_done, 1, __ATOMIC_RELEASE);
+  resolve_release(p_resolve);
+  return NULL;
+}
+
+NetConnect *net_connect_start(const char *host, int port, uint16_t token) {
+  NetConnect *p_connect = calloc(1, sizeof(NetConnect));
+  Resolve *p_resolve = calloc(1, sizeof(Resolve));
+  char *host_copy = strdup(host);
+  if (NULL == p_connect || NULL == p_resolve || NULL == host_copy) {
+    TraceLog(LOG_ERROR, "Could not allocate the connection to %s", host);
+    free(p_connect);
+    free(p_resolve);
+    free(host_copy);
+    return NULL;
+  }
+
+  p_resolve->refs = 2;
+  p_resolve->host = host_copy;
+  p_resolve->port = port;
+  p_connect->p_resolve = p_resolve;
+  p_connect->state = NET_CONNECT_RESOLVING;
+  p_connect->token = token;
+  p_connect->start_time = time_now_seconds();
+  p_connect->winner = -1;
+
+  pthread_t thread;
+  int error = pthread_create(&thread, NULL, resolve_main, p_resolve);
+  if (0 != error) {
+    TraceLog(LOG_ERROR, "Could not start the resolver thread: %s", strerror(error));
+    free(host_copy);
+    free(p_resolve);
+    free(p_connect);
+    return NULL;
+  }
+  // getaddrinfo can not be cancelled, nobody waits for it
+  pthread_detach(thread);
+  return p_connect;
+}
+
+static void close_attempt(Attempt *p_attempt) {
+  if (p_attempt->sock.fd >= 0) {
+    close(p_attempt->sock.fd);
+    p_attempt->sock.fd = -1;
+  }
+}
+
+void net_connect_destroy(NetConnect *p_connect) {
+  if (NULL == p_connect) return;
+
+  for (int i = 0; i < p_connect->attempt_count; ++i) {
+    close_attempt(&p_connect->attempts[i]);
+  }
+  resolve_release(p_connect->p_resolve);
+  free(p_connect);
+}
+
+/// Orders the addresses as RFC 8305 does: the family getaddrinfo put first,
+/// then the families take turns
+static void order_addresses(NetConnect *p_connect, const Resolve *p_resolve) {
+  bool is_taken[NET_RESOLVE_MAX_ADDRS] = {0};
+  bool wants_ipv4 = net_addr_is_ipv4(&p_resolve->addrs[0]);
+
+  for (int n = 0; n < p_resolve->count; ++n) {
+    int next = -1;
+    for (int i = 0; i < p_resolve->count && next < 0; ++i) {
+      if (!is_taken[i] && net_addr_is_ipv4(&p_resolve->addrs[i]) == wants_ipv4) next = i;
+    }
+    // only the other family is left
+    for (int i = 0; i < p_resolve->count && next < 0; ++i) {
+      if (!is_taken[i]) next = i;
+    }
+
+    is_taken[next] = true;
+    p_connect->attempts[n].addr = p_resolve->addrs[next];
+    p_connect->attempts[n].sock.fd = -1;
+    wants_ipv4 = !net_addr_is_ipv4(&p_resolve->addrs[next]);
+  }
+  p_connect->address_count = p_resolve->count;
+}
+
+static void fail_attempt(Attempt *p_attempt, const char *reason) {
+  char addr[NET_ADDR_STRLEN] = {0};
+  TraceLog(LOG_WARNING, "Could not reach %s: %s", net_addr_format(&p_attempt->addr, addr), reason);
+  close_attempt(p_attempt);
+  p_attempt->has_failed = true;
+}
+
+static void send_probe(NetConnect *p_connect, Attempt *p_attempt, double now) {
+  NetPing ping = {0};
+  ping.seq = p_attempt->probes++;
+  ping.time_ns = time_now_ns();
+  char buf[NET_PING_SIZE] = {0};
+  int len = net_encode_ping(buf, NET_CMD_PING, &ping, p_connect->token);
+
+  p_attempt->probe_time = now;
+  // an unreachable network fails right here, a closed port with the next receive
+  if (send(p_attempt->sock.fd, buf, len, 0) < 0 && EAGAIN != errno && EWOULDBLOCK != errno) {
+    fail_attempt(p_attempt, strerror(errno));
+  }
+}
+
+static void start_attempt(NetConnect *p_connect, double now) {
+  Attempt *p_attempt = &p_connect->attempts[p_connect->attempt_count++];
+  p_connect->attempt_time = now;
+  p_connect->stats.attempts += 1;
+
+  char addr[NET_ADDR_STRLEN] = {0};
+  TraceLog(LOG_INFO, "Trying %s", net_addr_format(&p_attempt->addr, addr));
+  if (!net_connect_udp(&p_attempt->addr, &p_attempt->sock)) {
+    p_attempt->sock.fd = -1;
+    p_attempt->has_failed = true;
+    return;
+  }
+  send_probe(p_connect, p_attempt, now);
+}
+
+/// Reads what came back to the attempt
+/// @returns true if the host answered the probe
+static bool receive_answer(NetConnect *p_connect, Attempt *p_attempt) {
+  char buf[NET_BUF_SIZE] = {0};
+  for (;;) {
+    ssize_t len = recv(p_attempt->sock.fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (len < 0) {
+      if (EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno) {
+        fail_attempt(p_attempt, strerror(errno));
+      }
+      return false;
+    }
+
+    NetPing pong = {0};
+    if (NET_CMD_PONG == buf[0] && net_decode_ping(buf, (int)len, &pong)
+      && net_cmd_token(buf) == p_connect->token) {
+      p_connect->stats.rtt = (time_now_ns() - pong.time_ns) * 1e-9;
+      return true;
+    }
+  }
+}
+
+/// Races the attempts, the first answer wins and the rest are closed
+static void try_attempts(NetConnect *p_connect, double now) {
+  bool is_pending = false;
+  for (int i = 0; i < p_connect->attempt_count; ++i) {
+    Attempt *p_attempt = &p_connect->attempts[i];
+    if (p_attempt->has_failed) continue;
+
+    if (receive_answer(p_connect, p_attempt)) {
+      p_connect->winner = i;
+      break;
+    }
+    if (p_attempt->has_failed) continue;
+
+    if (now - p_attempt->probe_time >= NET_CONNECT_PROBE_INTERVAL) {
+      send_probe(p_connect, p_attempt, now);
+    }
+    is_pending = is_pending || !p_attempt->has_failed;
+  }
+
+  if (p_connect->winner >= 0) {
+    for (int i = 0; i < p_connect->attempt_count; ++i) {
+      if (i != p_connect->winner) close_attempt(&p_connect->attempts[i]);
+    }
+    p_connect->state = NET_CONNECT_DONE;
+    p_connect->stats.connect_time = now - p_connect->start_time;
+    return;
+  }
+
+  // the next address goes while the previous ones may still answer
+  bool has_next = p_connect->attempt_count < p_connect->address_count;
+  if (has_next && (!is_pending || now - p_connect->attempt_time >= NET_CONNECT_ATTEMPT_DELAY)) {
+    start_attempt(p_connect, now);
+    return;
+  }
+
+  double elapsed = now - p_connect->start_time - p_connect->stats.resolve_time;
+  if ((!has_next && !is_pending) || elapsed >= NET_CONNECT_TIMEOUT) {
+    p_connect->state = NET_CONNECT_FAILED;
+    p_connect->stats.connect_time = now - p_connect->start_time;
+  }
+}
+
+NetConnectState net_connect_poll(NetConnect *p_connect, double now) {
+  if (NET_CONNECT_RESOLVING == p_connect->state) {
+    Resolve *p_resolve = p_connect->p_resolve;
+    if (!__atomic_load_n(&p_resolve->is_done, __ATOMIC_ACQUIRE)) {
+      return p_connect->state;
+    }
+
+    p_connect->stats.resolve_time = p_resolve->done_time - p_connect->start_time;
+    p_connect->stats.addresses = p_resolve->count > 0 ? p_resolve->count : 0;
+    if (p_resolve->count <= 0) {
+      p_connect->state = NET_CONNECT_FAILED;
+      return p_connect->state;
+    }
+    order_addresses(p_connect, p_resolve);
+    p_connect->state = NET_CONNECT_TRYING;
+  }
+
+  if (NET_CONNECT_TRYING == p_connect->state) {
+    try_attempts(p_connect, now);
+  }
+  return p_connect->state;
+}
+
+bool net_connect_take(NetConnect *p_connect, UdpSocket *out) {
+  if (NET_CONNECT_DONE != p_connect->state || p_connect->winner < 0) {
+    return false;
+  }
+
+  Attempt *p_attempt = &p_connect->attempts[p_connect->winner];
+  *out = p_attempt->sock;
+  p_attempt->sock.fd = -1;
+  p_connect->winner = -1;
+  return true;
+}
+
+const NetConnectStats *net_connect_stats(const NetConnect *p_connect) {
+  return &p_connect->stats;
+}
@@ -0,0 +1,64 @@
+#ifndef __NET_CONNECT_H__
+#define __NET_CONNECT_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "network.h"
+
+// The next address is tried this long after the previous one if that has not
+// answered yet, the connection attempt delay RFC 8305 recommends
+#define NET_CONNECT_ATTEMPT_DELAY 0.25
+
+// An attempt sends its probe again this often while it is not answered
+#define NET_CONNECT_PROBE_INTERVAL 0.25
+
+// Gives up this long after the host was resolved if none of its addresses answered
+#define NET_CONNECT_TIMEOUT 10.
+
+typedef enum {
+  // getaddrinfo runs on its own thread
+  NET_CONNECT_RESOLVING,
+  // probes race over the addresses
+  NET_CONNECT_TRYING,
+  NET_CONNECT_DONE,
+  NET_CONNECT_FAILED,
+} NetConnectState;
+
+typedef struct {
+  // seconds from net_connect_start
+  double resolve_time;
+  double connect_time;
+  int addresses;
+  int attempts;
+  // round trip of the probe that answered first
+  double rtt;
+} NetConnectStats;
+
+/// Connects to a host by name without ever blocking the caller: getaddrinfo resolves
+/// it on a helper thread, then the addresses (IPv6 and IPv4 taking turns, as
+/// getaddrinfo prefers them) are tried Happy Eyeballs style (RFC 8305). Every attempt
+/// has its own dual-stack socket and pings the host, a new one starts every
+/// NET_CONNECT_ATTEMPT_DELAY or as soon as the previous one failed, and the first
+/// address whose pong comes back wins. The host answers a ping without a session,
+/// so the attempts that lose leave nothing behind on it
+typedef struct NetConnect NetConnect;
+
+/// Starts resolving the host, the token goes into the probes
+/// @returns NULL if out of memory or the thread could not start
+NetConnect *net_connect_start(const char *host, int port, uint16_t token);
+
+/// Closes the sockets of the attempts. A resolver still running finishes on its own
+void net_connect_destroy(NetConnect *p_connect);
+
+/// Takes the answers, starts the next attempt when it is due and sends the probes again
+/// @returns the state after that
+NetConnectState net_connect_poll(NetConnect *p_connect, double now);
+
+/// Hands over the socket of the address that won, once net_connect_poll is done
+/// @returns false if it is not done
+bool net_connect_take(NetConnect *p_connect, UdpSocket *out);
+
+const NetConnectStats *net_connect_stats(const NetConnect *p_connect);
+
+#endif // !__NET_CONNECT_H__
@@ -0,0 +1,195 @@
+#include <math.h>
+#include <string.h>
+
+#include "raylib.h"
+
+#include "net_quality.h"
+
+void net_quality_init(NetQuality *p_quality, double now) {
+  memset(p_quality, 0, sizeof(*p_quality));
+  p_quality->next_ping_time = now;
+  p_quality->second_start = now;
+  p_quality->start = now;
+  net_quality_restart(p_quality);
+}
+
+void net_quality_restart(NetQuality *p_quality) {
+  p_quality->rtt = -1;
+  p_quality->min_rtt = -1;
+  p_quality->last_rtt = -1;
+  p_quality->jitter = 0;
+  p_quality->has_peer_ping = false;
+  p_quality->peer_received = 0;
+  p_quality->has_pong = false;
+  p_quality->second_peer_expected = 0;
+  p_quality->second_peer_received = 0;
+}
+
+bool net_quality_open_csv(NetQuality *p_quality, const char *path) {
+  net_quality_close_csv(p_quality);
+
+  p_quality->p_csv = fopen(path, "w");
+  if (NULL == p_quality->p_csv) {
+    TraceLog(LOG_ERROR, "Could not create %s", path);
+    return false;
+  }
+
+  fprintf(p_quality->p_csv, "time_s,rtt_ms,min_rtt_ms,jitter_ms,loss_in_pct,loss_out_pct,"
+          "bytes_in_per_s,bytes_out_per_s,packets_in_per_s,packets_out_per_s,"
+          "pings_in_expected,pings_in_received,pings_out_expected,pings_out_received\n");
+  return true;
+}
+
+void net_quality_close_csv(NetQuality *p_quality) {
+  if (NULL != p_quality->p_csv) {
+    fclose(p_quality->p_csv);
+    p_quality->p_csv = NULL;
+  }
+}
+
+bool net_quality_ping(NetQuality *p_quality, double now, NetPing *out) {
+  if (now < p_quality->next_ping_time) {
+    return false;
+  }
+
+  p_quality->next_ping_time = now + 1. / NET_QUALITY_PING_RATE;
+  memset(out, 0, sizeof(*out));
+  out->seq = p_quality->ping_seq++;
+  out->time_ns = (uint64_t)(now * 1e9);
+  return true;
+}
+
+void net_quality_on_ping(NetQuality *p_quality, const NetPing *p_ping) {
+  if (!p_quality->has_peer_ping) {
+    p_quality->has_peer_ping = true;
+    p_quality->peer_first_seq = p_ping->seq;
+    p_quality->peer_newest_seq = p_ping->seq;
+  } else if ((int32_t)(p_ping->seq - p_quality->peer_newest_seq) > 0) {
+    p_quality->peer_newest_seq = p_ping->seq;
+  }
+  p_quality->peer_received += 1;
+}
+
+void net_quality_on_pong(NetQuality *p_quality, const NetPing *p_pong, double arrival) {
+  // a pong older than the newest one only brings a round trip
+  if (!p_quality->has_pong || (int32_t)(p_pong->seq - p_quality->pong_seq) > 0) {
+    if (p_quality->has_pong && p_pong->received >= p_quality->pong_received) {
+      p_quality->second_loss_out.expected += p_pong->seq - p_quality->pong_seq;
+      p_quality->second_loss_out.received += p_pong->received - p_quality->pong_received;
+    }
+    p_quality->has_pong = true;
+    p_quality->pong_seq = p_pong->seq;
+    p_quality->pong_received = p_pong->received;
+  }
+
+  double rtt = arrival - p_pong->time_ns * 1e-9 - p_pong->hold_ns * 1e-9;
+  if (rtt < 0) rtt = 0;
+
+  if (p_quality->rtt < 0) {
+    p_quality->rtt = rtt;
+    p_quality->min_rtt = rtt;
+  } else {
+    p_quality->rtt += (rtt - p_quality->rtt) / 8;
+    p_quality->jitter += (fabs(rtt - p_quality->last_rtt) - p_quality->jitter) / 16;
+    if (rtt < p_quality->min_rtt) p_quality->min_rtt = rtt;
+  }
+  p_quality->last_rtt = rtt;
+}
+
+static void write_csv_row(NetQuality *p_quality, const NetQualitySecond *p_second, double now) {
+  FILE *p_csv = p_quality->p_csv;
+  fprintf(p_csv, "%.3f,", now - p_quality->start);
+  if (p_quality->rtt >= 0) {
+    fprintf(p_csv, "%.3f,%.3f,%.3f,", p_quality->rtt * 1000., p_quality->min_rtt * 1000.,
+            p_quality->jitter * 1000.);
+  } else {
+    fprintf(p_csv, ",,,");
+  }
+
+  const NetLossCount *p_counts[2] = { &p_second->loss_in, &p_second->loss_out };
+  for (int i = 0; i < 2; ++i) {
+    const NetLossCount *p_count = p_counts[i];
+    if (p_count->expected > 0) {
+      uint32_t received = p_count->received < p_count->expected ? p_count->received : p_count->expected;
+      fprintf(p_csv, "%.2f,", 100. * (p_count->expected - received) / p_count->expected);
+    } else {
+      fprintf(p_csv, ",");
+    }
+  }
+
+  fprintf(p_csv, "%.0f,%.0f,%.1f,%.1f,%u,%u,%u,%u\n",
+          p_second->bytes_in, p_second->bytes_out, p_second->packets_in, p_second->packets_out,
+          p_second->loss_in.expected, p_second->loss_in.received,
+          p_second->loss_out.expected, p_second->loss_out.received);
+  // a row a second, it is all there even if the game is killed
+  fflush(p_csv);
+}
+
+void net_quality_update(NetQuality *p_quality, double now, const NetBatchStats *p_io) {
+  double elapsed = now - p_quality->second_start;
+  if (elapsed < 1.) {
+    return;
+  }
+
+  const NetBatchStats *p_start = &p_quality->second_io;
+  NetQualitySecond *p_second = &p_quality->seconds[p_quality->seconds_count % NET_QUALITY_LOSS_WINDOW];
+  p_second->bytes_in = (p_io->bytes_received - p_start->bytes_received) / elapsed;
+  p_second->bytes_out = (p_io->bytes_sent - p_start->bytes_sent) / elapsed;
+  p_second->packets_in = (p_io->received - p_start->received) / elapsed;
+  p_second->packets_out = (p_io->sent - p_start->sent) / elapsed;
+
+  uint32_t peer_expected = p_quality->has_peer_ping
+    ? p_quality->peer_newest_seq - p_quality->peer_first_seq + 1
+    : 0;
+  p_second->loss_in.expected = peer_expected - p_quality->second_peer_expected;
+  p_second->loss_in.received = p_quality->peer_received - p_quality->second_peer_received;
+  p_second->loss_out = p_quality->second_loss_out;
+  p_quality->seconds_count += 1;
+
+  if (NULL != p_quality->p_csv) {
+    write_csv_row(p_quality, p_second, now);
+  }
+
+  p_quality->second_start = now;
+  p_quality->second_io = *p_io;
+  p_quality->second_peer_expected = peer_expected;
+  p_quality->second_peer_received = p_quality->peer_received;
+  memset(&p_quality->second_loss_out, 0, sizeof(p_quality->second_loss_out));
+}
+
+const NetQualitySecond *net_quality_last_second(const NetQuality *p_quality) {
+  if (0 == p_quality->seconds_count) {
+    return NULL;
+  }
+  return &p_quality->seconds[(p_quality->seconds_count - 1) % NET_QUALITY_LOSS_WINDOW];
+}
+
+/// @returns lost fraction of the pings of the loss window one way
+static double window_loss(const NetQuality *p_quality, bool is_incoming) {
+  uint64_t expected = 0;
+  uint64_t received = 0;
+  long count = p_quality->seconds_count < NET_QUALITY_LOSS_WINDOW
+    ? p_quality->seconds_count
+    : NET_QUALITY_LOSS_WINDOW;
+  for (long i = 0; i < count; ++i) {
+    const NetQualitySecond *p_second = &p_quality->seconds[i];
+    const NetLossCount *p_loss = is_incoming ? &p_second->loss_in : &p_second->loss_out;
+    expected += p_loss->expected;
+    received += p_loss->received;
+  }
+
+  if (0 == expected) {
+    return -1;
+  }
+  // a ping that was late for its second arrives in the next one
+  if (received > expected) received = expected;
+  return (double)(expected - received) / expected;
+}
+
+double net_quality_loss_in(const NetQuality *p_quality) {
+  return window_loss(p_quality, true);
+}
+
+double net_quality_loss_out(const NetQuality *p_quality) {
+  return window_loss(p_quality, false);
+}
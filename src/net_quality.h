@@ -0,0 +1,110 @@
+#ifndef __NET_QUALITY_H__
+#define __NET_QUALITY_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "network.h"
+
+// Pings per second each side sends, enough to tell the loss of a few seconds in percent
+#define NET_QUALITY_PING_RATE 20
+
+// The loss shown is of this many latest seconds
+#define NET_QUALITY_LOSS_WINDOW 10
+
+typedef struct {
+  // pings one side sent and the other received
+  uint32_t expected;
+  uint32_t received;
+} NetLossCount;
+
+/// One second of a connection, a row of the CSV
+typedef struct {
+  double bytes_in;
+  double bytes_out;
+  double packets_in;
+  double packets_out;
+  NetLossCount loss_in;
+  NetLossCount loss_out;
+} NetQualitySecond;
+
+/// Health of the connection to one peer: both sides ping each other and answer
+/// the pings with pongs. The round trip is measured between the receive timestamps
+/// of the kernel and without the time the peer held the ping, the loss each way
+/// from the gaps in the sequence of the pings, the rates from the socket totals
+typedef struct {
+  // smoothed round trip time (every sample counts 1/8 like in TCP), the lowest one
+  // and the latest one, seconds. Negative before the first pong
+  double rtt;
+  double min_rtt;
+  double last_rtt;
+  // mean difference of consecutive round trips (RFC 3550), seconds
+  double jitter;
+
+  // seq of the next ping
+  uint32_t ping_seq;
+  double next_ping_time;
+
+  // pings of the peer, their loss is the incoming one
+  bool has_peer_ping;
+  uint32_t peer_first_seq;
+  uint32_t peer_newest_seq;
+  uint32_t peer_received;
+
+  // newest pong: the outgoing loss is counted between pongs
+  bool has_pong;
+  uint32_t pong_seq;
+  uint32_t pong_received;
+
+  // the second being counted, the totals at its start
+  double second_start;
+  NetBatchStats second_io;
+  uint32_t second_peer_expected;
+  uint32_t second_peer_received;
+  NetLossCount second_loss_out;
+
+  // the last NET_QUALITY_LOSS_WINDOW seconds, the newest at seconds_count - 1
+  NetQualitySecond seconds[NET_QUALITY_LOSS_WINDOW];
+  long seconds_count;
+
+  double start;
+  // every second is appended if not NULL
+  FILE *p_csv;
+} NetQuality;
+
+void net_quality_init(NetQuality *p_quality, double now);
+
+/// Forgets the peer for a new one, keeps the rates and the CSV
+void net_quality_restart(NetQuality *p_quality);
+
+/// Appends a row per second from now on, closes the previous file
+/// @returns false if the file could not be created
+bool net_quality_open_csv(NetQuality *p_quality, const char *path);
+
+void net_quality_close_csv(NetQuality *p_quality);
+
+/// @returns true and the ping to send if it is time to ping the peer
+bool net_quality_ping(NetQuality *p_quality, double now, NetPing *out);
+
+/// Counts the peer's ping. Answer it with peer_received
+void net_quality_on_ping(NetQuality *p_quality, const NetPing *p_ping);
+
+/// Takes the round trip of the pong that arrived at the time
+void net_quality_on_pong(NetQuality *p_quality, const NetPing *p_pong, double arrival);
+
+/// Counts the rates from the totals of the socket, closes a second once it is over
+void net_quality_update(NetQuality *p_quality, double now, const NetBatchStats *p_io);
+
+/// @returns the newest complete second, NULL if there is none yet
+const NetQualitySecond *net_quality_last_second(const NetQuality *p_quality);
+
+/// @returns fraction of the peer's pings of the loss window that did not arrive,
+/// negative if none was expected
+double net_quality_loss_in(const NetQuality *p_quality);
+
+/// @returns fraction of the pings of the loss window the peer did not receive,
+/// negative if none was expected
+double net_quality_loss_out(const NetQuality *p_quality);
+
+#endif // !__NET_QUALITY_H__
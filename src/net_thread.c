@@ -0,0 +1,245 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "raylib.h"
+
+#include "net_thread.h"
+#include "timing.h"
+
+#define CACHE_LINE_SIZE 64
+#define RING_MASK (NET_THREAD_RING_CAPACITY - 1)
+
+/// Single producer single consumer ring: only the producer moves tail, only the
+/// consumer moves head, each publishes its slot with a release store
+typedef struct {
+  unsigned long head;
+  char head_padding[CACHE_LINE_SIZE - sizeof(unsigned long)];
+  unsigned long tail;
+  char tail_padding[CACHE_LINE_SIZE - sizeof(unsigned long)];
+  NetMessage slots[NET_THREAD_RING_CAPACITY];
+} MessageRing;
+
+struct NetThread {
+  // network thread to the game
+  MessageRing inbound;
+  // game to the network thread
+  MessageRing outbound;
+  int fd;
+  // written by the game to wake the thread up for sending or stopping
+  int wake_fd;
+  int should_stop;
+  pthread_t thread;
+  NetBatch *p_batch;
+  // written by the network thread, read with atomic loads by the game
+  NetThreadStats stats;
+};
+
+/// @returns the slot to fill before ring_push, NULL if the ring is full
+static NetMessage *ring_reserve(MessageRing *p_ring) {
+  unsigned long tail = __atomic_load_n(&p_ring->tail, __ATOMIC_RELAXED);
+  unsigned long head = __atomic_load_n(&p_ring->head, __ATOMIC_ACQUIRE);
+  if (tail - head == NET_THREAD_RING_CAPACITY) {
+    return NULL;
+  }
+  return &p_ring->slots[tail & RING_MASK];
+}
+
+static void ring_push(MessageRing *p_ring) {
+  unsigned long tail = __atomic_load_n(&p_ring->tail, __ATOMIC_RELAXED);
+  __atomic_store_n(&p_ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/// @returns the oldest message to read before ring_pop, NULL if the ring is empty
+static const NetMessage *ring_peek(MessageRing *p_ring) {
+  unsigned long head = __atomic_load_n(&p_ring->head, __ATOMIC_RELAXED);
+  unsigned long tail = __atomic_load_n(&p_ring->tail, __ATOMIC_ACQUIRE);
+  if (head == tail) {
+    return NULL;
+  }
+  return &p_ring->slots[head & RING_MASK];
+}
+
+static void ring_pop(MessageRing *p_ring) {
+  unsigned long head = __atomic_load_n(&p_ring->head, __ATOMIC_RELAXED);
+  __atomic_store_n(&p_ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void publish_stat(long *p_stat, long value) {
+  __atomic_store_n(p_stat, value, __ATOMIC_RELAXED);
+}
+
+static void receive_all(NetThread *p_thread) {
+  int count = 0;
+  do {
+    count = net_batch_recv(p_thread->p_batch);
+    double now = time_now_seconds();
+
+    for (int i = 0; i < count; ++i) {
+      NetMessage *p_message = ring_reserve(&p_thread->inbound);
+      if (NULL == p_message) {
+        publish_stat(&p_thread->stats.inbound_dropped, p_thread->stats.inbound_dropped + 1);
+        continue;
+      }
+
+      const char *buf = net_batch_datagram(p_thread->p_batch, i, &p_message->len, &p_message->addr);
+      memcpy(p_message->buf, buf, p_message->len);
+      uint64_t arrival_ns = net_batch_datagram_time(p_thread->p_batch, i);
+      p_message->time = 0 != arrival_ns ? arrival_ns * 1e-9 : now;
+      ring_push(&p_thread->inbound);
+    }
+  } while (NET_BATCH_CAPACITY == count);
+}
+
+static void send_all(NetThread *p_thread) {
+  const NetMessage *p_message = NULL;
+  while (NULL != (p_message = ring_peek(&p_thread->outbound))) {
+    net_batch_queue(p_thread->p_batch, &p_message->addr, p_message->buf, p_message->len);
+    ring_pop(&p_thread->outbound);
+  }
+  net_batch_flush(p_thread->p_batch);
+}
+
+static void *net_thread_main(void *p_arg) {
+  NetThread *p_thread = p_arg;
+  struct pollfd fds[2] = {
+    { .fd = net_batch_poll_fd(p_thread->p_batch), .events = POLLIN },
+    { .fd = p_thread->wake_fd, .events = POLLIN },
+  };
+
+  // arms the io_uring receive on this thread, and takes what came before it started
+  receive_all(p_thread);
+
+  while (!__atomic_load_n(&p_thread->should_stop, __ATOMIC_ACQUIRE)) {
+    if (poll(fds, 2, -1) < 0) {
+      if (EINTR == errno) continue;
+      TraceLog(LOG_ERROR, "Network thread could not wait for the socket: %s", strerror(errno));
+      break;
+    }
+
+    if (fds[0].revents & POLLIN) {
+      receive_all(p_thread);
+    }
+
+    if (fds[1].revents & POLLIN) {
+      uint64_t value = 0;
+      if (read(p_thread->wake_fd, &value, sizeof(value)) < 0 && EAGAIN != errno) {
+        TraceLog(LOG_WARNING, "Network thread could not read its wakeup: %s", strerror(errno));
+      }
+      send_all(p_thread);
+    }
+
+    const NetBatchStats *p_io = net_batch_stats(p_thread->p_batch);
+    publish_stat(&p_thread->stats.io.recv_syscalls, p_io->recv_syscalls);
+    publish_stat(&p_thread->stats.io.send_syscalls, p_io->send_syscalls);
+    publish_stat(&p_thread->stats.io.received, p_io->received);
+    publish_stat(&p_thread->stats.io.sent, p_io->sent);
+    publish_stat(&p_thread->stats.io.bytes_received, p_io->bytes_received);
+    publish_stat(&p_thread->stats.io.bytes_sent, p_io->bytes_sent);
+    publish_stat(&p_thread->stats.wakeups, p_thread->stats.wakeups + 1);
+  }
+
+  return NULL;
+}
+
+NetThread *net_thread_start(int fd) {
+  NetThread *p_thread = calloc(1, sizeof(NetThread));
+  if (NULL == p_thread) {
+    return NULL;
+  }
+
+  p_thread->fd = fd;
+  p_thread->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  p_thread->p_batch = net_batch_create(fd);
+  if (-1 == p_thread->wake_fd || NULL == p_thread->p_batch) {
+    TraceLog(LOG_ERROR, "Could not set up the network thread: %s", strerror(errno));
+    goto defer;
+  }
+
+  if (0 != pthread_create(&p_thread->thread, NULL, net_thread_main, p_thread)) {
+    TraceLog(LOG_ERROR, "Could not start the network thread");
+    goto defer;
+  }
+
+  return p_thread;
+
+defer:
+  if (-1 != p_thread->wake_fd) close(p_thread->wake_fd);
+  net_batch_destroy(p_thread->p_batch);
+  free(p_thread);
+  return NULL;
+}
+
+void net_thread_stop(NetThread *p_thread) {
+  if (NULL == p_thread) return;
+
+  __atomic_store_n(&p_thread->should_stop, 1, __ATOMIC_RELEASE);
+  net_thread_flush(p_thread);
+  pthread_join(p_thread->thread, NULL);
+
+  close(p_thread->wake_fd);
+  net_batch_destroy(p_thread->p_batch);
+  free(p_thread);
+}
+
+bool net_thread_recv(NetThread *p_thread, NetMessage *out) {
+  const NetMessage *p_message = ring_peek(&p_thread->inbound);
+  if (NULL == p_message) {
+    return false;
+  }
+
+  out->time = p_message->time;
+  out->addr = p_message->addr;
+  out->len = p_message->len;
+  memcpy(out->buf, p_message->buf, p_message->len);
+  ring_pop(&p_thread->inbound);
+  return true;
+}
+
+void net_thread_queue(NetThread *p_thread, const struct sockaddr_in6 *p_dest, const char *buf, int len) {
+  if (len > NET_BUF_SIZE) {
+    TraceLog(LOG_WARNING, "Datagram of %d bytes does not fit into the send ring", len);
+    return;
+  }
+
+  NetMessage *p_message = ring_reserve(&p_thread->outbound);
+  if (NULL == p_message) {
+    // only the game writes it
+    publish_stat(&p_thread->stats.outbound_dropped, p_thread->stats.outbound_dropped + 1);
+    return;
+  }
+
+  p_message->addr = *p_dest;
+  p_message->len = len;
+  memcpy(p_message->buf, buf, len);
+  ring_push(&p_thread->outbound);
+}
+
+void net_thread_flush(NetThread *p_thread) {
+  uint64_t value = 1;
+  if (write(p_thread->wake_fd, &value, sizeof(value)) < 0 && EAGAIN != errno) {
+    TraceLog(LOG_WARNING, "Could not wake the network thread: %s", strerror(errno));
+  }
+}
+
+NetThreadStats net_thread_stats(const NetThread *p_thread) {
+  const NetThreadStats *p_stats = &p_thread->stats;
+  NetThreadStats stats = {0};
+  stats.io.recv_syscalls = __atomic_load_n(&p_stats->io.recv_syscalls, __ATOMIC_RELAXED);
+  stats.io.send_syscalls = __atomic_load_n(&p_stats->io.send_syscalls, __ATOMIC_RELAXED);
+  stats.io.received = __atomic_load_n(&p_stats->io.received, __ATOMIC_RELAXED);
+  stats.io.sent = __atomic_load_n(&p_stats->io.sent, __ATOMIC_RELAXED);
+  stats.io.bytes_received = __atomic_load_n(&p_stats->io.bytes_received, __ATOMIC_RELAXED);
+  stats.io.bytes_sent = __atomic_load_n(&p_stats->io.bytes_sent, __ATOMIC_RELAXED);
+  stats.inbound_dropped = __atomic_load_n(&p_stats->inbound_dropped, __ATOMIC_RELAXED);
+  stats.outbound_dropped = __atomic_load_n(&p_stats->outbound_dropped, __ATOMIC_RELAXED);
+  stats.wakeups = __atomic_load_n(&p_stats->wakeups, __ATOMIC_RELAXED);
+  return stats;
+}
@@ -0,0 +1,57 @@
+#ifndef __NET_THREAD_H__
+#define __NET_THREAD_H__
+
+#include <stdbool.h>
+
+#include "network.h"
+
+// Messages each ring holds, a frame of a host sends and receives far fewer
+#define NET_THREAD_RING_CAPACITY 256
+
+/// A datagram on its way between the network thread and the game
+typedef struct {
+  // time_now_seconds when the kernel received it, or the network thread
+  // if the socket has no receive timestamps
+  double time;
+  // source of a received message, destination of a sent one
+  struct sockaddr_in6 addr;
+  int len;
+  char buf[NET_BUF_SIZE];
+} NetMessage;
+
+typedef struct {
+  NetBatchStats io;
+  // received while the game did not take them fast enough
+  long inbound_dropped;
+  // queued while the network thread did not send them fast enough
+  long outbound_dropped;
+  long wakeups;
+} NetThreadStats;
+
+/// Owns the socket on its own thread: receives datagrams the moment they arrive,
+/// stamps them with the arrival time and sends what the game queued as soon as
+/// it is flushed. Messages go both ways through wait-free single producer single
+/// consumer rings allocated once, the game never blocks on the socket
+typedef struct NetThread NetThread;
+
+/// Starts the thread on the socket, nobody else may read from it afterwards
+/// @returns NULL if out of memory or the thread could not start
+NetThread *net_thread_start(int fd);
+
+/// Stops the thread, sends nothing that is still queued. NULL is ignored
+void net_thread_stop(NetThread *p_thread);
+
+/// Takes the oldest received message
+/// @returns false if there is none
+bool net_thread_recv(NetThread *p_thread, NetMessage *out);
+
+/// Copies the datagram of len bytes (at most NET_BUF_SIZE) into the send ring,
+/// it is dropped if the ring is full
+void net_thread_queue(NetThread *p_thread, const struct sockaddr_in6 *p_dest, const char *buf, int len);
+
+/// Wakes the thread to send everything queued
+void net_thread_flush(NetThread *p_thread);
+
+NetThreadStats net_thread_stats(const NetThread *p_thread);
+
+#endif // !__NET_THREAD_H__
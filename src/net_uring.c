@@ -0,0 +1,502 @@
+// syscall and MAP_POPULATE, glibc has no io_uring wrappers
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include "raylib.h"
+
+#include "net_uring.h"
+
+// Only a flush and a rearm submit, each at most NET_BATCH_CAPACITY entries
+#define SQ_ENTRIES 128
+// Every provided buffer and send slot can complete before anyone reaps
+#define CQ_ENTRIES 1024
+
+#define RECV_GROUP 0
+#define RECV_TAG UINT64_MAX
+#define CANCEL_TAG (UINT64_MAX - 1)
+#define WAKE_TAG (UINT64_MAX - 2)
+
+// room for the SO_TIMESTAMPNS control message
+#define RECV_CONTROL_SIZE CMSG_SPACE(sizeof(struct timespec))
+#define RECV_ADDR_OFFSET sizeof(struct io_uring_recvmsg_out)
+#define RECV_CONTROL_OFFSET (RECV_ADDR_OFFSET + sizeof(struct sockaddr_in6))
+// recvmsg puts its header, the source address and the control messages in front of the payload
+#define RECV_PAYLOAD_OFFSET (RECV_CONTROL_OFFSET + RECV_CONTROL_SIZE)
+// 76 bytes of them and a datagram of NET_BUF_SIZE, rounded up so every buffer starts aligned
+#define RECV_BUF_SIZE ((RECV_PAYLOAD_OFFSET + NET_BUF_SIZE + 7) & ~(size_t)7)
+#define RECV_BUF_MASK (NET_URING_RECV_BUFFERS - 1)
+
+typedef struct {
+  unsigned *p_head;
+  unsigned *p_tail;
+  unsigned mask;
+  // entries filled since the last io_uring_enter
+  unsigned pending;
+} SubmissionQueue;
+
+typedef struct {
+  unsigned *p_head;
+  unsigned *p_tail;
+  unsigned mask;
+  struct io_uring_cqe *cqes;
+} CompletionQueue;
+
+typedef struct {
+  struct sockaddr_in6 addr;
+  int len;
+} SendSlot;
+
+struct NetUring {
+  int fd;
+  int ring_fd;
+  void *p_rings;
+  size_t rings_size;
+  struct io_uring_sqe *sqes;
+  size_t sqes_size;
+  SubmissionQueue sq;
+  CompletionQueue cq;
+
+  struct io_uring_buf_ring *p_buf_ring;
+  uint16_t buf_ring_tail;
+  char *recv_bufs;
+  struct msghdr recv_msg;
+  bool is_armed;
+  // completed buffers net_uring_recv did not take yet, oldest first
+  uint16_t ready_ids[NET_URING_RECV_BUFFERS];
+  unsigned ready_head;
+  unsigned ready_count;
+  int recv_lens[NET_URING_RECV_BUFFERS];
+  // buffers of the last net_uring_recv
+  uint16_t batch_ids[NET_BATCH_CAPACITY];
+  int batch_count;
+
+  // NET_URING_SEND_SLOTS of NET_BUF_SIZE
+  char *send_bufs;
+  SendSlot send_slots[NET_URING_SEND_SLOTS];
+  int free_slots[NET_URING_SEND_SLOTS];
+  int free_count;
+  int queued_slots[NET_BATCH_CAPACITY];
+  int queued_count;
+  int in_flight;
+  // a no-op completion keeps the ring readable for the received datagrams reap_sends took
+  bool is_wake_posted;
+
+  NetBatchStats *p_stats;
+};
+
+static int uring_setup(unsigned entries, struct io_uring_params *p_params) {
+  return (int)syscall(__NR_io_uring_setup, entries, p_params);
+}
+
+static int uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+  return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int ring_fd, unsigned opcode, void *p_arg, unsigned nr_args) {
+  return (int)syscall(__NR_io_uring_register, ring_fd, opcode, p_arg, nr_args);
+}
+
+/// @returns a cleared entry, submitted by the next submit
+static struct io_uring_sqe *get_sqe(NetUring *p_uring) {
+  // without SQPOLL the kernel takes every entry during io_uring_enter,
+  // and less than SQ_ENTRIES are ever filled in between
+  unsigned tail = *p_uring->sq.p_tail;
+  struct io_uring_sqe *p_sqe = &p_uring->sqes[tail & p_uring->sq.mask];
+  memset(p_sqe, 0, sizeof(*p_sqe));
+
+  __atomic_store_n(p_uring->sq.p_tail, tail + 1, __ATOMIC_RELEASE);
+  p_uring->sq.pending += 1;
+  return p_sqe;
+}
+
+/// Submits the pending entries, waits for min_complete completions
+/// @returns false if io_uring_enter failed
+static bool submit(NetUring *p_uring, unsigned min_complete) {
+  for (;;) {
+    unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+    int submitted = uring_enter(p_uring->ring_fd, p_uring->sq.pending, min_complete, flags);
+    if (submitted < 0) {
+      if (EINTR == errno) continue;
+      TraceLog(LOG_WARNING, "Could not submit to io_uring of fd %d: %s", p_uring->fd, strerror(errno));
+      return false;
+    }
+
+    // an entry the kernel rejects stops the submission, the rest goes with the next call
+    p_uring->sq.pending -= submitted;
+    if (0 == p_uring->sq.pending || 0 == submitted) {
+      return true;
+    }
+  }
+}
+
+static void recycle_buffer(NetUring *p_uring, uint16_t id) {
+  struct io_uring_buf *p_buf = &p_uring->p_buf_ring->bufs[p_uring->buf_ring_tail & RECV_BUF_MASK];
+  p_buf->addr = (uintptr_t)(p_uring->recv_bufs + (size_t)id * RECV_BUF_SIZE);
+  p_buf->len = RECV_BUF_SIZE;
+  p_buf->bid = id;
+  p_uring->buf_ring_tail += 1;
+}
+
+static void publish_buffers(NetUring *p_uring) {
+  __atomic_store_n(&p_uring->p_buf_ring->tail, p_uring->buf_ring_tail, __ATOMIC_RELEASE);
+}
+
+static void arm_recv(NetUring *p_uring) {
+  struct io_uring_sqe *p_sqe = get_sqe(p_uring);
+  p_sqe->opcode = IORING_OP_RECVMSG;
+  p_sqe->fd = p_uring->fd;
+  p_sqe->addr = (uintptr_t)&p_uring->recv_msg;
+  p_sqe->len = 1;
+  p_sqe->ioprio = IORING_RECV_MULTISHOT;
+  p_sqe->flags = IOSQE_BUFFER_SELECT;
+  p_sqe->buf_group = RECV_GROUP;
+  p_sqe->user_data = RECV_TAG;
+  p_uring->is_armed = true;
+}
+
+static void prepare_send(NetUring *p_uring, int slot) {
+  SendSlot *p_slot = &p_uring->send_slots[slot];
+  struct io_uring_sqe *p_sqe = get_sqe(p_uring);
+  p_sqe->opcode = IORING_OP_SEND;
+  p_sqe->fd = p_uring->fd;
+  p_sqe->addr = (uintptr_t)(p_uring->send_bufs + (size_t)slot * NET_BUF_SIZE);
+  p_sqe->len = p_slot->len;
+  // sendto: the destination goes along, no msghdr needed
+  p_sqe->addr2 = (uintptr_t)&p_slot->addr;
+  p_sqe->addr_len = sizeof(p_slot->addr);
+  p_sqe->user_data = slot;
+}
+
+static void on_recv(NetUring *p_uring, const struct io_uring_cqe *p_cqe) {
+  if (!(p_cqe->flags & IORING_CQE_F_MORE)) {
+    // ran out of buffers or was canceled, net_uring_recv posts it again
+    p_uring->is_armed = false;
+  }
+
+  if (p_cqe->res < 0) {
+    if (-ENOBUFS != p_cqe->res && -ECANCELED != p_cqe->res) {
+      TraceLog(LOG_WARNING, "Could not receive from fd %d: %s", p_uring->fd, strerror(-p_cqe->res));
+    }
+    return;
+  }
+
+  if (!(p_cqe->flags & IORING_CQE_F_BUFFER)) {
+    return;
+  }
+
+  uint16_t id = p_cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+  int len = p_cqe->res - (int)RECV_PAYLOAD_OFFSET;
+  if (len < 0) {
+    recycle_buffer(p_uring, id);
+    publish_buffers(p_uring);
+    return;
+  }
+
+  // a longer datagram is cut like the syscall backend does
+  p_uring->recv_lens[id] = len < NET_BUF_SIZE ? len : NET_BUF_SIZE;
+  p_uring->p_stats->bytes_received += p_uring->recv_lens[id];
+  p_uring->ready_ids[(p_uring->ready_head + p_uring->ready_count) & RECV_BUF_MASK] = id;
+  p_uring->ready_count += 1;
+}
+
+static void on_send(NetUring *p_uring, const struct io_uring_cqe *p_cqe) {
+  int slot = (int)p_cqe->user_data;
+
+  if (p_cqe->res < 0) {
+    TraceLog(LOG_WARNING, "Could not send to fd %d: %s", p_uring->fd, strerror(-p_cqe->res));
+  } else {
+    p_uring->p_stats->sent += 1;
+    p_uring->p_stats->bytes_sent += p_cqe->res;
+  }
+
+  p_uring->in_flight -= 1;
+  p_uring->free_slots[p_uring->free_count++] = slot;
+}
+
+/// Handles every completion there is without a syscall
+static void reap(NetUring *p_uring) {
+  unsigned head = *p_uring->cq.p_head;
+  unsigned tail = __atomic_load_n(p_uring->cq.p_tail, __ATOMIC_ACQUIRE);
+
+  for (; head != tail; ++head) {
+    const struct io_uring_cqe *p_cqe = &p_uring->cq.cqes[head & p_uring->cq.mask];
+    if (RECV_TAG == p_cqe->user_data) {
+      on_recv(p_uring, p_cqe);
+    } else if (WAKE_TAG == p_cqe->user_data) {
+      p_uring->is_wake_posted = false;
+    } else if (CANCEL_TAG != p_cqe->user_data) {
+      on_send(p_uring, p_cqe);
+    }
+  }
+
+  __atomic_store_n(p_uring->cq.p_head, head, __ATOMIC_RELEASE);
+}
+
+/// Reaps for the sends. Datagrams it takes off the completion queue no longer make
+/// the ring readable, so a no-op completion is posted to wake the receiver for them
+static void reap_sends(NetUring *p_uring) {
+  reap(p_uring);
+  if (p_uring->ready_count > 0 && !p_uring->is_wake_posted) {
+    struct io_uring_sqe *p_sqe = get_sqe(p_uring);
+    p_sqe->opcode = IORING_OP_NOP;
+    p_sqe->user_data = WAKE_TAG;
+    p_uring->is_wake_posted = submit(p_uring, 0);
+  }
+}
+
+static void release(NetUring *p_uring) {
+  if (-1 != p_uring->ring_fd) close(p_uring->ring_fd);
+  if (NULL != p_uring->p_rings) munmap(p_uring->p_rings, p_uring->rings_size);
+  if (NULL != p_uring->sqes) munmap(p_uring->sqes, p_uring->sqes_size);
+  if (NULL != p_uring->p_buf_ring) {
+    munmap(p_uring->p_buf_ring, NET_URING_RECV_BUFFERS * sizeof(struct io_uring_buf));
+  }
+  free(p_uring->recv_bufs);
+  free(p_uring->send_bufs);
+  free(p_uring);
+}
+
+static bool map_rings(NetUring *p_uring, const struct io_uring_params *p_params) {
+  size_t sq_size = p_params->sq_off.array + p_params->sq_entries * sizeof(unsigned);
+  size_t cq_size = p_params->cq_off.cqes + p_params->cq_entries * sizeof(struct io_uring_cqe);
+  p_uring->rings_size = sq_size > cq_size ? sq_size : cq_size;
+  p_uring->sqes_size = p_params->sq_entries * sizeof(struct io_uring_sqe);
+
+  void *p_rings = mmap(NULL, p_uring->rings_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, p_uring->ring_fd, IORING_OFF_SQ_RING);
+  void *p_sqes = mmap(NULL, p_uring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, p_uring->ring_fd, IORING_OFF_SQES);
+  p_uring->p_rings = MAP_FAILED == p_rings ? NULL : p_rings;
+  p_uring->sqes = MAP_FAILED == p_sqes ? NULL : p_sqes;
+  if (NULL == p_uring->p_rings || NULL == p_uring->sqes) {
+    return false;
+  }
+
+  char *p_base = p_rings;
+  p_uring->sq.p_head = (unsigned*)(p_base + p_params->sq_off.head);
+  p_uring->sq.p_tail = (unsigned*)(p_base + p_params->sq_off.tail);
+  p_uring->sq.mask = *(unsigned*)(p_base + p_params->sq_off.ring_mask);
+  p_uring->cq.p_head = (unsigned*)(p_base + p_params->cq_off.head);
+  p_uring->cq.p_tail = (unsigned*)(p_base + p_params->cq_off.tail);
+  p_uring->cq.mask = *(unsigned*)(p_base + p_params->cq_off.ring_mask);
+  p_uring->cq.cqes = (struct io_uring_cqe*)(p_base + p_params->cq_off.cqes);
+
+  // entry i of the ring always submits sqe i
+  unsigned *array = (unsigned*)(p_base + p_params->sq_off.array);
+  for (unsigned i = 0; i < p_params->sq_entries; ++i) {
+    array[i] = i;
+  }
+  return true;
+}
+
+static bool register_recv_buffers(NetUring *p_uring) {
+  size_t ring_size = NET_URING_RECV_BUFFERS * sizeof(struct io_uring_buf);
+  void *p_ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  p_uring->recv_bufs = malloc((size_t)NET_URING_RECV_BUFFERS * RECV_BUF_SIZE);
+  if (MAP_FAILED == p_ring || NULL == p_uring->recv_bufs) {
+    return false;
+  }
+  p_uring->p_buf_ring = p_ring;
+
+  struct io_uring_buf_reg reg = {0};
+  reg.ring_addr = (uintptr_t)p_ring;
+  reg.ring_entries = NET_URING_RECV_BUFFERS;
+  reg.bgid = RECV_GROUP;
+  if (uring_register(p_uring->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+    return false;
+  }
+
+  for (int id = 0; id < NET_URING_RECV_BUFFERS; ++id) {
+    recycle_buffer(p_uring, id);
+  }
+  publish_buffers(p_uring);
+
+  // only the lengths matter, the kernel picks the buffer
+  p_uring->recv_msg.msg_namelen = sizeof(struct sockaddr_in6);
+  p_uring->recv_msg.msg_controllen = RECV_CONTROL_SIZE;
+  return true;
+}
+
+static bool allocate_send_slots(NetUring *p_uring) {
+  p_uring->send_bufs = malloc((size_t)NET_URING_SEND_SLOTS * NET_BUF_SIZE);
+  if (NULL == p_uring->send_bufs) {
+    return false;
+  }
+
+  for (int i = 0; i < NET_URING_SEND_SLOTS; ++i) {
+    p_uring->free_slots[i] = NET_URING_SEND_SLOTS - 1 - i;
+  }
+  p_uring->free_count = NET_URING_SEND_SLOTS;
+  return true;
+}
+
+NetUring *net_uring_create(int fd, NetBatchStats *p_stats) {
+  NetUring *p_uring = calloc(1, sizeof(NetUring));
+  if (NULL == p_uring) {
+    return NULL;
+  }
+  p_uring->fd = fd;
+  p_uring->p_stats = p_stats;
+
+  struct io_uring_params params = {0};
+  params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+  params.cq_entries = CQ_ENTRIES;
+  p_uring->ring_fd = uring_setup(SQ_ENTRIES, &params);
+  if (-1 == p_uring->ring_fd) {
+    TraceLog(LOG_WARNING, "Could not set up io_uring: %s", strerror(errno));
+    goto defer;
+  }
+
+  if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !map_rings(p_uring, &params)) {
+    TraceLog(LOG_WARNING, "Could not map the io_uring rings: %s", strerror(errno));
+    goto defer;
+  }
+
+  // the provided buffer ring came with multishot receives, in 5.19 and 6.0
+  if (!register_recv_buffers(p_uring)) {
+    TraceLog(LOG_WARNING, "Could not register the io_uring receive buffers: %s", strerror(errno));
+    goto defer;
+  }
+
+  if (!allocate_send_slots(p_uring)) {
+    TraceLog(LOG_WARNING, "Could not allocate the io_uring send buffers");
+    goto defer;
+  }
+
+  return p_uring;
+
+defer:
+  release(p_uring);
+  return NULL;
+}
+
+void net_uring_destroy(NetUring *p_uring) {
+  if (NULL == p_uring) return;
+
+  net_uring_flush(p_uring);
+  if (p_uring->is_armed) {
+    struct io_uring_sqe *p_sqe = get_sqe(p_uring);
+    p_sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    p_sqe->addr = RECV_TAG;
+    p_sqe->user_data = CANCEL_TAG;
+  }
+
+  // the kernel must not touch the buffers once they are freed
+  while ((p_uring->in_flight > 0 || p_uring->is_armed) && submit(p_uring, 1)) {
+    reap(p_uring);
+  }
+
+  release(p_uring);
+}
+
+int net_uring_poll_fd(const NetUring *p_uring) {
+  return p_uring->ring_fd;
+}
+
+int net_uring_recv(NetUring *p_uring) {
+  for (int i = 0; i < p_uring->batch_count; ++i) {
+    recycle_buffer(p_uring, p_uring->batch_ids[i]);
+  }
+  if (p_uring->batch_count > 0) {
+    publish_buffers(p_uring);
+  }
+  p_uring->batch_count = 0;
+
+  if (!p_uring->is_armed) {
+    arm_recv(p_uring);
+    submit(p_uring, 0);
+    p_uring->p_stats->recv_syscalls += 1;
+  }
+
+  reap(p_uring);
+
+  while (p_uring->batch_count < NET_BATCH_CAPACITY && p_uring->ready_count > 0) {
+    p_uring->batch_ids[p_uring->batch_count++] = p_uring->ready_ids[p_uring->ready_head];
+    p_uring->ready_head = (p_uring->ready_head + 1) & RECV_BUF_MASK;
+    p_uring->ready_count -= 1;
+  }
+
+  p_uring->p_stats->received += p_uring->batch_count;
+  return p_uring->batch_count;
+}
+
+const char *net_uring_datagram(const NetUring *p_uring, int i, int *p_len, struct sockaddr_in6 *p_from) {
+  uint16_t id = p_uring->batch_ids[i];
+  const char *buf = p_uring->recv_bufs + (size_t)id * RECV_BUF_SIZE;
+
+  *p_len = p_uring->recv_lens[id];
+  if (NULL != p_from) {
+    memcpy(p_from, buf + RECV_ADDR_OFFSET, sizeof(*p_from));
+  }
+  return buf + RECV_PAYLOAD_OFFSET;
+}
+
+uint64_t net_uring_datagram_timestamp(const NetUring *p_uring, int i) {
+  char *buf = p_uring->recv_bufs + (size_t)p_uring->batch_ids[i] * RECV_BUF_SIZE;
+  struct io_uring_recvmsg_out header = {0};
+  memcpy(&header, buf, sizeof(header));
+
+  // the same walk as over the control messages of a recvmsg
+  struct msghdr msg = {0};
+  msg.msg_control = buf + RECV_CONTROL_OFFSET;
+  msg.msg_controllen = header.controllen;
+  for (struct cmsghdr *p_cmsg = CMSG_FIRSTHDR(&msg); NULL != p_cmsg; p_cmsg = CMSG_NXTHDR(&msg, p_cmsg)) {
+    if (SOL_SOCKET == p_cmsg->cmsg_level && SO_TIMESTAMPNS == p_cmsg->cmsg_type) {
+      struct timespec ts = {0};
+      memcpy(&ts, CMSG_DATA(p_cmsg), sizeof(ts));
+      return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    }
+  }
+  return 0;
+}
+
+void net_uring_queue(NetUring *p_uring, const struct sockaddr_in6 *p_dest, const char *buf, int len) {
+  if (len > NET_BUF_SIZE) {
+    TraceLog(LOG_WARNING, "Datagram of %d bytes does not fit into a batch", len);
+    return;
+  }
+
+  if (p_uring->queued_count == NET_BATCH_CAPACITY) {
+    net_uring_flush(p_uring);
+  }
+
+  // every slot is still on its way, wait for the oldest sends
+  while (0 == p_uring->free_count) {
+    if (!submit(p_uring, 1)) return;
+    reap_sends(p_uring);
+  }
+
+  int slot = p_uring->free_slots[--p_uring->free_count];
+  p_uring->send_slots[slot].addr = *p_dest;
+  p_uring->send_slots[slot].len = len;
+  memcpy(p_uring->send_bufs + (size_t)slot * NET_BUF_SIZE, buf, len);
+  p_uring->queued_slots[p_uring->queued_count++] = slot;
+}
+
+void net_uring_flush(NetUring *p_uring) {
+  if (0 == p_uring->queued_count) {
+    return;
+  }
+
+  for (int i = 0; i < p_uring->queued_count; ++i) {
+    prepare_send(p_uring, p_uring->queued_slots[i]);
+  }
+  p_uring->in_flight += p_uring->queued_count;
+  p_uring->queued_count = 0;
+
+  submit(p_uring, 0);
+  p_uring->p_stats->send_syscalls += 1;
+
+  // UDP sends complete during the submit, so their slots are free right away
+  reap_sends(p_uring);
+}
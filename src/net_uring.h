@@ -0,0 +1,53 @@
+#ifndef __NET_URING_H__
+#define __NET_URING_H__
+
+#include <stdbool.h>
+
+#include "network.h"
+
+// Provided buffers the kernel receives into, a power of two.
+// A buffer is busy from the completion until the next net_uring_recv
+#define NET_URING_RECV_BUFFERS 256
+
+// Send buffers, a flushed one is busy until its send completes
+#define NET_URING_SEND_SLOTS (2 * NET_BATCH_CAPACITY)
+
+/// io_uring backend of NetBatch. A single multishot recvmsg stays posted on the
+/// socket and the kernel fills the provided buffers of a registered buffer ring
+/// with datagrams on its own, so receiving only reads the completion queue.
+/// Queued datagrams are copied into slots allocated once and a flush submits all
+/// of them with one io_uring_enter
+typedef struct NetUring NetUring;
+
+/// Sets up the rings for the socket, p_stats is updated by every call
+/// @returns NULL if io_uring or one of the features it needs is not available
+NetUring *net_uring_create(int fd, NetBatchStats *p_stats);
+
+/// Sends what is queued and waits for the sends in flight. NULL is ignored
+void net_uring_destroy(NetUring *p_uring);
+
+/// @returns the ring fd, readable while completions are pending. The socket itself
+/// does not become readable anymore since the posted receive takes every datagram
+int net_uring_poll_fd(const NetUring *p_uring);
+
+/// Takes up to NET_BATCH_CAPACITY received datagrams, gives the buffers of the
+/// previous call back to the kernel. The receive is (re)armed here, its completions
+/// are run by the thread that armed it, so receive on the thread that waits
+/// @returns number of datagrams received, they stay valid until the next call
+int net_uring_recv(NetUring *p_uring);
+
+/// @returns the i-th datagram of the last net_uring_recv, p_from may be NULL
+const char *net_uring_datagram(const NetUring *p_uring, int i, int *p_len, struct sockaddr_in6 *p_from);
+
+/// @returns the SO_TIMESTAMPNS receive time of the i-th datagram in CLOCK_REALTIME
+/// nanoseconds, 0 if the kernel did not stamp it
+uint64_t net_uring_datagram_timestamp(const NetUring *p_uring, int i);
+
+/// Copies the datagram into a free send slot, flushes first if
+/// NET_BATCH_CAPACITY datagrams are queued
+void net_uring_queue(NetUring *p_uring, const struct sockaddr_in6 *p_dest, const char *buf, int len);
+
+/// Submits all the queued datagrams with one io_uring_enter
+void net_uring_flush(NetUring *p_uring);
+
+#endif // !__NET_URING_H__
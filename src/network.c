@@ -1,98 +1,206 @@
+// recvmmsg and sendmmsg
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <errno.h>
 
 #include "network.h"
+#include "net_uring.h"
+#include "timing.h"
 #include "raylib.h"
 
+static NetBackend selected_backend = NET_BACKEND_SYSCALL;
 
-static void send_all(int fd, const char *msg, size_t msg_len, int flags,
-                     const struct sockaddr_in *dest) {
-  ssize_t sent = 0;
-  ssize_t bytes = 0;
-  do {
-    bytes = sendto(fd, msg + sent, msg_len - sent, flags, (struct sockaddr*)dest, sizeof(*dest));
 
-    if (bytes < 0) {
-      // TraceLog(LOG_ERROR, "Could not write to fd %d: %s\n", fd, strerror(errno));
-      return;
-    }
+static void send_datagram(int fd, const char *msg, size_t msg_len, int flags,
+                          const struct sockaddr_in6 *dest) {
+  // a datagram goes whole or not at all
+  if (sendto(fd, msg, msg_len, flags, (struct sockaddr*)dest, sizeof(*dest)) < 0) {
+    // TraceLog(LOG_ERROR, "Could not write to fd %d: %s\n", fd, strerror(errno));
+  }
+}
 
-    if (bytes == 0) break;
+static void put_u32(unsigned char **p_ptr, uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    *(*p_ptr)++ = value >> (8 * i) & 0xff;
+  }
+}
 
-    sent += bytes;
-  } while (sent < msg_len);
+static uint32_t get_u32(const unsigned char **p_ptr) {
+  uint32_t value = 0;
+  for (int i = 0; i < 4; ++i) {
+    value |= (uint32_t)*(*p_ptr)++ << (8 * i);
+  }
+  return value;
 }
 
-static bool recv_all(int fd, char *buf, size_t buf_len, int flags) {
-  ssize_t received = 0;
-  ssize_t bytes = 0;
-  struct sockaddr_in src = {0};
-  socklen_t addrlen = 0;
-  do {
-    bytes = recvfrom(fd, buf + received, buf_len - received, flags, (struct sockaddr*)&src, &addrlen);
+static void put_f32(unsigned char **p_ptr, float value) {
+  uint32_t bits = 0;
+  memcpy(&bits, &value, sizeof(bits));
+  put_u32(p_ptr, bits);
+}
 
-    if (bytes < 0) {
-      // TraceLog(LOG_ERROR, "Could not read from fd %d: %s\n", fd, strerror(errno));
-      return false;
-    }
+static void put_u64(unsigned char **p_ptr, uint64_t value) {
+  put_u32(p_ptr, (uint32_t)value);
+  put_u32(p_ptr, (uint32_t)(value >> 32));
+}
 
-    if (bytes == 0) break;
+static uint64_t get_u64(const unsigned char **p_ptr) {
+  uint64_t value = get_u32(p_ptr);
+  return value | (uint64_t)get_u32(p_ptr) << 32;
+}
 
-    received += bytes;
-  } while (received < buf_len);
+static float get_f32(const unsigned char **p_ptr) {
+  uint32_t bits = get_u32(p_ptr);
+  float value = 0;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
 
-  // if received == buf_len then we run out of space in buf
-  return received <= buf_len;
+
+bool net_addr_from(const struct sockaddr *p_addr, struct sockaddr_in6 *out) {
+  memset(out, 0, sizeof(*out));
+  out->sin6_family = AF_INET6;
+
+  if (AF_INET6 == p_addr->sa_family) {
+    memcpy(out, p_addr, sizeof(*out));
+    return true;
+  }
+  if (AF_INET == p_addr->sa_family) {
+    struct sockaddr_in addr = {0};
+    memcpy(&addr, p_addr, sizeof(addr));
+    out->sin6_port = addr.sin_port;
+    // ::ffff:a.b.c.d
+    out->sin6_addr.s6_addr[10] = 0xff;
+    out->sin6_addr.s6_addr[11] = 0xff;
+    memcpy(&out->sin6_addr.s6_addr[12], &addr.sin_addr.s_addr, 4);
+    return true;
+  }
+  return false;
 }
 
+bool net_addr_is_ipv4(const struct sockaddr_in6 *p_addr) {
+  return IN6_IS_ADDR_V4MAPPED(&p_addr->sin6_addr);
+}
 
-bool connect_to_host_udp(const char *host, int port, UdpSocket *out) {
-  struct hostent *server = NULL;
-  struct sockaddr_in server_addr = {0};
+bool net_addr_equal(const struct sockaddr_in6 *p_a, const struct sockaddr_in6 *p_b) {
+  return p_a->sin6_port == p_b->sin6_port
+    && 0 == memcmp(&p_a->sin6_addr, &p_b->sin6_addr, sizeof(p_a->sin6_addr));
+}
+
+const char *net_addr_format(const struct sockaddr_in6 *p_addr, char *buf) {
+  char ip[INET6_ADDRSTRLEN] = {0};
+  if (net_addr_is_ipv4(p_addr)) {
+    inet_ntop(AF_INET, &p_addr->sin6_addr.s6_addr[12], ip, sizeof(ip));
+    snprintf(buf, NET_ADDR_STRLEN, "%s:%d", ip, ntohs(p_addr->sin6_port));
+  } else {
+    inet_ntop(AF_INET6, &p_addr->sin6_addr, ip, sizeof(ip));
+    snprintf(buf, NET_ADDR_STRLEN, "[%s]:%d", ip, ntohs(p_addr->sin6_port));
+  }
+  return buf;
+}
 
-  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+/// @returns a UDP socket of both IPv6 and IPv4 (mapped), -1 on error
+static int open_dual_stack_socket(void) {
+  int sock = socket(AF_INET6, SOCK_DGRAM, 0);
   if (-1 == sock) {
     TraceLog(LOG_ERROR, "Could not create a socket: %s\n", strerror(errno));
-    return false;
+    return -1;
   }
 
-  server = gethostbyname(host);
-  if (NULL == server) {
-    TraceLog(LOG_ERROR, "Could not find the host: %s\n", host);
+  int disable = 0;
+  if (-1 == setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, &disable, sizeof(disable))) {
+    TraceLog(LOG_ERROR, "Could not clear IPV6_V6ONLY: %s\n", strerror(errno));
     close(sock);
-    return false;
+    return -1;
   }
+  return sock;
+}
 
-  server_addr.sin_family = AF_INET;
-  server_addr.sin_port = htons(port);
-  memcpy(&server_addr.sin_addr.s_addr, server->h_addr_list[0], server->h_length);
+bool net_connect_udp(const struct sockaddr_in6 *p_addr, UdpSocket *out) {
+  int sock = open_dual_stack_socket();
+  if (-1 == sock) {
+    return false;
+  }
 
-  if (-1 == connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr))) {
-    TraceLog(LOG_ERROR, "Could not connect to the host %s: %s\n", host, strerror(errno));
+  if (-1 == connect(sock, (const struct sockaddr*)p_addr, sizeof(*p_addr))) {
+    char addr[NET_ADDR_STRLEN] = {0};
+    TraceLog(LOG_ERROR, "Could not connect to %s: %s\n", net_addr_format(p_addr, addr), strerror(errno));
     close(sock);
     return false;
   }
 
   out->fd = sock;
-  out->addr = server_addr;
+  out->addr = *p_addr;
   return true;
 }
 
-bool create_udp_server_socket(int port, UdpSocket *out) {
+int net_resolve(const char *host, int port, struct sockaddr_in6 *out, int capacity) {
+  char service[8] = {0};
+  snprintf(service, sizeof(service), "%d", port);
+
+  struct addrinfo hints = {0};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+
+  struct addrinfo *p_list = NULL;
+  int error = getaddrinfo(host, service, &hints, &p_list);
+  if (0 != error) {
+    TraceLog(LOG_ERROR, "Could not find the host %s: %s", host, gai_strerror(error));
+    return -1;
+  }
+
+  int count = 0;
+  for (const struct addrinfo *p_info = p_list; NULL != p_info && count < capacity; p_info = p_info->ai_next) {
+    if (net_addr_from(p_info->ai_addr, &out[count])) {
+      count += 1;
+    }
+  }
+  freeaddrinfo(p_list);
+  return count;
+}
+
+bool connect_to_host_udp(const char *host, int port, UdpSocket *out) {
+  struct sockaddr_in6 addrs[NET_RESOLVE_MAX_ADDRS];
+  int count = net_resolve(host, port, addrs, NET_RESOLVE_MAX_ADDRS);
+
+  // in the order of getaddrinfo, which puts the preferred family first
+  for (int i = 0; i < count; ++i) {
+    if (net_connect_udp(&addrs[i], out)) {
+      return true;
+    }
+  }
+  if (0 == count) {
+    TraceLog(LOG_ERROR, "The host %s has no address\n", host);
+  }
+  return false;
+}
+
+static bool open_udp_server_socket(int port, bool reuse_port, UdpSocket *out) {
   int server_socket;
-  struct sockaddr_in server_addr = {0};
+  struct sockaddr_in6 server_addr = {0};
 
-  if ((server_socket = socket(AF_INET, SOCK_DGRAM, 0)) == -1) {
-    TraceLog(LOG_ERROR, "Could not create a socket: %s\n", strerror(errno));
+  if ((server_socket = open_dual_stack_socket()) == -1) {
     return false;
   }
 
-  server_addr.sin_family = AF_INET;
-  server_addr.sin_port = htons(port);
-  server_addr.sin_addr.s_addr = INADDR_ANY;
+  int enable = 1;
+  if (reuse_port && -1 == setsockopt(server_socket, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable))) {
+    TraceLog(LOG_ERROR, "Could not set SO_REUSEPORT: %s\n", strerror(errno));
+    close(server_socket);
+    return false;
+  }
+
+  server_addr.sin6_family = AF_INET6;
+  server_addr.sin6_port = htons(port);
+  server_addr.sin6_addr = in6addr_any;
 
   if (bind(server_socket, (struct sockaddr*)&server_addr, sizeof(server_addr)) == -1) {
     TraceLog(LOG_ERROR, "Could not bind a socket: %s\n", strerror(errno));
@@ -105,50 +213,496 @@ bool create_udp_server_socket(int port, UdpSocket *out) {
   return true;
 }
 
-bool net_check_for_connection(const UdpSocket *sock, UdpSocket *out) {
-  char buf[NET_BUF_SIZE] = {0};
-  struct sockaddr_in client_addr = {0};
-  socklen_t addrlen = sizeof(client_addr);
+bool create_udp_server_socket(int port, UdpSocket *out) {
+  return open_udp_server_socket(port, false, out);
+}
+
+bool create_udp_reuseport_socket(int port, UdpSocket *out) {
+  return open_udp_server_socket(port, true, out);
+}
+
+static void put_token(char *buf, uint16_t token) {
+  buf[NET_CMD_TOKEN_OFFSET] = token & 0xff;
+  buf[NET_CMD_TOKEN_OFFSET + 1] = token >> 8;
+}
+
+int net_encode_connect(char *buf, NetRole role, uint16_t token) {
+  memset(buf, 0, NET_CMD_SIZE);
+  buf[0] = (char)NET_CMD_CONNECT;
+  buf[1] = (char)role;
+  put_token(buf, token);
+  return NET_CMD_SIZE;
+}
+
+int net_encode_input(char *buf, const NetInput *p_input, uint16_t token) {
+  unsigned char *ptr = (unsigned char*)buf;
+  memset(buf, 0, NET_INPUT_HEADER_SIZE);
+  *ptr++ = NET_CMD_UPDATE_INPUT;
+  put_u32(&ptr, p_input->tick);
+  put_u32(&ptr, p_input->snapshot_ack.tick);
+  put_token(buf, token);
+  ptr += 2;
+  put_u32(&ptr, p_input->snapshot_ack.bits);
+
+  unsigned char *p_run_count = ptr++;
+  for (int i = 0; i < p_input->count;) {
+    int len = 1;
+    while (i + len < p_input->count && p_input->keys[i + len] == p_input->keys[i]) len += 1;
+    *ptr++ = (unsigned char)((p_input->keys[i] & 3) << 6 | (len - 1));
+    *p_run_count += 1;
+    i += len;
+  }
+
+  return (int)(ptr - (unsigned char*)buf);
+}
+
+int net_encode_ping(char *buf, NetworkCmd cmd, const NetPing *p_ping, uint16_t token) {
+  unsigned char *ptr = (unsigned char*)buf;
+  *ptr++ = (unsigned char)cmd;
+  put_u32(&ptr, p_ping->seq);
+  put_u32(&ptr, p_ping->received);
+  put_token(buf, token);
+  ptr += 2;
+  put_u64(&ptr, p_ping->time_ns);
+  put_u32(&ptr, p_ping->hold_ns);
+  put_u64(&ptr, p_ping->peer_time_ns);
+  put_u32(&ptr, p_ping->input_tick);
+  put_u32(&ptr, p_ping->input_delay_ns);
+  put_u32(&ptr, p_ping->step_tick);
+  put_u32(&ptr, p_ping->state_tick);
+  put_u64(&ptr, p_ping->state_hash);
+  return NET_PING_SIZE;
+}
+
+int net_encode_ready(char *buf, int paddle_index, uint16_t token) {
+  memset(buf, 0, NET_CMD_SIZE);
+  buf[0] = (char)NET_CMD_READY;
+  buf[1] = (char)paddle_index;
+  put_token(buf, token);
+  return NET_CMD_SIZE;
+}
+
+int net_encode_closed(char *buf, uint16_t token) {
+  memset(buf, 0, NET_CMD_SIZE);
+  buf[0] = (char)NET_CMD_CLOSED;
+  put_token(buf, token);
+  return NET_CMD_SIZE;
+}
+
+int net_encode_resync(char *buf, uint16_t token) {
+  memset(buf, 0, NET_CMD_SIZE);
+  buf[0] = (char)NET_CMD_RESYNC;
+  put_token(buf, token);
+  return NET_CMD_SIZE;
+}
+
+int net_encode_event(char *buf, const NetEvent *p_event) {
+  unsigned char *ptr = (unsigned char*)buf;
+  *ptr++ = NET_CMD_EVENT;
+  put_u32(&ptr, p_event->tick);
+  *ptr++ = p_event->events;
+  put_f32(&ptr, p_event->ball_position[0]);
+  put_f32(&ptr, p_event->ball_position[1]);
+  put_f32(&ptr, p_event->ball_direction[0]);
+  put_f32(&ptr, p_event->ball_direction[1]);
+  put_f32(&ptr, p_event->ball_speed);
+  for (int i = 0; i < 2; ++i) {
+    *ptr++ = (uint16_t)p_event->scores[i] & 0xff;
+    *ptr++ = (uint16_t)p_event->scores[i] >> 8;
+  }
+  return NET_EVENT_SIZE;
+}
 
-  if (recvfrom(sock->fd, buf, NET_BUF_SIZE, MSG_DONTWAIT, (struct sockaddr*)&client_addr, &addrlen) != NET_BUF_SIZE
-    || buf[0] != NET_CMD_CONNECT) {
+NetRole net_decode_connect(const char *buf) {
+  return NET_ROLE_SPECTATOR == buf[1] ? NET_ROLE_SPECTATOR : NET_ROLE_PLAYER;
+}
+
+uint16_t net_cmd_token(const char *buf) {
+  const unsigned char *ptr = (const unsigned char*)buf + NET_CMD_TOKEN_OFFSET;
+  return ptr[0] | ptr[1] << 8;
+}
+
+bool net_decode_input(const char *buf, int len, NetInput *out) {
+  const unsigned char *ptr = (const unsigned char*)buf;
+  if (len < (int)NET_INPUT_HEADER_SIZE || NET_CMD_UPDATE_INPUT != *ptr++) {
+    return false;
+  }
+
+  memset(out, 0, sizeof(*out));
+  out->tick = get_u32(&ptr);
+  out->snapshot_ack.tick = get_u32(&ptr);
+  ptr += 2;
+  out->snapshot_ack.bits = get_u32(&ptr);
+
+  int run_count = *ptr++;
+  if (len < (int)NET_INPUT_HEADER_SIZE + run_count) {
+    return false;
+  }
+  for (int i = 0; i < run_count; ++i) {
+    unsigned char run = *ptr++;
+    int run_len = (run & 0x3f) + 1;
+    if (out->count + run_len > NET_INPUT_WINDOW) {
+      return false;
+    }
+    memset(out->keys + out->count, run >> 6, run_len);
+    out->count += run_len;
+  }
+
+  return out->count > 0;
+}
+
+bool net_decode_ping(const char *buf, int len, NetPing *out) {
+  const unsigned char *ptr = (const unsigned char*)buf;
+  if (len < (int)NET_PING_SIZE || (NET_CMD_PING != *ptr && NET_CMD_PONG != *ptr)) {
     return false;
   }
 
-  out->fd = sock->fd;
-  out->addr = client_addr;
+  ptr += 1;
+  out->seq = get_u32(&ptr);
+  out->received = get_u32(&ptr);
+  ptr += 2;
+  out->time_ns = get_u64(&ptr);
+  out->hold_ns = get_u32(&ptr);
+  out->peer_time_ns = get_u64(&ptr);
+  out->input_tick = get_u32(&ptr);
+  out->input_delay_ns = get_u32(&ptr);
+  out->step_tick = get_u32(&ptr);
+  out->state_tick = get_u32(&ptr);
+  out->state_hash = get_u64(&ptr);
   return true;
 }
 
-void net_send_cmd_wo_args(const UdpSocket *sock, NetworkCmd net_cmd) {
-  char buf[NET_BUF_SIZE] = {0};
-  buf[0] = (char)net_cmd;
-  send_all(sock->fd, buf, sizeof(buf), 0, &sock->addr);
+bool net_decode_event(const char *buf, int len, NetEvent *out) {
+  const unsigned char *ptr = (const unsigned char*)buf;
+  if (len < (int)NET_EVENT_SIZE || NET_CMD_EVENT != *ptr++) {
+    return false;
+  }
+
+  out->tick = get_u32(&ptr);
+  out->events = *ptr++;
+  out->ball_position[0] = get_f32(&ptr);
+  out->ball_position[1] = get_f32(&ptr);
+  out->ball_direction[0] = get_f32(&ptr);
+  out->ball_direction[1] = get_f32(&ptr);
+  out->ball_speed = get_f32(&ptr);
+  for (int i = 0; i < 2; ++i) {
+    out->scores[i] = (int16_t)(ptr[0] | ptr[1] << 8);
+    ptr += 2;
+  }
+  return true;
 }
 
-void net_send_position(const UdpSocket *sock, GameEntity e, float x, float y) {
-  // TODO: convert floats to network byte order
-  char buf[2 + sizeof(float) * 2 + 1] = {0};
-  char *ptr = buf;
-  *ptr = (char)NET_CMD_UPDATE_POSITION;
-  ptr += 1;
-  *ptr = (char)e;
-  ptr += 1;
-  memcpy(ptr, &x, sizeof(x));
-  ptr += sizeof(x);
-  memcpy(ptr, &y, sizeof(y));
+void net_ack_mark(NetAck *p_ack, uint32_t tick) {
+  if (0 == p_ack->tick) {
+    p_ack->tick = tick;
+    p_ack->bits = 0;
+    return;
+  }
+
+  int32_t diff = (int32_t)(tick - p_ack->tick);
+  if (diff > 0) {
+    // the newest tick becomes bit diff - 1, shifts are only defined below 32
+    uint64_t bits = diff > NET_ACK_BITS ? 0 : ((uint64_t)p_ack->bits << 1 | 1) << (diff - 1);
+    p_ack->bits = (uint32_t)bits;
+    p_ack->tick = tick;
+  } else if (diff < 0 && -diff <= NET_ACK_BITS) {
+    p_ack->bits |= 1u << (-diff - 1);
+  }
+}
+
+bool net_ack_has(const NetAck *p_ack, uint32_t tick) {
+  if (0 == p_ack->tick) return false;
+
+  int32_t diff = (int32_t)(p_ack->tick - tick);
+  if (0 == diff) return true;
+  return diff > 0 && diff <= NET_ACK_BITS && (p_ack->bits >> (diff - 1) & 1);
+}
+
+int net_recv_cmd(const UdpSocket *sock, char *buf) {
+  // a datagram always comes whole, one recv is one message
+  ssize_t bytes = recv(sock->fd, buf, NET_BUF_SIZE, MSG_DONTWAIT);
+  if (bytes < 0) {
+    // TraceLog(LOG_ERROR, "Could not read from fd %d: %s\n", sock->fd, strerror(errno));
+    return 0;
+  }
+  return (int)bytes;
+}
+
+void net_encode_snapshot(const NetSnapshot *p_snapshot, char *buf) {
+  unsigned char *ptr = (unsigned char*)buf;
+  int input_count = p_snapshot->input_count;
+  if (input_count > NET_TICK_INPUTS_HISTORY) input_count = NET_TICK_INPUTS_HISTORY;
+
+  memset(buf, 0, NET_SNAPSHOT_SIZE);
+
+  *ptr++ = NET_CMD_SNAPSHOT;
+  put_u32(&ptr, p_snapshot->tick);
+  for (int i = 0; i < GE_COUNT; ++i) {
+    put_f32(&ptr, p_snapshot->positions[i][0]);
+    put_f32(&ptr, p_snapshot->positions[i][1]);
+    put_f32(&ptr, p_snapshot->velocities[i][0]);
+    put_f32(&ptr, p_snapshot->velocities[i][1]);
+  }
+  for (int i = 0; i < 2; ++i) {
+    *ptr++ = (uint16_t)p_snapshot->scores[i] & 0xff;
+    *ptr++ = (uint16_t)p_snapshot->scores[i] >> 8;
+  }
+
+  // two ticks per byte, the newer one in the low nibble
+  *ptr++ = (unsigned char)input_count;
+  for (int i = 0; i < input_count; ++i) {
+    ptr[i / 2] |= (p_snapshot->inputs[i] & 0xf) << (4 * (i % 2));
+  }
+}
+
+void net_send_snapshot(const UdpSocket *sock, const NetSnapshot *p_snapshot) {
+  char buf[NET_SNAPSHOT_SIZE];
+  net_encode_snapshot(p_snapshot, buf);
+  send_datagram(sock->fd, buf, sizeof(buf), 0, &sock->addr);
+}
+
+bool net_decode_snapshot(const char *buf, int len, NetSnapshot *out) {
+  const unsigned char *ptr = (const unsigned char*)buf;
+  if (len != NET_SNAPSHOT_SIZE || NET_CMD_SNAPSHOT != *ptr++) {
+    return false;
+  }
+
+  out->tick = get_u32(&ptr);
+  for (int i = 0; i < GE_COUNT; ++i) {
+    out->positions[i][0] = get_f32(&ptr);
+    out->positions[i][1] = get_f32(&ptr);
+    out->velocities[i][0] = get_f32(&ptr);
+    out->velocities[i][1] = get_f32(&ptr);
+  }
+  for (int i = 0; i < 2; ++i) {
+    out->scores[i] = (int16_t)(ptr[0] | ptr[1] << 8);
+    ptr += 2;
+  }
+
+  out->input_count = *ptr++;
+  if (out->input_count > NET_TICK_INPUTS_HISTORY) out->input_count = NET_TICK_INPUTS_HISTORY;
+  for (int i = 0; i < out->input_count; ++i) {
+    out->inputs[i] = ptr[i / 2] >> (4 * (i % 2)) & 0xf;
+  }
+
+  return true;
+}
+
+void net_set_backend(NetBackend backend) {
+  selected_backend = backend;
+}
+
+bool net_parse_backend(const char *name, NetBackend *out) {
+  if (0 == strcmp(name, "syscall")) {
+    *out = NET_BACKEND_SYSCALL;
+  } else if (0 == strcmp(name, "io_uring")) {
+    *out = NET_BACKEND_IO_URING;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char *net_backend_name(NetBackend backend) {
+  return NET_BACKEND_IO_URING == backend ? "io_uring" : "syscall";
+}
+
+// room for the SO_TIMESTAMPNS control message of a datagram
+#define RECV_CONTROL_SIZE CMSG_SPACE(sizeof(struct timespec))
+
+struct NetBatch {
+  int fd;
+  // everything goes through it if not NULL
+  NetUring *p_uring;
+
+  struct mmsghdr recv_msgs[NET_BATCH_CAPACITY];
+  struct iovec recv_iovs[NET_BATCH_CAPACITY];
+  struct sockaddr_in6 recv_addrs[NET_BATCH_CAPACITY];
+  char recv_bufs[NET_BATCH_CAPACITY][NET_BUF_SIZE];
+  char recv_controls[NET_BATCH_CAPACITY][RECV_CONTROL_SIZE];
+  int recv_count;
+  // CLOCK_REALTIME - CLOCK_MONOTONIC at the last receive, the kernel stamps in the former
+  int64_t realtime_offset_ns;
+
+  struct mmsghdr send_msgs[NET_BATCH_CAPACITY];
+  struct iovec send_iovs[NET_BATCH_CAPACITY];
+  struct sockaddr_in6 send_addrs[NET_BATCH_CAPACITY];
+  char send_bufs[NET_BATCH_CAPACITY][NET_BUF_SIZE];
+  int send_count;
+
+  NetBatchStats stats;
+};
+
+NetBatch *net_batch_create(int fd) {
+  NetBatch *p_batch = calloc(1, sizeof(NetBatch));
+  if (NULL == p_batch) {
+    TraceLog(LOG_ERROR, "Could not allocate a batch of %d datagrams", NET_BATCH_CAPACITY);
+    return NULL;
+  }
+  p_batch->fd = fd;
+
+  // every message always points at its own buffer and address, only lengths change
+  for (int i = 0; i < NET_BATCH_CAPACITY; ++i) {
+    p_batch->recv_iovs[i].iov_base = p_batch->recv_bufs[i];
+    p_batch->recv_iovs[i].iov_len = NET_BUF_SIZE;
+    p_batch->recv_msgs[i].msg_hdr.msg_iov = &p_batch->recv_iovs[i];
+    p_batch->recv_msgs[i].msg_hdr.msg_iovlen = 1;
+    p_batch->recv_msgs[i].msg_hdr.msg_name = &p_batch->recv_addrs[i];
+    p_batch->recv_msgs[i].msg_hdr.msg_control = p_batch->recv_controls[i];
+
+    p_batch->send_iovs[i].iov_base = p_batch->send_bufs[i];
+    p_batch->send_msgs[i].msg_hdr.msg_iov = &p_batch->send_iovs[i];
+    p_batch->send_msgs[i].msg_hdr.msg_iovlen = 1;
+    p_batch->send_msgs[i].msg_hdr.msg_name = &p_batch->send_addrs[i];
+    p_batch->send_msgs[i].msg_hdr.msg_namelen = sizeof(p_batch->send_addrs[i]);
+  }
+
+  int on = 1;
+  if (-1 == setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on))) {
+    TraceLog(LOG_WARNING, "Could not enable receive timestamps on fd %d: %s", fd, strerror(errno));
+  }
 
-  send_all(sock->fd, buf, sizeof(buf), 0, &sock->addr);
+  if (NET_BACKEND_IO_URING == selected_backend) {
+    p_batch->p_uring = net_uring_create(fd, &p_batch->stats);
+    if (NULL == p_batch->p_uring) {
+      TraceLog(LOG_WARNING, "Falling back to recvmmsg and sendmmsg on fd %d", fd);
+    }
+  }
+
+  return p_batch;
+}
+
+void net_batch_destroy(NetBatch *p_batch) {
+  if (NULL == p_batch) return;
+  net_batch_flush(p_batch);
+  net_uring_destroy(p_batch->p_uring);
+  free(p_batch);
+}
+
+NetBackend net_batch_backend(const NetBatch *p_batch) {
+  return NULL != p_batch->p_uring ? NET_BACKEND_IO_URING : NET_BACKEND_SYSCALL;
+}
+
+int net_batch_poll_fd(const NetBatch *p_batch) {
+  return NULL != p_batch->p_uring ? net_uring_poll_fd(p_batch->p_uring) : p_batch->fd;
+}
+
+/// @returns CLOCK_REALTIME - CLOCK_MONOTONIC now
+static int64_t realtime_offset_ns(void) {
+  struct timespec ts = {0};
+  clock_gettime(CLOCK_REALTIME, &ts);
+  uint64_t realtime = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+  return (int64_t)(realtime - time_now_ns());
+}
+
+int net_batch_recv(NetBatch *p_batch) {
+  if (NULL != p_batch->p_uring) {
+    int count = net_uring_recv(p_batch->p_uring);
+    if (count > 0) p_batch->realtime_offset_ns = realtime_offset_ns();
+    return count;
+  }
+
+  for (int i = 0; i < NET_BATCH_CAPACITY; ++i) {
+    p_batch->recv_msgs[i].msg_hdr.msg_namelen = sizeof(p_batch->recv_addrs[i]);
+    p_batch->recv_msgs[i].msg_hdr.msg_controllen = RECV_CONTROL_SIZE;
+  }
+
+  int count = recvmmsg(p_batch->fd, p_batch->recv_msgs, NET_BATCH_CAPACITY, MSG_DONTWAIT, NULL);
+  p_batch->stats.recv_syscalls += 1;
+
+  if (count < 0) {
+    if (EAGAIN != errno && EWOULDBLOCK != errno) {
+      TraceLog(LOG_WARNING, "Could not receive from fd %d: %s", p_batch->fd, strerror(errno));
+    }
+    count = 0;
+  }
+
+  p_batch->recv_count = count;
+  p_batch->stats.received += count;
+  for (int i = 0; i < count; ++i) {
+    p_batch->stats.bytes_received += p_batch->recv_msgs[i].msg_len;
+  }
+  if (count > 0) p_batch->realtime_offset_ns = realtime_offset_ns();
+  return count;
 }
 
-void net_send_input(const UdpSocket *sock, int key) {
-  // TODO: convert int to network byte order
-  char buf[NET_BUF_SIZE] = {0};
-  buf[0] = (char)NET_CMD_UPDATE_INPUT;
-  memcpy(buf + 1, &key, sizeof(key));
-  send_all(sock->fd, buf, sizeof(buf), 0, &sock->addr);
+const char *net_batch_datagram(const NetBatch *p_batch, int i, int *p_len, struct sockaddr_in6 *p_from) {
+  if (NULL != p_batch->p_uring) {
+    return net_uring_datagram(p_batch->p_uring, i, p_len, p_from);
+  }
+
+  *p_len = (int)p_batch->recv_msgs[i].msg_len;
+  if (NULL != p_from) *p_from = p_batch->recv_addrs[i];
+  return p_batch->recv_bufs[i];
+}
+
+uint64_t net_batch_datagram_time(const NetBatch *p_batch, int i) {
+  uint64_t realtime = 0;
+  if (NULL != p_batch->p_uring) {
+    realtime = net_uring_datagram_timestamp(p_batch->p_uring, i);
+  } else {
+    struct msghdr *p_msg = (struct msghdr*)&p_batch->recv_msgs[i].msg_hdr;
+    for (struct cmsghdr *p_cmsg = CMSG_FIRSTHDR(p_msg); NULL != p_cmsg; p_cmsg = CMSG_NXTHDR(p_msg, p_cmsg)) {
+      if (SOL_SOCKET == p_cmsg->cmsg_level && SO_TIMESTAMPNS == p_cmsg->cmsg_type) {
+        struct timespec ts = {0};
+        memcpy(&ts, CMSG_DATA(p_cmsg), sizeof(ts));
+        realtime = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+        break;
+      }
+    }
+  }
+
+  return 0 != realtime ? realtime - (uint64_t)p_batch->realtime_offset_ns : 0;
+}
+
+void net_batch_queue(NetBatch *p_batch, const struct sockaddr_in6 *p_dest, const char *buf, int len) {
+  if (NULL != p_batch->p_uring) {
+    net_uring_queue(p_batch->p_uring, p_dest, buf, len);
+    return;
+  }
+
+  if (len > NET_BUF_SIZE) {
+    TraceLog(LOG_WARNING, "Datagram of %d bytes does not fit into a batch", len);
+    return;
+  }
+
+  if (p_batch->send_count == NET_BATCH_CAPACITY) {
+    net_batch_flush(p_batch);
+  }
+
+  int i = p_batch->send_count++;
+  p_batch->send_addrs[i] = *p_dest;
+  p_batch->send_iovs[i].iov_len = len;
+  memcpy(p_batch->send_bufs[i], buf, len);
+}
+
+void net_batch_flush(NetBatch *p_batch) {
+  if (NULL != p_batch->p_uring) {
+    net_uring_flush(p_batch->p_uring);
+    return;
+  }
+
+  int sent = 0;
+  while (sent < p_batch->send_count) {
+    int count = sendmmsg(p_batch->fd, p_batch->send_msgs + sent, p_batch->send_count - sent, 0);
+    p_batch->stats.send_syscalls += 1;
+
+    if (count < 0) {
+      if (EINTR == errno) continue;
+      // as with a single datagram, the rest is lost
+      TraceLog(LOG_WARNING, "Could not send to fd %d: %s", p_batch->fd, strerror(errno));
+      break;
+    }
+    for (int i = 0; i < count; ++i) {
+      p_batch->stats.bytes_sent += p_batch->send_msgs[sent + i].msg_len;
+    }
+    sent += count;
+  }
+
+  p_batch->stats.sent += sent;
+  p_batch->send_count = 0;
 }
 
-bool net_recv_cmd(const UdpSocket *sock, char *buf) {
-  return recv_all(sock->fd, buf, NET_BUF_SIZE, MSG_DONTWAIT);
+const NetBatchStats *net_batch_stats(const NetBatch *p_batch) {
+  return &p_batch->stats;
 }
@@ -2,45 +2,341 @@
 #define __NETWORK_H__
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <arpa/inet.h>
 
-#define NET_BUF_SIZE (2 + sizeof(float) * 2 + 1)
+// Size of the fixed commands NET_CMD_CONNECT, NET_CMD_READY and NET_CMD_CLOSED,
+// and of the header every NET_CMD_UPDATE_INPUT starts with
+#define NET_CMD_SIZE (2 + sizeof(float) * 2 + 1)
+
+// The last two bytes of every fixed command are the connection token the client
+// picked, little-endian. Together with the address it tells a session apart
+// from an earlier one that came from the same address and port
+#define NET_CMD_TOKEN_OFFSET (NET_CMD_SIZE - 2)
+
+// Paddle index NET_CMD_READY gives a spectator
+#define NET_PADDLE_SPECTATOR 2
+
+// Packed keys of this many latest ticks go in every NET_CMD_SNAPSHOT,
+// so a few lost datagrams do not leave a gap in the input stream
+#define NET_TICK_INPUTS_HISTORY 10
+
+// cmd, tick, 3 positions and velocities, 2 scores, inputs count and 2 inputs per byte
+#define NET_SNAPSHOT_SIZE (1 + 4 + GE_COUNT * 4 * 4 + 2 * 2 + 1 + NET_TICK_INPUTS_HISTORY / 2)
+
+// NET_CMD_STATE: cmd and the 26 fields of GameState, 4 bytes each
+#define NET_STATE_SIZE (1 + 26 * 4)
+
+// Enough for any message, NET_CMD_STATE is the largest
+#define NET_BUF_SIZE NET_STATE_SIZE
+
+// Ticks before the newest one a NetAck tells about
+#define NET_ACK_BITS 32
+
+// NET_CMD_UPDATE_INPUT carries the keys of at most this many latest ticks,
+// the ones the host did not ack yet, so a lost datagram is recovered from the next
+#define NET_INPUT_WINDOW 32
+
+// Fixed command header, ack bits of the snapshots and the count of key runs
+#define NET_INPUT_HEADER_SIZE (NET_CMD_SIZE + 4 + 1)
+
+// Every run of equal keys is a byte: 2 bits of the key and 6 bits of the length - 1
+#define NET_INPUT_MAX_SIZE (NET_INPUT_HEADER_SIZE + NET_INPUT_WINDOW)
+
+// NET_CMD_PING and NET_CMD_PONG: the fixed command header, the send time, the hold time,
+// the receive time of the answering side, the input tick of the host with its delay,
+// the tick of its next step and the hash of its state with the tick
+#define NET_PING_SIZE (NET_CMD_SIZE + 8 + 4 + 8 + 4 + 4 + 4 + 4 + 8)
+
+// NET_CMD_EVENT: cmd, tick, events, ball position, direction and speed, 2 scores
+#define NET_EVENT_SIZE (1 + 4 + 1 + 5 * 4 + 2 * 2)
+
+// Longest address net_addr_format makes: [ipv6]:port
+#define NET_ADDR_STRLEN (INET6_ADDRSTRLEN + 8)
+
+// Addresses of a host net_resolve keeps
+#define NET_RESOLVE_MAX_ADDRS 8
+
+// Datagrams a NetBatch receives or sends with one syscall
+#define NET_BATCH_CAPACITY 64
 
 typedef struct {
   int fd;
-  struct sockaddr_in addr;
+  struct sockaddr_in6 addr;
 } UdpSocket;
 
 typedef enum {
   NET_CMD_CONNECT,
   NET_CMD_READY,
   NET_CMD_UPDATE_INPUT,
-  NET_CMD_UPDATE_POSITION
+  NET_CMD_SNAPSHOT,
+  NET_CMD_DELTA_SNAPSHOT,
+  NET_CMD_PING,
+  NET_CMD_PONG,
+  NET_CMD_EVENT,
+  NET_CMD_CLOSED,
+  NET_CMD_RESYNC,
+  NET_CMD_STATE
 } NetworkCmd;
 
+typedef enum {
+  NET_ROLE_PLAYER,
+  NET_ROLE_SPECTATOR,
+} NetRole;
+
 typedef enum {
   GE_PADDLE_1,
   GE_PADDLE_2,
-  GE_BALL
+  GE_BALL,
+  GE_COUNT
 } GameEntity;
 
-/// Creates UDP IPv4 socket and connects to the host using 
-/// @returns int - socket
-/// @on error returns -1
+/// Newest tick received and which of the NET_ACK_BITS ticks before it were:
+/// bit i is set if tick - 1 - i was. Tick 0 means nothing was received yet
+typedef struct {
+  uint32_t tick;
+  uint32_t bits;
+} NetAck;
+
+/// Keys of the latest client ticks, newest first
+typedef struct {
+  // tick of keys[0]
+  uint32_t tick;
+  int count;
+  // packed with game_key_pack
+  unsigned char keys[NET_INPUT_WINDOW];
+  // snapshots the client has received
+  NetAck snapshot_ack;
+} NetInput;
+
+/// NET_CMD_PING, and NET_CMD_PONG that answers it with the same seq and time.
+/// Either side may ping the other
+typedef struct {
+  uint32_t seq;
+  // pings the answering side has received from the pinging one so far, 0 in a ping
+  uint32_t received;
+  // time_now_ns of the pinging side when it sent the ping
+  uint64_t time_ns;
+  // how long the answering side held the ping before it answered, 0 in a ping
+  uint32_t hold_ns;
+  // time_now_ns of the answering side when the ping arrived, 0 in a ping.
+  // With time_ns and hold_ns it tells the offset of the two clocks
+  uint64_t peer_time_ns;
+  // in a pong of the host to its player: the client tick the host steps with next
+  // and how long after peer_time_ns it does, tick 0 if it has no input yet
+  uint32_t input_tick;
+  uint32_t input_delay_ns;
+  // in a pong of the host to a session in a match: the tick of the state its
+  // next step (input_delay_ns after peer_time_ns) makes, 0 otherwise
+  uint32_t step_tick;
+  // in a pong of the host to its player: game_state_hash of the state its latest
+  // step made and the tick of that state, tick 0 before the first step.
+  // A rollback client that simulated the same tick compares it with its own
+  uint32_t state_tick;
+  uint64_t state_hash;
+} NetPing;
+
+/// Something that happened in a host step, sent right away however far the next
+/// snapshot is, with the ball as it left the step so the client can dead-reckon it
+typedef struct {
+  // tick of the state after the step, the same as its snapshot
+  uint32_t tick;
+  // GameEvent flags
+  unsigned char events;
+  float ball_position[2];
+  float ball_direction[2];
+  float ball_speed;
+  int16_t scores[2];
+} NetEvent;
+
+/// Everything the client needs from one host tick.
+/// On the wire every field is little-endian, floats as their IEEE 754 bits
+typedef struct {
+  // tick of the state, grows by one every step so it orders the snapshots
+  uint32_t tick;
+  float positions[GE_COUNT][2];
+  float velocities[GE_COUNT][2];
+  int16_t scores[2];
+  // keys of both paddles (packed with game_keys_pack) the host stepped
+  // tick - 1 - i with, for the clients that simulate the match themselves
+  int input_count;
+  unsigned char inputs[NET_TICK_INPUTS_HISTORY];
+  // inputs of the client the snapshot goes to that the host has received,
+  // tick 0 for a spectator
+  NetAck input_ack;
+} NetSnapshot;
+
+/// Maps an IPv4 address to IPv6 (::ffff:a.b.c.d), copies an IPv6 one
+/// @returns false if the address is of another family
+bool net_addr_from(const struct sockaddr *p_addr, struct sockaddr_in6 *out);
+
+/// @returns true if the address is an IPv4 one mapped to IPv6
+bool net_addr_is_ipv4(const struct sockaddr_in6 *p_addr);
+
+/// @returns true if the addresses and the ports are the same
+bool net_addr_equal(const struct sockaddr_in6 *p_a, const struct sockaddr_in6 *p_b);
+
+/// Formats the address as a.b.c.d:port if it is IPv4, [ipv6]:port otherwise,
+/// into buf of NET_ADDR_STRLEN
+/// @returns buf
+const char *net_addr_format(const struct sockaddr_in6 *p_addr, char *buf);
+
+/// Resolves the host (a name or an address of either family) with getaddrinfo,
+/// which blocks until the resolver answers
+/// @returns number of addresses written into out (at most capacity) in the order
+/// getaddrinfo prefers, -1 if the host could not be resolved
+int net_resolve(const char *host, int port, struct sockaddr_in6 *out, int capacity);
+
+/// Creates a dual-stack UDP socket and connects it to the address
+/// @returns false on error
+bool net_connect_udp(const struct sockaddr_in6 *p_addr, UdpSocket *out);
+
+/// Resolves the host and connects to the first of its addresses that works,
+/// blocking while it resolves
+/// @returns false if none does
 bool connect_to_host_udp(const char *host, int port, UdpSocket *out);
 
-/// Creates a UDP Ipv4 socket, binds it to any in addr and specified port
-/// @returns int - socket
-/// @on error returns -1
+/// Creates a dual-stack UDP socket bound to any address of the port: IPv4 peers
+/// come as IPv4 mapped IPv6 addresses
+/// @returns false on error
 bool create_udp_server_socket(int port, UdpSocket *out);
 
+/// Same as create_udp_server_socket with SO_REUSEPORT: every socket of the process
+/// can bind the same port, and the kernel spreads the clients between them by address
+bool create_udp_reuseport_socket(int port, UdpSocket *out);
+
+/// Encodes NET_CMD_CONNECT: the client wants to play or watch, into buf of at least NET_CMD_SIZE
+/// @returns size of the message
+int net_encode_connect(char *buf, NetRole role, uint16_t token);
+
+/// Encodes NET_CMD_UPDATE_INPUT into buf of at least NET_INPUT_MAX_SIZE: the tick of the
+/// newest input, the snapshot ack, and the keys run-length encoded since they rarely change
+/// @returns size of the message
+int net_encode_input(char *buf, const NetInput *p_input, uint16_t token);
+
+/// Encodes NET_CMD_PING or NET_CMD_PONG into buf of at least NET_PING_SIZE
+/// @returns size of the message
+int net_encode_ping(char *buf, NetworkCmd cmd, const NetPing *p_ping, uint16_t token);
+
+/// Encodes NET_CMD_READY: the match has started and the client plays the paddle,
+/// or NET_PADDLE_SPECTATOR if it only watches
+/// @returns size of the message
+int net_encode_ready(char *buf, int paddle_index, uint16_t token);
+
+/// Encodes NET_CMD_CLOSED: the host closed the session, its match is over
+/// @returns size of the message
+int net_encode_closed(char *buf, uint16_t token);
+
+/// Encodes NET_CMD_RESYNC: the rollback client lost track of the match and asks
+/// for the host's state, the host answers with NET_CMD_STATE
+/// @returns size of the message
+int net_encode_resync(char *buf, uint16_t token);
+
+/// Encodes NET_CMD_EVENT into buf of at least NET_EVENT_SIZE
+/// @returns size of the message
+int net_encode_event(char *buf, const NetEvent *p_event);
+
+/// @returns the role NET_CMD_CONNECT received into buf asks for
+NetRole net_decode_connect(const char *buf);
+
+/// @returns the connection token of the fixed command received into buf
+uint16_t net_cmd_token(const char *buf);
+
+/// Decodes NET_CMD_UPDATE_INPUT of len bytes received into buf
+/// @returns false if the message is malformed
+bool net_decode_input(const char *buf, int len, NetInput *out);
+
+/// Decodes NET_CMD_PING or NET_CMD_PONG of len bytes received into buf
+/// @returns false if the message is malformed
+bool net_decode_ping(const char *buf, int len, NetPing *out);
+
+/// @returns false if the message is not a NET_CMD_EVENT or is too short
+bool net_decode_event(const char *buf, int len, NetEvent *out);
+
+/// Marks the tick as received. Ticks older than NET_ACK_BITS before the newest are ignored
+void net_ack_mark(NetAck *p_ack, uint32_t tick);
+
+/// @returns true if the ack tells the tick was received
+bool net_ack_has(const NetAck *p_ack, uint32_t tick);
+
+/// Receives one datagram into buf of NET_BUF_SIZE without blocking
+/// @returns size of the datagram, 0 if there is none
+int net_recv_cmd(const UdpSocket *sock, char *buf);
+
+/// Sends the snapshot as a single NET_CMD_SNAPSHOT datagram
+void net_send_snapshot(const UdpSocket *sock, const NetSnapshot *p_snapshot);
+
+/// Encodes the snapshot into buf of at least NET_SNAPSHOT_SIZE
+void net_encode_snapshot(const NetSnapshot *p_snapshot, char *buf);
+
+/// Decodes NET_CMD_SNAPSHOT of len bytes received into buf
+/// @returns false if the message is not a whole snapshot
+bool net_decode_snapshot(const char *buf, int len, NetSnapshot *out);
+
+/// How a NetBatch talks to the kernel, picked once at startup
+typedef enum {
+  // recvmmsg and sendmmsg
+  NET_BACKEND_SYSCALL,
+  // a multishot receive always posted and one io_uring_enter per flush
+  NET_BACKEND_IO_URING,
+} NetBackend;
+
+/// Backend of the batches created from now on
+void net_set_backend(NetBackend backend);
+
+/// @returns false if the name is neither "syscall" nor "io_uring"
+bool net_parse_backend(const char *name, NetBackend *out);
+
+const char *net_backend_name(NetBackend backend);
+
+typedef struct {
+  long recv_syscalls;
+  long send_syscalls;
+  long received;
+  long sent;
+  long bytes_received;
+  long bytes_sent;
+} NetBatchStats;
+
+/// Receives and sends many datagrams of a socket with a single syscall each way,
+/// recvmmsg drains what is pending, sendmmsg flushes what was queued.
+/// All the headers and buffers are allocated once with it. Enables SO_TIMESTAMPNS
+/// on the socket
+typedef struct NetBatch NetBatch;
+
+/// Uses the backend of net_set_backend, falls back to NET_BACKEND_SYSCALL
+/// if the kernel does not support io_uring
+/// @returns NULL if out of memory
+NetBatch *net_batch_create(int fd);
+void net_batch_destroy(NetBatch *p_batch);
+
+NetBackend net_batch_backend(const NetBatch *p_batch);
+
+/// @returns the fd to wait on for received datagrams. With io_uring it is the
+/// ring, whose receive is armed by net_batch_recv on the thread that calls it:
+/// receive once on the waiting thread before the first wait
+int net_batch_poll_fd(const NetBatch *p_batch);
+
+/// Receives up to NET_BATCH_CAPACITY pending datagrams without blocking
+/// @returns number of datagrams received, they stay valid until the next call
+int net_batch_recv(NetBatch *p_batch);
+
+/// @returns the i-th datagram of the last net_batch_recv, p_from may be NULL
+const char *net_batch_datagram(const NetBatch *p_batch, int i, int *p_len, struct sockaddr_in6 *p_from);
+
+/// The kernel stamps every datagram when it arrives (SO_TIMESTAMPNS), so a receive
+/// time does not include how long the datagram waited in the socket buffer
+/// @returns the time_now_ns the i-th datagram of the last net_batch_recv arrived at,
+/// 0 if the socket does not support the timestamps
+uint64_t net_batch_datagram_time(const NetBatch *p_batch, int i);
 
+/// Copies the datagram of len bytes (at most NET_BUF_SIZE) into the send queue,
+/// flushes first if the queue is full
+void net_batch_queue(NetBatch *p_batch, const struct sockaddr_in6 *p_dest, const char *buf, int len);
 
-bool net_check_for_connection(const UdpSocket *sock, UdpSocket *out);
+/// Sends all the queued datagrams
+void net_batch_flush(NetBatch *p_batch);
 
-void net_send_cmd_wo_args(const UdpSocket *sock, NetworkCmd net_cmd);
-void net_send_position(const UdpSocket *sock, GameEntity e, float x, float y);
-void net_send_input(const UdpSocket *sock, int key);
-bool net_recv_cmd(const UdpSocket *sock, char *buf);
+const NetBatchStats *net_batch_stats(const NetBatch *p_batch);
 
 #endif // !__NETWORK_H__
@@ -0,0 +1,570 @@
+// ppoll
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "raylib.h"
+
+#include "args.h"
+#include "network.h"
+#include "impair.h"
+#include "timing.h"
+
+#define PROXY_DEFAULT_PORT 7778
+#define PROXY_DEFAULT_HOST_PORT 7777
+#define PROXY_DEFAULT_REPORT_INTERVAL 5
+#define PROXY_DEFAULT_CLIENT_TIMEOUT 10
+#define PROXY_DEFAULT_MAX_CLIENTS 64
+
+typedef struct {
+  int port;
+  const char *host;
+  int host_port;
+  const char *profile_path;
+  const char *log_path;
+  // 0 runs until SIGINT
+  int duration;
+  int report_interval;
+  // a socket each, a client beyond them is rejected
+  int max_clients;
+  // seconds without a datagram from a client before it is forgotten
+  int client_timeout;
+  uint64_t seed;
+  bool has_seed;
+} ProxyConfig;
+
+/// A client behind the proxy, the host sees it as the address of its own socket.
+/// The slot is free while upstream.fd < 0
+typedef struct {
+  struct sockaddr_in6 addr;
+  UdpSocket upstream;
+  // of its last datagram, the host goes on sending to a client that is gone
+  uint64_t last_active_ns;
+} ProxyClient;
+
+/// A copy of a datagram waiting for its release
+typedef struct {
+  uint64_t release_ns;
+  uint64_t arrival_ns;
+  // arrival order, breaks the ties of release_ns so copies keep it
+  uint64_t seq;
+  ImpairDirection direction;
+  int client;
+  int len;
+  char buf[NET_BUF_SIZE];
+} ProxyDatagram;
+
+typedef struct {
+  ProxyConfig cfg;
+  UdpSocket listen;
+  // the host is resolved once at start, a new client only connects a socket
+  struct sockaddr_in6 host_addrs[NET_RESOLVE_MAX_ADDRS];
+  int host_addr_count;
+  ImpairLink links[IMPAIR_DIRECTIONS];
+  // max_clients slots, and what is polled: the listening socket, then the slots
+  ProxyClient *clients;
+  struct pollfd *fds;
+  // slots ever taken, the free ones among them are reused first
+  int client_count;
+  int active_clients;
+  long rejected_clients;
+  long expired_clients;
+  // copies of expired clients thrown away before their release
+  long dropped_copies;
+  // warned that it is full, again once a slot is free
+  bool has_warned_full;
+
+  // min-heap of the pending copies by release time, the free ones on a stack
+  ProxyDatagram *pool;
+  int *heap;
+  int heap_count;
+  int *free_slots;
+  int free_count;
+  uint64_t next_seq;
+
+  uint64_t start_ns;
+  // a row per datagram if not NULL
+  FILE *p_log;
+} Proxy;
+
+static volatile sig_atomic_t proxy_should_stop = 0;
+
+static void handle_stop_signal(int signal) {
+  (void)signal;
+  proxy_should_stop = 1;
+}
+
+static bool is_earlier(const Proxy *p_proxy, int a, int b) {
+  const ProxyDatagram *p_a = &p_proxy->pool[a];
+  const ProxyDatagram *p_b = &p_proxy->pool[b];
+  return p_a->release_ns != p_b->release_ns ? p_a->release_ns < p_b->release_ns : p_a->seq < p_b->seq;
+}
+
+static void heap_push(Proxy *p_proxy, int slot) {
+  int i = p_proxy->heap_count++;
+  p_proxy->heap[i] = slot;
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (!is_earlier(p_proxy, p_proxy->heap[i], p_proxy->heap[parent])) break;
+    int tmp = p_proxy->heap[i];
+    p_proxy->heap[i] = p_proxy->heap[parent];
+    p_proxy->heap[parent] = tmp;
+    i = parent;
+  }
+}
+
+static void heap_sift_down(Proxy *p_proxy, int i) {
+  for (;;) {
+    int earliest = i;
+    int left = 2 * i + 1;
+    int right = left + 1;
+    if (left < p_proxy->heap_count && is_earlier(p_proxy, p_proxy->heap[left], p_proxy->heap[earliest])) {
+      earliest = left;
+    }
+    if (right < p_proxy->heap_count && is_earlier(p_proxy, p_proxy->heap[right], p_proxy->heap[earliest])) {
+      earliest = right;
+    }
+    if (earliest == i) break;
+    int tmp = p_proxy->heap[i];
+    p_proxy->heap[i] = p_proxy->heap[earliest];
+    p_proxy->heap[earliest] = tmp;
+    i = earliest;
+  }
+}
+
+static int heap_pop(Proxy *p_proxy) {
+  int top = p_proxy->heap[0];
+  p_proxy->heap[0] = p_proxy->heap[--p_proxy->heap_count];
+  heap_sift_down(p_proxy, 0);
+  return top;
+}
+
+static const char *fate_name(ImpairFate fate) {
+  switch (fate) {
+    case IMPAIR_SENT: return "sent";
+    case IMPAIR_LOST: return "lost";
+    case IMPAIR_QUEUE_FULL: return "queue_full";
+  }
+  return "";
+}
+
+/// Appends a row, delay_ms < 0 if the datagram was not sent
+static void log_datagram(Proxy *p_proxy, uint64_t now_ns, ImpairDirection direction, int client,
+                         int len, const char *event, double delay_ms) {
+  if (NULL == p_proxy->p_log) return;
+
+  fprintf(p_proxy->p_log, "%.6f,%s,%d,%d,%s,", (now_ns - p_proxy->start_ns) / 1e9,
+          impair_direction_name(direction), client, len, event);
+  if (delay_ms >= 0) {
+    fprintf(p_proxy->p_log, "%.3f\n", delay_ms);
+  } else {
+    fprintf(p_proxy->p_log, "\n");
+  }
+}
+
+/// @returns index of the client of the address, a new one for an unknown address,
+/// -1 if there is no room for it
+static int find_client(Proxy *p_proxy, const struct sockaddr_in6 *p_from) {
+  int free_slot = -1;
+  for (int i = 0; i < p_proxy->client_count; ++i) {
+    if (p_proxy->clients[i].upstream.fd < 0) {
+      if (free_slot < 0) free_slot = i;
+    } else if (net_addr_equal(&p_proxy->clients[i].addr, p_from)) {
+      return i;
+    }
+  }
+  if (free_slot < 0 && p_proxy->client_count < p_proxy->cfg.max_clients) {
+    free_slot = p_proxy->client_count;
+  }
+
+  if (free_slot < 0) {
+    p_proxy->rejected_clients += 1;
+    if (!p_proxy->has_warned_full) {
+      char addr[NET_ADDR_STRLEN] = {0};
+      TraceLog(LOG_WARNING, "Rejected %s, all %d clients are active (--max-clients), "
+               "an idle one is forgotten after %d s", net_addr_format(p_from, addr),
+               p_proxy->cfg.max_clients, p_proxy->cfg.client_timeout);
+      p_proxy->has_warned_full = true;
+    }
+    return -1;
+  }
+
+  ProxyClient *p_client = &p_proxy->clients[free_slot];
+  // in the order of getaddrinfo, which puts the preferred family first
+  bool is_connected = false;
+  for (int i = 0; i < p_proxy->host_addr_count && !is_connected; ++i) {
+    is_connected = net_connect_udp(&p_proxy->host_addrs[i], &p_client->upstream);
+  }
+  if (!is_connected) {
+    p_client->upstream.fd = -1;
+    p_proxy->rejected_clients += 1;
+    return -1;
+  }
+  p_client->addr = *p_from;
+  p_proxy->active_clients += 1;
+  if (free_slot == p_proxy->client_count) p_proxy->client_count += 1;
+
+  char addr[NET_ADDR_STRLEN] = {0};
+  TraceLog(LOG_INFO, "Client %d is %s", free_slot, net_addr_format(p_from, addr));
+  return free_slot;
+}
+
+/// Forgets the clients that sent nothing for client_timeout:
+/// closes their sockets and throws their pending copies away, so the slots
+/// of clients that reconnected or lost a race of addresses come back
+static void expire_idle(Proxy *p_proxy, uint64_t now_ns) {
+  uint64_t timeout_ns = p_proxy->cfg.client_timeout * 1000000000ull;
+  bool has_expired = false;
+  for (int i = 0; i < p_proxy->client_count; ++i) {
+    ProxyClient *p_client = &p_proxy->clients[i];
+    if (p_client->upstream.fd < 0 || now_ns - p_client->last_active_ns < timeout_ns) continue;
+
+    char addr[NET_ADDR_STRLEN] = {0};
+    TraceLog(LOG_INFO, "Client %d (%s) expired", i, net_addr_format(&p_client->addr, addr));
+    close(p_client->upstream.fd);
+    p_client->upstream.fd = -1;
+    p_proxy->active_clients -= 1;
+    p_proxy->expired_clients += 1;
+    has_expired = true;
+  }
+  if (!has_expired) return;
+  p_proxy->has_warned_full = false;
+
+  // keeps the copies of the clients left and makes a heap of them again
+  int kept = 0;
+  for (int i = 0; i < p_proxy->heap_count; ++i) {
+    int slot = p_proxy->heap[i];
+    ProxyDatagram *p_datagram = &p_proxy->pool[slot];
+    if (p_proxy->clients[p_datagram->client].upstream.fd >= 0) {
+      p_proxy->heap[kept++] = slot;
+      continue;
+    }
+    impair_link_drop(&p_proxy->links[p_datagram->direction]);
+    log_datagram(p_proxy, now_ns, p_datagram->direction, p_datagram->client, p_datagram->len, "expired", -1);
+    p_proxy->dropped_copies += 1;
+    p_proxy->free_slots[p_proxy->free_count++] = slot;
+  }
+  p_proxy->heap_count = kept;
+  for (int i = kept / 2 - 1; i >= 0; --i) {
+    heap_sift_down(p_proxy, i);
+  }
+}
+
+/// Decides the fate of the datagram and queues its copies
+static void admit(Proxy *p_proxy, ImpairDirection direction, int client, const char *buf, int len,
+                  uint64_t now_ns) {
+  ImpairDecision decision = impair_link_admit(&p_proxy->links[direction], now_ns, len);
+  if (IMPAIR_SENT != decision.fate) {
+    log_datagram(p_proxy, now_ns, direction, client, len, fate_name(decision.fate), -1);
+    return;
+  }
+
+  for (int i = 0; i < decision.copies; ++i) {
+    // the links never hold more than the pool, their limits add up to its size
+    int slot = p_proxy->free_slots[--p_proxy->free_count];
+    ProxyDatagram *p_datagram = &p_proxy->pool[slot];
+    p_datagram->release_ns = decision.release_ns[i];
+    p_datagram->arrival_ns = now_ns;
+    p_datagram->seq = p_proxy->next_seq++;
+    p_datagram->direction = direction;
+    p_datagram->client = client;
+    p_datagram->len = len;
+    memcpy(p_datagram->buf, buf, len);
+    heap_push(p_proxy, slot);
+  }
+}
+
+/// Reads everything the sockets have and admits it
+static void receive_all(Proxy *p_proxy, const struct pollfd *fds) {
+  char buf[NET_BUF_SIZE] = {0};
+
+  if (fds[0].revents & POLLIN) {
+    for (;;) {
+      struct sockaddr_in6 from = {0};
+      socklen_t from_len = sizeof(from);
+      int len = recvfrom(p_proxy->listen.fd, buf, sizeof(buf), MSG_DONTWAIT,
+                         (struct sockaddr *)&from, &from_len);
+      if (len < 0) break;
+
+      int client = find_client(p_proxy, &from);
+      if (client < 0) continue;
+      uint64_t now = time_now_ns();
+      p_proxy->clients[client].last_active_ns = now;
+      admit(p_proxy, IMPAIR_UP, client, buf, len, now);
+    }
+  }
+
+  for (int i = 0; i < p_proxy->client_count; ++i) {
+    if (!(fds[1 + i].revents & POLLIN)) continue;
+
+    for (;;) {
+      int len = recv(p_proxy->clients[i].upstream.fd, buf, sizeof(buf), MSG_DONTWAIT);
+      if (len < 0) break;
+      admit(p_proxy, IMPAIR_DOWN, i, buf, len, time_now_ns());
+    }
+  }
+}
+
+/// Sends the copies that are due, upstream from the socket of their client
+static void release_due(Proxy *p_proxy) {
+  uint64_t now = time_now_ns();
+
+  while (p_proxy->heap_count > 0 && p_proxy->pool[p_proxy->heap[0]].release_ns <= now) {
+    int slot = heap_pop(p_proxy);
+    ProxyDatagram *p_datagram = &p_proxy->pool[slot];
+    ProxyClient *p_client = &p_proxy->clients[p_datagram->client];
+
+    int sent = IMPAIR_UP == p_datagram->direction
+      ? send(p_client->upstream.fd, p_datagram->buf, p_datagram->len, 0)
+      : sendto(p_proxy->listen.fd, p_datagram->buf, p_datagram->len, 0,
+               (const struct sockaddr *)&p_client->addr, sizeof(p_client->addr));
+    if (sent < 0 && ECONNREFUSED != errno) {
+      TraceLog(LOG_WARNING, "Could not send %s to client %d: %s",
+               impair_direction_name(p_datagram->direction), p_datagram->client, strerror(errno));
+    }
+
+    impair_link_release(&p_proxy->links[p_datagram->direction], p_datagram->arrival_ns, now);
+    log_datagram(p_proxy, now, p_datagram->direction, p_datagram->client, p_datagram->len,
+                 "sent", (now - p_datagram->arrival_ns) / 1e6);
+    p_proxy->free_slots[p_proxy->free_count++] = slot;
+  }
+}
+
+static void print_stats(ImpairDirection direction, const ImpairStats *p_stats) {
+  printf("%-4s: %ld datagrams (%ld bytes), lost %ld (%.2f%%), queue full %ld, duplicated %ld, "
+         "reordered %ld, delay mean %.2f ms, max %.2f ms\n",
+         impair_direction_name(direction), p_stats->datagrams, p_stats->bytes,
+         p_stats->lost, p_stats->datagrams > 0 ? 100. * p_stats->lost / p_stats->datagrams : 0.,
+         p_stats->queue_full, p_stats->duplicated, p_stats->reordered,
+         p_stats->sent > 0 ? p_stats->delay_ms_sum / p_stats->sent : 0., p_stats->max_delay_ms);
+}
+
+static void print_report(const Proxy *p_proxy) {
+  printf("clients %d (%ld rejected, %ld expired), pending %d (%ld of expired clients dropped)\n",
+         p_proxy->active_clients, p_proxy->rejected_clients, p_proxy->expired_clients,
+         p_proxy->heap_count, p_proxy->dropped_copies);
+  for (int i = 0; i < IMPAIR_DIRECTIONS; ++i) {
+    print_stats(i, &p_proxy->links[i].stats);
+  }
+  fflush(stdout);
+}
+
+static void run(Proxy *p_proxy) {
+  const ProxyConfig *p_cfg = &p_proxy->cfg;
+  struct pollfd *fds = p_proxy->fds;
+
+  uint64_t report_ns = p_proxy->start_ns + p_cfg->report_interval * 1000000000ull;
+  uint64_t end_ns = p_proxy->start_ns + p_cfg->duration * 1000000000ull;
+
+  while (!proxy_should_stop && (0 == p_cfg->duration || time_now_ns() < end_ns)) {
+    fds[0].fd = p_proxy->listen.fd;
+    fds[0].events = POLLIN;
+    for (int i = 0; i < p_proxy->client_count; ++i) {
+      fds[1 + i].fd = p_proxy->clients[i].upstream.fd;
+      fds[1 + i].events = POLLIN;
+      fds[1 + i].revents = 0;
+    }
+
+    // wakes up for the next release, the report and the end of the run at the latest
+    uint64_t now = time_now_ns();
+    uint64_t wake_ns = now + 100000000ull;
+    if (p_proxy->heap_count > 0 && p_proxy->pool[p_proxy->heap[0]].release_ns < wake_ns) {
+      wake_ns = p_proxy->pool[p_proxy->heap[0]].release_ns;
+    }
+    uint64_t timeout_ns = wake_ns > now ? wake_ns - now : 0;
+    struct timespec timeout = { (time_t)(timeout_ns / 1000000000ull), (long)(timeout_ns % 1000000000ull) };
+
+    int ready = ppoll(fds, 1 + p_proxy->client_count, &timeout, NULL);
+    if (ready < 0 && EINTR != errno) {
+      TraceLog(LOG_ERROR, "Could not wait for the sockets: %s", strerror(errno));
+      break;
+    }
+    if (ready > 0) {
+      receive_all(p_proxy, fds);
+    }
+    release_due(p_proxy);
+
+    now = time_now_ns();
+    expire_idle(p_proxy, now);
+    if (p_cfg->report_interval > 0 && now >= report_ns) {
+      report_ns = now + p_cfg->report_interval * 1000000000ull;
+      print_report(p_proxy);
+    }
+  }
+}
+
+/// Every client has its own upstream socket, so it needs as many descriptors
+static bool raise_file_limit(int clients) {
+  struct rlimit limit = {0};
+  if (0 != getrlimit(RLIMIT_NOFILE, &limit)) {
+    TraceLog(LOG_ERROR, "Could not get the file limit: %s", strerror(errno));
+    return false;
+  }
+
+  // the listening socket, the log and the standard ones
+  rlim_t needed = clients + 16;
+  if (limit.rlim_cur >= needed) return true;
+
+  limit.rlim_cur = limit.rlim_max < needed ? limit.rlim_max : needed;
+  if (0 != setrlimit(RLIMIT_NOFILE, &limit) || limit.rlim_cur < needed) {
+    TraceLog(LOG_ERROR, "%d clients need %lu files, the limit is %lu (ulimit -n)", clients,
+             (unsigned long)needed, (unsigned long)limit.rlim_cur);
+    return false;
+  }
+  return true;
+}
+
+static ProxyConfig parse_args(int argc, char **argv) {
+  ProxyConfig config = {0};
+  config.port = PROXY_DEFAULT_PORT;
+  config.host = "127.0.0.1";
+  config.host_port = PROXY_DEFAULT_HOST_PORT;
+  config.report_interval = PROXY_DEFAULT_REPORT_INTERVAL;
+  config.max_clients = PROXY_DEFAULT_MAX_CLIENTS;
+  config.client_timeout = PROXY_DEFAULT_CLIENT_TIMEOUT;
+
+  shift_args(&argc, &argv);
+
+  while (argc > 0) {
+    char *arg = shift_args(&argc, &argv);
+    if (argc < 1) {
+      TraceLog(LOG_FATAL, "Value must be provided for %s", arg);
+    }
+    char *value = shift_args(&argc, &argv);
+
+    if (0 == strcmp(arg, "--port")) {
+      config.port = args_int("--port", value, 1, 65535);
+    } else if (0 == strcmp(arg, "--host")) {
+      config.host = value;
+    } else if (0 == strcmp(arg, "--host-port")) {
+      config.host_port = args_int("--host-port", value, 1, 65535);
+    } else if (0 == strcmp(arg, "--profile")) {
+      config.profile_path = value;
+    } else if (0 == strcmp(arg, "--log")) {
+      config.log_path = value;
+    } else if (0 == strcmp(arg, "--seed")) {
+      config.seed = strtoull(value, NULL, 0);
+      config.has_seed = true;
+    } else if (0 == strcmp(arg, "--duration")) {
+      config.duration = args_int("--duration", value, 0, INT_MAX);
+    } else if (0 == strcmp(arg, "--report-interval")) {
+      config.report_interval = args_int("--report-interval", value, 0, INT_MAX);
+    } else if (0 == strcmp(arg, "--max-clients")) {
+      // an upstream socket each, so a local port each
+      config.max_clients = args_int("--max-clients", value, 1, 65535);
+    } else if (0 == strcmp(arg, "--client-timeout")) {
+      config.client_timeout = args_int("--client-timeout", value, 1, INT_MAX);
+    } else {
+      TraceLog(LOG_FATAL, "Unknown argument %s", arg);
+    }
+  }
+
+  return config;
+}
+
+int main(int argc, char **argv) {
+  Proxy proxy = {0};
+  proxy.cfg = parse_args(argc, argv);
+  const ProxyConfig *p_cfg = &proxy.cfg;
+  proxy.listen.fd = -1;
+  int result = 1;
+
+  struct sigaction action = {0};
+  action.sa_handler = handle_stop_signal;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  ImpairConfig cfgs[IMPAIR_DIRECTIONS] = { impair_config_default(), impair_config_default() };
+  uint64_t seed = 1;
+  if (NULL != p_cfg->profile_path && !impair_load_profile(p_cfg->profile_path, cfgs, &seed)) {
+    goto defer;
+  }
+  // the flag wins over the profile, to repeat a profile with other seeds
+  if (p_cfg->has_seed) seed = p_cfg->seed;
+
+  int pool_size = 0;
+  for (int i = 0; i < IMPAIR_DIRECTIONS; ++i) {
+    // the directions draw from their own streams
+    impair_link_init(&proxy.links[i], &cfgs[i], seed + i * 0x9e3779b97f4a7c15ull);
+    impair_log_config(i, &cfgs[i]);
+    pool_size += cfgs[i].limit;
+  }
+
+  proxy.pool = malloc(sizeof(ProxyDatagram) * pool_size);
+  proxy.heap = malloc(sizeof(int) * pool_size);
+  proxy.free_slots = malloc(sizeof(int) * pool_size);
+  if (NULL == proxy.pool || NULL == proxy.heap || NULL == proxy.free_slots) {
+    TraceLog(LOG_ERROR, "Could not allocate %d pending datagrams", pool_size);
+    goto defer;
+  }
+  if (!raise_file_limit(p_cfg->max_clients)) {
+    goto defer;
+  }
+  proxy.clients = calloc(p_cfg->max_clients, sizeof(ProxyClient));
+  proxy.fds = calloc(1 + p_cfg->max_clients, sizeof(struct pollfd));
+  if (NULL == proxy.clients || NULL == proxy.fds) {
+    TraceLog(LOG_ERROR, "Could not allocate %d clients", p_cfg->max_clients);
+    goto defer;
+  }
+  for (int i = 0; i < pool_size; ++i) {
+    proxy.free_slots[i] = pool_size - 1 - i;
+  }
+  proxy.free_count = pool_size;
+
+  if (NULL != p_cfg->log_path) {
+    proxy.p_log = fopen(p_cfg->log_path, "w");
+    if (NULL == proxy.p_log) {
+      TraceLog(LOG_ERROR, "Could not create the log %s: %s", p_cfg->log_path, strerror(errno));
+      goto defer;
+    }
+    fprintf(proxy.p_log, "# seed %llu, profile %s\n", (unsigned long long)seed,
+            NULL != p_cfg->profile_path ? p_cfg->profile_path : "none");
+    fprintf(proxy.p_log, "time_s,direction,client,bytes,fate,delay_ms\n");
+  }
+
+  proxy.host_addr_count = net_resolve(p_cfg->host, p_cfg->host_port, proxy.host_addrs, NET_RESOLVE_MAX_ADDRS);
+  if (proxy.host_addr_count < 0) {
+    goto defer;
+  }
+  if (0 == proxy.host_addr_count) {
+    TraceLog(LOG_ERROR, "The host %s has no address", p_cfg->host);
+    goto defer;
+  }
+
+  if (!create_udp_server_socket(p_cfg->port, &proxy.listen)) {
+    goto defer;
+  }
+
+  printf("Relaying port %d to %s:%d, seed %llu\n", p_cfg->port, p_cfg->host, p_cfg->host_port,
+         (unsigned long long)seed);
+  fflush(stdout);
+
+  proxy.start_ns = time_now_ns();
+  run(&proxy);
+
+  printf("\n");
+  print_report(&proxy);
+  result = 0;
+
+defer:
+  if (NULL != proxy.p_log) fclose(proxy.p_log);
+  if (proxy.listen.fd >= 0) close(proxy.listen.fd);
+  for (int i = 0; i < proxy.client_count; ++i) {
+    if (proxy.clients[i].upstream.fd >= 0) close(proxy.clients[i].upstream.fd);
+  }
+  free(proxy.fds);
+  free(proxy.clients);
+  free(proxy.free_slots);
+  free(proxy.heap);
+  free(proxy.pool);
+  return result;
+}
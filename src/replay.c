@@ -0,0 +1,182 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "raylib.h"
+
+#include "replay.h"
+
+static void write_run(ReplayRecorder *p_rec) {
+  unsigned char buf[1 + 5] = {0};
+  size_t len = 0;
+  uint32_t count = p_rec->run_length;
+
+  buf[len++] = p_rec->keys;
+  do {
+    buf[len] = count & 0x7f;
+    count >>= 7;
+    buf[len++] |= count ? 0x80 : 0;
+  } while (count);
+
+  if (fwrite(buf, 1, len, p_rec->file) != len || 0 != fflush(p_rec->file)) {
+    TraceLog(LOG_ERROR, "Could not write the replay: %s\n", strerror(errno));
+  }
+}
+
+bool replay_recorder_begin(ReplayRecorder *p_rec, const char *path, const GameContext *ctx) {
+  memset(p_rec, 0, sizeof(*p_rec));
+
+  ReplayHeader header = {0};
+  memcpy(header.magic, REPLAY_MAGIC, sizeof(header.magic));
+  header.version = REPLAY_VERSION;
+  header.tick_dt = ctx->tick_dt;
+  header.state = ctx->state;
+
+  p_rec->file = fopen(path, "wb");
+  if (NULL == p_rec->file) {
+    TraceLog(LOG_ERROR, "Could not create the replay %s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  if (1 != fwrite(&header, sizeof(header), 1, p_rec->file) || 0 != fflush(p_rec->file)) {
+    TraceLog(LOG_ERROR, "Could not write the replay %s: %s\n", path, strerror(errno));
+    fclose(p_rec->file);
+    p_rec->file = NULL;
+    return false;
+  }
+
+  return true;
+}
+
+void replay_recorder_push(ReplayRecorder *p_rec, const GameContext *ctx) {
+  if (NULL == p_rec->file) return;
+
+  unsigned char keys = game_keys_pack(ctx->state.pressed_key);
+
+  if (p_rec->run_length > 0 && (keys != p_rec->keys || UINT32_MAX == p_rec->run_length)) {
+    write_run(p_rec);
+    p_rec->run_length = 0;
+  }
+
+  p_rec->keys = keys;
+  p_rec->run_length += 1;
+  p_rec->ticks += 1;
+}
+
+void replay_recorder_end(ReplayRecorder *p_rec) {
+  if (NULL == p_rec->file) return;
+
+  if (p_rec->run_length > 0) {
+    write_run(p_rec);
+  }
+
+  fclose(p_rec->file);
+  p_rec->file = NULL;
+}
+
+bool replay_reader_open(ReplayReader *p_reader, const char *path) {
+  memset(p_reader, 0, sizeof(*p_reader));
+
+  int fd = open(path, O_RDONLY);
+  if (-1 == fd) {
+    TraceLog(LOG_ERROR, "Could not open the replay %s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  struct stat st = {0};
+  if (-1 == fstat(fd, &st)) {
+    TraceLog(LOG_ERROR, "Could not stat the replay %s: %s\n", path, strerror(errno));
+    close(fd);
+    return false;
+  }
+
+  if ((size_t)st.st_size < sizeof(ReplayHeader)) {
+    TraceLog(LOG_ERROR, "Replay %s is too short\n", path);
+    close(fd);
+    return false;
+  }
+
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping stays valid without the descriptor
+  close(fd);
+  if (MAP_FAILED == data) {
+    TraceLog(LOG_ERROR, "Could not map the replay %s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  p_reader->data = data;
+  p_reader->size = st.st_size;
+  p_reader->offset = sizeof(ReplayHeader);
+  memcpy(&p_reader->header, data, sizeof(ReplayHeader));
+
+  if (0 != memcmp(p_reader->header.magic, REPLAY_MAGIC, sizeof(p_reader->header.magic))
+    || REPLAY_VERSION != p_reader->header.version
+    || !(p_reader->header.tick_dt > 0)) {
+    TraceLog(LOG_ERROR, "%s is not a replay of this version\n", path);
+    replay_reader_close(p_reader);
+    return false;
+  }
+
+  return true;
+}
+
+void replay_reader_close(ReplayReader *p_reader) {
+  if (NULL != p_reader->data) {
+    munmap((void*)p_reader->data, p_reader->size);
+  }
+  memset(p_reader, 0, sizeof(*p_reader));
+}
+
+GameContext replay_reader_initial_context(const ReplayReader *p_reader) {
+  const ReplayHeader *p_header = &p_reader->header;
+  GameContext ctx = game_context_create();
+
+  ctx.tick_dt = p_header->tick_dt;
+  ctx.state = p_header->state;
+  ctx.paddles[0].prev_rect = ctx.state.paddles[0].rect;
+  ctx.paddles[1].prev_rect = ctx.state.paddles[1].rect;
+  ctx.ball.prev_rect = ctx.state.ball.rect;
+
+  return ctx;
+}
+
+bool replay_reader_next(ReplayReader *p_reader, GameContext *ctx) {
+  if (0 == p_reader->run_left) {
+    if (p_reader->offset >= p_reader->size) {
+      return false;
+    }
+
+    unsigned char keys = p_reader->data[p_reader->offset++];
+    uint32_t count = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+      if (p_reader->offset >= p_reader->size) {
+        // run cut by a crash while it was written
+        return false;
+      }
+      unsigned char byte = p_reader->data[p_reader->offset++];
+      count |= (uint32_t)(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) break;
+    }
+
+    if (0 == count) {
+      return false;
+    }
+
+    p_reader->keys = keys;
+    p_reader->run_left = count;
+  }
+
+  p_reader->run_left -= 1;
+  p_reader->tick += 1;
+
+  game_keys_unpack(p_reader->keys, ctx->state.pressed_key);
+  game_apply_pressed_key(&ctx->state, 0);
+  game_apply_pressed_key(&ctx->state, 1);
+  return true;
+}
@@ -0,0 +1,67 @@
+#ifndef __REPLAY_H__
+#define __REPLAY_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "game.h"
+
+#define REPLAY_MAGIC "PPRP"
+#define REPLAY_VERSION 2
+
+/// Start of a replay file: the state the match starts from.
+/// Only 4 byte fields, so there is no padding, written in host byte order.
+/// It is followed by runs of inputs until the end of the file,
+/// every run is one byte of both keys and the LEB128 number of ticks
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  float tick_dt;
+  GameState state;
+} ReplayHeader;
+
+typedef struct {
+  FILE *file;
+  // keys of the run that is not written yet
+  unsigned char keys;
+  uint32_t run_length;
+  long ticks;
+} ReplayRecorder;
+
+typedef struct {
+  const unsigned char *data;
+  size_t size;
+  size_t offset;
+  ReplayHeader header;
+
+  unsigned char keys;
+  uint32_t run_left;
+  long tick;
+} ReplayReader;
+
+/// Creates the replay file and writes the state ctx is in as the start of the match
+/// @returns false if the file can not be written
+bool replay_recorder_begin(ReplayRecorder *p_rec, const char *path, const GameContext *ctx);
+
+/// Records ctx->pressed_key of both paddles for the step that is about to run.
+/// Runs are flushed as soon as they end, so a crash loses at most the last run
+void replay_recorder_push(ReplayRecorder *p_rec, const GameContext *ctx);
+
+/// Writes the last run and closes the file, does nothing if nothing is recorded
+void replay_recorder_end(ReplayRecorder *p_rec);
+
+/// Maps the replay file into memory and checks its header
+/// @returns false if the file can not be read or is not a replay
+bool replay_reader_open(ReplayReader *p_reader, const char *path);
+void replay_reader_close(ReplayReader *p_reader);
+
+/// Context in the state the recorded match has started from
+GameContext replay_reader_initial_context(const ReplayReader *p_reader);
+
+/// Sets ctx->pressed_key and paddle accelerations for the next recorded step
+/// @returns false once every recorded step has been read
+bool replay_reader_next(ReplayReader *p_reader, GameContext *ctx);
+
+#endif // !__REPLAY_H__
@@ -0,0 +1,206 @@
+#include <assert.h>
+#include <string.h>
+
+#include "raylib.h"
+
+#include "rollback.h"
+#include "timing.h"
+
+#define SLOT(tick) ((tick) % GAME_STATE_RING_CAPACITY)
+
+/// Keys the tick is stepped with: confirmed ones if the host already sent them,
+/// otherwise the local key and the last remote key the host used
+static void predict_keys(Rollback *p_rb, uint32_t tick, int local_key) {
+  int slot = SLOT(tick);
+  if (p_rb->keys_tick[slot] == tick && p_rb->is_confirmed[slot]) {
+    return;
+  }
+
+  // local key of a tick that is simulated again stays as it was
+  if (p_rb->keys_tick[slot] != tick) {
+    p_rb->keys[slot][p_rb->local_index] = local_key;
+  }
+  p_rb->keys[slot][1 - p_rb->local_index] = p_rb->remote_key;
+  p_rb->keys_tick[slot] = tick;
+  p_rb->is_confirmed[slot] = false;
+}
+
+/// Sets the keys of the tick and saves the state it is stepped from
+static void prepare_tick(Rollback *p_rb, GameState *p_state) {
+  int slot = SLOT(p_state->tick);
+  p_state->pressed_key[0] = p_rb->keys[slot][0];
+  p_state->pressed_key[1] = p_rb->keys[slot][1];
+  game_apply_pressed_key(p_state, 0);
+  game_apply_pressed_key(p_state, 1);
+
+  game_state_save(&p_rb->ring, p_state);
+}
+
+/// Keeps the hash of the state a step has just made for rollback_verify
+static void record_hash(Rollback *p_rb, const GameState *p_state) {
+  int slot = SLOT(p_state->tick);
+  p_rb->hashes[slot] = game_state_hash(p_state);
+  p_rb->hash_ticks[slot] = p_state->tick;
+}
+
+void rollback_init(Rollback *p_rb, const GameState *p_state, int local_index) {
+  assert(ROLLBACK_MAX_PREDICTION < GAME_STATE_RING_CAPACITY);
+  assert(local_index >= 0 && local_index < 2);
+
+  memset(p_rb, 0, sizeof(*p_rb));
+  p_rb->local_index = local_index;
+  p_rb->confirmed_tick = p_state->tick;
+  p_rb->remote_key = p_state->pressed_key[1 - local_index];
+  for (int i = 0; i < GAME_STATE_RING_CAPACITY; ++i) {
+    p_rb->keys_tick[i] = UINT32_MAX;
+    p_rb->hash_ticks[i] = UINT32_MAX;
+  }
+}
+
+bool rollback_step(Rollback *p_rb, GameContext *ctx, int local_key, float dt, unsigned *p_events) {
+  uint32_t tick = ctx->state.tick;
+  if (tick - p_rb->confirmed_tick >= ROLLBACK_MAX_PREDICTION) {
+    return false;
+  }
+
+  predict_keys(p_rb, tick, local_key);
+  prepare_tick(p_rb, &ctx->state);
+  *p_events = game_step(ctx, dt);
+  record_hash(p_rb, &ctx->state);
+
+  return true;
+}
+
+bool rollback_confirm(Rollback *p_rb, uint32_t tick, const int32_t keys[2], uint32_t current_tick) {
+  if ((int32_t)(tick - p_rb->confirmed_tick) < 0) {
+    return true;
+  }
+
+  // stepping on with the keys after the gap would desync the match for good
+  if (tick != p_rb->confirmed_tick) {
+    TraceLog(LOG_WARNING, "Inputs of ticks %u..%u are lost", p_rb->confirmed_tick, tick - 1);
+    return false;
+  }
+
+  if ((int32_t)(tick - current_tick) >= GAME_STATE_RING_CAPACITY) {
+    TraceLog(LOG_WARNING, "Inputs of tick %u are too far ahead of tick %u", tick, current_tick);
+    return true;
+  }
+
+  int slot = SLOT(tick);
+  bool was_simulated = (int32_t)(tick - current_tick) < 0;
+
+  if (was_simulated && p_rb->keys_tick[slot] == tick
+    && (p_rb->keys[slot][0] != keys[0] || p_rb->keys[slot][1] != keys[1])) {
+    if (!p_rb->has_mismatch || (int32_t)(tick - p_rb->mismatch_tick) < 0) {
+      p_rb->mismatch_tick = tick;
+    }
+    p_rb->has_mismatch = true;
+  }
+
+  p_rb->keys[slot][0] = keys[0];
+  p_rb->keys[slot][1] = keys[1];
+  p_rb->keys_tick[slot] = tick;
+  p_rb->is_confirmed[slot] = true;
+
+  p_rb->confirmed_tick = tick + 1;
+  p_rb->remote_key = keys[1 - p_rb->local_index];
+  return true;
+}
+
+bool rollback_resync(Rollback *p_rb, GameContext *ctx, const GameState *p_host) {
+  uint32_t current_tick = ctx->state.tick;
+  int32_t ahead = (int32_t)(current_tick - p_host->tick);
+  if (ahead >= GAME_STATE_RING_CAPACITY) {
+    return false;
+  }
+
+  p_rb->stats.resyncs += 1;
+  p_rb->confirmed_tick = p_host->tick;
+  p_rb->remote_key = p_host->pressed_key[1 - p_rb->local_index];
+
+  // the hashes of the ticks before it are of the states that went wrong
+  for (int i = 0; i < GAME_STATE_RING_CAPACITY; ++i) {
+    p_rb->hash_ticks[i] = UINT32_MAX;
+  }
+  p_rb->has_host_hash = false;
+  record_hash(p_rb, p_host);
+
+  if (ahead <= 0) {
+    ctx->state = *p_host;
+    p_rb->has_mismatch = false;
+    return true;
+  }
+
+  // rollback_resolve starts from the host's state instead of a mispredicted one
+  game_state_save(&p_rb->ring, p_host);
+  p_rb->mismatch_tick = p_host->tick;
+  p_rb->has_mismatch = true;
+  return true;
+}
+
+void rollback_resolve(Rollback *p_rb, GameContext *ctx, float dt) {
+  if (!p_rb->has_mismatch) {
+    return;
+  }
+  p_rb->has_mismatch = false;
+
+  uint32_t current_tick = ctx->state.tick;
+  GameState state = {0};
+  if (!game_state_restore(&p_rb->ring, p_rb->mismatch_tick, &state)) {
+    TraceLog(LOG_WARNING, "Tick %u is not kept anymore, can not roll back", p_rb->mismatch_tick);
+    return;
+  }
+
+  uint64_t start = time_now_ns();
+
+  while (state.tick != current_tick) {
+    // ticks after the confirmed ones get the new remote prediction,
+    // their local keys stay as they were
+    predict_keys(p_rb, state.tick, 0);
+    prepare_tick(p_rb, &state);
+    game_state_step(&state, dt);
+    record_hash(p_rb, &state);
+  }
+
+  uint64_t elapsed = time_now_ns() - start;
+  int depth = (int)(current_tick - p_rb->mismatch_tick);
+
+  p_rb->stats.rollbacks += 1;
+  p_rb->stats.resimulated_ticks += depth;
+  p_rb->stats.last_depth = depth;
+  if (depth > p_rb->stats.max_depth) p_rb->stats.max_depth = depth;
+  p_rb->stats.resimulation_ns += elapsed;
+  if (elapsed > p_rb->stats.max_resimulation_ns) p_rb->stats.max_resimulation_ns = elapsed;
+
+  ctx->state = state;
+}
+
+void rollback_expect_hash(Rollback *p_rb, uint32_t tick, uint64_t hash) {
+  if (p_rb->has_host_hash && (int32_t)(tick - p_rb->host_hash_tick) <= 0) {
+    return;
+  }
+  p_rb->host_hash_tick = tick;
+  p_rb->host_hash = hash;
+  p_rb->has_host_hash = true;
+}
+
+bool rollback_verify(Rollback *p_rb, uint32_t current_tick) {
+  uint32_t tick = p_rb->host_hash_tick;
+  // the keys of every tick before it are confirmed and the client has stepped up to it
+  if (!p_rb->has_host_hash || p_rb->has_mismatch
+    || (int32_t)(tick - p_rb->confirmed_tick) > 0 || (int32_t)(tick - current_tick) > 0) {
+    return true;
+  }
+  p_rb->has_host_hash = false;
+
+  // simulated too long ago to tell, the next pong brings a newer tick
+  int slot = SLOT(tick);
+  if (p_rb->hash_ticks[slot] != tick || p_rb->hashes[slot] == p_rb->host_hash) {
+    return true;
+  }
+
+  p_rb->stats.desyncs += 1;
+  TraceLog(LOG_WARNING, "The state of tick %u differs from the host's", tick);
+  return false;
+}
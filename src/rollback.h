@@ -0,0 +1,90 @@
+#ifndef __ROLLBACK_H__
+#define __ROLLBACK_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "game.h"
+
+// How far the local simulation may run ahead of the last confirmed tick,
+// past that it waits for the host. Must stay below the ring capacity,
+// so every unconfirmed tick can be rewound to
+#define ROLLBACK_MAX_PREDICTION 32
+
+typedef struct {
+  long rollbacks;
+  long resimulated_ticks;
+  int last_depth;
+  int max_depth;
+  uint64_t resimulation_ns;
+  uint64_t max_resimulation_ns;
+  // times the host's state was taken instead of the simulated one
+  long resyncs;
+  // times a confirmed tick hashed differently than on the host
+  long desyncs;
+} RollbackStats;
+
+/// Client side prediction and rollback over the inputs the host stepped with.
+/// Ticks are simulated right away with the local key and the remote key
+/// predicted to stay the same, and re-simulated once the host's keys differ
+typedef struct {
+  GameStateRing ring;
+  // keys every tick was (or will be) stepped with, by tick % capacity
+  int32_t keys[GAME_STATE_RING_CAPACITY][2];
+  uint32_t keys_tick[GAME_STATE_RING_CAPACITY];
+  bool is_confirmed[GAME_STATE_RING_CAPACITY];
+  // game_state_hash of the state every tick was simulated to, by tick % capacity
+  uint64_t hashes[GAME_STATE_RING_CAPACITY];
+  uint32_t hash_ticks[GAME_STATE_RING_CAPACITY];
+
+  int local_index;
+  // ticks before it have keys confirmed by the host
+  uint32_t confirmed_tick;
+  // earliest simulated tick that was stepped with wrong keys
+  uint32_t mismatch_tick;
+  bool has_mismatch;
+  int32_t remote_key;
+
+  // the host's hash of a tick, checked once the tick is confirmed and simulated
+  uint32_t host_hash_tick;
+  uint64_t host_hash;
+  bool has_host_hash;
+
+  RollbackStats stats;
+} Rollback;
+
+/// Starts predicting from the state, the local player controls the paddle at local_index
+void rollback_init(Rollback *p_rb, const GameState *p_state, int local_index);
+
+/// Steps ctx one tick with the local key and the predicted (or already confirmed) remote key
+/// @returns false without stepping if the prediction window is full
+bool rollback_step(Rollback *p_rb, GameContext *ctx, int local_key, float dt, unsigned *p_events);
+
+/// Records keys of both paddles the host stepped the tick with.
+/// Ticks that are already confirmed are ignored
+/// @returns false without recording them if the inputs of the ticks between
+/// the confirmed ones and this one were lost, see rollback_resync
+bool rollback_confirm(Rollback *p_rb, uint32_t tick, const int32_t keys[2], uint32_t current_tick);
+
+/// Starts over from the exact state of the host (NET_CMD_STATE) once inputs were lost
+/// or rollback_verify failed: the ticks before it count as confirmed, and the ticks
+/// simulated after it are re-simulated from it with the local keys they had by the
+/// next rollback_resolve. A host ahead of the client replaces ctx->state right away
+/// @returns false if the client is too far ahead to get back to the state
+bool rollback_resync(Rollback *p_rb, GameContext *ctx, const GameState *p_host);
+
+/// Rewinds ctx->state to the earliest mispredicted tick and re-simulates it
+/// back to the current tick with the corrected keys
+void rollback_resolve(Rollback *p_rb, GameContext *ctx, float dt);
+
+/// Takes the hash of the host's state at the tick from a pong, a newer one
+/// replaces the one not checked yet
+void rollback_expect_hash(Rollback *p_rb, uint32_t tick, uint64_t hash);
+
+/// Compares the host's hash with the one of the same tick simulated with confirmed
+/// keys, once there is one. Call it after rollback_resolve
+/// @returns false if they differ: the simulation went its own way, rollback_resync
+/// with the host's state is the only way back
+bool rollback_verify(Rollback *p_rb, uint32_t current_tick);
+
+#endif // !__ROLLBACK_H__
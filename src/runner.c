@@ -0,0 +1,257 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "runner.h"
+#include "timing.h"
+
+#define TASK_EMPTY -1
+#define TASK_ABORT -2
+
+#define CACHE_LINE_SIZE 64
+
+/// Chase-Lev work-stealing deque of task indices.
+/// Only the owner pushes and pops at the bottom, thieves take from the top.
+/// Every task lives in exactly one deque, so capacity for all tasks never overflows
+typedef struct {
+  long top;
+  char top_padding[CACHE_LINE_SIZE - sizeof(long)];
+  long bottom;
+  char bottom_padding[CACHE_LINE_SIZE - sizeof(long)];
+  int *tasks;
+  long mask;
+} TaskDeque;
+
+typedef struct {
+  int first;
+  int count;
+  long ticks_done;
+} RunnerTask;
+
+typedef struct {
+  MatchRunner *p_runner;
+  RunnerTask *tasks;
+  TaskDeque *deques;
+  long remaining;
+} RunnerShared;
+
+typedef struct {
+  RunnerShared *p_shared;
+  int index;
+  unsigned rng;
+} RunnerWorker;
+
+
+/// @returns CPU time of the calling thread
+static uint64_t thread_cpu_ns(void) {
+  struct timespec ts = {0};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static bool deque_init(TaskDeque *deque, int capacity) {
+  long size = 1;
+  while (size < capacity) size <<= 1;
+
+  memset(deque, 0, sizeof(*deque));
+  deque->tasks = malloc(size * sizeof(int));
+  deque->mask = size - 1;
+  return NULL != deque->tasks;
+}
+
+static void deque_push(TaskDeque *deque, int task) {
+  long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+  __atomic_store_n(&deque->tasks[bottom & deque->mask], task, __ATOMIC_RELAXED);
+  __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+}
+
+static int deque_pop(TaskDeque *deque) {
+  long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+  __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  long top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+  if (top > bottom) {
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return TASK_EMPTY;
+  }
+
+  int task = __atomic_load_n(&deque->tasks[bottom & deque->mask], __ATOMIC_RELAXED);
+  if (top == bottom) {
+    // last task, race against thieves for it
+    if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+      task = TASK_EMPTY;
+    }
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+  }
+
+  return task;
+}
+
+static int deque_steal(TaskDeque *deque) {
+  long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+
+  if (top >= bottom) {
+    return TASK_EMPTY;
+  }
+
+  int task = __atomic_load_n(&deque->tasks[top & deque->mask], __ATOMIC_RELAXED);
+  if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                                   __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+    return TASK_ABORT;
+  }
+
+  return task;
+}
+
+static unsigned xorshift(unsigned *p_state) {
+  unsigned x = *p_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *p_state = x;
+}
+
+/// Advances every live match of the task by up to quantum ticks
+/// @returns true if some match of the task is still running
+static bool run_task(MatchRunner *p_runner, RunnerTask *p_task, RunnerWorkerStats *p_stats) {
+  long ticks_left = p_runner->max_ticks - p_task->ticks_done;
+  long ticks = ticks_left < p_runner->quantum ? ticks_left : p_runner->quantum;
+  bool is_live = false;
+
+  for (int i = 0; i < p_task->count; ++i) {
+    GameContext *ctx = &p_runner->contexts[p_task->first + i];
+
+    for (long t = 0; t < ticks && NULL != ctx->update; ++t) {
+      ctx->update(ctx, ctx->tick_dt);
+      p_stats->ticks += 1;
+    }
+
+    is_live = is_live || NULL != ctx->update;
+  }
+
+  p_task->ticks_done += ticks;
+  return is_live && p_task->ticks_done < p_runner->max_ticks;
+}
+
+static void *worker_main(void *arg) {
+  RunnerWorker *p_worker = arg;
+  RunnerShared *p_shared = p_worker->p_shared;
+  MatchRunner *p_runner = p_shared->p_runner;
+  RunnerWorkerStats *p_stats = &p_runner->workers[p_worker->index];
+  TaskDeque *p_own = &p_shared->deques[p_worker->index];
+
+  while (__atomic_load_n(&p_shared->remaining, __ATOMIC_ACQUIRE) > 0) {
+    int task = deque_pop(p_own);
+
+    if (task < 0 && p_runner->worker_count > 1) {
+      int victim = xorshift(&p_worker->rng) % (p_runner->worker_count - 1);
+      victim += victim >= p_worker->index;
+
+      p_stats->steal_attempts += 1;
+      task = deque_steal(&p_shared->deques[victim]);
+      p_stats->tasks_stolen += task >= 0;
+    }
+
+    if (task < 0) {
+      sched_yield();
+      continue;
+    }
+
+    uint64_t start = thread_cpu_ns();
+    bool is_live = run_task(p_runner, &p_shared->tasks[task], p_stats);
+    p_stats->busy_ns += thread_cpu_ns() - start;
+    p_stats->tasks_run += 1;
+
+    if (is_live) {
+      deque_push(p_own, task);
+    } else {
+      __atomic_sub_fetch(&p_shared->remaining, 1, __ATOMIC_RELEASE);
+    }
+  }
+
+  return NULL;
+}
+
+bool runner_run(MatchRunner *p_runner) {
+  assert(p_runner->worker_count > 0 && p_runner->worker_count <= RUNNER_MAX_WORKERS);
+  assert(p_runner->group_size > 0);
+  assert(p_runner->quantum > 0);
+
+  int task_count = (p_runner->count + p_runner->group_size - 1) / p_runner->group_size;
+  bool ok = true;
+
+  RunnerShared shared = {0};
+  shared.p_runner = p_runner;
+  shared.remaining = task_count;
+  shared.tasks = calloc(task_count, sizeof(RunnerTask));
+  shared.deques = calloc(p_runner->worker_count, sizeof(TaskDeque));
+  RunnerWorker *workers = calloc(p_runner->worker_count, sizeof(RunnerWorker));
+  pthread_t *threads = calloc(p_runner->worker_count, sizeof(pthread_t));
+  int started = 0;
+
+  if (NULL == shared.tasks || NULL == shared.deques || NULL == workers || NULL == threads) {
+    ok = false;
+    goto defer;
+  }
+
+  memset(p_runner->workers, 0, sizeof(p_runner->workers));
+
+  for (int i = 0; i < p_runner->worker_count; ++i) {
+    if (!deque_init(&shared.deques[i], task_count)) {
+      ok = false;
+      goto defer;
+    }
+  }
+
+  // deal the tasks round robin, stealing takes care of the imbalance later
+  for (int i = 0; i < task_count; ++i) {
+    shared.tasks[i].first = i * p_runner->group_size;
+    shared.tasks[i].count = p_runner->count - shared.tasks[i].first;
+    if (shared.tasks[i].count > p_runner->group_size) {
+      shared.tasks[i].count = p_runner->group_size;
+    }
+    deque_push(&shared.deques[i % p_runner->worker_count], i);
+  }
+
+  uint64_t start = time_now_ns();
+
+  for (; started < p_runner->worker_count; ++started) {
+    workers[started] = (RunnerWorker){
+      .p_shared = &shared,
+      .index = started,
+      .rng = 2463534242u + started * 7919u,
+    };
+    if (0 != pthread_create(&threads[started], NULL, worker_main, &workers[started])) {
+      // let the started workers drain the deques of the missing ones
+      ok = false;
+      break;
+    }
+  }
+
+  for (int i = 0; i < started; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+
+  p_runner->wall_ns = time_now_ns() - start;
+
+defer:
+  if (NULL != shared.deques) {
+    for (int i = 0; i < p_runner->worker_count; ++i) {
+      free(shared.deques[i].tasks);
+    }
+  }
+  free(shared.deques);
+  free(shared.tasks);
+  free(workers);
+  free(threads);
+  return ok;
+}
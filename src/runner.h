@@ -0,0 +1,47 @@
+#ifndef __RUNNER_H__
+#define __RUNNER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "game.h"
+
+#define RUNNER_MAX_WORKERS 64
+#define RUNNER_DEFAULT_GROUP_SIZE 8
+#define RUNNER_DEFAULT_QUANTUM 256
+
+/// Per worker statistics, filled by runner_run
+typedef struct {
+  long tasks_run;
+  long tasks_stolen;
+  long steal_attempts;
+  long ticks;
+  // CPU time the worker's thread spent advancing matches, so a preempted worker
+  // is not counted busy. The rest is looking for work or not running at all
+  uint64_t busy_ns;
+} RunnerWorkerStats;
+
+typedef struct {
+  // contexts are advanced by their own ctx->update with ctx->tick_dt,
+  // a match is done when ctx->update becomes NULL or after max_ticks ticks
+  GameContext *contexts;
+  int count;
+
+  int worker_count;
+  // matches advanced together by one task
+  int group_size;
+  // ticks a task advances each of its matches before it goes back to a deque
+  int quantum;
+  long max_ticks;
+
+  RunnerWorkerStats workers[RUNNER_MAX_WORKERS];
+  uint64_t wall_ns;
+} MatchRunner;
+
+/// Advances every context of p_runner->contexts until all matches are done,
+/// using a pool of worker threads balanced by work stealing.
+/// Fills p_runner->workers and p_runner->wall_ns
+/// @returns false if the worker threads could not be started
+bool runner_run(MatchRunner *p_runner);
+
+#endif // !__RUNNER_H__
@@ -0,0 +1,964 @@
+// pthread_setaffinity_np and CPU_SET
+#define _GNU_SOURCE
+
+#include <signal.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "raylib.h"
+
+#include "args.h"
+#include "network.h"
+#include "game.h"
+#include "delta.h"
+#include "session.h"
+#include "event_loop.h"
+#include "timing.h"
+
+#define SERVER_DEFAULT_PORT 7777
+#define SERVER_DEFAULT_ROOMS_PER_CORE 512
+#define SERVER_DEFAULT_REPORT_INTERVAL 5
+#define SERVER_MAX_THREADS 256
+
+// Sessions of a core per room it hosts, the players and a spectator on average
+#define SERVER_SESSIONS_PER_ROOM 3
+#define ROOM_MAX_SPECTATORS 4
+
+// How often the sessions are checked for the timeout
+#define SERVER_EXPIRE_PERIOD_NS 1000000000ull
+
+// Tick times are counted in 1 us buckets up to this, longer ones go in the last bucket
+#define SERVER_TICK_HISTOGRAM_US 20000
+
+// A player alone on its core for this long goes to the lobby, where a lone player
+// of another core picks it up
+#define SERVER_LOBBY_WAIT_NS 500000000ull
+
+// Datagrams a core holds for the players other cores handed to it, more are dropped
+#define SERVER_INBOX_CAPACITY 256
+
+typedef struct {
+  int port;
+  int thread_count;
+  int tick_rate;
+  // snapshots a room sends a second, events go out right after their step
+  int send_rate;
+  int rooms_per_core;
+  float timeout;
+  // 0 runs until SIGINT
+  int duration;
+  int report_interval;
+  NetBackend net_backend;
+} ServerConfig;
+
+/// A 1v1 match, the session players[i] plays the paddle i
+typedef struct {
+  GameState state;
+  int players[2];
+  int player_count;
+  int spectators[ROOM_MAX_SPECTATORS];
+  int spectator_count;
+  unsigned char sent_keys[NET_TICK_INPUTS_HISTORY];
+  // a snapshot is sent once send_rate per tick adds up to the tick rate
+  int send_credit;
+  long matches;
+} Room;
+
+typedef struct {
+  long ticks;
+  long matches;
+  long datagrams;
+  long rejected;
+  long closed_rooms;
+  // lone players given to and taken from the other cores
+  long handed_over;
+  long adopted;
+  // of the players handed over, the inbox of their core was full
+  long forward_dropped;
+  // time to step and send all the rooms of the shard for one tick
+  long tick_histogram[SERVER_TICK_HISTOGRAM_US + 1];
+  uint64_t max_tick_ns;
+} ServerStats;
+
+/// A datagram one core received for a player it handed to another one
+typedef struct {
+  struct sockaddr_in6 addr;
+  uint64_t arrival_ns;
+  int len;
+  char buf[NET_BUF_SIZE];
+} ServerDatagram;
+
+typedef struct {
+  pthread_mutex_t lock;
+  ServerDatagram *datagrams;
+  int count;
+} ServerInbox;
+
+/// What the cores share. The kernel hashes the clients to the cores, so with an odd
+/// number of players on two of them both would wait for an opponent forever. A player
+/// alone long enough is posted here, and a core with a lone player of its own takes
+/// it: it opens a session for the player and seats it. The kernel keeps sending the
+/// player's datagrams to the first core, which forwards them into the inbox of the
+/// core that took it; the answers go out of that core's socket on the same port
+typedef struct {
+  pthread_mutex_t lock;
+  // core of the posted player, -1 if none. Only that core clears it
+  int worker;
+  int session_id;
+  struct sockaddr_in6 addr;
+  uint16_t token;
+  // the core that took the posted player, -1 until one did
+  int taken_by;
+  // one a core
+  ServerInbox *inboxes;
+} ServerLobby;
+
+/// One thread pinned to a core with its own SO_REUSEPORT socket and rooms. Workers
+/// share the read only config and the lobby, where lone players find an opponent
+typedef struct {
+  int index;
+  const ServerConfig *p_cfg;
+  ServerLobby *p_lobby;
+  UdpSocket sock;
+  NetBatch *p_batch;
+  EventLoop loop;
+  // time_now_ns the rooms step next, the pongs tell the players
+  uint64_t next_step_ns;
+  SessionTable sessions;
+  // rooms in use are the first room_count, a closed one is replaced by the last
+  Room *rooms;
+  int room_count;
+  // room with one player waiting for an opponent, -1 if none
+  int waiting_room;
+  uint64_t waiting_since_ns;
+  // the player of waiting_room is in the lobby
+  bool is_posted;
+  // the inbox is moved here to be handled outside its lock
+  ServerDatagram *inbox_datagrams;
+  // the next spectator looks for a room with a free seat from it
+  int spectated_room;
+  bool is_ok;
+
+  ServerStats stats;
+  // since the last report
+  ServerStats interval;
+} ServerWorker;
+
+static volatile sig_atomic_t server_should_stop = 0;
+
+static void handle_stop_signal(int signal) {
+  (void)signal;
+  server_should_stop = 1;
+}
+
+static void send_ready(ServerWorker *p_worker, int session_id) {
+  const Session *p_session = session_get(&p_worker->sessions, session_id);
+  char buf[NET_CMD_SIZE] = {0};
+  int len = net_encode_ready(buf, p_session->paddle, p_session->token);
+  net_batch_queue(p_worker->p_batch, &p_session->addr, buf, len);
+}
+
+/// Opens a room for the player alone
+static void open_room(ServerWorker *p_worker, int session_id, uint64_t now_ns) {
+  Session *p_session = session_get(&p_worker->sessions, session_id);
+  Room *p_room = &p_worker->rooms[p_worker->room_count];
+  memset(p_room, 0, sizeof(*p_room));
+  p_room->state = game_state_create();
+  p_room->players[0] = session_id;
+  p_room->player_count = 1;
+  p_session->room = p_worker->room_count;
+  p_session->paddle = 0;
+  p_worker->waiting_room = p_worker->room_count;
+  p_worker->waiting_since_ns = now_ns;
+  p_worker->room_count += 1;
+}
+
+/// Seats the player against the one waiting, both get NET_CMD_READY with their paddle
+static void seat_opponent(ServerWorker *p_worker, int session_id) {
+  Session *p_session = session_get(&p_worker->sessions, session_id);
+  Room *p_room = &p_worker->rooms[p_worker->waiting_room];
+  p_room->players[1] = session_id;
+  p_room->player_count = 2;
+  p_session->room = p_worker->waiting_room;
+  p_session->paddle = 1;
+  p_worker->waiting_room = -1;
+
+  send_ready(p_worker, p_room->players[0]);
+  send_ready(p_worker, p_room->players[1]);
+}
+
+/// Drops the room from the ones in use, the last room takes its place
+static void remove_room(ServerWorker *p_worker, int room_index) {
+  Room *p_room = &p_worker->rooms[room_index];
+  if (p_worker->waiting_room == room_index) {
+    p_worker->waiting_room = -1;
+  }
+
+  int last = p_worker->room_count - 1;
+  p_worker->room_count -= 1;
+  if (room_index == last) return;
+
+  *p_room = p_worker->rooms[last];
+  for (int i = 0; i < p_room->player_count; ++i) {
+    session_get(&p_worker->sessions, p_room->players[i])->room = room_index;
+  }
+  for (int i = 0; i < p_room->spectator_count; ++i) {
+    session_get(&p_worker->sessions, p_room->spectators[i])->room = room_index;
+  }
+  if (p_worker->waiting_room == last) {
+    p_worker->waiting_room = room_index;
+  }
+}
+
+static bool lobby_init(ServerLobby *p_lobby, int worker_count) {
+  pthread_mutex_init(&p_lobby->lock, NULL);
+  p_lobby->worker = -1;
+  p_lobby->taken_by = -1;
+  p_lobby->inboxes = calloc(worker_count, sizeof(ServerInbox));
+  if (NULL == p_lobby->inboxes) return false;
+
+  for (int i = 0; i < worker_count; ++i) {
+    pthread_mutex_init(&p_lobby->inboxes[i].lock, NULL);
+    p_lobby->inboxes[i].datagrams = malloc(sizeof(ServerDatagram) * SERVER_INBOX_CAPACITY);
+    if (NULL == p_lobby->inboxes[i].datagrams) return false;
+  }
+  return true;
+}
+
+static void lobby_fini(ServerLobby *p_lobby, int worker_count) {
+  if (NULL != p_lobby->inboxes) {
+    for (int i = 0; i < worker_count; ++i) {
+      pthread_mutex_destroy(&p_lobby->inboxes[i].lock);
+      free(p_lobby->inboxes[i].datagrams);
+    }
+  }
+  free(p_lobby->inboxes);
+  pthread_mutex_destroy(&p_lobby->lock);
+}
+
+/// Posts the player of the waiting room in the lobby, unless another one is there
+static void lobby_post(ServerWorker *p_worker) {
+  ServerLobby *p_lobby = p_worker->p_lobby;
+  const Room *p_room = &p_worker->rooms[p_worker->waiting_room];
+  const Session *p_session = session_get(&p_worker->sessions, p_room->players[0]);
+
+  pthread_mutex_lock(&p_lobby->lock);
+  if (p_lobby->worker < 0) {
+    p_lobby->worker = p_worker->index;
+    p_lobby->session_id = p_room->players[0];
+    p_lobby->addr = p_session->addr;
+    p_lobby->token = p_session->token;
+    p_lobby->taken_by = -1;
+    p_worker->is_posted = true;
+  }
+  pthread_mutex_unlock(&p_lobby->lock);
+}
+
+/// @returns the core that took the posted player, -1 if none did yet
+static int lobby_taken_by(ServerWorker *p_worker) {
+  ServerLobby *p_lobby = p_worker->p_lobby;
+  pthread_mutex_lock(&p_lobby->lock);
+  int taken_by = p_lobby->taken_by;
+  pthread_mutex_unlock(&p_lobby->lock);
+  return taken_by;
+}
+
+/// Takes the posted player of the waiting room out of the lobby
+/// @returns the core that took it meanwhile, -1 if none did
+static int lobby_withdraw(ServerWorker *p_worker) {
+  ServerLobby *p_lobby = p_worker->p_lobby;
+  pthread_mutex_lock(&p_lobby->lock);
+  int taken_by = p_lobby->taken_by;
+  p_lobby->worker = -1;
+  p_lobby->taken_by = -1;
+  pthread_mutex_unlock(&p_lobby->lock);
+  p_worker->is_posted = false;
+  return taken_by;
+}
+
+/// Takes the player another core posted and opens a session for it on this one
+/// @returns the session, -1 if there is none to take
+static int lobby_adopt(ServerWorker *p_worker, uint64_t now_ns) {
+  ServerLobby *p_lobby = p_worker->p_lobby;
+  int session_id = -1;
+  pthread_mutex_lock(&p_lobby->lock);
+  if (p_lobby->worker >= 0 && p_lobby->worker != p_worker->index && p_lobby->taken_by < 0) {
+    session_id = session_open(&p_worker->sessions, &p_lobby->addr, p_lobby->token, NET_ROLE_PLAYER, now_ns);
+    if (session_id >= 0) {
+      p_lobby->taken_by = p_worker->index;
+      p_worker->stats.adopted += 1;
+    }
+  }
+  pthread_mutex_unlock(&p_lobby->lock);
+  return session_id;
+}
+
+/// The player of the waiting room plays on the core that took it from the lobby:
+/// its room is gone and its datagrams go to that core from now on
+static void hand_over(ServerWorker *p_worker, int core) {
+  int room_index = p_worker->waiting_room;
+  Session *p_session = session_get(&p_worker->sessions, p_worker->rooms[room_index].players[0]);
+  p_session->handed_to = core;
+  p_session->room = -1;
+  remove_room(p_worker, room_index);
+  p_worker->stats.handed_over += 1;
+}
+
+/// Puts the player into the room waiting for an opponent, or opens a new one and
+/// seats a player another core posted in the lobby against it if there is one
+/// @returns false if all the rooms of the core are taken
+static bool match_player(ServerWorker *p_worker, int session_id, uint64_t now_ns) {
+  if (p_worker->waiting_room >= 0 && p_worker->is_posted) {
+    int core = lobby_withdraw(p_worker);
+    if (core >= 0) hand_over(p_worker, core);
+  }
+
+  if (p_worker->waiting_room < 0) {
+    if (p_worker->room_count == p_worker->p_cfg->rooms_per_core) {
+      return false;
+    }
+    open_room(p_worker, session_id, now_ns);
+
+    session_id = lobby_adopt(p_worker, now_ns);
+    if (session_id < 0) return true;
+  }
+
+  seat_opponent(p_worker, session_id);
+  return true;
+}
+
+/// Hands the player alone for SERVER_LOBBY_WAIT_NS over to the lobby, or seats the one
+/// another core posted there against it. A posted player that was taken leaves the core
+static void share_waiting_player(ServerWorker *p_worker, uint64_t now_ns) {
+  if (p_worker->waiting_room < 0) return;
+
+  if (p_worker->is_posted) {
+    if (lobby_taken_by(p_worker) >= 0) {
+      hand_over(p_worker, lobby_withdraw(p_worker));
+    }
+    return;
+  }
+  if (now_ns - p_worker->waiting_since_ns < SERVER_LOBBY_WAIT_NS) return;
+
+  int session_id = lobby_adopt(p_worker, now_ns);
+  if (session_id >= 0) {
+    seat_opponent(p_worker, session_id);
+  } else {
+    lobby_post(p_worker);
+  }
+}
+
+/// Queues the datagram of a player handed over for the core that serves it now
+static void forward_datagram(ServerWorker *p_worker, int core, const char *buf, int len,
+                             const struct sockaddr_in6 *p_from, uint64_t arrival_ns) {
+  ServerInbox *p_inbox = &p_worker->p_lobby->inboxes[core];
+  pthread_mutex_lock(&p_inbox->lock);
+  if (p_inbox->count < SERVER_INBOX_CAPACITY) {
+    ServerDatagram *p_datagram = &p_inbox->datagrams[p_inbox->count++];
+    p_datagram->addr = *p_from;
+    p_datagram->arrival_ns = arrival_ns;
+    p_datagram->len = len;
+    memcpy(p_datagram->buf, buf, len);
+  } else {
+    p_worker->stats.forward_dropped += 1;
+  }
+  pthread_mutex_unlock(&p_inbox->lock);
+}
+
+/// Seats the spectator in the next room that is playing and has a free seat
+/// @returns false if there is none
+static bool watch_room(ServerWorker *p_worker, int session_id) {
+  for (int i = 0; i < p_worker->room_count; ++i) {
+    int room_index = (p_worker->spectated_room + i) % p_worker->room_count;
+    Room *p_room = &p_worker->rooms[room_index];
+    if (p_room->player_count < 2 || p_room->spectator_count == ROOM_MAX_SPECTATORS) continue;
+
+    p_room->spectators[p_room->spectator_count++] = session_id;
+    session_get(&p_worker->sessions, session_id)->room = room_index;
+    p_worker->spectated_room = room_index + 1;
+    send_ready(p_worker, session_id);
+    return true;
+  }
+  return false;
+}
+
+/// Tells the session its room is closed and closes it, unless it is the one that left
+static void close_session(ServerWorker *p_worker, int session_id, int leaver_id) {
+  if (session_id != leaver_id) {
+    const Session *p_session = session_get(&p_worker->sessions, session_id);
+    char buf[NET_CMD_SIZE] = {0};
+    int len = net_encode_closed(buf, p_session->token);
+    net_batch_queue(p_worker->p_batch, &p_session->addr, buf, len);
+  }
+  session_close(&p_worker->sessions, session_id);
+}
+
+/// Closes the sessions of the room along with it, everyone but the session that left gets
+/// NET_CMD_CLOSED. The last room takes its place
+static void close_room(ServerWorker *p_worker, int room_index, int leaver_id) {
+  Room *p_room = &p_worker->rooms[room_index];
+  if (p_worker->waiting_room == room_index && p_worker->is_posted) {
+    // a core that took the player meanwhile times it out on its own
+    lobby_withdraw(p_worker);
+  }
+  for (int i = 0; i < p_room->player_count; ++i) {
+    close_session(p_worker, p_room->players[i], leaver_id);
+  }
+  for (int i = 0; i < p_room->spectator_count; ++i) {
+    close_session(p_worker, p_room->spectators[i], leaver_id);
+  }
+  p_worker->stats.closed_rooms += 1;
+  remove_room(p_worker, room_index);
+}
+
+/// A player that left ends the match of its room, a spectator only leaves its seat
+static void on_session_expired(void *p_user, int session_id) {
+  ServerWorker *p_worker = p_user;
+  const Session *p_session = session_get(&p_worker->sessions, session_id);
+  if (p_session->room < 0) return;
+
+  Room *p_room = &p_worker->rooms[p_session->room];
+  if (NET_ROLE_PLAYER == p_session->role) {
+    close_room(p_worker, p_session->room, session_id);
+    return;
+  }
+
+  for (int i = 0; i < p_room->spectator_count; ++i) {
+    if (p_room->spectators[i] == session_id) {
+      p_room->spectators[i] = p_room->spectators[--p_room->spectator_count];
+      break;
+    }
+  }
+}
+
+static void accept_session(ServerWorker *p_worker, const struct sockaddr_in6 *p_addr,
+                           const char *buf, uint64_t now_ns) {
+  NetRole role = net_decode_connect(buf);
+  int session_id = session_open(&p_worker->sessions, p_addr, net_cmd_token(buf), role, now_ns);
+  if (session_id < 0) {
+    p_worker->stats.rejected += 1;
+    return;
+  }
+
+  bool is_seated = NET_ROLE_PLAYER == role
+    ? match_player(p_worker, session_id, now_ns)
+    : watch_room(p_worker, session_id);
+  if (!is_seated) {
+    session_close(&p_worker->sessions, session_id);
+    p_worker->stats.rejected += 1;
+  }
+}
+
+/// Answers the ping of a client that probes the addresses before it connects,
+/// without opening a session for it
+static void answer_probe(ServerWorker *p_worker, const struct sockaddr_in6 *p_addr,
+                         const char *buf, int len, uint64_t arrival, uint64_t now_ns) {
+  NetPing ping = {0};
+  if (!net_decode_ping(buf, len, &ping)) return;
+
+  ping.hold_ns = 0 != arrival ? (uint32_t)(time_now_ns() - arrival) : 0;
+  ping.peer_time_ns = 0 != arrival ? arrival : now_ns;
+  char pong[NET_PING_SIZE] = {0};
+  int pong_len = net_encode_ping(pong, NET_CMD_PONG, &ping, net_cmd_token(buf));
+  net_batch_queue(p_worker->p_batch, p_addr, pong, pong_len);
+}
+
+/// Handles the datagram by the session of its address and token. arrival is the kernel's
+/// receive time, 0 if unknown
+static void handle_datagram(ServerWorker *p_worker, const char *buf, int len,
+                            const struct sockaddr_in6 *p_from, uint64_t arrival, uint64_t now) {
+  if (len < (int)NET_CMD_SIZE) return;
+
+  int session_id = session_find(&p_worker->sessions, p_from, net_cmd_token(buf));
+  if (session_id < 0) {
+    if (NET_CMD_CONNECT == buf[0]) {
+      accept_session(p_worker, p_from, buf, now);
+    } else if (NET_CMD_PING == buf[0]) {
+      answer_probe(p_worker, p_from, buf, len, arrival, now);
+    }
+    return;
+  }
+
+  Session *p_session = session_get(&p_worker->sessions, session_id);
+  p_session->last_seen_ns = now;
+  if (p_session->handed_to >= 0) {
+    forward_datagram(p_worker, p_session->handed_to, buf, len, p_from, 0 != arrival ? arrival : now);
+    return;
+  }
+  Room *p_room = &p_worker->rooms[p_session->room];
+
+  switch (buf[0]) {
+    case NET_CMD_CONNECT: {
+      // the previous NET_CMD_READY was lost
+      if (2 == p_room->player_count) {
+        send_ready(p_worker, session_id);
+      }
+    } break;
+
+    case NET_CMD_UPDATE_INPUT: {
+      NetInput input = {0};
+      if (!net_decode_input(buf, len, &input)) break;
+
+      delta_encoder_ack(&p_session->encoder, input.snapshot_ack.tick);
+      // applied by tick in step_rooms
+      if (NET_ROLE_PLAYER == p_session->role) {
+        input_receiver_push(&p_session->input, &input);
+      }
+    } break;
+
+    case NET_CMD_PING: {
+      NetPing ping = {0};
+      if (!net_decode_ping(buf, len, &ping)) break;
+
+      p_session->pings_received += 1;
+      ping.received = p_session->pings_received;
+      ping.hold_ns = 0 != arrival ? (uint32_t)(time_now_ns() - arrival) : 0;
+      ping.peer_time_ns = 0 != arrival ? arrival : now;
+      // every room steps at once, spectators stamp the snapshots by the step too
+      uint32_t delay_ns = p_worker->next_step_ns > ping.peer_time_ns
+        ? (uint32_t)(p_worker->next_step_ns - ping.peer_time_ns)
+        : 0;
+      if (p_session->room >= 0 && 2 == p_worker->rooms[p_session->room].player_count) {
+        ping.step_tick = p_worker->rooms[p_session->room].state.tick + 1;
+        ping.input_delay_ns = delay_ns;
+      }
+      if (NET_ROLE_PLAYER == p_session->role && 0 != p_session->input.next_tick) {
+        ping.input_tick = p_session->input.next_tick;
+        ping.input_delay_ns = delay_ns;
+      }
+      // the room is between its steps, its state is as the latest one left it
+      if (NET_ROLE_PLAYER == p_session->role && p_session->room >= 0
+        && 2 == p_worker->rooms[p_session->room].player_count) {
+        const GameState *p_state = &p_worker->rooms[p_session->room].state;
+        ping.state_tick = p_state->tick;
+        ping.state_hash = game_state_hash(p_state);
+      }
+      char pong[NET_PING_SIZE] = {0};
+      int pong_len = net_encode_ping(pong, NET_CMD_PONG, &ping, p_session->token);
+      net_batch_queue(p_worker->p_batch, &p_session->addr, pong, pong_len);
+    } break;
+
+    case NET_CMD_RESYNC: {
+      // a rollback client lost track of the match and takes the room's state as is
+      if (NET_ROLE_PLAYER != p_session->role || 2 != p_room->player_count) break;
+
+      char state[NET_STATE_SIZE] = {0};
+      int state_len = game_state_encode(state, &p_room->state);
+      net_batch_queue(p_worker->p_batch, &p_session->addr, state, state_len);
+    } break;
+  }
+}
+
+static void handle_datagrams(ServerWorker *p_worker, int count) {
+  uint64_t now = time_now_ns();
+
+  for (int i = 0; i < count; ++i) {
+    int len = 0;
+    struct sockaddr_in6 from = {0};
+    const char *buf = net_batch_datagram(p_worker->p_batch, i, &len, &from);
+    handle_datagram(p_worker, buf, len, &from, net_batch_datagram_time(p_worker->p_batch, i), now);
+  }
+  p_worker->stats.datagrams += count;
+}
+
+/// Handles the datagrams the other cores forwarded for the players they handed over
+static void handle_inbox(ServerWorker *p_worker) {
+  ServerInbox *p_inbox = &p_worker->p_lobby->inboxes[p_worker->index];
+  pthread_mutex_lock(&p_inbox->lock);
+  int count = p_inbox->count;
+  memcpy(p_worker->inbox_datagrams, p_inbox->datagrams, sizeof(ServerDatagram) * count);
+  p_inbox->count = 0;
+  pthread_mutex_unlock(&p_inbox->lock);
+
+  uint64_t now = time_now_ns();
+  for (int i = 0; i < count; ++i) {
+    const ServerDatagram *p_datagram = &p_worker->inbox_datagrams[i];
+    handle_datagram(p_worker, p_datagram->buf, p_datagram->len, &p_datagram->addr, p_datagram->arrival_ns, now);
+  }
+}
+
+/// Delta encodes the snapshot with the inputs the session acks for and queues it
+static void send_snapshot(ServerWorker *p_worker, int session_id, NetSnapshot *p_snapshot) {
+  char buf[NET_BUF_SIZE] = {0};
+  Session *p_session = session_get(&p_worker->sessions, session_id);
+  p_snapshot->input_ack = NET_ROLE_PLAYER == p_session->role ? p_session->input.ack : (NetAck){0};
+  int len = delta_encode(&p_session->encoder, p_snapshot, buf);
+  net_batch_queue(p_worker->p_batch, &p_session->addr, buf, len);
+}
+
+/// Queues the hits, bounces and points of the step for everyone in the room
+static void send_event(ServerWorker *p_worker, const Room *p_room, unsigned events) {
+  char buf[NET_EVENT_SIZE] = {0};
+  NetEvent event = game_state_event(&p_room->state, events);
+  int len = net_encode_event(buf, &event);
+
+  for (int j = 0; j < 2; ++j) {
+    net_batch_queue(p_worker->p_batch, &session_get(&p_worker->sessions, p_room->players[j])->addr, buf, len);
+  }
+  for (int j = 0; j < p_room->spectator_count; ++j) {
+    net_batch_queue(p_worker->p_batch, &session_get(&p_worker->sessions, p_room->spectators[j])->addr, buf, len);
+  }
+}
+
+/// Steps every full room one tick, queues its events and, at the send rate, a snapshot
+/// for each of its players and spectators
+static void step_rooms(ServerWorker *p_worker, float tick_dt) {
+  const ServerConfig *p_cfg = p_worker->p_cfg;
+  for (int i = 0; i < p_worker->room_count; ++i) {
+    Room *p_room = &p_worker->rooms[i];
+    if (p_room->player_count < 2) continue;
+
+    for (int j = 0; j < 2; ++j) {
+      Session *p_session = session_get(&p_worker->sessions, p_room->players[j]);
+      p_room->state.pressed_key[j] = game_key_unpack(input_receiver_take(&p_session->input));
+      game_apply_pressed_key(&p_room->state, j);
+    }
+    unsigned events = game_state_step(&p_room->state, tick_dt);
+    if (events & GAME_EVENT_MATCH_OVER) {
+      p_room->matches += 1;
+      p_worker->stats.matches += 1;
+    }
+
+    memmove(p_room->sent_keys + 1, p_room->sent_keys, sizeof(p_room->sent_keys) - 1);
+    p_room->sent_keys[0] = game_keys_pack(p_room->state.pressed_key);
+
+    unsigned sent_events = events & (GAME_EVENT_PADDLE_HIT | GAME_EVENT_WALL_BOUNCE | GAME_EVENT_SCORE);
+    if (GAME_EVENT_NONE != sent_events) {
+      send_event(p_worker, p_room, sent_events);
+    }
+
+    p_room->send_credit += p_cfg->send_rate;
+    if (p_room->send_credit < p_cfg->tick_rate) continue;
+    p_room->send_credit -= p_cfg->tick_rate;
+
+    NetSnapshot snapshot = game_state_snapshot(&p_room->state, p_room->sent_keys);
+    for (int j = 0; j < 2; ++j) {
+      send_snapshot(p_worker, p_room->players[j], &snapshot);
+    }
+    for (int j = 0; j < p_room->spectator_count; ++j) {
+      send_snapshot(p_worker, p_room->spectators[j], &snapshot);
+    }
+  }
+}
+
+static void record_tick_time(ServerStats *p_stats, uint64_t elapsed_ns) {
+  uint64_t us = elapsed_ns / 1000;
+  if (us > SERVER_TICK_HISTOGRAM_US) us = SERVER_TICK_HISTOGRAM_US;
+  p_stats->tick_histogram[us] += 1;
+  p_stats->ticks += 1;
+  if (elapsed_ns > p_stats->max_tick_ns) p_stats->max_tick_ns = elapsed_ns;
+}
+
+/// @returns the tick time in microseconds that p (in range [0, 1]) of the ticks do not exceed
+static double tick_percentile(const ServerStats *p_stats, double p) {
+  long rank = (long)(p * p_stats->ticks);
+  long seen = 0;
+  for (int i = 0; i <= SERVER_TICK_HISTOGRAM_US; ++i) {
+    seen += p_stats->tick_histogram[i];
+    if (seen > rank) return i;
+  }
+  return SERVER_TICK_HISTOGRAM_US;
+}
+
+static void merge_stats(ServerStats *p_into, const ServerStats *p_from) {
+  p_into->ticks += p_from->ticks;
+  p_into->matches += p_from->matches;
+  p_into->datagrams += p_from->datagrams;
+  p_into->rejected += p_from->rejected;
+  p_into->closed_rooms += p_from->closed_rooms;
+  p_into->handed_over += p_from->handed_over;
+  p_into->adopted += p_from->adopted;
+  p_into->forward_dropped += p_from->forward_dropped;
+  for (int i = 0; i <= SERVER_TICK_HISTOGRAM_US; ++i) {
+    p_into->tick_histogram[i] += p_from->tick_histogram[i];
+  }
+  if (p_from->max_tick_ns > p_into->max_tick_ns) p_into->max_tick_ns = p_from->max_tick_ns;
+}
+
+static void print_tick_times(const ServerStats *p_stats) {
+  printf("tick p50 %.0f us, p99 %.0f us, p99.9 %.0f us, max %.1f us",
+         tick_percentile(p_stats, .5), tick_percentile(p_stats, .99),
+         tick_percentile(p_stats, .999), p_stats->max_tick_ns / 1000.);
+}
+
+static int count_full_rooms(const ServerWorker *p_worker) {
+  int count = 0;
+  for (int i = 0; i < p_worker->room_count; ++i) {
+    count += 2 == p_worker->rooms[i].player_count;
+  }
+  return count;
+}
+
+static void pin_to_core(int core) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(core % sysconf(_SC_NPROCESSORS_ONLN), &set);
+  if (0 != pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) {
+    TraceLog(LOG_WARNING, "Could not pin worker %d to its core", core);
+  }
+}
+
+static void *worker_main(void *p_arg) {
+  ServerWorker *p_worker = p_arg;
+  const ServerConfig *p_cfg = p_worker->p_cfg;
+  float tick_dt = 1.f / p_cfg->tick_rate;
+
+  pin_to_core(p_worker->index);
+
+  if (!event_loop_start_ticks(&p_worker->loop, tick_dt)) {
+    return NULL;
+  }
+
+  // the io_uring receive runs its completions on the thread that armed it
+  handle_datagrams(p_worker, net_batch_recv(p_worker->p_batch));
+
+  uint64_t start_ns = time_now_ns();
+  uint64_t report_ns = start_ns + p_cfg->report_interval * 1000000000ull;
+  uint64_t expire_ns = start_ns + SERVER_EXPIRE_PERIOD_NS;
+  uint64_t end_ns = start_ns + p_cfg->duration * 1000000000ull;
+
+  while (!server_should_stop && (0 == p_cfg->duration || time_now_ns() < end_ns)) {
+    uint64_t due_ticks = 0;
+    unsigned events = event_loop_wait(&p_worker->loop, -1, &due_ticks);
+    // the due ticks step right after the datagrams
+    p_worker->next_step_ns = 0 != due_ticks ? time_now_ns() : p_worker->loop.next_tick_ns;
+
+    if (events & EVENT_LOOP_READABLE) {
+      int count = 0;
+      do {
+        count = net_batch_recv(p_worker->p_batch);
+        handle_datagrams(p_worker, count);
+      } while (NET_BATCH_CAPACITY == count);
+    }
+    // the inputs of the players other cores handed over are in before the rooms step
+    handle_inbox(p_worker);
+
+    for (uint64_t i = 0; i < due_ticks; ++i) {
+      uint64_t tick_start = time_now_ns();
+      step_rooms(p_worker, tick_dt);
+      net_batch_flush(p_worker->p_batch);
+      record_tick_time(&p_worker->interval, time_now_ns() - tick_start);
+    }
+    uint64_t now = time_now_ns();
+    share_waiting_player(p_worker, now);
+    // READY of the new rooms and anything else queued outside the ticks
+    net_batch_flush(p_worker->p_batch);
+
+    if (now >= expire_ns) {
+      expire_ns = now + SERVER_EXPIRE_PERIOD_NS;
+      session_table_expire(&p_worker->sessions, now, on_session_expired, p_worker);
+    }
+
+    if (p_cfg->report_interval > 0 && now >= report_ns) {
+      report_ns = now + p_cfg->report_interval * 1000000000ull;
+      // one printf per line, so lines of the workers do not interleave
+      char line[256] = {0};
+      ServerStats *p_interval = &p_worker->interval;
+      snprintf(line, sizeof(line),
+               "core %2d: rooms %d playing, %d waiting, sessions %d, "
+               "tick p50 %.0f us, p99 %.0f us, max %.1f us\n",
+               p_worker->index, count_full_rooms(p_worker), p_worker->waiting_room >= 0,
+               p_worker->sessions.count,
+               tick_percentile(p_interval, .5), tick_percentile(p_interval, .99),
+               p_interval->max_tick_ns / 1000.);
+      fputs(line, stdout);
+      fflush(stdout);
+
+      merge_stats(&p_worker->stats, p_interval);
+      memset(p_interval, 0, sizeof(*p_interval));
+    }
+  }
+
+  merge_stats(&p_worker->stats, &p_worker->interval);
+  p_worker->is_ok = true;
+  return NULL;
+}
+
+static bool worker_init(ServerWorker *p_worker, int index, const ServerConfig *p_cfg, ServerLobby *p_lobby) {
+  p_worker->index = index;
+  p_worker->p_cfg = p_cfg;
+  p_worker->p_lobby = p_lobby;
+  p_worker->waiting_room = -1;
+  p_worker->loop.epoll_fd = -1;
+  p_worker->loop.timer_fd = -1;
+  p_worker->sock.fd = -1;
+
+  if (!create_udp_reuseport_socket(p_cfg->port, &p_worker->sock)) {
+    return false;
+  }
+
+  p_worker->rooms = malloc(sizeof(Room) * p_cfg->rooms_per_core);
+  p_worker->inbox_datagrams = malloc(sizeof(ServerDatagram) * SERVER_INBOX_CAPACITY);
+  p_worker->p_batch = net_batch_create(p_worker->sock.fd);
+  bool has_sessions = session_table_init(&p_worker->sessions,
+                                         p_cfg->rooms_per_core * SERVER_SESSIONS_PER_ROOM, p_cfg->timeout);
+  if (NULL == p_worker->rooms || NULL == p_worker->inbox_datagrams || NULL == p_worker->p_batch || !has_sessions) {
+    TraceLog(LOG_ERROR, "Could not allocate %d rooms of worker %d", p_cfg->rooms_per_core, index);
+    return false;
+  }
+
+  return event_loop_init(&p_worker->loop, net_batch_poll_fd(p_worker->p_batch));
+}
+
+static void worker_fini(ServerWorker *p_worker) {
+  event_loop_fini(&p_worker->loop);
+  net_batch_destroy(p_worker->p_batch);
+  session_table_fini(&p_worker->sessions);
+  free(p_worker->rooms);
+  free(p_worker->inbox_datagrams);
+  if (p_worker->sock.fd >= 0) close(p_worker->sock.fd);
+}
+
+static ServerConfig parse_args(int argc, char **argv) {
+  ServerConfig config = {0};
+  config.port = SERVER_DEFAULT_PORT;
+  config.thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+  config.tick_rate = GAME_DEFAULT_TICK_RATE;
+  config.rooms_per_core = SERVER_DEFAULT_ROOMS_PER_CORE;
+  config.report_interval = SERVER_DEFAULT_REPORT_INTERVAL;
+  config.timeout = SESSION_DEFAULT_TIMEOUT;
+
+  shift_args(&argc, &argv);
+
+  while (argc > 0) {
+    char *arg = shift_args(&argc, &argv);
+    if (argc < 1) {
+      TraceLog(LOG_FATAL, "Value must be provided for %s", arg);
+    }
+    char *value = shift_args(&argc, &argv);
+
+    if (0 == strcmp(arg, "--port")) {
+      config.port = args_int("--port", value, 1, 65535);
+    } else if (0 == strcmp(arg, "--threads")) {
+      config.thread_count = args_int("--threads", value, 1, SERVER_MAX_THREADS);
+    } else if (0 == strcmp(arg, "--tick-rate")) {
+      config.tick_rate = args_int("--tick-rate", value, 1, INT_MAX);
+    } else if (0 == strcmp(arg, "--send-rate")) {
+      config.send_rate = args_int("--send-rate", value, 1, INT_MAX);
+    } else if (0 == strcmp(arg, "--rooms-per-core")) {
+      config.rooms_per_core = args_int("--rooms-per-core", value, 1, INT_MAX);
+    } else if (0 == strcmp(arg, "--timeout")) {
+      config.timeout = args_double("--timeout", value);
+      if (config.timeout <= 0) {
+        TraceLog(LOG_FATAL, "--timeout must be positive, got %s", value);
+      }
+    } else if (0 == strcmp(arg, "--duration")) {
+      config.duration = args_int("--duration", value, 0, INT_MAX);
+    } else if (0 == strcmp(arg, "--report-interval")) {
+      config.report_interval = args_int("--report-interval", value, 0, INT_MAX);
+    } else if (0 == strcmp(arg, "--net-backend")) {
+      if (!net_parse_backend(value, &config.net_backend)) {
+        TraceLog(LOG_FATAL, "Network backend must be syscall or io_uring");
+      }
+    } else {
+      TraceLog(LOG_FATAL, "Unknown argument %s", arg);
+    }
+  }
+
+  if (config.thread_count <= 0 || config.thread_count > SERVER_MAX_THREADS) {
+    TraceLog(LOG_FATAL, "Number of threads must be in range [1, %d]", SERVER_MAX_THREADS);
+  }
+  if (0 == config.send_rate) {
+    config.send_rate = config.tick_rate;
+  }
+  // every snapshot brings the keys of the ticks since the previous one
+  if (config.send_rate > config.tick_rate || config.send_rate * NET_TICK_INPUTS_HISTORY < config.tick_rate) {
+    TraceLog(LOG_FATAL, "Snapshot rate must be in range [%d, %d] Hz at %d ticks/sec",
+             (config.tick_rate + NET_TICK_INPUTS_HISTORY - 1) / NET_TICK_INPUTS_HISTORY,
+             config.tick_rate, config.tick_rate);
+  }
+
+  return config;
+}
+
+int main(int argc, char **argv) {
+  ServerConfig cfg = parse_args(argc, argv);
+  SetTraceLogLevel(LOG_WARNING);
+  net_set_backend(cfg.net_backend);
+  int result = 1;
+  int initialized = 0;
+  int started = 0;
+
+  struct sigaction action = {0};
+  action.sa_handler = handle_stop_signal;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  ServerWorker *workers = calloc(cfg.thread_count, sizeof(ServerWorker));
+  pthread_t *threads = calloc(cfg.thread_count, sizeof(pthread_t));
+  ServerStats *p_total = calloc(1, sizeof(ServerStats));
+  ServerLobby lobby = {0};
+  bool has_lobby = lobby_init(&lobby, cfg.thread_count);
+  if (NULL == workers || NULL == threads || NULL == p_total || !has_lobby) {
+    TraceLog(LOG_ERROR, "Could not allocate %d workers", cfg.thread_count);
+    goto defer;
+  }
+
+  // every socket is bound before any thread starts, so the kernel spreads clients over all of them
+  for (; initialized < cfg.thread_count; ++initialized) {
+    if (!worker_init(&workers[initialized], initialized, &cfg, &lobby)) {
+      // the one that failed half way is cleaned up too
+      initialized += 1;
+      goto defer;
+    }
+  }
+
+  printf("Serving on port %d with %d threads, %d rooms per core, %d ticks/sec, %d snapshots/sec\n",
+         cfg.port, cfg.thread_count, cfg.rooms_per_core, cfg.tick_rate, cfg.send_rate);
+  fflush(stdout);
+
+  for (; started < cfg.thread_count; ++started) {
+    if (0 != pthread_create(&threads[started], NULL, worker_main, &workers[started])) {
+      TraceLog(LOG_ERROR, "Could not start worker %d", started);
+      server_should_stop = 1;
+      break;
+    }
+  }
+
+  for (int i = 0; i < started; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+
+  int total_rooms = 0;
+  printf("\n");
+  for (int i = 0; i < started; ++i) {
+    const ServerWorker *p_worker = &workers[i];
+    int rooms = count_full_rooms(p_worker);
+    total_rooms += rooms;
+    const SessionTableStats *p_sessions = &p_worker->sessions.stats;
+    printf("core %2d: %d rooms (%ld closed), %ld matches, %ld sessions (%ld expired, %ld rejected), "
+           "players %ld handed over (%ld datagrams dropped), %ld taken over, "
+           "%ld datagrams, %.2f probes/lookup, ",
+           i, rooms, p_worker->stats.closed_rooms, p_worker->stats.matches,
+           p_sessions->opened, p_sessions->expired, p_worker->stats.rejected,
+           p_worker->stats.handed_over, p_worker->stats.forward_dropped, p_worker->stats.adopted,
+           p_worker->stats.datagrams, p_sessions->lookups > 0 ? (double)p_sessions->probes / p_sessions->lookups : 0.);
+    print_tick_times(&p_worker->stats);
+    printf("\n");
+    merge_stats(p_total, &p_worker->stats);
+  }
+
+  printf("total: %d rooms on %d cores, %ld ticks, ", total_rooms, started, p_total->ticks);
+  print_tick_times(p_total);
+  printf("\n");
+
+  result = started == cfg.thread_count ? 0 : 1;
+  for (int i = 0; i < started; ++i) {
+    if (!workers[i].is_ok) result = 1;
+  }
+
+defer:
+  for (int i = 0; i < initialized; ++i) {
+    worker_fini(&workers[i]);
+  }
+  lobby_fini(&lobby, cfg.thread_count);
+  free(p_total);
+  free(threads);
+  free(workers);
+  return result;
+}
@@ -0,0 +1,192 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "session.h"
+#include "timing.h"
+
+#define SLOT_EMPTY -1
+
+/// splitmix64 finalizer, every bit of the key moves every bit of the hash
+static uint64_t mix(uint64_t key) {
+  key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ull;
+  key = (key ^ (key >> 27)) * 0x94d049bb133111ebull;
+  return key ^ (key >> 31);
+}
+
+static uint32_t session_hash(const SessionTable *p_table, const struct sockaddr_in6 *p_addr, uint16_t token) {
+  uint64_t halves[2] = {0};
+  memcpy(halves, &p_addr->sin6_addr, sizeof(halves));
+
+  // the high half is the same for every IPv4 peer (mapped), the low one holds its address
+  uint64_t key = mix(halves[0] ^ p_table->seed);
+  key = mix(key ^ halves[1]);
+  key = mix(key ^ ((uint64_t)p_addr->sin6_port << 16 | token));
+  return (uint32_t)key;
+}
+
+static bool is_same_key(const Session *p_session, const struct sockaddr_in6 *p_addr, uint16_t token) {
+  return net_addr_equal(&p_session->addr, p_addr) && p_session->token == token;
+}
+
+/// @returns slot of the session, or the empty slot it would go into
+static uint32_t find_slot(SessionTable *p_table, uint32_t hash,
+                          const struct sockaddr_in6 *p_addr, uint16_t token) {
+  uint32_t slot = hash & p_table->slot_mask;
+  p_table->stats.lookups += 1;
+
+  for (;;) {
+    p_table->stats.probes += 1;
+    const SessionSlot *p_slot = &p_table->slots[slot];
+    if (SLOT_EMPTY == p_slot->id) {
+      return slot;
+    }
+    if (p_slot->hash == hash && is_same_key(&p_table->sessions[p_slot->id], p_addr, token)) {
+      return slot;
+    }
+    slot = (slot + 1) & p_table->slot_mask;
+  }
+}
+
+bool session_table_init(SessionTable *p_table, int capacity, float timeout) {
+  assert(capacity > 0);
+  memset(p_table, 0, sizeof(*p_table));
+
+  // at most half full, so a miss stops at an empty slot after a probe or two
+  uint32_t slot_count = 1;
+  while (slot_count < 2u * capacity) slot_count <<= 1;
+
+  p_table->slots = malloc(sizeof(SessionSlot) * slot_count);
+  p_table->sessions = calloc(capacity, sizeof(Session));
+  p_table->is_open = calloc(capacity, sizeof(bool));
+  p_table->free_ids = malloc(sizeof(int32_t) * capacity);
+  if (NULL == p_table->slots || NULL == p_table->sessions
+    || NULL == p_table->is_open || NULL == p_table->free_ids) {
+    session_table_fini(p_table);
+    return false;
+  }
+
+  for (uint32_t i = 0; i < slot_count; ++i) {
+    p_table->slots[i].id = SLOT_EMPTY;
+  }
+  // lower ids first, they are the ones iterated first
+  for (int i = 0; i < capacity; ++i) {
+    p_table->free_ids[i] = capacity - 1 - i;
+  }
+
+  p_table->slot_mask = slot_count - 1;
+  p_table->free_count = capacity;
+  p_table->capacity = capacity;
+  p_table->timeout_ns = (uint64_t)(timeout * 1e9);
+  p_table->seed = time_now_ns() * 0x9e3779b97f4a7c15ull;
+  return true;
+}
+
+void session_table_fini(SessionTable *p_table) {
+  free(p_table->slots);
+  free(p_table->sessions);
+  free(p_table->is_open);
+  free(p_table->free_ids);
+  memset(p_table, 0, sizeof(*p_table));
+}
+
+int session_find(SessionTable *p_table, const struct sockaddr_in6 *p_addr, uint16_t token) {
+  uint32_t hash = session_hash(p_table, p_addr, token);
+  return p_table->slots[find_slot(p_table, hash, p_addr, token)].id;
+}
+
+int session_open(SessionTable *p_table, const struct sockaddr_in6 *p_addr, uint16_t token,
+                 NetRole role, uint64_t now_ns) {
+  uint32_t hash = session_hash(p_table, p_addr, token);
+  uint32_t slot = find_slot(p_table, hash, p_addr, token);
+  if (SLOT_EMPTY != p_table->slots[slot].id) {
+    return p_table->slots[slot].id;
+  }
+
+  if (0 == p_table->free_count) {
+    p_table->stats.rejected += 1;
+    return -1;
+  }
+
+  int id = p_table->free_ids[--p_table->free_count];
+  p_table->slots[slot].hash = hash;
+  p_table->slots[slot].id = id;
+  p_table->is_open[id] = true;
+  p_table->count += 1;
+  p_table->stats.opened += 1;
+
+  Session *p_session = &p_table->sessions[id];
+  p_session->addr = *p_addr;
+  p_session->token = token;
+  p_session->role = role;
+  p_session->paddle = NET_PADDLE_SPECTATOR;
+  p_session->room = -1;
+  p_session->handed_to = -1;
+  p_session->last_seen_ns = now_ns;
+  delta_encoder_init(&p_session->encoder);
+  input_receiver_init(&p_session->input);
+  p_session->pings_received = 0;
+  return id;
+}
+
+void session_close(SessionTable *p_table, int id) {
+  if (id < 0 || id >= p_table->capacity || !p_table->is_open[id]) {
+    return;
+  }
+
+  const Session *p_session = &p_table->sessions[id];
+  uint32_t hash = session_hash(p_table, &p_session->addr, p_session->token);
+  uint32_t hole = find_slot(p_table, hash, &p_session->addr, p_session->token);
+  assert(p_table->slots[hole].id == id);
+
+  // backward shift: the slots after the hole that would not be found
+  // past it anymore move into it, so no tombstones pile up
+  uint32_t slot = hole;
+  for (;;) {
+    p_table->slots[hole].id = SLOT_EMPTY;
+
+    for (;;) {
+      slot = (slot + 1) & p_table->slot_mask;
+      if (SLOT_EMPTY == p_table->slots[slot].id) goto done;
+
+      uint32_t home = p_table->slots[slot].hash & p_table->slot_mask;
+      bool stays = hole <= slot
+        ? hole < home && home <= slot
+        : hole < home || home <= slot;
+      if (!stays) break;
+    }
+
+    p_table->slots[hole] = p_table->slots[slot];
+    hole = slot;
+  }
+
+done:
+  p_table->is_open[id] = false;
+  p_table->free_ids[p_table->free_count++] = id;
+  p_table->count -= 1;
+}
+
+Session *session_get(SessionTable *p_table, int id) {
+  if (id < 0 || id >= p_table->capacity || !p_table->is_open[id]) {
+    return NULL;
+  }
+  return &p_table->sessions[id];
+}
+
+int session_table_expire(SessionTable *p_table, uint64_t now_ns,
+                         void (*on_expire)(void *p_user, int id), void *p_user) {
+  int closed = 0;
+  for (int id = 0; id < p_table->capacity; ++id) {
+    if (!p_table->is_open[id] || now_ns - p_table->sessions[id].last_seen_ns < p_table->timeout_ns) {
+      continue;
+    }
+
+    if (NULL != on_expire) {
+      on_expire(p_user, id);
+    }
+    session_close(p_table, id);
+    p_table->stats.expired += 1;
+    closed += 1;
+  }
+  return closed;
+}
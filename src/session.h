@@ -0,0 +1,96 @@
+#ifndef __SESSION_H__
+#define __SESSION_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "network.h"
+#include "delta.h"
+#include "input_stream.h"
+
+// A session that sent nothing for this long is closed
+#define SESSION_DEFAULT_TIMEOUT 5.f
+
+/// One peer of a host socket: a player or a spectator
+typedef struct {
+  struct sockaddr_in6 addr;
+  uint16_t token;
+  NetRole role;
+  // paddle of a player, NET_PADDLE_SPECTATOR for a spectator
+  int paddle;
+  // whatever the owner groups sessions by (a room), -1 if none
+  int room;
+  // another shard of the owner serves the peer now and gets its datagrams, -1 if none
+  int handed_to;
+  uint64_t last_seen_ns;
+  // snapshots to this peer go delta encoded against the newest one it acked
+  DeltaEncoder encoder;
+  // inputs of a player by its tick
+  InputReceiver input;
+  // pings of the peer, every pong tells the count
+  uint32_t pings_received;
+} Session;
+
+typedef struct {
+  long lookups;
+  // slots looked at by all the lookups, equal to lookups if there are no collisions
+  long probes;
+  long opened;
+  long expired;
+  // sessions that did not fit
+  long rejected;
+} SessionTableStats;
+
+typedef struct {
+  // hash of the key, so most probes do not touch the session itself
+  uint32_t hash;
+  // index into sessions, -1 if the slot is empty
+  int32_t id;
+} SessionSlot;
+
+/// Sessions of a host socket keyed by the source address and the connection token.
+/// An open addressing (linear probing) index at most half full points into a
+/// fixed pool, so the session of every datagram is found in O(1) and a session
+/// keeps its id while it is open
+typedef struct {
+  SessionSlot *slots;
+  uint32_t slot_mask;
+  Session *sessions;
+  bool *is_open;
+  // ids of the closed sessions, the next one to open is on top
+  int32_t *free_ids;
+  int free_count;
+  int capacity;
+  int count;
+  uint64_t timeout_ns;
+  // mixed into the hashes, so peers can not pick addresses that all collide
+  uint64_t seed;
+  SessionTableStats stats;
+} SessionTable;
+
+/// @returns false if out of memory
+bool session_table_init(SessionTable *p_table, int capacity, float timeout);
+void session_table_fini(SessionTable *p_table);
+
+/// @returns id of the session of the address and the token, -1 if there is none
+int session_find(SessionTable *p_table, const struct sockaddr_in6 *p_addr, uint16_t token);
+
+/// Opens a session seen now with paddle NET_PADDLE_SPECTATOR and no room,
+/// the delta encoder starts without a baseline and the input receiver empty
+/// @returns id of the new session, -1 if the table is full
+int session_open(SessionTable *p_table, const struct sockaddr_in6 *p_addr, uint16_t token,
+                 NetRole role, uint64_t now_ns);
+
+/// Closing a session that is not open does nothing
+void session_close(SessionTable *p_table, int id);
+
+/// @returns the session of the id, NULL if it is not open
+Session *session_get(SessionTable *p_table, int id);
+
+/// Closes every session not seen for the timeout, calls on_expire before closing it.
+/// on_expire may close other sessions
+/// @returns number of sessions closed
+int session_table_expire(SessionTable *p_table, uint64_t now_ns,
+                         void (*on_expire)(void *p_user, int id), void *p_user);
+
+#endif // !__SESSION_H__
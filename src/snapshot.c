@@ -0,0 +1,179 @@
+#include <math.h>
+#include <string.h>
+
+#include "snapshot.h"
+
+#define SLOT(p_buf, i) (((p_buf)->begin + (i)) % SNAPSHOT_BUFFER_CAPACITY)
+
+// Gains of the smoothed interval and jitter (as in RFC 3550)
+#define INTERVAL_GAIN (1. / 8)
+#define JITTER_GAIN (1. / 16)
+// Jitter is a mean deviation, a few of them cover almost all late arrivals
+#define JITTER_MARGIN 3.
+// The render clock runs at most this much faster or slower while the delay changes
+#define DELAY_TIME_SCALE 0.1
+
+void snapshot_buffer_init(SnapshotBuffer *p_buf) {
+  memset(p_buf, 0, sizeof(*p_buf));
+  p_buf->delay = SNAPSHOT_MAX_DELAY / 2;
+}
+
+const Snapshot *snapshot_buffer_newest(const SnapshotBuffer *p_buf) {
+  if (p_buf->len == 0) {
+    return NULL;
+  }
+  return &p_buf->snapshots[SLOT(p_buf, p_buf->len - 1)];
+}
+
+bool snapshot_buffer_push(SnapshotBuffer *p_buf, uint32_t tick, double time, double arrival,
+                          const Vector2 positions[SNAPSHOT_ENTITIES]) {
+  const Snapshot *p_newest = snapshot_buffer_newest(p_buf);
+  if (NULL != p_newest && (int32_t)(tick - p_newest->tick) <= 0) {
+    p_buf->stats.stale += 1;
+    return false;
+  }
+
+  double transit = arrival - time;
+  if (p_buf->stats.received > 0) {
+    double interval = time - p_buf->last_time;
+    if (p_buf->stats.received == 1) {
+      p_buf->interval = interval;
+    } else {
+      p_buf->interval += (interval - p_buf->interval) * INTERVAL_GAIN;
+      p_buf->transit += (transit - p_buf->transit) * INTERVAL_GAIN;
+    }
+    p_buf->jitter += (fabs(transit - p_buf->last_transit) - p_buf->jitter) * JITTER_GAIN;
+  } else {
+    p_buf->transit = transit;
+  }
+  p_buf->last_time = time;
+  p_buf->last_transit = transit;
+  p_buf->stats.received += 1;
+
+  if (p_buf->len == SNAPSHOT_BUFFER_CAPACITY) {
+    p_buf->begin = SLOT(p_buf, 1);
+    p_buf->len -= 1;
+  }
+
+  Snapshot *p_snapshot = &p_buf->snapshots[SLOT(p_buf, p_buf->len)];
+  p_snapshot->tick = tick;
+  p_snapshot->time = time;
+  memcpy(p_snapshot->positions, positions, sizeof(p_snapshot->positions));
+  p_buf->len += 1;
+
+  return true;
+}
+
+void snapshot_buffer_push_event(SnapshotBuffer *p_buf, uint32_t tick, double time, Vector2 position, Vector2 velocity) {
+  const Snapshot *p_newest = snapshot_buffer_newest(p_buf);
+  if (NULL != p_newest && (int32_t)(tick - p_newest->tick) <= 0) {
+    return;
+  }
+
+  SnapshotEvent *p_event = &p_buf->events[p_buf->event_count % SNAPSHOT_EVENT_CAPACITY];
+  p_event->tick = tick;
+  p_event->time = time;
+  p_event->position = position;
+  p_event->velocity = velocity;
+  p_buf->event_count += 1;
+}
+
+/// @returns the earliest (or the latest) event after the tick and before the other one,
+/// NULL if there is none
+static const SnapshotEvent *find_event(const SnapshotBuffer *p_buf, uint32_t after, uint32_t before,
+                                       bool is_latest) {
+  const SnapshotEvent *p_found = NULL;
+  int count = p_buf->event_count < SNAPSHOT_EVENT_CAPACITY ? p_buf->event_count : SNAPSHOT_EVENT_CAPACITY;
+  for (int i = 0; i < count; ++i) {
+    const SnapshotEvent *p_event = &p_buf->events[i];
+    if ((int32_t)(p_event->tick - after) <= 0 || (int32_t)(before - p_event->tick) <= 0) continue;
+
+    int32_t order = (int32_t)(p_event->tick - (NULL != p_found ? p_found->tick : 0));
+    if (NULL == p_found || (is_latest ? order > 0 : order < 0)) p_found = p_event;
+  }
+  return p_found;
+}
+
+static Vector2 lerp(Vector2 from, Vector2 to, float alpha) {
+  return CLITERAL(Vector2){ from.x + (to.x - from.x) * alpha, from.y + (to.y - from.y) * alpha };
+}
+
+double snapshot_buffer_target_delay(const SnapshotBuffer *p_buf) {
+  double delay = p_buf->interval + p_buf->jitter * JITTER_MARGIN;
+  if (delay < SNAPSHOT_MIN_DELAY) delay = SNAPSHOT_MIN_DELAY;
+  if (delay > SNAPSHOT_MAX_DELAY) delay = SNAPSHOT_MAX_DELAY;
+  // a snapshot can not be rendered before it arrives
+  return fmax(p_buf->transit, 0.) + delay;
+}
+
+bool snapshot_buffer_sample(SnapshotBuffer *p_buf, double now, float dt, Vector2 out[SNAPSHOT_ENTITIES]) {
+  if (p_buf->len == 0) {
+    return false;
+  }
+
+  // the interval is not known until the second snapshot, start right at the target after it
+  if (p_buf->stats.received == 2 && p_buf->render_time == 0) {
+    p_buf->delay = snapshot_buffer_target_delay(p_buf);
+  } else if (p_buf->stats.received > 2) {
+    double max_change = dt * DELAY_TIME_SCALE;
+    double change = snapshot_buffer_target_delay(p_buf) - p_buf->delay;
+    p_buf->delay += fmax(-max_change, fmin(change, max_change));
+  }
+
+  double render_time = now - p_buf->delay;
+  // never go back in time, even if the delay grew
+  if (render_time < p_buf->render_time) {
+    render_time = p_buf->render_time;
+  }
+  p_buf->render_time = render_time;
+
+  const Snapshot *p_newest = snapshot_buffer_newest(p_buf);
+  if (render_time >= p_newest->time) {
+    if (p_buf->stats.received > 1) {
+      p_buf->stats.underruns += 1;
+    }
+    memcpy(out, p_newest->positions, sizeof(p_newest->positions));
+
+    // the next snapshot is late, the ball moves on from the latest event after the newest one
+    const SnapshotEvent *p_event = find_event(p_buf, p_newest->tick, p_newest->tick + INT32_MAX, true);
+    if (NULL != p_event) {
+      double elapsed = fmin(fmax(render_time - p_event->time, 0.), SNAPSHOT_MAX_DELAY);
+      out[SNAPSHOT_BALL].x = p_event->position.x + p_event->velocity.x * (float)elapsed;
+      out[SNAPSHOT_BALL].y = p_event->position.y + p_event->velocity.y * (float)elapsed;
+    }
+    return true;
+  }
+
+  const Snapshot *p_oldest = &p_buf->snapshots[p_buf->begin];
+  if (render_time <= p_oldest->time) {
+    memcpy(out, p_oldest->positions, sizeof(p_oldest->positions));
+    return true;
+  }
+
+  // snapshots before the one right at or before the render time are not needed anymore
+  int from = 0;
+  while (p_buf->snapshots[SLOT(p_buf, from + 1)].time <= render_time) {
+    from += 1;
+  }
+  p_buf->begin = SLOT(p_buf, from);
+  p_buf->len -= from;
+
+  const Snapshot *p_from = &p_buf->snapshots[p_buf->begin];
+  const Snapshot *p_to = &p_buf->snapshots[SLOT(p_buf, 1)];
+  float alpha = (float)((render_time - p_from->time) / (p_to->time - p_from->time));
+
+  for (int i = 0; i < SNAPSHOT_ENTITIES; ++i) {
+    out[i] = lerp(p_from->positions[i], p_to->positions[i], alpha);
+  }
+
+  // at its tick the ball was where the event says, not on the line between the snapshots
+  const SnapshotEvent *p_event = find_event(p_buf, p_from->tick, p_to->tick, false);
+  if (NULL != p_event) {
+    float event_alpha = (float)(p_event->tick - p_from->tick) / (p_to->tick - p_from->tick);
+    out[SNAPSHOT_BALL] = alpha < event_alpha
+      ? lerp(p_from->positions[SNAPSHOT_BALL], p_event->position, alpha / event_alpha)
+      : lerp(p_event->position, p_to->positions[SNAPSHOT_BALL], (alpha - event_alpha) / (1 - event_alpha));
+  }
+
+  return true;
+}
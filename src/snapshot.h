@@ -0,0 +1,100 @@
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "raylib.h"
+
+#define SNAPSHOT_BUFFER_CAPACITY 64
+
+// Positions of the remote entities: both paddles and the ball
+#define SNAPSHOT_ENTITIES 3
+#define SNAPSHOT_BALL 2
+
+// Ball states of host events kept for the snapshots around them
+#define SNAPSHOT_EVENT_CAPACITY 8
+
+// Bounds of the render delay on top of the transit, in seconds
+#define SNAPSHOT_MIN_DELAY 0.010
+#define SNAPSHOT_MAX_DELAY 0.250
+
+typedef struct {
+  uint32_t tick;
+  // local time the host stepped to the tick at
+  double time;
+  Vector2 positions[SNAPSHOT_ENTITIES];
+} Snapshot;
+
+/// The ball as a host event (a hit, a bounce or a point) left it, usually between
+/// two snapshots when the host sends fewer snapshots than it steps
+typedef struct {
+  uint32_t tick;
+  double time;
+  Vector2 position;
+  // pixels per second
+  Vector2 velocity;
+} SnapshotEvent;
+
+typedef struct {
+  long received;
+  // frames rendered past the newest snapshot
+  long underruns;
+  // snapshots that arrived after a newer one and were dropped
+  long stale;
+} SnapshotStats;
+
+/// Snapshots of the remote entities stamped with the time the host stepped to their
+/// tick, so they are as evenly spaced as the host's steps however they arrive.
+/// They are rendered a small delay in the past, so there are two snapshots
+/// around the render time to interpolate between even if the packets arrive unevenly.
+/// The delay follows the transit, the interval and the jitter of the snapshots
+typedef struct {
+  Snapshot snapshots[SNAPSHOT_BUFFER_CAPACITY];
+  int begin;
+  int len;
+
+  double last_time;
+  double last_transit;
+  // smoothed interval between the snapshots, arrival - time of a snapshot and how
+  // much that changes from one to the next (RFC 3550 jitter), in seconds
+  double interval;
+  double transit;
+  double jitter;
+  // current render delay, eases towards the target delay
+  double delay;
+  double render_time;
+
+  // the ball of the latest events, passed through between the snapshots around them
+  // and dead-reckoned past the newest snapshot
+  SnapshotEvent events[SNAPSHOT_EVENT_CAPACITY];
+  int event_count;
+
+  SnapshotStats stats;
+} SnapshotBuffer;
+
+void snapshot_buffer_init(SnapshotBuffer *p_buf);
+
+/// Adds the positions of the host tick stepped at the time and received at arrival,
+/// both local times, and updates the interval, transit and jitter estimates
+/// @returns false if the tick is not newer than the newest snapshot, it is dropped then
+bool snapshot_buffer_push(SnapshotBuffer *p_buf, uint32_t tick, double time, double arrival,
+                          const Vector2 positions[SNAPSHOT_ENTITIES]);
+
+/// Adds the ball of the host event of the tick stepped at the time,
+/// it is dropped if a snapshot of the tick or a newer one is there already
+void snapshot_buffer_push_event(SnapshotBuffer *p_buf, uint32_t tick, double time, Vector2 position, Vector2 velocity);
+
+/// @returns the latest snapshot received, NULL if there is none
+const Snapshot *snapshot_buffer_newest(const SnapshotBuffer *p_buf);
+
+/// Interpolates the positions at now - delay, the delay moves towards the target
+/// by at most a fraction of dt so the remote entities do not jump. The ball goes
+/// through the events between the two snapshots instead of cutting the corner
+/// @returns false if there is no snapshot yet
+bool snapshot_buffer_sample(SnapshotBuffer *p_buf, double now, float dt, Vector2 out[SNAPSHOT_ENTITIES]);
+
+/// Delay the buffer aims for: the transit, one interval between snapshots and a margin for jitter
+double snapshot_buffer_target_delay(const SnapshotBuffer *p_buf);
+
+#endif // !__SNAPSHOT_H__
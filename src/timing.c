@@ -0,0 +1,18 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <time.h>
+
+#include "timing.h"
+
+
+double time_now_seconds(void) {
+  struct timespec ts = {0};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+uint64_t time_now_ns(void) {
+  struct timespec ts = {0};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
@@ -0,0 +1,13 @@
+#ifndef __TIMING_H__
+#define __TIMING_H__
+
+#include <stdint.h>
+
+/// Monotonic clock that works without a raylib window
+/// @returns seconds since an unspecified point in the past
+double time_now_seconds(void);
+
+/// Same as time_now_seconds in nanoseconds
+uint64_t time_now_ns(void);
+
+#endif // !__TIMING_H__